@@ -88,6 +88,7 @@ static int __init parse_core(struct device_node *core, int package_id,
 			return -EINVAL;
 		}
 
+		cpu_topology[cpu].cluster_id = package_id;
 		cpu_topology[cpu].package_id = package_id;
 		cpu_topology[cpu].core_id = core_id;
 	} else if (leaf) {
@@ -250,6 +251,12 @@ static void update_siblings_masks(unsigned int cpuid)
 		cpumask_set_cpu(cpuid, &cpu_topo->core_sibling);
 		cpumask_set_cpu(cpu, &cpuid_topo->core_sibling);
 
+		if (cpuid_topo->cluster_id != cpu_topo->cluster_id)
+			continue;
+
+		cpumask_set_cpu(cpuid, &cpu_topo->cluster_sibling);
+		cpumask_set_cpu(cpu, &cpuid_topo->cluster_sibling);
+
 		if (cpuid_topo->core_id != cpu_topo->core_id)
 			continue;
 
@@ -288,6 +295,9 @@ void store_cpu_topology(unsigned int cpuid)
 					 MPIDR_AFFINITY_LEVEL(mpidr, 3) << 16;
 	}
 
+	/* MPIDR only tells us about the cluster a CPU sits in */
+	cpuid_topo->cluster_id = cpuid_topo->package_id;
+
 	pr_debug("CPU%u: cluster %d core %d thread %d mpidr %#016llx\n",
 		 cpuid, cpuid_topo->package_id, cpuid_topo->core_id,
 		 cpuid_topo->thread_id, mpidr);
@@ -305,6 +315,8 @@ static void clear_cpu_topology(int cpu)
 
 	cpumask_clear(&cpu_topo->core_sibling);
 	cpumask_set_cpu(cpu, &cpu_topo->core_sibling);
+	cpumask_clear(&cpu_topo->cluster_sibling);
+	cpumask_set_cpu(cpu, &cpu_topo->cluster_sibling);
 	cpumask_clear(&cpu_topo->thread_sibling);
 	cpumask_set_cpu(cpu, &cpu_topo->thread_sibling);
 }
@@ -318,6 +330,7 @@ static void __init reset_cpu_topology(void)
 
 		cpu_topo->thread_id = -1;
 		cpu_topo->core_id = 0;
+		cpu_topo->cluster_id = -1;
 		cpu_topo->package_id = -1;
 		cpu_topo->llc_id = -1;
 
@@ -331,6 +344,8 @@ void remove_cpu_topology(unsigned int cpu)
 
 	for_each_cpu(sibling, topology_core_cpumask(cpu))
 		cpumask_clear_cpu(cpu, topology_core_cpumask(sibling));
+	for_each_cpu(sibling, topology_cluster_cpumask(cpu))
+		cpumask_clear_cpu(cpu, topology_cluster_cpumask(sibling));
 	for_each_cpu(sibling, topology_sibling_cpumask(cpu))
 		cpumask_clear_cpu(cpu, topology_sibling_cpumask(sibling));
 	for_each_cpu(sibling, topology_llc_cpumask(cpu))
@@ -366,6 +381,9 @@ static int __init parse_acpi_topology(void)
 			cpu_topology[cpu].thread_id  = -1;
 			cpu_topology[cpu].core_id    = topology_id;
 		}
+		/* The PPTT level right above the core is its cluster */
+		topology_id = find_acpi_cpu_topology(cpu, is_threaded ? 2 : 1);
+		cpu_topology[cpu].cluster_id = topology_id;
 		topology_id = find_acpi_cpu_topology_package(cpu);
 		cpu_topology[cpu].package_id = topology_id;
 
@@ -471,6 +471,16 @@ static int __kprobes do_page_fault(unsigned long addr, unsigned int esr,
 
 	perf_sw_event(PERF_COUNT_SW_PAGE_FAULTS, 1, regs, addr);
 
+	/*
+	 * Try a user data fault without mmap_sem first; anything the
+	 * speculative handler cannot deal with comes back as VM_FAULT_RETRY.
+	 */
+	if (user_mode(regs) && !is_el0_instruction_abort(esr)) {
+		fault = handle_speculative_fault(mm, addr, mm_flags);
+		if (fault != VM_FAULT_RETRY)
+			goto done;
+	}
+
 	/*
 	 * As per x86, we may deadlock here. However, since the kernel only
 	 * validly references user space from well defined areas of the code,
@@ -521,6 +531,7 @@ static int __kprobes do_page_fault(unsigned long addr, unsigned int esr,
 	}
 	up_read(&mm->mmap_sem);
 
+done:
 	/*
 	 * Handle the "normal" (no error) case first.
 	 */
@@ -97,6 +97,8 @@
 #define MADV_WIPEONFORK 18		/* Zero memory on fork, child only */
 #define MADV_KEEPONFORK 19		/* Undo MADV_WIPEONFORK */
 
+#define MADV_COLLAPSE_ASYNC 200		/* Queue range for khugepaged collapse */
+
 /* compatibility flags */
 #define MAP_FILE	0
 
@@ -1305,6 +1305,18 @@ __do_page_fault(struct pt_regs *regs, unsigned long error_code,
 	if (error_code & X86_PF_INSTR)
 		flags |= FAULT_FLAG_INSTRUCTION;
 
+	/*
+	 * Try a not-present user fault without mmap_sem first.  Anything the
+	 * speculative handler cannot deal with comes back as VM_FAULT_RETRY
+	 * and goes through the regular path below.
+	 */
+	if ((error_code & X86_PF_USER) &&
+	    !(error_code & (X86_PF_PROT | X86_PF_PK))) {
+		fault = handle_speculative_fault(mm, address, flags);
+		if (fault != VM_FAULT_RETRY)
+			goto done;
+	}
+
 	/*
 	 * When running in the kernel we expect faults to occur only to
 	 * addresses in user space.  All other faults represent errors in
@@ -1424,6 +1436,7 @@ __do_page_fault(struct pt_regs *regs, unsigned long error_code,
 		return;
 	}
 
+done:
 	/*
 	 * Major/minor page fault accounting. If any of the events
 	 * returned VM_FAULT_MAJOR, we account it as a major fault.
@@ -3617,6 +3617,7 @@ static int macb_init(struct platform_device *pdev)
 				queue->irq, err);
 			return err;
 		}
+		netif_napi_set_irq(&queue->napi, queue->irq);
 
 		INIT_WORK(&queue->tx_error_task, macb_tx_error_task);
 		q++;
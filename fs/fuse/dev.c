@@ -317,15 +317,57 @@ static unsigned len_args(unsigned numargs, struct fuse_arg *args)
 	return nbytes;
 }
 
-static u64 fuse_get_unique(struct fuse_iqueue *fiq)
+static u64 fuse_get_unique(struct fuse_conn *fc)
 {
-	return ++fiq->reqctr;
+	return atomic64_inc_return(&fc->reqctr);
+}
+
+/*
+ * Lock the input queue for a new request.  That's the queue of the
+ * current CPU if a device is bound to it, the common queue otherwise.
+ */
+static struct fuse_iqueue *fuse_lock_iqueue(struct fuse_conn *fc)
+{
+	struct fuse_iqueue __percpu *cpu_iq = READ_ONCE(fc->cpu_iq);
+	struct fuse_iqueue *fiq;
+
+	if (cpu_iq) {
+		fiq = raw_cpu_ptr(cpu_iq);
+		if (READ_ONCE(fiq->nr_readers)) {
+			spin_lock(&fiq->waitq.lock);
+			if (fiq->nr_readers)
+				return fiq;
+			spin_unlock(&fiq->waitq.lock);
+		}
+	}
+	fiq = &fc->iq;
+	spin_lock(&fiq->waitq.lock);
+	return fiq;
+}
+
+/*
+ * Lock the input queue a pending request is on.  The request may move
+ * to the common queue when the last device bound to its queue goes
+ * away, which happens with both queue locks held.
+ */
+static struct fuse_iqueue *fuse_lock_req_iqueue(struct fuse_req *req)
+{
+	struct fuse_iqueue *fiq;
+
+	for (;;) {
+		fiq = READ_ONCE(req->iq);
+		spin_lock(&fiq->waitq.lock);
+		if (likely(fiq == req->iq))
+			return fiq;
+		spin_unlock(&fiq->waitq.lock);
+	}
 }
 
 static void queue_request(struct fuse_iqueue *fiq, struct fuse_req *req)
 {
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
+	req->iq = fiq;
 	list_add_tail(&req->list, &fiq->pending);
 	wake_up_locked(&fiq->waitq);
 	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
@@ -356,13 +398,13 @@ static void flush_bg_queue(struct fuse_conn *fc)
 	while (fc->active_background < fc->max_background &&
 	       !list_empty(&fc->bg_queue)) {
 		struct fuse_req *req;
-		struct fuse_iqueue *fiq = &fc->iq;
+		struct fuse_iqueue *fiq;
 
 		req = list_entry(fc->bg_queue.next, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
-		spin_lock(&fiq->waitq.lock);
-		req->in.h.unique = fuse_get_unique(fiq);
+		fiq = fuse_lock_iqueue(fc);
+		req->in.h.unique = fuse_get_unique(fc);
 		queue_request(fiq, req);
 		spin_unlock(&fiq->waitq.lock);
 	}
@@ -455,7 +497,7 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 		if (!err)
 			return;
 
-		spin_lock(&fiq->waitq.lock);
+		fiq = fuse_lock_req_iqueue(req);
 		/* Request is not yet in userspace, bail out */
 		if (test_bit(FR_PENDING, &req->flags)) {
 			list_del(&req->list);
@@ -476,15 +518,15 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 
 static void __fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq;
 
 	BUG_ON(test_bit(FR_BACKGROUND, &req->flags));
-	spin_lock(&fiq->waitq.lock);
+	fiq = fuse_lock_iqueue(fc);
 	if (!fiq->connected) {
 		spin_unlock(&fiq->waitq.lock);
 		req->out.h.error = -ENOTCONN;
 	} else {
-		req->in.h.unique = fuse_get_unique(fiq);
+		req->in.h.unique = fuse_get_unique(fc);
 		queue_request(fiq, req);
 		/* acquire extra reference, since request is still needed
 		   after request_end() */
@@ -1073,7 +1115,7 @@ static int request_pending(struct fuse_iqueue *fiq)
  *
  * Called with fiq->waitq.lock held, releases it
  */
-static int fuse_read_interrupt(struct fuse_iqueue *fiq,
+static int fuse_read_interrupt(struct fuse_conn *fc, struct fuse_iqueue *fiq,
 			       struct fuse_copy_state *cs,
 			       size_t nbytes, struct fuse_req *req)
 __releases(fiq->waitq.lock)
@@ -1084,7 +1126,7 @@ __releases(fiq->waitq.lock)
 	int err;
 
 	list_del_init(&req->intr_entry);
-	req->intr_unique = fuse_get_unique(fiq);
+	req->intr_unique = fuse_get_unique(fc);
 	memset(&ih, 0, sizeof(ih));
 	memset(&arg, 0, sizeof(arg));
 	ih.len = reqsize;
@@ -1126,7 +1168,8 @@ static struct fuse_forget_link *dequeue_forget(struct fuse_iqueue *fiq,
 	return head;
 }
 
-static int fuse_read_single_forget(struct fuse_iqueue *fiq,
+static int fuse_read_single_forget(struct fuse_conn *fc,
+				   struct fuse_iqueue *fiq,
 				   struct fuse_copy_state *cs,
 				   size_t nbytes)
 __releases(fiq->waitq.lock)
@@ -1139,7 +1182,7 @@ __releases(fiq->waitq.lock)
 	struct fuse_in_header ih = {
 		.opcode = FUSE_FORGET,
 		.nodeid = forget->forget_one.nodeid,
-		.unique = fuse_get_unique(fiq),
+		.unique = fuse_get_unique(fc),
 		.len = sizeof(ih) + sizeof(arg),
 	};
 
@@ -1159,8 +1202,9 @@ __releases(fiq->waitq.lock)
 	return ih.len;
 }
 
-static int fuse_read_batch_forget(struct fuse_iqueue *fiq,
-				   struct fuse_copy_state *cs, size_t nbytes)
+static int fuse_read_batch_forget(struct fuse_conn *fc,
+				  struct fuse_iqueue *fiq,
+				  struct fuse_copy_state *cs, size_t nbytes)
 __releases(fiq->waitq.lock)
 {
 	int err;
@@ -1170,7 +1214,7 @@ __releases(fiq->waitq.lock)
 	struct fuse_batch_forget_in arg = { .count = 0 };
 	struct fuse_in_header ih = {
 		.opcode = FUSE_BATCH_FORGET,
-		.unique = fuse_get_unique(fiq),
+		.unique = fuse_get_unique(fc),
 		.len = sizeof(ih) + sizeof(arg),
 	};
 
@@ -1214,9 +1258,9 @@ static int fuse_read_forget(struct fuse_conn *fc, struct fuse_iqueue *fiq,
 __releases(fiq->waitq.lock)
 {
 	if (fc->minor < 16 || fiq->forget_list_head.next->next == NULL)
-		return fuse_read_single_forget(fiq, cs, nbytes);
+		return fuse_read_single_forget(fc, fiq, cs, nbytes);
 	else
-		return fuse_read_batch_forget(fiq, cs, nbytes);
+		return fuse_read_batch_forget(fc, fiq, cs, nbytes);
 }
 
 /*
@@ -1233,7 +1277,7 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 {
 	ssize_t err;
 	struct fuse_conn *fc = fud->fc;
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq = fud->iq;
 	struct fuse_pqueue *fpq = &fud->pq;
 	struct fuse_req *req;
 	struct fuse_in *in;
@@ -1247,10 +1291,18 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 		goto err_unlock;
 
 	err = wait_event_interruptible_exclusive_locked(fiq->waitq,
-				!fiq->connected || request_pending(fiq));
+				!fiq->connected || request_pending(fiq) ||
+				fud->iq != fiq);
 	if (err)
 		goto err_unlock;
 
+	/* Unbound from a per-CPU queue while waiting */
+	if (fud->iq != fiq) {
+		spin_unlock(&fiq->waitq.lock);
+		fiq = fud->iq;
+		goto restart;
+	}
+
 	if (!fiq->connected) {
 		err = (fc->aborted && fc->abort_err) ? -ECONNABORTED : -ENODEV;
 		goto err_unlock;
@@ -1259,7 +1311,7 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 	if (!list_empty(&fiq->interrupts)) {
 		req = list_entry(fiq->interrupts.next, struct fuse_req,
 				 intr_entry);
-		return fuse_read_interrupt(fiq, cs, nbytes, req);
+		return fuse_read_interrupt(fc, fiq, cs, nbytes, req);
 	}
 
 	if (forget_pending(fiq)) {
@@ -1316,7 +1368,7 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 	/* matches barrier in request_wait_answer() */
 	smp_mb__after_atomic();
 	if (test_bit(FR_INTERRUPTED, &req->flags))
-		queue_interrupt(fiq, req);
+		queue_interrupt(&fc->iq, req);
 
 	return reqsize;
 
@@ -1675,7 +1727,7 @@ static int fuse_retrieve(struct fuse_conn *fc, struct inode *inode,
 		num = file_size - outarg->offset;
 
 	num_pages = (num + offset + PAGE_SIZE - 1) >> PAGE_SHIFT;
-	num_pages = min(num_pages, FUSE_MAX_PAGES_PER_REQ);
+	num_pages = min(num_pages, fc->max_pages);
 
 	req = fuse_get_req(fc, num_pages);
 	if (IS_ERR(req))
@@ -2030,7 +2082,9 @@ static __poll_t fuse_dev_poll(struct file *file, poll_table *wait)
 	if (!fud)
 		return EPOLLERR;
 
-	fiq = &fud->fc->iq;
+	fiq = fud->iq;
+	if (!poll_does_not_wait(wait))
+		fud->polled = true;
 	poll_wait(file, &fiq->waitq, wait);
 
 	spin_lock(&fiq->waitq.lock);
@@ -2075,6 +2129,28 @@ static void end_polls(struct fuse_conn *fc)
 	}
 }
 
+/*
+ * Disconnect an input queue and move its pending requests to @to_end
+ *
+ * Called with fc->lock held
+ */
+static void fuse_iqueue_abort(struct fuse_iqueue *fiq,
+			      struct list_head *to_end)
+{
+	struct fuse_req *req;
+
+	spin_lock(&fiq->waitq.lock);
+	fiq->connected = 0;
+	list_for_each_entry(req, &fiq->pending, list)
+		clear_bit(FR_PENDING, &req->flags);
+	list_splice_tail_init(&fiq->pending, to_end);
+	while (forget_pending(fiq))
+		kfree(dequeue_forget(fiq, 1, NULL));
+	wake_up_all_locked(&fiq->waitq);
+	spin_unlock(&fiq->waitq.lock);
+	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+}
+
 /*
  * Abort all requests.
  *
@@ -2095,8 +2171,6 @@ static void end_polls(struct fuse_conn *fc)
  */
 void fuse_abort_conn(struct fuse_conn *fc, bool is_abort)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
-
 	spin_lock(&fc->lock);
 	if (fc->connected) {
 		struct fuse_dev *fud;
@@ -2129,16 +2203,14 @@ void fuse_abort_conn(struct fuse_conn *fc, bool is_abort)
 		fc->max_background = UINT_MAX;
 		flush_bg_queue(fc);
 
-		spin_lock(&fiq->waitq.lock);
-		fiq->connected = 0;
-		list_for_each_entry(req, &fiq->pending, list)
-			clear_bit(FR_PENDING, &req->flags);
-		list_splice_tail_init(&fiq->pending, &to_end);
-		while (forget_pending(fiq))
-			kfree(dequeue_forget(fiq, 1, NULL));
-		wake_up_all_locked(&fiq->waitq);
-		spin_unlock(&fiq->waitq.lock);
-		kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+		if (fc->cpu_iq) {
+			int cpu;
+
+			for_each_possible_cpu(cpu)
+				fuse_iqueue_abort(per_cpu_ptr(fc->cpu_iq, cpu),
+						  &to_end);
+		}
+		fuse_iqueue_abort(&fc->iq, &to_end);
 		end_polls(fc);
 		wake_up_all(&fc->blocked_waitq);
 		spin_unlock(&fc->lock);
@@ -2155,6 +2227,102 @@ void fuse_wait_aborted(struct fuse_conn *fc)
 	wait_event(fc->blocked_waitq, atomic_read(&fc->num_waiting) == 0);
 }
 
+/*
+ * Detach a device from its per-CPU queue.  When the last device bound
+ * to a queue goes away, its pending requests are handed over to the
+ * common queue, so that the remaining devices pick them up.  Called
+ * with fc->lock held.
+ */
+static void fuse_dev_unbind_queue(struct fuse_dev *fud)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_iqueue *fiq = fud->iq;
+	struct fuse_req *req;
+
+	if (fiq == &fc->iq)
+		return;
+
+	spin_lock(&fiq->waitq.lock);
+	/* A reader waiting on this queue moves over to the common one */
+	fud->iq = &fc->iq;
+	wake_up_all_locked(&fiq->waitq);
+	if (!--fiq->nr_readers && !list_empty(&fiq->pending)) {
+		spin_lock_nested(&fc->iq.waitq.lock, SINGLE_DEPTH_NESTING);
+		list_for_each_entry(req, &fiq->pending, list)
+			WRITE_ONCE(req->iq, &fc->iq);
+		list_splice_tail_init(&fiq->pending, &fc->iq.pending);
+		wake_up_all_locked(&fc->iq.waitq);
+		spin_unlock(&fc->iq.waitq.lock);
+		kill_fasync(&fc->iq.fasync, SIGIO, POLL_IN);
+	}
+	spin_unlock(&fiq->waitq.lock);
+}
+
+/* Count the devices other than @skip that read from the common queue */
+static unsigned int fuse_nr_unbound(struct fuse_conn *fc, struct fuse_dev *skip)
+{
+	struct fuse_dev *fud;
+	unsigned int nr = 0;
+
+	list_for_each_entry(fud, &fc->devices, entry) {
+		if (fud != skip && fud->iq == &fc->iq)
+			nr++;
+	}
+	return nr;
+}
+
+static int fuse_dev_bind_queue(struct fuse_dev *fud, struct file *file,
+			       unsigned int cpu)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_iqueue __percpu *cpu_iq = NULL;
+	struct fuse_iqueue *fiq;
+	int err, i;
+
+	if (cpu >= nr_cpu_ids || !cpu_possible(cpu))
+		return -EINVAL;
+	/*
+	 * fasync and poll waiters are registered on the queue the device
+	 * reads from, and would never be woken from the new one.
+	 */
+	if (fud->iq != &fc->iq || (file->f_flags & FASYNC) || fud->polled)
+		return -EBUSY;
+
+	if (!READ_ONCE(fc->cpu_iq)) {
+		cpu_iq = alloc_percpu(struct fuse_iqueue);
+		if (!cpu_iq)
+			return -ENOMEM;
+		for_each_possible_cpu(i)
+			fuse_iqueue_init(per_cpu_ptr(cpu_iq, i));
+	}
+
+	err = -ENODEV;
+	spin_lock(&fc->lock);
+	/*
+	 * FORGETs, INTERRUPTs, notify replies and requests from CPUs without
+	 * a bound device only go to the common queue: keep it a reader.
+	 */
+	if (fc->connected && !fuse_nr_unbound(fc, fud)) {
+		err = -EBUSY;
+	} else if (fc->connected) {
+		if (!fc->cpu_iq) {
+			/* Pairs with READ_ONCE() in fuse_lock_iqueue() */
+			smp_store_release(&fc->cpu_iq, cpu_iq);
+			cpu_iq = NULL;
+		}
+		fiq = per_cpu_ptr(fc->cpu_iq, cpu);
+		spin_lock(&fiq->waitq.lock);
+		fiq->nr_readers++;
+		spin_unlock(&fiq->waitq.lock);
+		fud->iq = fiq;
+		err = 0;
+	}
+	spin_unlock(&fc->lock);
+	free_percpu(cpu_iq);
+
+	return err;
+}
+
 int fuse_dev_release(struct inode *inode, struct file *file)
 {
 	struct fuse_dev *fud = fuse_get_dev(file);
@@ -2163,6 +2331,16 @@ int fuse_dev_release(struct inode *inode, struct file *file)
 		struct fuse_conn *fc = fud->fc;
 		struct fuse_pqueue *fpq = &fud->pq;
 		LIST_HEAD(to_end);
+		struct fuse_dev *pos;
+
+		spin_lock(&fc->lock);
+		if (fud->iq == &fc->iq && !fuse_nr_unbound(fc, fud)) {
+			/* The last reader of the common queue is going away */
+			list_for_each_entry(pos, &fc->devices, entry)
+				fuse_dev_unbind_queue(pos);
+		}
+		fuse_dev_unbind_queue(fud);
+		spin_unlock(&fc->lock);
 
 		spin_lock(&fpq->lock);
 		WARN_ON(!list_empty(&fpq->io));
@@ -2190,7 +2368,7 @@ static int fuse_dev_fasync(int fd, struct file *file, int on)
 		return -EPERM;
 
 	/* No locking - fasync_helper does its own locking */
-	return fasync_helper(fd, file, on, &fud->fc->iq.fasync);
+	return fasync_helper(fd, file, on, &fud->iq->fasync);
 }
 
 static int fuse_device_clone(struct fuse_conn *fc, struct file *new)
@@ -2215,7 +2393,38 @@ static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
 {
 	int err = -ENOTTY;
 
-	if (cmd == FUSE_DEV_IOC_CLONE) {
+	if (cmd == FUSE_DEV_IOC_BIND_QUEUE) {
+		struct fuse_dev *fud = fuse_get_dev(file);
+		u32 cpu;
+
+		err = -EINVAL;
+		if (fud && file->f_op == &fuse_dev_operations) {
+			err = -EFAULT;
+			if (!get_user(cpu, (__u32 __user *) arg))
+				err = fuse_dev_bind_queue(fud, file, cpu);
+		}
+	} else if (cmd == FUSE_DEV_IOC_BACKING_OPEN) {
+		struct fuse_dev *fud = fuse_get_dev(file);
+		struct fuse_backing_map map;
+
+		err = -EINVAL;
+		if (fud && file->f_op == &fuse_dev_operations) {
+			err = -EFAULT;
+			if (!copy_from_user(&map, (void __user *) arg,
+					    sizeof(map)))
+				err = fuse_backing_open(fud->fc, &map);
+		}
+	} else if (cmd == FUSE_DEV_IOC_BACKING_CLOSE) {
+		struct fuse_dev *fud = fuse_get_dev(file);
+		u32 backing_id;
+
+		err = -EINVAL;
+		if (fud && file->f_op == &fuse_dev_operations) {
+			err = -EFAULT;
+			if (!get_user(backing_id, (__u32 __user *) arg))
+				err = fuse_backing_close(fud->fc, backing_id);
+		}
+	} else if (cmd == FUSE_DEV_IOC_CLONE) {
 		int oldfd;
 
 		err = -EFAULT;
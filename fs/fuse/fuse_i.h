@@ -27,9 +27,13 @@
 #include <linux/pid_namespace.h>
 #include <linux/refcount.h>
 #include <linux/user_namespace.h>
+#include <linux/idr.h>
 
-/** Max number of pages that can be used in a single read request */
-#define FUSE_MAX_PAGES_PER_REQ 32
+/** Default max number of pages that can be used in a single read request */
+#define FUSE_DEFAULT_MAX_PAGES_PER_REQ 32
+
+/** Maximum of max_pages received in init_out */
+#define FUSE_MAX_MAX_PAGES 1024
 
 /** Bias for fi->writectr, meaning new writepages must not be sent */
 #define FUSE_NOWRITE INT_MIN
@@ -156,6 +160,9 @@ struct fuse_file {
 
 	/** Has flock been performed on this file? */
 	bool flock:1;
+
+	/** Backing file serving read/write/mmap (FOPEN_PASSTHROUGH) */
+	struct file *passthrough;
 };
 
 /** One input argument of a request */
@@ -314,6 +321,9 @@ struct fuse_req {
 	/** Unique ID for the interrupt request */
 	u64 intr_unique;
 
+	/** Input queue the request was put on */
+	struct fuse_iqueue *iq;
+
 	/* Request flags, updated with test/set/clear_bit() */
 	unsigned long flags;
 
@@ -391,8 +401,8 @@ struct fuse_iqueue {
 	/** Readers of the connection are waiting on this */
 	wait_queue_head_t waitq;
 
-	/** The next unique request id */
-	u64 reqctr;
+	/** Number of devices bound to this queue (per-CPU queues only) */
+	unsigned nr_readers;
 
 	/** The list of pending requests */
 	struct list_head pending;
@@ -432,6 +442,12 @@ struct fuse_dev {
 	/** Fuse connection for this device */
 	struct fuse_conn *fc;
 
+	/** Input queue this device reads requests from */
+	struct fuse_iqueue *iq;
+
+	/** Has been polled on its input queue, which pins it there */
+	bool polled;
+
 	/** Processing queue */
 	struct fuse_pqueue pq;
 
@@ -476,9 +492,18 @@ struct fuse_conn {
 	/** Maximum write size */
 	unsigned max_write;
 
+	/** Maximum number of pages that can be used in a single request */
+	unsigned int max_pages;
+
 	/** Input queue */
 	struct fuse_iqueue iq;
 
+	/** Per-CPU input queues, allocated when a device first binds to one */
+	struct fuse_iqueue __percpu *cpu_iq;
+
+	/** The next unique request id, shared by all input queues */
+	atomic64_t reqctr;
+
 	/** The next unique kernel file handle */
 	u64 khctr;
 
@@ -631,6 +656,9 @@ struct fuse_conn {
 	/** Does the filesystem support posix acls? */
 	unsigned posix_acl:1;
 
+	/** Can read/write/mmap be passed through to backing files? */
+	unsigned passthrough:1;
+
 	/** Check permissions based on the file mode or not? */
 	unsigned default_permissions:1;
 
@@ -675,6 +703,9 @@ struct fuse_conn {
 
 	/** List of device instances belonging to this connection */
 	struct list_head devices;
+
+	/** Backing files registered for passthrough, indexed by id */
+	struct idr backing_files_map;
 };
 
 static inline struct fuse_conn *get_fuse_conn_super(struct super_block *sb)
@@ -888,6 +919,8 @@ void fuse_conn_init(struct fuse_conn *fc, struct user_namespace *user_ns);
  */
 void fuse_conn_put(struct fuse_conn *fc);
 
+void fuse_iqueue_init(struct fuse_iqueue *fiq);
+
 struct fuse_dev *fuse_dev_alloc(struct fuse_conn *fc);
 void fuse_dev_free(struct fuse_dev *fud);
 
@@ -967,6 +1000,17 @@ int fuse_dev_release(struct inode *inode, struct file *file);
 
 bool fuse_write_update_size(struct inode *inode, loff_t pos);
 
+/* passthrough.c */
+int fuse_backing_open(struct fuse_conn *fc, struct fuse_backing_map *map);
+int fuse_backing_close(struct fuse_conn *fc, int backing_id);
+void fuse_backing_files_free(struct fuse_conn *fc);
+int fuse_passthrough_open(struct fuse_conn *fc, struct fuse_file *ff,
+			  struct file *file, int backing_id);
+void fuse_passthrough_release(struct fuse_file *ff);
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *iter);
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *iter);
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+
 int fuse_flush_times(struct inode *inode, struct fuse_file *ff);
 int fuse_write_inode(struct inode *inode, struct writeback_control *wbc);
 
@@ -0,0 +1,233 @@
+/*
+  FUSE: Filesystem in Userspace
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+
+  Passthrough: read, write and mmap of a file are served directly from
+  a backing file on another filesystem, registered by the server via
+  FUSE_DEV_IOC_BACKING_OPEN and attached at open time with
+  FOPEN_PASSTHROUGH.  Everything else still goes to the server.
+*/
+
+#include "fuse_i.h"
+
+#include <linux/file.h>
+#include <linux/idr.h>
+#include <linux/uio.h>
+
+int fuse_backing_open(struct fuse_conn *fc, struct fuse_backing_map *map)
+{
+	struct file *file;
+	struct super_block *backing_sb;
+	int res;
+
+	/* Backing files are not visible in lsof, don't let anyone hide them */
+	res = -EPERM;
+	if (!capable(CAP_SYS_ADMIN))
+		goto out;
+
+	res = -EOPNOTSUPP;
+	if (!fc->passthrough)
+		goto out;
+
+	res = -EINVAL;
+	if (map->flags || map->padding)
+		goto out;
+
+	res = -EBADF;
+	file = fget(map->fd);
+	if (!file)
+		goto out;
+
+	res = -EINVAL;
+	if (!S_ISREG(file_inode(file)->i_mode) ||
+	    !file->f_op->read_iter || !file->f_op->write_iter)
+		goto out_fput;
+
+	/* The fuse sb is stacked on top of the backing one, see INIT */
+	res = -ELOOP;
+	backing_sb = file_inode(file)->i_sb;
+	if (backing_sb->s_stack_depth >= FILESYSTEM_MAX_STACK_DEPTH - 1)
+		goto out_fput;
+
+	idr_preload(GFP_KERNEL);
+	spin_lock(&fc->lock);
+	res = idr_alloc_cyclic(&fc->backing_files_map, file, 1, 0, GFP_ATOMIC);
+	spin_unlock(&fc->lock);
+	idr_preload_end();
+	if (res > 0)
+		return res;
+
+out_fput:
+	fput(file);
+out:
+	return res;
+}
+
+int fuse_backing_close(struct fuse_conn *fc, int backing_id)
+{
+	struct file *file;
+
+	if (!capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	if (backing_id <= 0)
+		return -EINVAL;
+
+	spin_lock(&fc->lock);
+	file = idr_remove(&fc->backing_files_map, backing_id);
+	spin_unlock(&fc->lock);
+	if (!file)
+		return -ENOENT;
+
+	/* Files opened through it keep their own reference */
+	fput(file);
+	return 0;
+}
+
+static int fuse_backing_id_free(int id, void *p, void *data)
+{
+	fput(p);
+	return 0;
+}
+
+void fuse_backing_files_free(struct fuse_conn *fc)
+{
+	idr_for_each(&fc->backing_files_map, fuse_backing_id_free, NULL);
+	idr_destroy(&fc->backing_files_map);
+}
+
+/*
+ * Open the backing file registered as @backing_id for @file.  The open
+ * is done with the credentials of the server which registered it, and
+ * the open flags of @file, so that the usual permission checks of the
+ * backing filesystem apply.
+ */
+int fuse_passthrough_open(struct fuse_conn *fc, struct fuse_file *ff,
+			  struct file *file, int backing_id)
+{
+	struct file *backing, *passthrough;
+	int flags = file->f_flags & ~(O_CREAT | O_EXCL | O_NOCTTY | O_TRUNC);
+
+	if (!fc->passthrough)
+		return -EINVAL;
+
+	spin_lock(&fc->lock);
+	backing = idr_find(&fc->backing_files_map, backing_id);
+	if (backing)
+		get_file(backing);
+	spin_unlock(&fc->lock);
+	if (!backing)
+		return -ENOENT;
+
+	passthrough = dentry_open(&backing->f_path, flags, backing->f_cred);
+	fput(backing);
+	if (IS_ERR(passthrough))
+		return PTR_ERR(passthrough);
+
+	ff->passthrough = passthrough;
+	return 0;
+}
+
+void fuse_passthrough_release(struct fuse_file *ff)
+{
+	if (ff->passthrough) {
+		fput(ff->passthrough);
+		ff->passthrough = NULL;
+	}
+}
+
+static rwf_t fuse_iocb_to_rwf(struct kiocb *iocb)
+{
+	int ifl = iocb->ki_flags;
+	rwf_t flags = 0;
+
+	if (ifl & IOCB_NOWAIT)
+		flags |= RWF_NOWAIT;
+	if (ifl & IOCB_HIPRI)
+		flags |= RWF_HIPRI;
+	if (ifl & IOCB_DSYNC)
+		flags |= RWF_DSYNC;
+	if (ifl & IOCB_SYNC)
+		flags |= RWF_SYNC;
+
+	return flags;
+}
+
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *iter)
+{
+	struct fuse_file *ff = iocb->ki_filp->private_data;
+	struct file *backing = ff->passthrough;
+	const struct cred *old_cred;
+	ssize_t ret;
+
+	if (!iov_iter_count(iter))
+		return 0;
+
+	old_cred = override_creds(backing->f_cred);
+	ret = vfs_iter_read(backing, iter, &iocb->ki_pos,
+			    fuse_iocb_to_rwf(iocb));
+	revert_creds(old_cred);
+
+	return ret;
+}
+
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *iter)
+{
+	struct file *file = iocb->ki_filp;
+	struct inode *inode = file_inode(file);
+	struct fuse_file *ff = file->private_data;
+	struct file *backing = ff->passthrough;
+	const struct cred *old_cred;
+	ssize_t ret;
+
+	if (!iov_iter_count(iter))
+		return 0;
+
+	inode_lock(inode);
+	old_cred = override_creds(backing->f_cred);
+	file_start_write(backing);
+	ret = vfs_iter_write(backing, iter, &iocb->ki_pos,
+			     fuse_iocb_to_rwf(iocb));
+	file_end_write(backing);
+	revert_creds(old_cred);
+
+	/* Size and times changed under us, mode may have (suid clearing) */
+	if (ret > 0)
+		fuse_write_update_size(inode, iocb->ki_pos);
+	fuse_invalidate_attr(inode);
+	inode_unlock(inode);
+
+	return ret;
+}
+
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_file *ff = file->private_data;
+	struct file *backing = ff->passthrough;
+	const struct cred *old_cred;
+	int ret;
+
+	if (!backing->f_op->mmap)
+		return -ENODEV;
+
+	if (WARN_ON(file != vma->vm_file))
+		return -EIO;
+
+	vma->vm_file = get_file(backing);
+
+	old_cred = override_creds(backing->f_cred);
+	ret = call_mmap(vma->vm_file, vma);
+	revert_creds(old_cred);
+
+	if (ret) {
+		/* Drop reference count from new vm_file value */
+		fput(backing);
+	} else {
+		/* Drop reference count from previous vm_file value */
+		fput(file);
+	}
+
+	return ret;
+}
@@ -18,6 +18,7 @@
 #include <linux/vmalloc.h>
 #include <linux/mtd/mtd.h>
 #include <linux/mm.h> /* kvfree() */
+#include <linux/ktime.h>
 #include "nodelist.h"
 
 static void jffs2_build_remove_unlinked_inode(struct jffs2_sb_info *,
@@ -102,17 +103,20 @@ static int jffs2_build_filesystem(struct jffs2_sb_info *c)
 	struct jffs2_inode_cache *ic;
 	struct jffs2_full_dirent *fd;
 	struct jffs2_full_dirent *dead_fds = NULL;
+	ktime_t start, scanned;
 
 	dbg_fsbuild("build FS data structures\n");
 
 	/* First, scan the medium and build all the inode caches with
 	   lists of physical nodes */
 
+	start = ktime_get();
 	c->flags |= JFFS2_SB_FLAG_SCANNING;
 	ret = jffs2_scan_medium(c);
 	c->flags &= ~JFFS2_SB_FLAG_SCANNING;
 	if (ret)
 		goto exit;
+	scanned = ktime_get();
 
 	dbg_fsbuild("scanned flash completely\n");
 	jffs2_dbg_dump_block_lists_nolock(c);
@@ -216,6 +220,13 @@ static int jffs2_build_filesystem(struct jffs2_sb_info *c)
 
 	dbg_fsbuild("FS build complete\n");
 
+	c->mount_scan_ms = ktime_ms_delta(scanned, start);
+	c->mount_build_ms = ktime_ms_delta(ktime_get(), scanned);
+	pr_info("%s: scanned %u blocks in %u ms (%u from summary, %u read ahead), built in %u ms\n",
+		c->mtd->name, c->nr_blocks, c->mount_scan_ms,
+		c->mount_sum_blocks, c->mount_ahead_blocks,
+		c->mount_build_ms);
+
 	/* Rotate the lists by some number to ensure wear levelling */
 	jffs2_rotate_lists(c);
 
@@ -142,6 +142,12 @@ struct jffs2_sb_info {
 	struct jffs2_summary *summary;		/* Summary information */
 	struct jffs2_mount_opts mount_opts;
 
+	/* Mount statistics: how the blocks were scanned, and how long it took */
+	uint32_t mount_sum_blocks;	/* Scanned from their summary node */
+	uint32_t mount_ahead_blocks;	/* Read ahead by the parallel scan */
+	uint32_t mount_scan_ms;
+	uint32_t mount_build_ms;
+
 #ifdef CONFIG_JFFS2_FS_XATTR
 #define XATTRINDEX_HASHSIZE	(57)
 	uint32_t highest_xid;
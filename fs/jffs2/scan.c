@@ -18,6 +18,8 @@
 #include <linux/pagemap.h>
 #include <linux/crc32.h>
 #include <linux/compiler.h>
+#include <linux/workqueue.h>
+#include <linux/completion.h>
 #include "nodelist.h"
 #include "summary.h"
 #include "debug.h"
@@ -47,6 +49,8 @@ static int jffs2_scan_inode_node(struct jffs2_sb_info *c, struct jffs2_erasebloc
 				 struct jffs2_raw_inode *ri, uint32_t ofs, struct jffs2_summary *s);
 static int jffs2_scan_dirent_node(struct jffs2_sb_info *c, struct jffs2_eraseblock *jeb,
 				 struct jffs2_raw_dirent *rd, uint32_t ofs, struct jffs2_summary *s);
+static int jffs2_fill_scan_buf(struct jffs2_sb_info *c, void *buf,
+			       uint32_t ofs, uint32_t len);
 
 static inline int min_free(struct jffs2_sb_info *c)
 {
@@ -88,6 +92,182 @@ static int file_dirty(struct jffs2_sb_info *c, struct jffs2_eraseblock *jeb)
 	return 0;
 }
 
+#ifdef CONFIG_JFFS2_PARALLEL_SCAN
+/*
+ * Read-ahead for the scan: unbound workers read whole erase blocks into a
+ * ring of buffers, so the flash is read on several CPUs at once while the
+ * scan parses the blocks before.  A block which was read ahead is then
+ * scanned from its buffer just like a point()ed one.  Parsing itself stays
+ * serial, as it builds the shared inode caches and node lists.
+ */
+#define JFFS2_SCAN_AHEAD_BYTES (4 << 20)
+
+struct jffs2_scan_slot {
+	struct work_struct work;
+	struct completion done;
+	struct jffs2_sb_info *c;
+	struct jffs2_eraseblock *jeb;	/* NULL if not queued */
+	unsigned char *buf;
+	int full;			/* buf holds all of jeb */
+};
+
+struct jffs2_scan_ahead {
+	int nr_slots;
+	struct jffs2_scan_slot slot[];
+};
+
+static void jffs2_scan_ahead_work(struct work_struct *work)
+{
+	struct jffs2_scan_slot *slot;
+	struct jffs2_eraseblock *jeb;
+	struct jffs2_sb_info *c;
+	struct jffs2_sum_marker *sm;
+
+	slot = container_of(work, struct jffs2_scan_slot, work);
+	c = slot->c;
+	jeb = slot->jeb;
+	if (jffs2_cleanmarker_oob(c) && mtd_block_isbad(c->mtd, jeb->offset))
+		goto out;
+
+	/*
+	 * Only the summary of a block which has one is read by the scan.
+	 * Leave those to it, including the ones with a bogus offset, which
+	 * a point()ed block is not checked for.
+	 */
+	if (jffs2_sum_active()) {
+		sm = (void *)slot->buf + c->sector_size - sizeof(*sm);
+		if (jffs2_fill_scan_buf(c, sm, jeb->offset + c->sector_size -
+					sizeof(*sm), sizeof(*sm)))
+			goto out;
+		if (je32_to_cpu(sm->magic) == JFFS2_SUM_MAGIC)
+			goto out;
+	}
+
+	if (!jffs2_fill_scan_buf(c, slot->buf, jeb->offset, c->sector_size))
+		slot->full = 1;
+ out:
+	complete(&slot->done);
+}
+
+static void jffs2_scan_ahead_queue(struct jffs2_sb_info *c,
+				   struct jffs2_scan_ahead *ra, int i)
+{
+	struct jffs2_scan_slot *slot;
+
+	if (i >= c->nr_blocks)
+		return;
+
+	slot = &ra->slot[i % ra->nr_slots];
+	slot->jeb = &c->blocks[i];
+	slot->full = 0;
+	reinit_completion(&slot->done);
+	queue_work(system_unbound_wq, &slot->work);
+}
+
+/* Wait for block @i; returns its contents, or NULL to read it as usual */
+static unsigned char *jffs2_scan_ahead_get(struct jffs2_sb_info *c,
+					   struct jffs2_scan_ahead *ra, int i)
+{
+	struct jffs2_scan_slot *slot;
+
+	if (!ra)
+		return NULL;
+
+	slot = &ra->slot[i % ra->nr_slots];
+	wait_for_completion(&slot->done);
+	slot->jeb = NULL;
+	if (!slot->full)
+		return NULL;
+
+	c->mount_ahead_blocks++;
+	return slot->buf;
+}
+
+/* Block @i has been scanned, reuse its slot for the next one */
+static void jffs2_scan_ahead_put(struct jffs2_sb_info *c,
+				 struct jffs2_scan_ahead *ra, int i)
+{
+	if (ra)
+		jffs2_scan_ahead_queue(c, ra, i + ra->nr_slots);
+}
+
+static void jffs2_scan_ahead_stop(struct jffs2_scan_ahead *ra)
+{
+	int i;
+
+	if (!ra)
+		return;
+
+	for (i = 0; i < ra->nr_slots; i++) {
+		if (ra->slot[i].jeb)
+			wait_for_completion(&ra->slot[i].done);
+		kfree(ra->slot[i].buf);
+	}
+	kfree(ra);
+}
+
+static struct jffs2_scan_ahead *jffs2_scan_ahead_start(struct jffs2_sb_info *c)
+{
+	struct jffs2_scan_ahead *ra;
+	int i, nr;
+
+	nr = min_t(int, 2 * num_online_cpus(),
+		   JFFS2_SCAN_AHEAD_BYTES / c->sector_size);
+	nr = min_t(int, nr, c->nr_blocks);
+	if (num_online_cpus() < 2 || nr < 2)
+		return NULL;
+
+	ra = kzalloc(sizeof(*ra) + nr * sizeof(ra->slot[0]), GFP_KERNEL);
+	if (!ra)
+		return NULL;
+
+	ra->nr_slots = nr;
+	for (i = 0; i < nr; i++) {
+		struct jffs2_scan_slot *slot = &ra->slot[i];
+
+		INIT_WORK(&slot->work, jffs2_scan_ahead_work);
+		init_completion(&slot->done);
+		slot->c = c;
+		/* Not worth failing the mount for, just scan serially */
+		slot->buf = kmalloc(c->sector_size, GFP_KERNEL | __GFP_NOWARN);
+		if (!slot->buf) {
+			jffs2_scan_ahead_stop(ra);
+			return NULL;
+		}
+	}
+
+	jffs2_dbg(1, "Reading ahead %d blocks for the scan\n", nr);
+	for (i = 0; i < nr; i++)
+		jffs2_scan_ahead_queue(c, ra, i);
+
+	return ra;
+}
+#else
+struct jffs2_scan_ahead;
+
+static inline struct jffs2_scan_ahead *
+jffs2_scan_ahead_start(struct jffs2_sb_info *c)
+{
+	return NULL;
+}
+
+static inline unsigned char *jffs2_scan_ahead_get(struct jffs2_sb_info *c,
+						  struct jffs2_scan_ahead *ra,
+						  int i)
+{
+	return NULL;
+}
+
+static inline void jffs2_scan_ahead_put(struct jffs2_sb_info *c,
+					struct jffs2_scan_ahead *ra, int i)
+{
+}
+
+static inline void jffs2_scan_ahead_stop(struct jffs2_scan_ahead *ra)
+{
+}
+#endif
+
 int jffs2_scan_medium(struct jffs2_sb_info *c)
 {
 	int i, ret;
@@ -95,6 +275,7 @@ int jffs2_scan_medium(struct jffs2_sb_info *c)
 	unsigned char *flashbuf = NULL;
 	uint32_t buf_size = 0;
 	struct jffs2_summary *s = NULL; /* summary info collected by the scan process */
+	struct jffs2_scan_ahead *ra = NULL;
 #ifndef __ECOS
 	size_t pointlen, try_size;
 
@@ -140,16 +321,27 @@ int jffs2_scan_medium(struct jffs2_sb_info *c)
 		}
 	}
 
+	/* No point reading ahead what we can point() at */
+	if (buf_size)
+		ra = jffs2_scan_ahead_start(c);
+
 	for (i=0; i<c->nr_blocks; i++) {
 		struct jffs2_eraseblock *jeb = &c->blocks[i];
+		unsigned char *blockbuf;
 
 		cond_resched();
 
 		/* reset summary info for next eraseblock scan */
 		jffs2_sum_reset_collected(s);
 
-		ret = jffs2_scan_eraseblock(c, jeb, buf_size?flashbuf:(flashbuf+jeb->offset),
-						buf_size, s);
+		blockbuf = jffs2_scan_ahead_get(c, ra, i);
+		if (blockbuf)
+			ret = jffs2_scan_eraseblock(c, jeb, blockbuf, 0, s);
+		else
+			ret = jffs2_scan_eraseblock(c, jeb, buf_size?flashbuf:(flashbuf+jeb->offset),
+						    buf_size, s);
+
+		jffs2_scan_ahead_put(c, ra, i);
 
 		if (ret < 0)
 			goto out;
@@ -274,6 +466,7 @@ int jffs2_scan_medium(struct jffs2_sb_info *c)
 	}
 	ret = 0;
  out:
+	jffs2_scan_ahead_stop(ra);
 	if (buf_size)
 		kfree(flashbuf);
 #ifndef __ECOS
@@ -543,6 +736,8 @@ static int jffs2_scan_eraseblock (struct jffs2_sb_info *c, struct jffs2_eraseblo
 			   If it returns positive, that's a block classification
 			   (i.e. BLK_STATE_xxx) so return that too.
 			   If it returns zero, fall through to full scan. */
+			if (err > 0)
+				c->mount_sum_blocks++;
 			if (err)
 				return err;
 		}
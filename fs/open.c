@@ -65,6 +65,24 @@ int do_truncate(struct dentry *dentry, loff_t length, unsigned int time_attrs,
 	return ret;
 }
 
+/*
+ * Huge pages in the page cache of a regular file are only ever read.
+ * Drop the page cache before the file can be written to; truncation is
+ * handled by truncate_pagecache().  The caller holds write access to @inode.
+ */
+static void drop_thp_pagecache(struct inode *inode)
+{
+	/*
+	 * Pairs with smp_mb() in collapse_file(): either we see the THP, or
+	 * khugepaged sees our write access and backs off.
+	 */
+	smp_mb();
+	if (filemap_nr_thps(inode->i_mapping)) {
+		filemap_write_and_wait(inode->i_mapping);
+		truncate_inode_pages(inode->i_mapping, 0);
+	}
+}
+
 long vfs_truncate(const struct path *path, loff_t length)
 {
 	struct inode *inode;
@@ -787,6 +805,9 @@ static int do_dentry_open(struct file *f,
 
 	file_ra_state_init(&f->f_ra, f->f_mapping->host->i_mapping);
 
+	if (f->f_mode & FMODE_WRITE)
+		drop_thp_pagecache(inode);
+
 	/* NB: we're sure to have correct a_ops only after f_op->open */
 	if (f->f_flags & O_DIRECT) {
 		if (!f->f_mapping->a_ops || !f->f_mapping->a_ops->direct_IO)
@@ -25,6 +25,9 @@
 
 #define OVL_COPY_UP_CHUNK_SIZE (1 << 20)
 
+/* Max files copied up by the background worker between fsyncs */
+#define OVL_COPY_UP_BATCH 16
+
 static int ovl_ccup_set(const char *buf, const struct kernel_param *param)
 {
 	pr_warn("overlayfs: \"check_copy_up\" module option is obsolete\n");
@@ -119,12 +122,20 @@ int ovl_copy_xattr(struct dentry *old, struct dentry *new)
 	return error;
 }
 
-static int ovl_copy_up_data(struct path *old, struct path *new, loff_t len)
+/*
+ * Copy @len bytes of data from @old to @new.  With @sync, the data is
+ * on disk on return, otherwise writeback has only been started and the
+ * caller has to fsync @new before relying on it.
+ */
+static int ovl_copy_up_data(struct ovl_fs *ofs, struct path *old,
+			    struct path *new, loff_t len, bool sync)
 {
 	struct file *old_file;
 	struct file *new_file;
 	loff_t old_pos = 0;
 	loff_t new_pos = 0;
+	loff_t data_pos = -1;
+	bool skip_hole = false;
 	int error = 0;
 
 	if (len == 0)
@@ -142,12 +153,17 @@ static int ovl_copy_up_data(struct path *old, struct path *new, loff_t len)
 
 	/* Try to use clone_file_range to clone up within the same fs */
 	error = do_clone_file_range(old_file, 0, new_file, 0, len);
-	if (!error)
+	if (!error) {
+		atomic64_add(len, &ofs->stats.bytes);
 		goto out;
+	}
 	/* Couldn't clone, so now we try to copy the data */
 	error = 0;
 
-	/* FIXME: copy up sparse files efficiently */
+	/* Holes are skipped if the lower fs can tell us where they are */
+	if ((old_file->f_mode & FMODE_LSEEK) && old_file->f_op->llseek)
+		skip_hole = true;
+
 	while (len) {
 		size_t this_len = OVL_COPY_UP_CHUNK_SIZE;
 		long bytes;
@@ -160,6 +176,28 @@ static int ovl_copy_up_data(struct path *old, struct path *new, loff_t len)
 			break;
 		}
 
+		/*
+		 * Look for the next data only once we have copied past the
+		 * last one found, so a fully allocated file costs a single
+		 * lseek per chunk.  The size of the upper file is set by the
+		 * caller, so a hole at the end is not copied either.
+		 */
+		if (skip_hole && data_pos < old_pos) {
+			data_pos = vfs_llseek(old_file, old_pos, SEEK_DATA);
+			if (data_pos == -ENXIO || data_pos >= old_pos + len) {
+				atomic64_add(len, &ofs->stats.holes);
+				break;
+			} else if (data_pos > old_pos) {
+				atomic64_add(data_pos - old_pos,
+					     &ofs->stats.holes);
+				len -= data_pos - old_pos;
+				old_pos = new_pos = data_pos;
+				continue;
+			} else if (data_pos < 0) {
+				skip_hole = false;
+			}
+		}
+
 		bytes = do_splice_direct(old_file, &old_pos,
 					 new_file, &new_pos,
 					 this_len, SPLICE_F_MOVE);
@@ -168,12 +206,15 @@ static int ovl_copy_up_data(struct path *old, struct path *new, loff_t len)
 			break;
 		}
 		WARN_ON(old_pos != new_pos);
+		atomic64_add(bytes, &ofs->stats.bytes);
 
 		len -= bytes;
 	}
 out:
-	if (!error)
+	if (!error && sync)
 		error = vfs_fsync(new_file, 0);
+	else if (!error)
+		error = filemap_fdatawrite(new_file->f_mapping);
 	fput(new_file);
 out_fput:
 	fput(old_file);
@@ -526,7 +567,8 @@ static int ovl_copy_up_inode(struct ovl_copy_up_ctx *c, struct dentry *temp)
 		upperpath.dentry = temp;
 
 		ovl_path_lowerdata(c->dentry, &datapath);
-		err = ovl_copy_up_data(&datapath, &upperpath, c->stat.size);
+		err = ovl_copy_up_data(c->dentry->d_sb->s_fs_info, &datapath,
+				       &upperpath, c->stat.size, true);
 		if (err)
 			return err;
 	}
@@ -538,8 +580,9 @@ static int ovl_copy_up_inode(struct ovl_copy_up_ctx *c, struct dentry *temp)
 			return err;
 	}
 
+	/* Holes at the end are not copied, so size is set for data too */
 	inode_lock(temp->d_inode);
-	if (c->metacopy)
+	if (S_ISREG(c->stat.mode))
 		err = ovl_set_size(temp, &c->stat);
 	if (!err)
 		err = ovl_set_attr(temp, &c->stat);
@@ -702,37 +745,193 @@ static bool ovl_need_meta_copy_up(struct dentry *dentry, umode_t mode,
 }
 
 /* Copy up data of an inode which was copied up metadata only in the past. */
-static int ovl_copy_up_meta_inode_data(struct ovl_copy_up_ctx *c)
+static int ovl_copy_up_meta_data(struct dentry *dentry, loff_t len, bool sync)
 {
 	struct path upperpath, datapath;
-	int err;
 
-	ovl_path_upper(c->dentry, &upperpath);
+	ovl_path_upper(dentry, &upperpath);
 	if (WARN_ON(upperpath.dentry == NULL))
 		return -EIO;
 
-	ovl_path_lowerdata(c->dentry, &datapath);
+	ovl_path_lowerdata(dentry, &datapath);
 	if (WARN_ON(datapath.dentry == NULL))
 		return -EIO;
 
-	err = ovl_copy_up_data(&datapath, &upperpath, c->stat.size);
+	return ovl_copy_up_data(dentry->d_sb->s_fs_info, &datapath,
+				&upperpath, len, sync);
+}
+
+static int ovl_set_meta_upperdata(struct dentry *dentry)
+{
+	int err;
+
+	err = vfs_removexattr(ovl_dentry_upper(dentry), OVL_XATTR_METACOPY);
+	if (err)
+		return err;
+
+	ovl_set_upperdata(d_inode(dentry));
+	return 0;
+}
+
+static int ovl_copy_up_meta_inode_data(struct ovl_copy_up_ctx *c)
+{
+	int err;
+
+	err = ovl_copy_up_meta_data(c->dentry, c->stat.size, true);
 	if (err)
 		return err;
 
-	err = vfs_removexattr(upperpath.dentry, OVL_XATTR_METACOPY);
+	return ovl_set_meta_upperdata(c->dentry);
+}
+
+struct ovl_copy_up_async {
+	struct list_head list;
+	struct dentry *dentry;
+	bool copied;
+};
+
+/*
+ * One step of background data copy up of @dentry: copy the data, or with
+ * @finish, fsync it and switch the inode over to upper data.  Returns 1
+ * if someone else did the data copy up in the meantime.
+ */
+static int ovl_copy_up_async_one(struct dentry *dentry, bool finish)
+{
+	struct path upperpath;
+	struct file *file;
+	loff_t len;
+	int err;
+
+	err = ovl_want_write(dentry);
 	if (err)
 		return err;
 
-	ovl_set_upperdata(d_inode(c->dentry));
+	err = ovl_copy_up_start(dentry, O_WRONLY);
+	if (err)
+		goto out_drop_write;
+
+	if (!finish) {
+		/* Size can't change without a data copy up, held off by us */
+		len = i_size_read(d_inode(ovl_dentry_upper(dentry)));
+		err = ovl_copy_up_meta_data(dentry, len, false);
+	} else {
+		ovl_path_upper(dentry, &upperpath);
+		file = ovl_path_open(&upperpath, O_LARGEFILE | O_WRONLY);
+		err = PTR_ERR_OR_ZERO(file);
+		if (!err) {
+			err = vfs_fsync(file, 0);
+			fput(file);
+		}
+		if (!err)
+			err = ovl_set_meta_upperdata(dentry);
+	}
+	ovl_copy_up_end(dentry);
+out_drop_write:
+	ovl_drop_write(dentry);
+
 	return err;
 }
 
+/*
+ * Background data copy up of files which were copied up metadata only
+ * (async_copy_up=on).  Readers keep using the lower data until a file is
+ * done, and a writer which gets there first does the copy up itself.
+ *
+ * Files are taken in batches: the data of all of them is copied and
+ * writeback started before any is fsynced, so the fsyncs mostly wait on
+ * I/O already in flight and can share journal commits in the upper fs.
+ */
+void ovl_copy_up_work(struct work_struct *work)
+{
+	struct ovl_fs *ofs = container_of(work, struct ovl_fs, copy_up_work);
+	struct ovl_copy_up_async *ca, *tmp;
+	const struct cred *old_cred;
+	LIST_HEAD(batch);
+	int n;
+
+	old_cred = override_creds(ofs->creator_cred);
+	for (;;) {
+		spin_lock(&ofs->copy_up_lock);
+		for (n = 0; n < OVL_COPY_UP_BATCH; n++) {
+			if (list_empty(&ofs->copy_up_list))
+				break;
+			list_move_tail(ofs->copy_up_list.next, &batch);
+		}
+		spin_unlock(&ofs->copy_up_lock);
+		if (list_empty(&batch))
+			break;
+
+		list_for_each_entry(ca, &batch, list)
+			ca->copied = !ovl_copy_up_async_one(ca->dentry, false);
+
+		list_for_each_entry_safe(ca, tmp, &batch, list) {
+			if (ca->copied)
+				ovl_copy_up_async_one(ca->dentry, true);
+			ovl_clear_flag(OVL_DATA_COPY_UP_QUEUED,
+				       d_inode(ca->dentry));
+			list_del(&ca->list);
+			dput(ca->dentry);
+			kfree(ca);
+		}
+	}
+	revert_creds(old_cred);
+}
+
+static void ovl_queue_data_copy_up(struct dentry *dentry)
+{
+	struct ovl_fs *ofs = dentry->d_sb->s_fs_info;
+	struct ovl_copy_up_async *ca;
+
+	if (test_and_set_bit(OVL_DATA_COPY_UP_QUEUED,
+			     &OVL_I(d_inode(dentry))->flags))
+		return;
+
+	/* Best effort, a writer will do the data copy up anyway */
+	ca = kmalloc(sizeof(*ca), GFP_KERNEL);
+	if (!ca) {
+		ovl_clear_flag(OVL_DATA_COPY_UP_QUEUED, d_inode(dentry));
+		return;
+	}
+	ca->dentry = dget(dentry);
+
+	spin_lock(&ofs->copy_up_lock);
+	list_add_tail(&ca->list, &ofs->copy_up_list);
+	spin_unlock(&ofs->copy_up_lock);
+
+	atomic64_inc(&ofs->stats.queued);
+	queue_work(system_unbound_wq, &ofs->copy_up_work);
+}
+
+/* Wait for background data copy up to finish, before umount */
+void ovl_copy_up_flush(struct ovl_fs *ofs)
+{
+	flush_work(&ofs->copy_up_work);
+}
+
+static void ovl_copy_up_account(struct ovl_fs *ofs, ktime_t start)
+{
+	u64 ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	u64 max = atomic64_read(&ofs->stats.max_ns);
+
+	atomic64_inc(&ofs->stats.files);
+	atomic64_add(ns, &ofs->stats.time_ns);
+	while (ns > max) {
+		u64 old = atomic64_cmpxchg(&ofs->stats.max_ns, max, ns);
+
+		if (old == max)
+			break;
+		max = old;
+	}
+}
+
 static int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
 			   int flags)
 {
 	int err;
 	DEFINE_DELAYED_CALL(done);
+	struct ovl_fs *ofs = dentry->d_sb->s_fs_info;
 	struct path parentpath;
+	ktime_t start;
 	struct ovl_copy_up_ctx ctx = {
 		.parent = parent,
 		.dentry = dentry,
@@ -772,6 +971,7 @@ static int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
 			return PTR_ERR(ctx.link);
 	}
 
+	start = ktime_get();
 	err = ovl_copy_up_start(dentry, flags);
 	/* err < 0: interrupted, err > 0: raced with another copy-up */
 	if (unlikely(err)) {
@@ -785,9 +985,14 @@ static int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
 		if (!err && ovl_dentry_needs_data_copy_up_locked(dentry, flags))
 			err = ovl_copy_up_meta_inode_data(&ctx);
 		ovl_copy_up_end(dentry);
+		if (!err)
+			ovl_copy_up_account(ofs, start);
 	}
 	do_delayed_call(&done);
 
+	if (!err && ctx.metacopy && ofs->config.async_copy_up)
+		ovl_queue_data_copy_up(dentry);
+
 	return err;
 }
 
@@ -40,6 +40,8 @@ enum ovl_inode_flag {
 	OVL_UPPERDATA,
 	/* Inode number will remain constant over copy up. */
 	OVL_CONST_INO,
+	/* Metacopy inode queued for background data copy up */
+	OVL_DATA_COPY_UP_QUEUED,
 };
 
 enum ovl_entry_flag {
@@ -415,6 +417,8 @@ int ovl_set_attr(struct dentry *upper, struct kstat *stat);
 struct ovl_fh *ovl_encode_real_fh(struct dentry *real, bool is_upper);
 int ovl_set_origin(struct dentry *dentry, struct dentry *lower,
 		   struct dentry *upper);
+void ovl_copy_up_work(struct work_struct *work);
+void ovl_copy_up_flush(struct ovl_fs *ofs);
 
 /* export.c */
 extern const struct export_operations ovl_export_operations;
@@ -20,6 +20,7 @@ struct ovl_config {
 	bool nfs_export;
 	int xino;
 	bool metacopy;
+	bool async_copy_up;
 };
 
 struct ovl_sb {
@@ -41,6 +42,19 @@ struct ovl_path {
 	struct dentry *dentry;
 };
 
+/* Copy up counters, shown in /proc/<pid>/mountstats */
+struct ovl_copy_up_stats {
+	/* Copy ups done on behalf of a caller, and time spent in them */
+	atomic64_t files;
+	atomic64_t time_ns;
+	atomic64_t max_ns;
+	/* Data copied or cloned, and skipped as holes in the lower file */
+	atomic64_t bytes;
+	atomic64_t holes;
+	/* Files queued for background data copy up */
+	atomic64_t queued;
+};
+
 /* private information held for overlayfs's superblock */
 struct ovl_fs {
 	struct vfsmount *upper_mnt;
@@ -67,6 +81,11 @@ struct ovl_fs {
 	bool workdir_locked;
 	/* Inode numbers in all layers do not use the high xino_bits */
 	unsigned int xino_bits;
+	/* Metacopy files waiting for background data copy up */
+	spinlock_t copy_up_lock;
+	struct list_head copy_up_list;
+	struct work_struct copy_up_work;
+	struct ovl_copy_up_stats stats;
 };
 
 /* private information held for every overlayfs dentry */
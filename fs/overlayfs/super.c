@@ -362,6 +362,24 @@ static int ovl_show_options(struct seq_file *m, struct dentry *dentry)
 	if (ofs->config.metacopy != ovl_metacopy_def)
 		seq_printf(m, ",metacopy=%s",
 			   ofs->config.metacopy ? "on" : "off");
+	if (ofs->config.async_copy_up)
+		seq_puts(m, ",async_copy_up=on");
+	return 0;
+}
+
+static int ovl_show_stats(struct seq_file *m, struct dentry *dentry)
+{
+	struct ovl_fs *ofs = dentry->d_sb->s_fs_info;
+	struct ovl_copy_up_stats *st = &ofs->stats;
+
+	seq_printf(m, "copy_up: files=%llu time_us=%llu max_us=%llu",
+		   (u64)atomic64_read(&st->files),
+		   div_u64(atomic64_read(&st->time_ns), NSEC_PER_USEC),
+		   div_u64(atomic64_read(&st->max_ns), NSEC_PER_USEC));
+	seq_printf(m, " bytes=%llu holes=%llu queued=%llu",
+		   (u64)atomic64_read(&st->bytes),
+		   (u64)atomic64_read(&st->holes),
+		   (u64)atomic64_read(&st->queued));
 	return 0;
 }
 
@@ -383,6 +401,7 @@ static const struct super_operations ovl_super_operations = {
 	.sync_fs	= ovl_sync_fs,
 	.statfs		= ovl_statfs,
 	.show_options	= ovl_show_options,
+	.show_stats	= ovl_show_stats,
 	.remount_fs	= ovl_remount,
 };
 
@@ -401,6 +420,8 @@ enum {
 	OPT_XINO_AUTO,
 	OPT_METACOPY_ON,
 	OPT_METACOPY_OFF,
+	OPT_ASYNC_COPY_UP_ON,
+	OPT_ASYNC_COPY_UP_OFF,
 	OPT_ERR,
 };
 
@@ -419,6 +440,8 @@ static const match_table_t ovl_tokens = {
 	{OPT_XINO_AUTO,			"xino=auto"},
 	{OPT_METACOPY_ON,		"metacopy=on"},
 	{OPT_METACOPY_OFF,		"metacopy=off"},
+	{OPT_ASYNC_COPY_UP_ON,		"async_copy_up=on"},
+	{OPT_ASYNC_COPY_UP_OFF,		"async_copy_up=off"},
 	{OPT_ERR,			NULL}
 };
 
@@ -554,6 +577,14 @@ static int ovl_parse_opt(char *opt, struct ovl_config *config)
 			config->metacopy = false;
 			break;
 
+		case OPT_ASYNC_COPY_UP_ON:
+			config->async_copy_up = true;
+			break;
+
+		case OPT_ASYNC_COPY_UP_OFF:
+			config->async_copy_up = false;
+			break;
+
 		default:
 			pr_err("overlayfs: unrecognized mount option \"%s\" or missing value\n", p);
 			return -EINVAL;
@@ -581,6 +612,12 @@ static int ovl_parse_opt(char *opt, struct ovl_config *config)
 		config->metacopy = false;
 	}
 
+	/* Background copy up is only done for the data of metacopy files */
+	if (config->async_copy_up && !config->metacopy) {
+		pr_warn("overlayfs: background data copy up requires \"metacopy=on\", falling back to async_copy_up=off.\n");
+		config->async_copy_up = false;
+	}
+
 	return 0;
 }
 
@@ -1056,6 +1093,7 @@ static int ovl_make_workdir(struct ovl_fs *ofs, struct path *workpath)
 		ofs->noxattr = true;
 		ofs->config.index = false;
 		ofs->config.metacopy = false;
+		ofs->config.async_copy_up = false;
 		pr_warn("overlayfs: upper fs does not support xattr, falling back to index=off and metacopy=off.\n");
 		err = 0;
 	} else {
@@ -1386,6 +1424,10 @@ static int ovl_fill_super(struct super_block *sb, void *data, int silent)
 	if (!cred)
 		goto out_err;
 
+	spin_lock_init(&ofs->copy_up_lock);
+	INIT_LIST_HEAD(&ofs->copy_up_list);
+	INIT_WORK(&ofs->copy_up_work, ovl_copy_up_work);
+
 	ofs->config.index = ovl_index_def;
 	ofs->config.nfs_export = ovl_nfs_export_def;
 	ofs->config.xino = ovl_xino_def();
@@ -1518,11 +1560,19 @@ static struct dentry *ovl_mount(struct file_system_type *fs_type, int flags,
 	return mount_nodev(fs_type, flags, raw_data, ovl_fill_super);
 }
 
+static void ovl_kill_sb(struct super_block *sb)
+{
+	/* Background copy up holds dentries, which must be gone by now */
+	if (sb->s_root)
+		ovl_copy_up_flush(sb->s_fs_info);
+	kill_anon_super(sb);
+}
+
 static struct file_system_type ovl_fs_type = {
 	.owner		= THIS_MODULE,
 	.name		= "overlay",
 	.mount		= ovl_mount,
-	.kill_sb	= kill_anon_super,
+	.kill_sb	= ovl_kill_sb,
 };
 MODULE_ALIAS_FS("overlay");
 
@@ -833,6 +833,14 @@ static int show_smaps_rollup(struct seq_file *m, void *v)
 
 	__show_smap(m, &mss);
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	seq_put_decimal_ull_width(m, "THPCollapsed:   ",
+				  atomic_long_read(&mm->thp_collapsed), 8);
+	seq_put_decimal_ull_width(m, "\nTHPCollapseFail:",
+				  atomic_long_read(&mm->thp_collapse_failed), 8);
+	seq_putc(m, '\n');
+#endif
+
 	release_task_mempolicy(priv);
 	up_read(&mm->mmap_sem);
 	mmput(mm);
@@ -1131,8 +1139,10 @@ static ssize_t clear_refs_write(struct file *file, const char __user *buf,
 					goto out_mm;
 				}
 				for (vma = mm->mmap; vma; vma = vma->vm_next) {
+					vm_write_begin(vma);
 					vma->vm_flags &= ~VM_SOFTDIRTY;
 					vma_set_page_prot(vma);
+					vm_write_end(vma);
 				}
 				downgrade_write(&mm->mmap_sem);
 				break;
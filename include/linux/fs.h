@@ -421,6 +421,10 @@ struct address_space {
 	struct list_head	private_list;	/* for use by the address_space */
 	void			*private_data;	/* ditto */
 	errseq_t		wb_err;
+#ifdef CONFIG_READ_ONLY_THP_FOR_FS
+	/* number of THPs, only for non-shmem files */
+	atomic_t		nr_thps;
+#endif
 } __attribute__((aligned(sizeof(long)))) __randomize_layout;
 	/*
 	 * On most architectures that alignment is already the case; but
@@ -856,6 +860,22 @@ struct fown_struct {
 	int signum;		/* posix.1b rt signal to be delivered on IO */
 };
 
+/*
+ * Requests at a fixed distance from each other, forwards or backwards,
+ * followed by readahead alongside the main window in struct file_ra_state.
+ * This keeps interleaved strided and reverse readers of one file fed.
+ * Kept small as it is embedded in every struct file: the PG_readahead
+ * page of the last window follows from @last, @stride and @size.
+ */
+#define RA_NR_STREAMS	4
+
+struct file_ra_stream {
+	pgoff_t last;			/* start of the last request covered */
+	int stride;			/* pages between requests, 0 if unknown */
+	unsigned short size;		/* requests in the last window */
+	unsigned short stamp;		/* last use, to recycle the oldest */
+};
+
 /*
  * Track a single file's readahead state
  */
@@ -868,6 +888,9 @@ struct file_ra_state {
 	unsigned int ra_pages;		/* Maximum readahead window */
 	unsigned int mmap_miss;		/* Cache miss stat for mmap accesses */
 	loff_t prev_pos;		/* Cache last read() position */
+
+	unsigned short stream_stamp;
+	struct file_ra_stream streams[RA_NR_STREAMS];
 };
 
 /*
@@ -8,6 +8,7 @@
 struct inode;
 struct mm_struct;
 struct task_struct;
+struct timespec64;
 
 extern int
 handle_futex_death(u32 __user *uaddr, struct task_struct *curr, int pi);
@@ -55,6 +56,10 @@ extern void exit_robust_list(struct task_struct *curr);
 
 long do_futex(u32 __user *uaddr, int op, u32 val, ktime_t *timeout,
 	      u32 __user *uaddr2, u32 val2, u32 val3);
+long futex_waitv(struct futex_waitv __user *waiters, unsigned int nr_futexes,
+		 unsigned int flags, struct timespec64 *ts, clockid_t clockid);
+extern void futex_mm_grow(struct mm_struct *mm);
+extern void futex_mm_free(struct mm_struct *mm);
 #ifdef CONFIG_HAVE_FUTEX_CMPXCHG
 #define futex_cmpxchg_enabled 1
 #else
@@ -71,6 +76,14 @@ static inline long do_futex(u32 __user *uaddr, int op, u32 val,
 {
 	return -EINVAL;
 }
+
+static inline void futex_mm_grow(struct mm_struct *mm)
+{
+}
+
+static inline void futex_mm_free(struct mm_struct *mm)
+{
+}
 #endif
 
 #ifdef CONFIG_FUTEX_PI
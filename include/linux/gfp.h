@@ -555,7 +555,7 @@ extern void page_frag_free(void *addr);
 #define free_page(addr) free_pages((addr), 0)
 
 void page_alloc_init(void);
-void drain_zone_pages(struct zone *zone, struct per_cpu_pages *pcp);
+void drain_zone_pages(struct zone *zone, struct per_cpu_pageset *pset);
 void drain_all_pages(struct zone *zone);
 void drain_local_pages(struct zone *zone);
 
@@ -15,6 +15,8 @@ extern int __khugepaged_enter(struct mm_struct *mm);
 extern void __khugepaged_exit(struct mm_struct *mm);
 extern int khugepaged_enter_vma_merge(struct vm_area_struct *vma,
 				      unsigned long vm_flags);
+extern int khugepaged_request_collapse(struct vm_area_struct *vma,
+				       unsigned long start, unsigned long end);
 
 #define khugepaged_enabled()					       \
 	(transparent_hugepage_flags &				       \
@@ -25,6 +25,7 @@ enum migrate_reason {
 	MR_MEMPOLICY_MBIND,
 	MR_NUMA_MISPLACED,
 	MR_CONTIG_RANGE,
+	MR_DEMOTION,
 	MR_TYPES
 };
 
@@ -123,6 +124,26 @@ static inline void __ClearPageMovable(struct page *page)
 }
 #endif
 
+/*
+ * Nodes with CPUs form the fast memory tier; CPU-less nodes with memory are
+ * treated as slower memory that cold pages can be demoted to.
+ */
+static inline bool node_is_toptier(int node)
+{
+	return node_state(node, N_CPU);
+}
+
+#if defined(CONFIG_MIGRATION) && defined(CONFIG_NUMA)
+extern bool numa_demotion_enabled;
+extern int next_demotion_node(int node);
+#else
+#define numa_demotion_enabled	false
+static inline int next_demotion_node(int node)
+{
+	return NUMA_NO_NODE;
+}
+#endif
+
 #ifdef CONFIG_NUMA_BALANCING
 extern bool pmd_trans_migrating(pmd_t pmd);
 extern int migrate_misplaced_page(struct page *page,
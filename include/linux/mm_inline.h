@@ -4,6 +4,7 @@
 
 #include <linux/huge_mm.h>
 #include <linux/swap.h>
+#include <linux/jump_label.h>
 
 /**
  * page_is_file_cache - should the page be on a file LRU or anon LRU?
@@ -44,9 +45,178 @@ static __always_inline void update_lru_size(struct lruvec *lruvec,
 #endif
 }
 
+#ifdef CONFIG_LRU_GEN
+
+DECLARE_STATIC_KEY_FALSE(lru_gen_key);
+
+static inline bool lru_gen_enabled(void)
+{
+	return static_branch_unlikely(&lru_gen_key);
+}
+
+static inline int lru_gen_from_seq(unsigned long seq)
+{
+	return seq % MAX_NR_GENS;
+}
+
+/* Returns the generation @page is on, or -1 if it is not on one */
+static inline int page_lru_gen(struct page *page)
+{
+	return ((READ_ONCE(page->flags) >> LRU_GEN_PGSHIFT) & LRU_GEN_MASK) - 1;
+}
+
+/*
+ * Other page flags are changed with atomic bitops without the lru_lock, so
+ * the generation field has to be replaced atomically as well.
+ */
+static inline void set_page_lru_gen(struct page *page, int gen)
+{
+	unsigned long old_flags, flags;
+
+	do {
+		old_flags = flags = READ_ONCE(page->flags);
+		flags &= ~(LRU_GEN_MASK << LRU_GEN_PGSHIFT);
+		flags |= (unsigned long)(gen + 1) << LRU_GEN_PGSHIFT;
+	} while (unlikely(cmpxchg(&page->flags, old_flags, flags) != old_flags));
+}
+
+static inline bool lru_gen_is_active(struct lruvec *lruvec, int type, int gen)
+{
+	unsigned long max_seq = lruvec->lrugen.max_seq[type];
+
+	return gen == lru_gen_from_seq(max_seq) ||
+	       gen == lru_gen_from_seq(max_seq - 1);
+}
+
+/*
+ * Move @page between generations in the size accounting; a generation of
+ * -1 stands for "not on a generation list".
+ */
+static inline void lru_gen_update_size(struct lruvec *lruvec,
+				struct page *page, int old_gen, int new_gen)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int type = page_is_file_cache(page);
+	int zid = page_zonenum(page);
+	int nr_pages = hpage_nr_pages(page);
+	enum lru_list lru = type * LRU_FILE;
+
+	if (old_gen >= 0) {
+		lrugen->nr_pages[old_gen][type][zid] -= nr_pages;
+		update_lru_size(lruvec, lru +
+				lru_gen_is_active(lruvec, type, old_gen),
+				zid, -nr_pages);
+	}
+	if (new_gen >= 0) {
+		lrugen->nr_pages[new_gen][type][zid] += nr_pages;
+		update_lru_size(lruvec, lru +
+				lru_gen_is_active(lruvec, type, new_gen),
+				zid, nr_pages);
+	}
+}
+
+/*
+ * Active pages go to the youngest generation and everything else to the
+ * oldest one. PG_active is not kept for pages on generation lists.
+ */
+static inline bool lru_gen_add_page(struct lruvec *lruvec, struct page *page,
+				    bool tail)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int type = page_is_file_cache(page);
+	struct list_head *head;
+	int gen;
+
+	if (!lrugen->enabled || PageUnevictable(page))
+		return false;
+
+	if (PageActive(page)) {
+		ClearPageActive(page);
+		gen = lru_gen_from_seq(lrugen->max_seq[type]);
+	} else {
+		gen = lru_gen_from_seq(lrugen->min_seq[type]);
+	}
+
+	set_page_lru_gen(page, gen);
+	lru_gen_update_size(lruvec, page, -1, gen);
+	head = &lrugen->lists[gen][type][page_zonenum(page)];
+	if (tail)
+		list_add_tail(&page->lru, head);
+	else
+		list_add(&page->lru, head);
+	return true;
+}
+
+static inline bool lru_gen_del_page(struct lruvec *lruvec, struct page *page)
+{
+	int gen = page_lru_gen(page);
+
+	if (gen < 0)
+		return false;
+
+	list_del(&page->lru);
+	lru_gen_update_size(lruvec, page, gen, -1);
+	set_page_lru_gen(page, -1);
+	return true;
+}
+
+/*
+ * For isolation outside reclaim: report a page in one of the two youngest
+ * generations as active, like a page isolated from the active list.
+ */
+static inline void lru_gen_mark_active(struct lruvec *lruvec, struct page *page)
+{
+	int gen = page_lru_gen(page);
+
+	if (gen >= 0 && lru_gen_is_active(lruvec, page_is_file_cache(page), gen))
+		SetPageActive(page);
+}
+
+/* Tail pages of a split THP inherit the generation of the head page */
+static inline void lru_gen_add_page_tail(struct page *page,
+					 struct page *page_tail)
+{
+	int gen = page_lru_gen(page);
+
+	if (gen >= 0)
+		set_page_lru_gen(page_tail, gen);
+}
+
+#else /* !CONFIG_LRU_GEN */
+
+static inline bool lru_gen_enabled(void)
+{
+	return false;
+}
+
+static inline bool lru_gen_add_page(struct lruvec *lruvec, struct page *page,
+				    bool tail)
+{
+	return false;
+}
+
+static inline bool lru_gen_del_page(struct lruvec *lruvec, struct page *page)
+{
+	return false;
+}
+
+static inline void lru_gen_mark_active(struct lruvec *lruvec, struct page *page)
+{
+}
+
+static inline void lru_gen_add_page_tail(struct page *page,
+					 struct page *page_tail)
+{
+}
+
+#endif /* CONFIG_LRU_GEN */
+
 static __always_inline void add_page_to_lru_list(struct page *page,
 				struct lruvec *lruvec, enum lru_list lru)
 {
+	if (lru_gen_enabled() && lru_gen_add_page(lruvec, page, false))
+		return;
+
 	update_lru_size(lruvec, lru, page_zonenum(page), hpage_nr_pages(page));
 	list_add(&page->lru, &lruvec->lists[lru]);
 }
@@ -54,6 +224,9 @@ static __always_inline void add_page_to_lru_list(struct page *page,
 static __always_inline void add_page_to_lru_list_tail(struct page *page,
 				struct lruvec *lruvec, enum lru_list lru)
 {
+	if (lru_gen_enabled() && lru_gen_add_page(lruvec, page, true))
+		return;
+
 	update_lru_size(lruvec, lru, page_zonenum(page), hpage_nr_pages(page));
 	list_add_tail(&page->lru, &lruvec->lists[lru]);
 }
@@ -61,6 +234,9 @@ static __always_inline void add_page_to_lru_list_tail(struct page *page,
 static __always_inline void del_page_from_lru_list(struct page *page,
 				struct lruvec *lruvec, enum lru_list lru)
 {
+	if (lru_gen_enabled() && lru_gen_del_page(lruvec, page))
+		return;
+
 	list_del(&page->lru);
 	update_lru_size(lruvec, lru, page_zonenum(page), -hpage_nr_pages(page));
 }
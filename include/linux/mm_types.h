@@ -9,6 +9,7 @@
 #include <linux/spinlock.h>
 #include <linux/rbtree.h>
 #include <linux/rwsem.h>
+#include <linux/seqlock.h>
 #include <linux/completion.h>
 #include <linux/cpumask.h>
 #include <linux/uprobes.h>
@@ -316,6 +317,7 @@ struct vm_area_struct {
 	void * vm_private_data;		/* was vm_pte (shared mem) */
 
 	atomic_long_t swap_readahead_info;
+	atomic_long_t swap_readahead_stride;
 #ifndef CONFIG_MMU
 	struct vm_region *vm_region;	/* NOMMU mapping region */
 #endif
@@ -323,6 +325,15 @@ struct vm_area_struct {
 	struct mempolicy *vm_policy;	/* NUMA policy for the VMA */
 #endif
 	struct vm_userfaultfd_ctx vm_userfaultfd_ctx;
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	/*
+	 * Bumped around every change to the fields the speculative fault
+	 * handler relies on; odd while a writer is in progress and left odd
+	 * once the VMA has been unlinked.
+	 */
+	seqcount_t vm_sequence;
+	atomic_t vm_ref_count;		/* see get_vma() and put_vma() */
+#endif
 } __randomize_layout;
 
 struct core_thread {
@@ -337,10 +348,14 @@ struct core_state {
 };
 
 struct kioctx_table;
+struct futex_private_hash;
 struct mm_struct {
 	struct {
 		struct vm_area_struct *mmap;		/* list of VMAs */
 		struct rb_root mm_rb;
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+		rwlock_t mm_rb_lock;	/* Protects mm_rb against lockless lookups */
+#endif
 		u64 vmacache_seqnum;                   /* per-thread vmacache */
 #ifdef CONFIG_MMU
 		unsigned long (*get_unmapped_area) (struct file *filp,
@@ -457,6 +472,11 @@ struct mm_struct {
 #if defined(CONFIG_TRANSPARENT_HUGEPAGE) && !USE_SPLIT_PMD_PTLOCKS
 		pgtable_t pmd_huge_pte; /* protected by page_table_lock */
 #endif
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+		/* khugepaged collapse statistics, see smaps_rollup */
+		atomic_long_t thp_collapsed;
+		atomic_long_t thp_collapse_failed;
+#endif
 #ifdef CONFIG_NUMA_BALANCING
 		/*
 		 * numa_next_scan is the next time that the PTEs will be marked
@@ -487,6 +507,11 @@ struct mm_struct {
 #endif
 		struct work_struct async_put_work;
 
+#ifdef CONFIG_FUTEX
+		/* Hash for private futexes, see futex_mm_grow() */
+		struct futex_private_hash *futex_hash;
+#endif
+
 #if IS_ENABLED(CONFIG_HMM)
 		/* HMM needs to track a few things per mm */
 		struct hmm *hmm;
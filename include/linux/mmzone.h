@@ -174,6 +174,8 @@ enum node_stat_item {
 	NR_SHMEM,		/* shmem pages (included tmpfs/GEM pages) */
 	NR_SHMEM_THPS,
 	NR_SHMEM_PMDMAPPED,
+	NR_FILE_THPS,
+	NR_FILE_PMDMAPPED,
 	NR_ANON_THPS,
 	NR_UNSTABLE_NFS,	/* NFS unstable pages */
 	NR_VMSCAN_WRITE,
@@ -181,6 +183,12 @@ enum node_stat_item {
 	NR_DIRTIED,		/* page dirtyings since bootup */
 	NR_WRITTEN,		/* page writings since bootup */
 	NR_INDIRECTLY_RECLAIMABLE_BYTES, /* measured in bytes */
+#ifdef CONFIG_NUMA_BALANCING
+	PGPROMOTE_SUCCESS,	/* pages promoted from a slow memory node */
+	PGPROMOTE_CANDIDATE,	/* hinting faults on slow memory */
+#endif
+	PGDEMOTE_KSWAPD,	/* pages demoted by kswapd */
+	PGDEMOTE_DIRECT,	/* pages demoted by direct reclaim */
 	NR_VM_NODE_STAT_ITEMS
 };
 
@@ -233,6 +241,36 @@ struct zone_reclaim_stat {
 	unsigned long		recent_scanned[2];
 };
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * The multi-generational LRU keeps evictable pages on per-generation lists
+ * instead of the active and inactive lists. Generations are numbered by a
+ * sequence that only increases; each type (anon, file) spans the sequences
+ * from min_seq to max_seq, and a sequence maps to a list by seq % MAX_NR_GENS.
+ * Aging creates a new youngest generation and moves pages found accessed in
+ * page tables into it; eviction takes pages from the oldest generation and
+ * retires it once it is empty.
+ *
+ * The two youngest generations are accounted as active and the rest as
+ * inactive, so the LRU size counters keep their meaning.
+ */
+#define MIN_NR_GENS		2
+#define MAX_NR_GENS		4
+#define ANON_AND_FILE		2
+
+struct lru_gen_struct {
+	/* Whether pages are added to the generation lists */
+	bool enabled;
+	/* Set while a reclaimer walks page tables for this lruvec */
+	unsigned long walking;
+	unsigned long max_seq[ANON_AND_FILE];
+	unsigned long min_seq[ANON_AND_FILE];
+	struct list_head lists[MAX_NR_GENS][ANON_AND_FILE][MAX_NR_ZONES];
+	/* Pages on each list, in base pages */
+	long nr_pages[MAX_NR_GENS][ANON_AND_FILE][MAX_NR_ZONES];
+};
+#endif
+
 struct lruvec {
 	struct list_head		lists[NR_LRU_LISTS];
 	struct zone_reclaim_stat	reclaim_stat;
@@ -240,6 +278,9 @@ struct lruvec {
 	atomic_long_t			inactive_age;
 	/* Refaults at the time of last reclaim cycle */
 	unsigned long			refaults;
+#ifdef CONFIG_LRU_GEN
+	struct lru_gen_struct		lrugen;
+#endif
 #ifdef CONFIG_MEMCG
 	struct pglist_data *pgdat;
 #endif
@@ -280,8 +321,20 @@ struct per_cpu_pages {
 	struct list_head lists[MIGRATE_PCPTYPES];
 };
 
+/*
+ * Orders above zero that also get per-cpu lists: every order up to
+ * PAGE_ALLOC_COSTLY_ORDER and, with THP, the PMD order. For these lists
+ * count, high and batch are in units of pages of that order.
+ */
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+#define NR_PCP_HIGH_ORDERS	(PAGE_ALLOC_COSTLY_ORDER + 1)
+#else
+#define NR_PCP_HIGH_ORDERS	PAGE_ALLOC_COSTLY_ORDER
+#endif
+
 struct per_cpu_pageset {
 	struct per_cpu_pages pcp;
+	struct per_cpu_pages order_pcp[NR_PCP_HIGH_ORDERS];
 #ifdef CONFIG_NUMA
 	s8 expire;
 	u16 vm_numa_stat_diff[NR_VM_NUMA_STAT_ITEMS];
@@ -662,6 +715,13 @@ typedef struct pglist_data {
 
 	int kswapd_failures;		/* Number of 'reclaimed == 0' runs */
 
+#ifdef CONFIG_NUMA_BALANCING
+	/* Start of the current promotion rate limit window, in ms */
+	unsigned int nbp_rl_start;
+	/* PGPROMOTE_CANDIDATE at the start of the window */
+	unsigned long nbp_rl_nr_cand;
+#endif
+
 #ifdef CONFIG_COMPACTION
 	int kcompactd_max_order;
 	enum zone_type kcompactd_classzone_idx;
@@ -766,6 +826,13 @@ extern void init_currently_empty_zone(struct zone *zone, unsigned long start_pfn
 				     unsigned long size);
 
 extern void lruvec_init(struct lruvec *lruvec);
+#ifdef CONFIG_LRU_GEN
+extern void lru_gen_init_lruvec(struct lruvec *lruvec);
+#else
+static inline void lru_gen_init_lruvec(struct lruvec *lruvec)
+{
+}
+#endif
 
 static inline struct pglist_data *lruvec_pgdat(struct lruvec *lruvec)
 {
@@ -72,8 +72,21 @@ struct sched_domain_shared {
 	atomic_t	ref;
 	atomic_t	nr_busy_cpus;
 	int		has_idle_cores;
+
+	/*
+	 * CPUs of the LLC that are running their idle task, updated on
+	 * idle entry and exit. Only a hint for the wakeup scan.
+	 *
+	 * NOTE: this field is variable length, see sched_domain::span.
+	 */
+	unsigned long	idle_cpus_span[0];
 };
 
+static inline struct cpumask *sds_idle_cpus(struct sched_domain_shared *sds)
+{
+	return to_cpumask(sds->idle_cpus_span);
+}
+
 struct sched_domain {
 	/* These fields must be setup */
 	struct sched_domain *parent;	/* top domain must be null terminated */
@@ -89,6 +89,8 @@
 
 /* Avoid kmemleak tracing */
 #define SLAB_NOLEAKTRACE	((slab_flags_t __force)0x00800000U)
+/* Keep per cpu magazines of free objects (SLUB only) */
+#define SLAB_MAGAZINE		((slab_flags_t __force)0x01000000U)
 
 /* Fault injection mark */
 #ifdef CONFIG_FAILSLAB
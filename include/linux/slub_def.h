@@ -36,6 +36,10 @@ enum stat_item {
 	CPU_PARTIAL_FREE,	/* Refill cpu partial on free */
 	CPU_PARTIAL_NODE,	/* Refill cpu partial from node partial */
 	CPU_PARTIAL_DRAIN,	/* Drain cpu partial to node partial */
+	MAGAZINE_ALLOC,		/* Allocation from cpu magazine */
+	MAGAZINE_REFILL,	/* Magazine empty, refilled from cpu slab */
+	MAGAZINE_FREE,		/* Free to cpu magazine */
+	MAGAZINE_FLUSH,		/* Magazine full, half returned to slabs */
 	NR_SLUB_STAT_ITEMS };
 
 struct kmem_cache_cpu {
@@ -50,6 +54,17 @@ struct kmem_cache_cpu {
 #endif
 };
 
+#define SLUB_MAGAZINE_SIZE	32
+
+/*
+ * Per cpu stack of free objects for SLAB_MAGAZINE caches, refilled from and
+ * flushed to the slabs in batches of SLUB_MAGAZINE_SIZE / 2.
+ */
+struct kmem_cache_magazine {
+	unsigned int nr;
+	void *objects[SLUB_MAGAZINE_SIZE];
+};
+
 #ifdef CONFIG_SLUB_CPU_PARTIAL
 #define slub_percpu_partial(c)		((c)->partial)
 
@@ -81,6 +96,8 @@ struct kmem_cache_order_objects {
  */
 struct kmem_cache {
 	struct kmem_cache_cpu __percpu *cpu_slab;
+	/* NULL unless SLAB_MAGAZINE */
+	struct kmem_cache_magazine __percpu *magazine;
 	/* Used for retriving partial slabs etc */
 	slab_flags_t flags;
 	unsigned long min_partial;
@@ -287,6 +287,7 @@ struct vma_swap_readahead {
 	unsigned short win;
 	unsigned short offset;
 	unsigned short nr_pte;
+	unsigned short step;	/* distance between ptes, in ptes */
 #ifdef CONFIG_64BIT
 	pte_t *ptes;
 #else
@@ -27,7 +27,12 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 		FOR_ALL_ZONES(ALLOCSTALL),
 		FOR_ALL_ZONES(PGSCAN_SKIP),
 		PGFREE, PGACTIVATE, PGDEACTIVATE, PGLAZYFREE,
+		PGALLOC_PCP_HIGH_ORDER_HIT, PGALLOC_PCP_HIGH_ORDER_MISS,
 		PGFAULT, PGMAJFAULT,
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+		SPECULATIVE_PGFAULT,
+		SPECULATIVE_PGFAULT_ABORT,
+#endif
 		PGLAZYFREED,
 		PGREFILL,
 		PGSTEAL_KSWAPD,
@@ -43,6 +48,9 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 		PAGEOUTRUN, PGROTATED,
 		DROP_PAGECACHE, DROP_SLAB,
 		OOM_KILL,
+#ifdef CONFIG_LRU_GEN
+		LRU_GEN_AGING, LRU_GEN_PROMOTED,
+#endif
 #ifdef CONFIG_NUMA_BALANCING
 		NUMA_PTE_UPDATES,
 		NUMA_HUGE_PTE_UPDATES,
@@ -109,6 +117,8 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 #ifdef CONFIG_SWAP
 		SWAP_RA,
 		SWAP_RA_HIT,
+		SWAP_RA_WASTED,
+		SWAP_RA_PATTERN,
 #endif
 		NR_VM_EVENT_ITEMS
 };
@@ -106,6 +106,9 @@ struct work_struct {
 #ifdef CONFIG_LOCKDEP
 	struct lockdep_map lockdep_map;
 #endif
+#ifdef CONFIG_WQ_LATENCY_HIST
+	u64 queued_at;
+#endif
 };
 
 #define WORK_DATA_INIT()	ATOMIC_LONG_INIT((unsigned long)WORK_STRUCT_NO_POOL)
@@ -340,6 +343,16 @@ enum {
 	 */
 	WQ_POWER_EFFICIENT	= 1 << 7,
 
+	/*
+	 * Work items of a WQ_MEDPRI workqueue are started ahead of all
+	 * other work items pending in the same worker_pool, and execute at
+	 * a nice level between that of normal and WQ_HIGHPRI workers. This
+	 * lets a latency sensitive unbound workqueue share the pool of bulk
+	 * unbound workqueues with the same attributes without queueing
+	 * behind their work.
+	 */
+	WQ_MEDPRI		= 1 << 8,
+
 	__WQ_DRAINING		= 1 << 16, /* internal: workqueue is draining */
 	__WQ_ORDERED		= 1 << 17, /* internal: workqueue is ordered */
 	__WQ_LEGACY		= 1 << 18, /* internal: create*_workqueue() */
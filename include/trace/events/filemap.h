@@ -54,6 +54,83 @@ DEFINE_EVENT(mm_filemap_op_page_cache, mm_filemap_add_to_page_cache,
 	TP_ARGS(page)
 	);
 
+#ifndef __FILEMAP_DECLARE_TRACE_ENUMS_ONCE_ONLY
+#define __FILEMAP_DECLARE_TRACE_ENUMS_ONCE_ONLY
+
+/* How a readahead decision was reached, for the mm_filemap_readahead event */
+enum ra_pattern {
+	RA_PATTERN_INITIAL,		/* start of file or of a stream */
+	RA_PATTERN_SEQUENTIAL,		/* continues the main window */
+	RA_PATTERN_MARKER,		/* PG_readahead without window state */
+	RA_PATTERN_CONTEXT,		/* sequential history in the page cache */
+	RA_PATTERN_STRIDE,		/* a strided stream */
+	RA_PATTERN_REVERSE,		/* a backward stream */
+	RA_PATTERN_RANDOM,		/* no pattern, just the request */
+};
+
+#endif /* end __FILEMAP_DECLARE_TRACE_ENUMS_ONCE_ONLY */
+
+TRACE_DEFINE_ENUM(RA_PATTERN_INITIAL);
+TRACE_DEFINE_ENUM(RA_PATTERN_SEQUENTIAL);
+TRACE_DEFINE_ENUM(RA_PATTERN_MARKER);
+TRACE_DEFINE_ENUM(RA_PATTERN_CONTEXT);
+TRACE_DEFINE_ENUM(RA_PATTERN_STRIDE);
+TRACE_DEFINE_ENUM(RA_PATTERN_REVERSE);
+TRACE_DEFINE_ENUM(RA_PATTERN_RANDOM);
+
+#define show_ra_pattern(pattern)					\
+	__print_symbolic(pattern,					\
+		{ RA_PATTERN_INITIAL,		"initial" },		\
+		{ RA_PATTERN_SEQUENTIAL,	"sequential" },		\
+		{ RA_PATTERN_MARKER,		"marker" },		\
+		{ RA_PATTERN_CONTEXT,		"context" },		\
+		{ RA_PATTERN_STRIDE,		"stride" },		\
+		{ RA_PATTERN_REVERSE,		"reverse" },		\
+		{ RA_PATTERN_RANDOM,		"random" })
+
+/*
+ * A readahead decision: "hit" when the reader ran into a PG_readahead page
+ * of an earlier window, "miss" when it found the page missing.
+ */
+TRACE_EVENT(mm_filemap_readahead,
+
+	TP_PROTO(struct address_space *mapping, pgoff_t index,
+		 unsigned long req_size, bool hit, int pattern,
+		 unsigned long nr_pages),
+
+	TP_ARGS(mapping, index, req_size, hit, pattern, nr_pages),
+
+	TP_STRUCT__entry(
+		__field(unsigned long, i_ino)
+		__field(dev_t, s_dev)
+		__field(pgoff_t, index)
+		__field(unsigned long, req_size)
+		__field(unsigned long, nr_pages)
+		__field(bool, hit)
+		__field(int, pattern)
+	),
+
+	TP_fast_assign(
+		__entry->i_ino = mapping->host->i_ino;
+		if (mapping->host->i_sb)
+			__entry->s_dev = mapping->host->i_sb->s_dev;
+		else
+			__entry->s_dev = mapping->host->i_rdev;
+		__entry->index = index;
+		__entry->req_size = req_size;
+		__entry->nr_pages = nr_pages;
+		__entry->hit = hit;
+		__entry->pattern = pattern;
+	),
+
+	TP_printk("dev %d:%d ino %lx index=%lu req=%lu %s pattern=%s nr_pages=%lu",
+		MAJOR(__entry->s_dev), MINOR(__entry->s_dev),
+		__entry->i_ino, __entry->index, __entry->req_size,
+		__entry->hit ? "hit" : "miss",
+		show_ra_pattern(__entry->pattern),
+		__entry->nr_pages)
+);
+
 TRACE_EVENT(filemap_set_wb_err,
 		TP_PROTO(struct address_space *mapping, errseq_t eseq),
 
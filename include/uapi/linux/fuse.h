@@ -116,6 +116,15 @@
  *
  *  7.27
  *  - add FUSE_ABORT_ERROR
+ *
+ *  7.28
+ *  - add FUSE_MAX_PAGES, add max_pages to init_out
+ *  - add FUSE_DEV_IOC_BIND_QUEUE
+ *
+ *  Not tied to a minor version, negotiated through the INIT flags only:
+ *  - add FUSE_INIT_EXT, add flags2 to fuse_init_in and fuse_init_out
+ *  - add FUSE_PASSTHROUGH, FOPEN_PASSTHROUGH and fuse_open_out.backing_id
+ *  - add FUSE_DEV_IOC_BACKING_OPEN and FUSE_DEV_IOC_BACKING_CLOSE
  */
 
 #ifndef _LINUX_FUSE_H
@@ -151,7 +160,7 @@
 #define FUSE_KERNEL_VERSION 7
 
 /** Minor version number of this interface */
-#define FUSE_KERNEL_MINOR_VERSION 27
+#define FUSE_KERNEL_MINOR_VERSION 28
 
 /** The node ID of the root inode */
 #define FUSE_ROOT_ID 1
@@ -219,10 +228,12 @@ struct fuse_file_lock {
  * FOPEN_DIRECT_IO: bypass page cache for this open file
  * FOPEN_KEEP_CACHE: don't invalidate the data cache on open
  * FOPEN_NONSEEKABLE: the file is not seekable
+ * FOPEN_PASSTHROUGH: read/write/mmap go to the backing file in backing_id
  */
 #define FOPEN_DIRECT_IO		(1 << 0)
 #define FOPEN_KEEP_CACHE	(1 << 1)
 #define FOPEN_NONSEEKABLE	(1 << 2)
+#define FOPEN_PASSTHROUGH	(1 << 7)
 
 /**
  * INIT request/reply flags
@@ -249,6 +260,9 @@ struct fuse_file_lock {
  * FUSE_HANDLE_KILLPRIV: fs handles killing suid/sgid/cap on write/chown/trunc
  * FUSE_POSIX_ACL: filesystem supports posix acls
  * FUSE_ABORT_ERROR: reading the device after abort returns ECONNABORTED
+ * FUSE_MAX_PAGES: init_out.max_pages contains the max number of req pages
+ * FUSE_INIT_EXT: extended fuse_init_in request, flags2 is valid
+ * FUSE_PASSTHROUGH: read/write/mmap of an open file may go to a backing file
  */
 #define FUSE_ASYNC_READ		(1 << 0)
 #define FUSE_POSIX_LOCKS	(1 << 1)
@@ -272,6 +286,10 @@ struct fuse_file_lock {
 #define FUSE_HANDLE_KILLPRIV	(1 << 19)
 #define FUSE_POSIX_ACL		(1 << 20)
 #define FUSE_ABORT_ERROR	(1 << 21)
+#define FUSE_MAX_PAGES		(1 << 22)
+#define FUSE_INIT_EXT		(1 << 30)
+/* bits 32..63 get shifted down 32 bits into the flags2 field */
+#define FUSE_PASSTHROUGH	(1ULL << 37)
 
 /**
  * CUSE INIT request/reply flags
@@ -503,7 +521,7 @@ struct fuse_create_in {
 struct fuse_open_out {
 	uint64_t	fh;
 	uint32_t	open_flags;
-	uint32_t	padding;
+	int32_t		backing_id;
 };
 
 struct fuse_release_in {
@@ -596,6 +614,8 @@ struct fuse_init_in {
 	uint32_t	minor;
 	uint32_t	max_readahead;
 	uint32_t	flags;
+	uint32_t	flags2;
+	uint32_t	unused[11];
 };
 
 #define FUSE_COMPAT_INIT_OUT_SIZE 8
@@ -610,7 +630,10 @@ struct fuse_init_out {
 	uint16_t	congestion_threshold;
 	uint32_t	max_write;
 	uint32_t	time_gran;
-	uint32_t	unused[9];
+	uint16_t	max_pages;
+	uint16_t	padding;
+	uint32_t	flags2;
+	uint32_t	unused[7];
 };
 
 #define CUSE_INIT_INFO_MAX 4096
@@ -780,6 +803,30 @@ struct fuse_notify_retrieve_in {
 
 /* Device ioctls: */
 #define FUSE_DEV_IOC_CLONE	_IOR(229, 0, uint32_t)
+/*
+ * Bind a cloned device to the request queue of a CPU: requests issued
+ * on that CPU are then read from the devices bound to it only.  This
+ * must be done before the device is polled or set up for SIGIO.
+ *
+ * FORGETs, INTERRUPTs, notify replies and requests from CPUs without a
+ * bound device are only read from unbound devices, so binding the last
+ * unbound device fails with EBUSY.  Should the last unbound device be
+ * closed anyway, all devices go back to reading the common queue.
+ */
+#define FUSE_DEV_IOC_BIND_QUEUE	_IOW(229, 4, uint32_t)
+
+struct fuse_backing_map {
+	int32_t		fd;
+	uint32_t	flags;
+	uint64_t	padding;
+};
+
+/*
+ * Register a file for passthrough, returns its backing id, to be put in
+ * fuse_open_out.backing_id along with FOPEN_PASSTHROUGH.
+ */
+#define FUSE_DEV_IOC_BACKING_OPEN	_IOW(229, 1, struct fuse_backing_map)
+#define FUSE_DEV_IOC_BACKING_CLOSE	_IOW(229, 2, uint32_t)
 
 struct fuse_lseek_in {
 	uint64_t	fh;
@@ -41,6 +41,29 @@
 #define FUTEX_CMP_REQUEUE_PI_PRIVATE	(FUTEX_CMP_REQUEUE_PI | \
 					 FUTEX_PRIVATE_FLAG)
 
+/*
+ * Size of the futex word for futex_waitv(), only 32 bit futexes are
+ * supported for now.
+ */
+#define FUTEX_32		2
+
+/* Maximum number of futexes futex_waitv() waits on at once */
+#define FUTEX_WAITV_MAX		128
+
+/**
+ * struct futex_waitv - A waiter for vectorized wait
+ * @val:	Expected value at uaddr
+ * @uaddr:	User address to wait on
+ * @flags:	FUTEX_32, optionally or'ed with FUTEX_PRIVATE_FLAG
+ * @__reserved:	Reserved member to preserve alignment, must be 0
+ */
+struct futex_waitv {
+	__u64 val;
+	__u64 uaddr;
+	__u32 flags;
+	__u32 __reserved;
+};
+
 /*
  * Support for robust futexes: the kernel cleans up held futexes at
  * thread exit time.
@@ -9,6 +9,7 @@ struct sched_param {
 };
 
 #define SCHED_ATTR_SIZE_VER0	48	/* sizeof first published struct */
+#define SCHED_ATTR_SIZE_VER1	56	/* add: latency_nice, __reserved */
 
 /*
  * Extended scheduling parameters data structure.
@@ -46,6 +47,12 @@ struct sched_param {
  *  @sched_runtime	representative of the task's runtime
  *  @sched_period	representative of the task's period
  *
+ * In addition, @sched_latency_nice (-20 .. 19, default 0) tells the fair
+ * scheduler how much the task cares about wakeup latency, independently
+ * of its nice value and thus its CPU share. It is applied when
+ * SCHED_FLAG_LATENCY_NICE is set: lower values make the task preempt the
+ * running task sooner on wakeup and search harder for an idle CPU.
+ *
  * Given this task model, there are a multiplicity of scheduling algorithms
  * and policies, that can be used to ensure all the tasks will make their
  * timing constraints.
@@ -70,6 +77,10 @@ struct sched_attr {
 	__u64 sched_runtime;
 	__u64 sched_deadline;
 	__u64 sched_period;
+
+	/* SCHED_NORMAL, SCHED_BATCH: wakeup latency hint, see above */
+	__s32 sched_latency_nice;
+	__u32 __reserved;	/* must be zero */
 };
 
 #endif /* _UAPI_LINUX_SCHED_TYPES_H */
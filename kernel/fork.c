@@ -325,6 +325,10 @@ struct vm_area_struct *vm_area_dup(struct vm_area_struct *orig)
 	if (new) {
 		*new = *orig;
 		INIT_LIST_HEAD(&new->anon_vma_chain);
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+		seqcount_init(&new->vm_sequence);
+		atomic_set(&new->vm_ref_count, 1);
+#endif
 	}
 	return new;
 }
@@ -680,6 +684,7 @@ void __put_task_struct(struct task_struct *tsk)
 
 	cgroup_free(tsk);
 	task_numa_free(tsk);
+	sched_core_free(tsk);
 	security_task_free(tsk);
 	exit_creds(tsk);
 	delayacct_tsk_free(tsk);
@@ -926,6 +931,9 @@ static struct mm_struct *mm_init(struct mm_struct *mm, struct task_struct *p,
 {
 	mm->mmap = NULL;
 	mm->mm_rb = RB_ROOT;
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	rwlock_init(&mm->mm_rb_lock);
+#endif
 	mm->vmacache_seqnum = 0;
 	atomic_set(&mm->mm_users, 1);
 	atomic_set(&mm->mm_count, 1);
@@ -948,8 +956,15 @@ static struct mm_struct *mm_init(struct mm_struct *mm, struct task_struct *p,
 	init_tlb_flush_pending(mm);
 #if defined(CONFIG_TRANSPARENT_HUGEPAGE) && !USE_SPLIT_PMD_PTLOCKS
 	mm->pmd_huge_pte = NULL;
+#endif
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	atomic_long_set(&mm->thp_collapsed, 0);
+	atomic_long_set(&mm->thp_collapse_failed, 0);
 #endif
 	mm_init_uprobes_state(mm);
+#ifdef CONFIG_FUTEX
+	mm->futex_hash = NULL;
+#endif
 
 	if (current->mm) {
 		mm->flags = current->mm->flags & MMF_INIT_MASK;
@@ -1008,6 +1023,7 @@ static inline void __mmput(struct mm_struct *mm)
 	}
 	if (mm->binfmt)
 		module_put(mm->binfmt->module);
+	futex_mm_free(mm);
 	mmdrop(mm);
 }
 
@@ -1321,6 +1337,7 @@ static int copy_mm(unsigned long clone_flags, struct task_struct *tsk)
 
 	if (clone_flags & CLONE_VM) {
 		mmget(oldmm);
+		futex_mm_grow(oldmm);
 		mm = oldmm;
 		goto good_mm;
 	}
@@ -1780,6 +1797,9 @@ static __latent_entropy struct task_struct *copy_process(
 	p->default_timer_slack_ns = current->timer_slack_ns;
 
 	task_io_accounting_init(&p->ioac);
+#ifdef CONFIG_PSI
+	p->psi_flags = 0;
+#endif
 	acct_clear_integrals(p);
 
 	posix_cpu_timers_init(p);
@@ -1949,6 +1969,8 @@ static __latent_entropy struct task_struct *copy_process(
 	if (retval)
 		goto bad_fork_free_pid;
 
+	sched_core_fork(p);
+
 	/*
 	 * Make it visible to the rest of the system, but dont wake it up yet.
 	 * Need tasklist lock for parent etc handling!
@@ -2048,6 +2070,7 @@ static __latent_entropy struct task_struct *copy_process(
 	return p;
 
 bad_fork_cancel_cgroup:
+	sched_core_free(p);
 	spin_unlock(&current->sighand->siglock);
 	write_unlock_irq(&tasklist_lock);
 	cgroup_cancel_fork(p);
@@ -65,7 +65,6 @@
 #include <linux/sched/mm.h>
 #include <linux/hugetlb.h>
 #include <linux/freezer.h>
-#include <linux/bootmem.h>
 #include <linux/fault-inject.h>
 
 #include <asm/futex.h>
@@ -171,6 +170,14 @@
  * the code that actually moves the futex(es) between hash buckets (requeue_futex)
  * will do the additional required waiter count housekeeping. This is done for
  * double_lock_hb() and double_unlock_hb(), respectively.
+ *
+ * Private futexes of a process with more than one thread are hashed into a
+ * table of its own, which is replaced by a larger one as the number of
+ * threads grows (see futex_mm_grow()). The replacement marks every old bucket
+ * dead under its lock and moves the queued futex_qs over the same way
+ * requeue_futex() does, so after taking a bucket lock, or when the lockless
+ * waiters check comes up empty, a dead bucket means the key has to be hashed
+ * again.
  */
 
 #ifndef CONFIG_HAVE_FUTEX_CMPXCHG
@@ -254,6 +261,15 @@ static const struct futex_q futex_q_init = {
 	.bitset = FUTEX_BITSET_MATCH_ANY
 };
 
+/*
+ * One entry of a futex_waitv() wait: the user supplied waiter and the
+ * futex_q queued for it.
+ */
+struct futex_vector {
+	struct futex_waitv w;
+	struct futex_q q;
+};
+
 /*
  * Hash buckets are shared by all the futex_keys that hash to the same
  * location.  Each key may have multiple futex_q structures, one for each task
@@ -263,19 +279,44 @@ struct futex_hash_bucket {
 	atomic_t waiters;
 	spinlock_t lock;
 	struct plist_head chain;
+	int dead;
 } ____cacheline_aligned_in_smp;
 
 /*
- * The base of the bucket array and its size are always used together
- * (after initialization only in hash_futex()), so ensure that they
- * reside in the same cacheline.
+ * The global hash is split into one table per node, each allocated on its
+ * node, so that the buckets of shared futexes are spread over the machine
+ * rather than all living on the boot node. The base of the table array and
+ * the per node size are always used together (after initialization only in
+ * hash_futex()), so ensure that they reside in the same cacheline.
  */
 static struct {
-	struct futex_hash_bucket *queues;
+	struct futex_hash_bucket **queues;
 	unsigned long            hashsize;
-} __futex_data __read_mostly __aligned(2*sizeof(long));
-#define futex_queues   (__futex_data.queues)
-#define futex_hashsize (__futex_data.hashsize)
+	unsigned int             hashshift;
+} __futex_data __read_mostly __aligned(4*sizeof(long));
+#define futex_queues    (__futex_data.queues)
+#define futex_hashsize  (__futex_data.hashsize)
+#define futex_hashshift (__futex_data.hashshift)
+
+/*
+ * Per process hash for private futexes, hanging off mm->futex_hash. Tables
+ * that have been replaced stay around, dead, until the mm goes away since
+ * futex_q::lock_ptr and bucket pointers of concurrent operations may still
+ * point into them.
+ */
+struct futex_private_hash {
+	struct futex_private_hash *retired;
+	unsigned long             hashmask;
+	struct futex_hash_bucket  *queues;
+};
+
+#define FUTEX_PRIVATE_HASH_MIN		16
+#define FUTEX_PRIVATE_HASH_MAX		8192
+/* Buckets per thread sharing the mm */
+#define FUTEX_PRIVATE_HASH_SCALE	4
+
+/* Serializes private hash replacement against itself */
+static DEFINE_MUTEX(futex_private_hash_mutex);
 
 
 /*
@@ -383,19 +424,82 @@ static inline int hb_waiters_pending(struct futex_hash_bucket *hb)
 #endif
 }
 
+/*
+ * Is @hb a bucket of a replaced private hash? Pairs with the smp_wmb() in
+ * futex_private_hash_move() such that a waiters count that dropped because
+ * the futex_qs were moved away is never observed without the dead mark.
+ */
+static inline bool hb_dead(struct futex_hash_bucket *hb)
+{
+	smp_rmb();
+	return READ_ONCE(hb->dead);
+}
+
+static inline u32 futex_key_hash(union futex_key *key)
+{
+	return jhash2((u32*)&key->both.word,
+		      (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
+		      key->both.offset);
+}
+
 /**
- * hash_futex - Return the hash bucket in the global hash
+ * hash_futex - Return the hash bucket for a futex key
  * @key:	Pointer to the futex key for which the hash is calculated
  *
  * We hash on the keys returned from get_futex_key (see below) and return the
- * corresponding hash bucket in the global hash.
+ * corresponding hash bucket in the private hash of the mm for private futexes
+ * of a multi-threaded process, and in the global hash otherwise.
  */
 static struct futex_hash_bucket *hash_futex(union futex_key *key)
 {
-	u32 hash = jhash2((u32*)&key->both.word,
-			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
-			  key->both.offset);
-	return &futex_queues[hash & (futex_hashsize - 1)];
+	u32 hash = futex_key_hash(key);
+	unsigned int node;
+
+	if (!(key->both.offset & (FUT_OFF_INODE|FUT_OFF_MMSHARED))) {
+		struct futex_private_hash *fph;
+
+		/* Pairs with smp_store_release() in futex_mm_grow() */
+		fph = smp_load_acquire(&key->private.mm->futex_hash);
+		if (fph)
+			return &fph->queues[hash & fph->hashmask];
+	}
+
+	node = (hash >> futex_hashshift) % nr_node_ids;
+	return &futex_queues[node][hash & (futex_hashsize - 1)];
+}
+
+/*
+ * Return the locked, live bucket for @key.
+ */
+static struct futex_hash_bucket *futex_hash_lock(union futex_key *key)
+{
+	struct futex_hash_bucket *hb;
+
+	for (;;) {
+		hb = hash_futex(key);
+		spin_lock(&hb->lock);
+		if (likely(!hb_dead(hb)))
+			return hb;
+		spin_unlock(&hb->lock);
+		cpu_relax();
+	}
+}
+
+/*
+ * Lock the bucket @q is queued on. @q may be moved to another bucket by a
+ * requeue or a private hash replacement whenever the lock is not held.
+ */
+static void futex_q_lock(struct futex_q *q)
+{
+	spinlock_t *lock_ptr;
+
+	for (;;) {
+		lock_ptr = READ_ONCE(q->lock_ptr);
+		spin_lock(lock_ptr);
+		if (likely(lock_ptr == q->lock_ptr))
+			return;
+		spin_unlock(lock_ptr);
+	}
 }
 
 
@@ -888,7 +992,6 @@ void exit_pi_state_list(struct task_struct *curr)
 		next = head->next;
 		pi_state = list_entry(next, struct futex_pi_state, list);
 		key = pi_state->key;
-		hb = hash_futex(&key);
 
 		/*
 		 * We can race against put_pi_state() removing itself from the
@@ -908,7 +1011,7 @@ void exit_pi_state_list(struct task_struct *curr)
 		}
 		raw_spin_unlock_irq(&curr->pi_lock);
 
-		spin_lock(&hb->lock);
+		hb = futex_hash_lock(&key);
 		raw_spin_lock_irq(&pi_state->pi_mutex.wait_lock);
 		raw_spin_lock(&curr->pi_lock);
 		/*
@@ -1527,13 +1630,21 @@ futex_wake(u32 __user *uaddr, unsigned int flags, int nr_wake, u32 bitset)
 	if (unlikely(ret != 0))
 		goto out;
 
-	hb = hash_futex(&key);
-
 	/* Make sure we really have tasks to wakeup */
-	if (!hb_waiters_pending(hb))
-		goto out_put_key;
+	do {
+		hb = hash_futex(&key);
+		if (hb_waiters_pending(hb))
+			break;
+		if (likely(!hb_dead(hb)))
+			goto out_put_key;
+		cpu_relax();
+	} while (1);
 
 	spin_lock(&hb->lock);
+	if (unlikely(hb_dead(hb))) {
+		spin_unlock(&hb->lock);
+		hb = futex_hash_lock(&key);
+	}
 
 	plist_for_each_entry_safe(this, next, &hb->chain, list) {
 		if (match_futex (&this->key, &key)) {
@@ -1629,11 +1740,16 @@ futex_wake_op(u32 __user *uaddr1, unsigned int flags, u32 __user *uaddr2,
 	if (unlikely(ret != 0))
 		goto out_put_key1;
 
+retry_private:
 	hb1 = hash_futex(&key1);
 	hb2 = hash_futex(&key2);
-
-retry_private:
 	double_lock_hb(hb1, hb2);
+	if (unlikely(hb_dead(hb1) || hb_dead(hb2))) {
+		double_unlock_hb(hb1, hb2);
+		cpu_relax();
+		goto retry_private;
+	}
+
 	op_ret = futex_atomic_op_inuser(op, uaddr2);
 	if (unlikely(op_ret < 0)) {
 
@@ -1918,12 +2034,17 @@ static int futex_requeue(u32 __user *uaddr1, unsigned int flags,
 		goto out_put_keys;
 	}
 
+retry_private:
 	hb1 = hash_futex(&key1);
 	hb2 = hash_futex(&key2);
-
-retry_private:
 	hb_waiters_inc(hb2);
 	double_lock_hb(hb1, hb2);
+	if (unlikely(hb_dead(hb1) || hb_dead(hb2))) {
+		double_unlock_hb(hb1, hb2);
+		hb_waiters_dec(hb2);
+		cpu_relax();
+		goto retry_private;
+	}
 
 	if (likely(cmpval != NULL)) {
 		u32 curval;
@@ -2143,6 +2264,7 @@ static inline struct futex_hash_bucket *queue_lock(struct futex_q *q)
 {
 	struct futex_hash_bucket *hb;
 
+retry:
 	hb = hash_futex(&q->key);
 
 	/*
@@ -2158,6 +2280,12 @@ static inline struct futex_hash_bucket *queue_lock(struct futex_q *q)
 	q->lock_ptr = &hb->lock;
 
 	spin_lock(&hb->lock); /* implies smp_mb(); (A) */
+	if (unlikely(hb_dead(hb))) {
+		spin_unlock(&hb->lock);
+		hb_waiters_dec(hb);
+		cpu_relax();
+		goto retry;
+	}
 	return hb;
 }
 
@@ -2410,7 +2538,7 @@ static int fixup_pi_state_owner(u32 __user *uaddr, struct futex_q *q,
 
 	ret = fault_in_user_writeable(uaddr);
 
-	spin_lock(q->lock_ptr);
+	futex_q_lock(q);
 	raw_spin_lock_irq(&pi_state->pi_mutex.wait_lock);
 
 	/*
@@ -2698,6 +2826,258 @@ static long futex_wait_restart(struct restart_block *restart)
 				restart->futex.val, tp, restart->futex.bitset);
 }
 
+/**
+ * unqueue_multiple() - Remove several futex_qs from their hash buckets
+ * @vs:		the futex_vector array
+ * @count:	number of entries of @vs to unqueue
+ *
+ * Drops the key references of all @count entries.
+ *
+ * Return:
+ *  - >=0 - index of the last futex that was woken;
+ *  -  -1 - no futex was woken
+ */
+static int unqueue_multiple(struct futex_vector *vs, int count)
+{
+	int ret = -1, i;
+
+	for (i = 0; i < count; i++) {
+		if (!unqueue_me(&vs[i].q))
+			ret = i;
+	}
+
+	return ret;
+}
+
+/**
+ * futex_wait_multiple_setup() - Prepare to wait on and queue several futexes
+ * @vs:		the futex_vector array
+ * @count:	number of entries of @vs
+ * @woken:	storage for the index of a futex woken during the setup
+ *
+ * Each futex has to be queued before the next one is looked at, since two
+ * hash bucket locks can't be held at the same time without risking a
+ * deadlock. The task state has to be set before the first one is queued so
+ * that no wakeup is lost, but get_futex_key() may sleep. So first all the
+ * keys are looked up, then the task state is set and the futexes are
+ * compared and queued one by one.
+ *
+ * Return:
+ *  -  0 - all futexes contain their expected value and have been queued;
+ *  -  1 - a futex was woken while the later ones were set up, its index is
+ *	   in @woken, nothing is queued anymore;
+ *  - <0 - -EFAULT or -EWOULDBLOCK, nothing is queued anymore
+ */
+static int futex_wait_multiple_setup(struct futex_vector *vs, int count,
+				     int *woken)
+{
+	struct futex_hash_bucket *hb;
+	int ret, i, j;
+	u32 uval;
+
+retry:
+	for (i = 0; i < count; i++) {
+		int fshared = vs[i].w.flags & FUTEX_PRIVATE_FLAG ?
+			      0 : FLAGS_SHARED;
+
+		ret = get_futex_key(u64_to_user_ptr(vs[i].w.uaddr), fshared,
+				    &vs[i].q.key, VERIFY_READ);
+		if (unlikely(ret)) {
+			for (j = 0; j < i; j++)
+				put_futex_key(&vs[j].q.key);
+			return ret;
+		}
+	}
+
+	set_current_state(TASK_INTERRUPTIBLE);
+
+	for (i = 0; i < count; i++) {
+		u32 __user *uaddr = u64_to_user_ptr(vs[i].w.uaddr);
+		struct futex_q *q = &vs[i].q;
+		u32 val = vs[i].w.val;
+
+		hb = queue_lock(q);
+		ret = get_futex_value_locked(&uval, uaddr);
+
+		if (!ret && uval == val) {
+			/* Queue right away, the bucket lock has to go */
+			queue_me(q, hb);
+			continue;
+		}
+
+		queue_unlock(hb);
+		__set_current_state(TASK_RUNNING);
+
+		/*
+		 * Undo what has been done so far. A futex that was woken
+		 * meanwhile wins over any error.
+		 */
+		*woken = unqueue_multiple(vs, i);
+		for (j = i; j < count; j++)
+			put_futex_key(&vs[j].q.key);
+		if (*woken >= 0)
+			return 1;
+
+		if (ret) {
+			/*
+			 * The fault has to be handled without any futex
+			 * queued, otherwise wakeups could be lost.
+			 */
+			if (get_user(uval, uaddr))
+				return -EFAULT;
+
+			goto retry;
+		}
+
+		return -EWOULDBLOCK;
+	}
+
+	return 0;
+}
+
+/*
+ * Sleep unless the timeout has expired or one of the futexes has been
+ * woken already.
+ */
+static void futex_sleep_multiple(struct futex_vector *vs, unsigned int count,
+				 struct hrtimer_sleeper *to)
+{
+	if (to && !to->task)
+		return;
+
+	for (; count; count--, vs++) {
+		if (!READ_ONCE(vs->q.lock_ptr))
+			return;
+	}
+
+	freezable_schedule();
+}
+
+/**
+ * futex_wait_multiple() - Wait until one of several futexes is woken
+ * @vs:		the futex_vector array
+ * @count:	number of entries of @vs
+ * @to:		the prepared hrtimer_sleeper, or null for no timeout
+ *
+ * Return:
+ *  - >=0 - index of a futex that was woken;
+ *  -  <0 - -ETIMEDOUT, -ERESTARTSYS, -EFAULT or -EWOULDBLOCK
+ */
+static int futex_wait_multiple(struct futex_vector *vs, unsigned int count,
+			       struct hrtimer_sleeper *to)
+{
+	int ret, woken = 0;
+
+	if (to)
+		hrtimer_start_expires(&to->timer, HRTIMER_MODE_ABS);
+
+	for (;;) {
+		ret = futex_wait_multiple_setup(vs, count, &woken);
+		if (ret)
+			return ret > 0 ? woken : ret;
+
+		futex_sleep_multiple(vs, count, to);
+
+		__set_current_state(TASK_RUNNING);
+
+		/* unqueue_multiple() drops the key refs */
+		ret = unqueue_multiple(vs, count);
+		if (ret >= 0)
+			return ret;
+
+		if (to && !to->task)
+			return -ETIMEDOUT;
+		if (signal_pending(current))
+			return -ERESTARTSYS;
+
+		/* Spurious wakeup, queue up again */
+	}
+}
+
+static int futex_parse_waitv(struct futex_vector *vs,
+			     struct futex_waitv __user *uwaitv,
+			     unsigned int nr_futexes)
+{
+	struct futex_waitv aux;
+	unsigned int i;
+
+	for (i = 0; i < nr_futexes; i++) {
+		if (copy_from_user(&aux, &uwaitv[i], sizeof(aux)))
+			return -EFAULT;
+
+		if ((aux.flags & ~(FUTEX_32 | FUTEX_PRIVATE_FLAG)) ||
+		    !(aux.flags & FUTEX_32) || aux.__reserved)
+			return -EINVAL;
+
+		if (aux.val > U32_MAX)
+			return -EINVAL;
+
+		vs[i].w = aux;
+		vs[i].q = futex_q_init;
+	}
+
+	return 0;
+}
+
+/**
+ * futex_waitv() - Wait on a vector of futexes
+ * @waiters:	array of struct futex_waitv, one per futex
+ * @nr_futexes:	number of entries of @waiters, 1 to FUTEX_WAITV_MAX
+ * @flags:	no flags are defined yet, must be 0
+ * @ts:		absolute timeout, or null to wait forever
+ * @clockid:	CLOCK_MONOTONIC or CLOCK_REALTIME, the clock @ts refers to
+ *
+ * Like FUTEX_WAIT on each of the futexes at once: the task sleeps until any
+ * of them is woken, or returns right away if any of them does not contain
+ * its expected value.
+ *
+ * Return: the index of a woken futex, or a negative error code
+ */
+long futex_waitv(struct futex_waitv __user *waiters, unsigned int nr_futexes,
+		 unsigned int flags, struct timespec64 *ts, clockid_t clockid)
+{
+	struct hrtimer_sleeper timeout, *to = NULL;
+	struct futex_vector *vs;
+	long ret;
+
+	if (flags)
+		return -EINVAL;
+
+	if (!nr_futexes || nr_futexes > FUTEX_WAITV_MAX || !waiters)
+		return -EINVAL;
+
+	if (ts) {
+		if (clockid != CLOCK_REALTIME && clockid != CLOCK_MONOTONIC)
+			return -EINVAL;
+		if (!timespec64_valid(ts))
+			return -EINVAL;
+
+		to = &timeout;
+		hrtimer_init_on_stack(&to->timer, clockid, HRTIMER_MODE_ABS);
+		hrtimer_init_sleeper(to, current);
+		hrtimer_set_expires_range_ns(&to->timer, timespec64_to_ktime(*ts),
+					     current->timer_slack_ns);
+	}
+
+	vs = kcalloc(nr_futexes, sizeof(*vs), GFP_KERNEL);
+	if (!vs) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	ret = futex_parse_waitv(vs, waiters, nr_futexes);
+	if (!ret)
+		ret = futex_wait_multiple(vs, nr_futexes, to);
+
+	kfree(vs);
+out:
+	if (to) {
+		hrtimer_cancel(&to->timer);
+		destroy_hrtimer_on_stack(&to->timer);
+	}
+	return ret;
+}
+
 
 /*
  * Userspace tried a 0 -> TID atomic transition of the futex value
@@ -2806,7 +3186,7 @@ static int futex_lock_pi(u32 __user *uaddr, unsigned int flags,
 		if (ret == 1)
 			ret = 0;
 
-		spin_lock(q.lock_ptr);
+		futex_q_lock(&q);
 		goto no_block;
 	}
 
@@ -2816,7 +3196,7 @@ static int futex_lock_pi(u32 __user *uaddr, unsigned int flags,
 
 	ret = rt_mutex_wait_proxy_lock(&q.pi_state->pi_mutex, to, &rt_waiter);
 
-	spin_lock(q.lock_ptr);
+	futex_q_lock(&q);
 	/*
 	 * If we failed to acquire the lock (signal/timeout), we must
 	 * first acquire the hb->lock before removing the lock from the
@@ -2916,8 +3296,7 @@ static int futex_unlock_pi(u32 __user *uaddr, unsigned int flags)
 	if (ret)
 		return ret;
 
-	hb = hash_futex(&key);
-	spin_lock(&hb->lock);
+	hb = futex_hash_lock(&key);
 
 	/*
 	 * Check waiters first. We do not trust user space values at
@@ -3110,7 +3489,7 @@ static int futex_wait_requeue_pi(u32 __user *uaddr, unsigned int flags,
 	struct futex_pi_state *pi_state = NULL;
 	struct rt_mutex_waiter rt_waiter;
 	struct futex_hash_bucket *hb;
-	union futex_key key2 = FUTEX_KEY_INIT;
+	union futex_key key1, key2 = FUTEX_KEY_INIT;
 	struct futex_q q = futex_q_init;
 	int res, ret;
 
@@ -3166,9 +3545,11 @@ static int futex_wait_requeue_pi(u32 __user *uaddr, unsigned int flags,
 	}
 
 	/* Queue the futex_q, drop the hb lock, wait for wakeup. */
+	key1 = q.key;
 	futex_wait_queue_me(hb, &q, to);
 
-	spin_lock(&hb->lock);
+	/* The private hash may have been replaced while we slept */
+	hb = futex_hash_lock(&key1);
 	ret = handle_early_requeue_pi_wakeup(hb, &q, &key2, to);
 	spin_unlock(&hb->lock);
 	if (ret)
@@ -3190,7 +3571,7 @@ static int futex_wait_requeue_pi(u32 __user *uaddr, unsigned int flags,
 		 * did a lock-steal - fix up the PI-state in that case.
 		 */
 		if (q.pi_state && (q.pi_state->owner != current)) {
-			spin_lock(q.lock_ptr);
+			futex_q_lock(&q);
 			ret = fixup_pi_state_owner(uaddr2, &q, current);
 			if (ret && rt_mutex_owner(&q.pi_state->pi_mutex) == current) {
 				pi_state = q.pi_state;
@@ -3215,7 +3596,7 @@ static int futex_wait_requeue_pi(u32 __user *uaddr, unsigned int flags,
 		pi_mutex = &q.pi_state->pi_mutex;
 		ret = rt_mutex_wait_proxy_lock(pi_mutex, to, &rt_waiter);
 
-		spin_lock(q.lock_ptr);
+		futex_q_lock(&q);
 		if (ret && !rt_mutex_cleanup_proxy_lock(pi_mutex, &rt_waiter))
 			ret = 0;
 
@@ -3589,6 +3970,159 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 	return do_futex(uaddr, op, val, tp, uaddr2, val2, val3);
 }
 
+SYSCALL_DEFINE5(futex_waitv, struct futex_waitv __user *, waiters,
+		unsigned int, nr_futexes, unsigned int, flags,
+		struct __kernel_timespec __user *, timeout, clockid_t, clockid)
+{
+	struct timespec64 ts;
+
+	if (timeout && get_timespec64(&ts, timeout))
+		return -EFAULT;
+
+	return futex_waitv(waiters, nr_futexes, flags, timeout ? &ts : NULL,
+			   clockid);
+}
+
+static void futex_hash_init(struct futex_hash_bucket *queues, unsigned long size)
+{
+	unsigned long i;
+
+	for (i = 0; i < size; i++) {
+		atomic_set(&queues[i].waiters, 0);
+		plist_head_init(&queues[i].chain);
+		spin_lock_init(&queues[i].lock);
+		queues[i].dead = 0;
+	}
+}
+
+/*
+ * Move all futex_qs of the buckets of @old over to @new, the way
+ * requeue_futex() moves them, and mark the old buckets dead so that any
+ * operation that looked up a bucket of @old retries with @new.
+ *
+ * Nobody can hold a lock of @new yet since it is not published, so taking
+ * the new bucket lock nested inside the old one cannot deadlock.
+ */
+static void futex_private_hash_move(struct futex_private_hash *old,
+				    struct futex_private_hash *new)
+{
+	struct futex_hash_bucket *hb, *nhb;
+	struct futex_q *this, *next;
+	unsigned long i;
+
+	for (i = 0; i <= old->hashmask; i++) {
+		hb = &old->queues[i];
+
+		spin_lock(&hb->lock);
+		WRITE_ONCE(hb->dead, 1);
+		/* Pairs with hb_dead() */
+		smp_wmb();
+
+		plist_for_each_entry_safe(this, next, &hb->chain, list) {
+			nhb = &new->queues[futex_key_hash(&this->key) &
+					   new->hashmask];
+
+			spin_lock_nested(&nhb->lock, SINGLE_DEPTH_NESTING);
+			plist_del(&this->list, &hb->chain);
+			plist_add(&this->list, &nhb->chain);
+			this->lock_ptr = &nhb->lock;
+			hb_waiters_inc(nhb);
+			hb_waiters_dec(hb);
+			spin_unlock(&nhb->lock);
+		}
+		spin_unlock(&hb->lock);
+	}
+}
+
+static struct futex_private_hash *futex_private_hash_alloc(unsigned long size)
+{
+	struct futex_private_hash *fph;
+
+	fph = kmalloc(sizeof(*fph), GFP_KERNEL);
+	if (!fph)
+		return NULL;
+
+	fph->queues = kvmalloc_array(size, sizeof(*fph->queues), GFP_KERNEL);
+	if (!fph->queues) {
+		kfree(fph);
+		return NULL;
+	}
+
+	futex_hash_init(fph->queues, size);
+	fph->hashmask = size - 1;
+	fph->retired = NULL;
+
+	return fph;
+}
+
+/**
+ * futex_mm_grow - Size the private futex hash of @mm for one more thread
+ * @mm:		the mm a new thread is being cloned into, already accounted
+ *		for in mm->mm_users
+ *
+ * The hash is set up when the first thread is cloned: at that point
+ * nothing else uses @mm, hence no private futex of it can have waiters in
+ * the global hash yet. If that moment was missed because somebody else
+ * held a reference, the process keeps using the global hash. Once there is
+ * a private hash it is grown to FUTEX_PRIVATE_HASH_SCALE buckets per user
+ * of @mm. Failing to allocate is not fatal, the old table keeps working.
+ */
+void futex_mm_grow(struct mm_struct *mm)
+{
+	struct futex_private_hash *fph, *old;
+	unsigned long size;
+
+	size = roundup_pow_of_two(FUTEX_PRIVATE_HASH_SCALE *
+				  atomic_read(&mm->mm_users));
+	size = clamp_t(unsigned long, size, FUTEX_PRIVATE_HASH_MIN,
+		       FUTEX_PRIVATE_HASH_MAX);
+
+	old = READ_ONCE(mm->futex_hash);
+	if (!old) {
+		if (atomic_read(&mm->mm_users) != 2)
+			return;
+	} else if (old->hashmask + 1 >= size) {
+		return;
+	}
+
+	mutex_lock(&futex_private_hash_mutex);
+	old = mm->futex_hash;
+	if (old && old->hashmask + 1 >= size)
+		goto unlock;
+
+	fph = futex_private_hash_alloc(size);
+	if (!fph)
+		goto unlock;
+
+	if (old) {
+		futex_private_hash_move(old, fph);
+		fph->retired = old;
+	}
+
+	/* Pairs with smp_load_acquire() in hash_futex() */
+	smp_store_release(&mm->futex_hash, fph);
+unlock:
+	mutex_unlock(&futex_private_hash_mutex);
+}
+
+/*
+ * Called when the last user of @mm is gone, no futex operation on its
+ * private futexes can be in progress anymore.
+ */
+void futex_mm_free(struct mm_struct *mm)
+{
+	struct futex_private_hash *fph = mm->futex_hash;
+	struct futex_private_hash *retired;
+
+	mm->futex_hash = NULL;
+	while (fph) {
+		retired = fph->retired;
+		kvfree(fph->queues);
+		kfree(fph);
+		fph = retired;
+	}
+}
+
 static void __init futex_detect_cmpxchg(void)
 {
 #ifndef CONFIG_HAVE_FUTEX_CMPXCHG
@@ -3611,29 +4145,39 @@ static void __init futex_detect_cmpxchg(void)
 
 static int __init futex_init(void)
 {
-	unsigned int futex_shift;
-	unsigned long i;
+	unsigned long hashsize;
+	int node;
 
 #if CONFIG_BASE_SMALL
-	futex_hashsize = 16;
+	hashsize = 16;
 #else
-	futex_hashsize = roundup_pow_of_two(256 * num_possible_cpus());
+	hashsize = roundup_pow_of_two(256 * num_possible_cpus());
 #endif
+	hashsize = max(rounddown_pow_of_two(hashsize / nr_node_ids), 16UL);
+
+	futex_queues = kcalloc(nr_node_ids, sizeof(*futex_queues), GFP_KERNEL);
+	if (!futex_queues)
+		panic("futex: cannot allocate hash tables\n");
+
+	for (node = 0; node < nr_node_ids; node++) {
+		int nid = node_state(node, N_MEMORY) ? node : NUMA_NO_NODE;
+
+		futex_queues[node] = kvmalloc_node(hashsize *
+						   sizeof(**futex_queues),
+						   GFP_KERNEL, nid);
+		if (!futex_queues[node])
+			panic("futex: cannot allocate hash table for node %d\n",
+			      node);
+		futex_hash_init(futex_queues[node], hashsize);
+	}
 
-	futex_queues = alloc_large_system_hash("futex", sizeof(*futex_queues),
-					       futex_hashsize, 0,
-					       futex_hashsize < 256 ? HASH_SMALL : 0,
-					       &futex_shift, NULL,
-					       futex_hashsize, futex_hashsize);
-	futex_hashsize = 1UL << futex_shift;
+	futex_hashsize = hashsize;
+	futex_hashshift = ilog2(hashsize);
 
-	futex_detect_cmpxchg();
+	pr_info("futex hash table entries: %lu (%d nodes)\n", hashsize,
+		nr_node_ids);
 
-	for (i = 0; i < futex_hashsize; i++) {
-		atomic_set(&futex_queues[i].waiters, 0);
-		plist_head_init(&futex_queues[i].chain);
-		spin_lock_init(&futex_queues[i].lock);
-	}
+	futex_detect_cmpxchg();
 
 	return 0;
 }
@@ -23,6 +23,7 @@
 #ifndef __LINUX_RCU_H
 #define __LINUX_RCU_H
 
+#include <linux/slab.h>
 #include <trace/events/rcu.h>
 #ifdef CONFIG_RCU_TRACE
 #define RCU_TRACE(stmt) stmt
@@ -215,20 +216,53 @@ static inline void debug_rcu_head_unqueue(struct rcu_head *head)
 }
 #endif	/* #else !CONFIG_DEBUG_OBJECTS_RCU_HEAD */
 
-void kfree(const void *);
+/*
+ * Objects of kfree_rcu() callbacks invoked in one batch are gathered and
+ * handed back to the slab allocator with kfree_bulk().
+ */
+#define RCU_KFREE_BULK	16
+
+struct rcu_kfree_bulk {
+	unsigned int nr;
+	void *ptrs[RCU_KFREE_BULK];
+};
+
+#define RCU_KFREE_BULK_INITIALIZER { .nr = 0 }
+
+static inline void rcu_kfree_bulk_flush(struct rcu_kfree_bulk *bulk)
+{
+	if (bulk->nr) {
+		kfree_bulk(bulk->nr, bulk->ptrs);
+		bulk->nr = 0;
+	}
+}
+
+static inline void rcu_kfree_bulk_add(struct rcu_kfree_bulk *bulk, void *ptr)
+{
+	if (!bulk) {
+		kfree(ptr);
+		return;
+	}
+	bulk->ptrs[bulk->nr++] = ptr;
+	if (bulk->nr == RCU_KFREE_BULK)
+		rcu_kfree_bulk_flush(bulk);
+}
 
 /*
  * Reclaim the specified callback, either by invoking it (non-lazy case)
  * or freeing it directly (lazy case).  Return true if lazy, false otherwise.
+ * Lazy callbacks are freed through @bulk if it is non-NULL, in which case
+ * the caller must flush it after the batch.
  */
-static inline bool __rcu_reclaim(const char *rn, struct rcu_head *head)
+static inline bool __rcu_reclaim(const char *rn, struct rcu_head *head,
+				 struct rcu_kfree_bulk *bulk)
 {
 	unsigned long offset = (unsigned long)head->func;
 
 	rcu_lock_acquire(&rcu_callback_map);
 	if (__is_kfree_rcu_offset(offset)) {
 		RCU_TRACE(trace_rcu_invoke_kfree_callback(rn, head, offset);)
-		kfree((void *)head - offset);
+		rcu_kfree_bulk_add(bulk, (void *)head - offset);
 		rcu_lock_release(&rcu_callback_map);
 		return true;
 	} else {
@@ -50,6 +50,7 @@
 #include <asm/byteorder.h>
 #include <linux/torture.h>
 #include <linux/vmalloc.h>
+#include <linux/kernel_stat.h>
 
 #include "rcu.h"
 
@@ -93,6 +94,10 @@ torture_param(bool, shutdown, !IS_ENABLED(MODULE),
 	      "Shutdown at end of performance tests.");
 torture_param(int, verbose, 1, "Enable verbose debugging printk()s");
 torture_param(int, writer_holdoff, 0, "Holdoff (us) between GPs, zero to disable");
+torture_param(bool, kfree_rcu_test, false, "Do a kfree_rcu() perf test instead");
+torture_param(int, kfree_nthreads, -1, "Number of kfree_rcu() threads");
+torture_param(int, kfree_alloc_num, 8000, "Number of objects freed per kfree_rcu() loop");
+torture_param(int, kfree_loops, 10, "Number of kfree_rcu() loops per thread");
 
 static char *perf_type = "rcu";
 module_param(perf_type, charp, 0444);
@@ -531,6 +536,15 @@ rcu_perf_writer(void *arg)
 	return 0;
 }
 
+/* Print the number of grace periods per second over @duration ns. */
+static void rcu_perf_print_gp_rate(unsigned long batches, u64 duration)
+{
+	if (!duration)
+		return;
+	pr_alert("%s%s gp rate: %llu per 1000 s\n", perf_type, PERF_FLAG,
+		 div64_u64((u64)batches * NSEC_PER_SEC * 1000, duration));
+}
+
 static void
 rcu_perf_print_module_parms(struct rcu_perf_ops *cur_ops, const char *tag)
 {
@@ -539,6 +553,8 @@ rcu_perf_print_module_parms(struct rcu_perf_ops *cur_ops, const char *tag)
 		 perf_type, tag, nrealreaders, nrealwriters, verbose, shutdown);
 }
 
+static void kfree_perf_cleanup(void);
+
 static void
 rcu_perf_cleanup(void)
 {
@@ -548,6 +564,11 @@ rcu_perf_cleanup(void)
 	u64 *wdp;
 	u64 *wdpp;
 
+	if (kfree_rcu_test) {
+		kfree_perf_cleanup();
+		return;
+	}
+
 	/*
 	 * Would like warning at start, but everything is expedited
 	 * during the mid-boot phase, so have to wait till the end.
@@ -588,6 +609,10 @@ rcu_perf_cleanup(void)
 			 ngps,
 			 rcuperf_seq_diff(b_rcu_perf_writer_finished,
 					  b_rcu_perf_writer_started));
+		rcu_perf_print_gp_rate(rcuperf_seq_diff(b_rcu_perf_writer_finished,
+							b_rcu_perf_writer_started),
+				       t_rcu_perf_writer_finished -
+				       t_rcu_perf_writer_started);
 		for (i = 0; i < nrealwriters; i++) {
 			if (!writer_durations)
 				break;
@@ -655,6 +680,186 @@ rcu_perf_shutdown(void *arg)
 	return -EINVAL;
 }
 
+/*
+ * kfree_rcu() performance tests: each thread allocates and kfree_rcu()s
+ * kfree_alloc_num objects in each of kfree_loops loops.  Once all of
+ * them are done and the objects are freed, the number of grace periods
+ * the frees took and the kernel CPU time spent per freed object are
+ * reported.  The latter is sampled on all CPUs, so keep the system
+ * otherwise idle.
+ */
+static int kfree_nrealthreads;
+static struct task_struct **kfree_reader_tasks;
+static atomic_t n_kfree_perf_thread_started;
+static atomic_t n_kfree_perf_thread_ended;
+static u64 t_kfree_perf_started;
+static unsigned long b_kfree_perf_started;
+static u64 c_kfree_perf_started;
+
+struct kfree_obj {
+	char kfree_obj[8];
+	struct rcu_head rh;
+};
+
+/* Kernel CPU time, including interrupts, of all CPUs so far. */
+static u64 kfree_perf_cputime(void)
+{
+	u64 sum = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		u64 *cpustat = kcpustat_cpu(cpu).cpustat;
+
+		sum += cpustat[CPUTIME_SYSTEM] + cpustat[CPUTIME_SOFTIRQ] +
+		       cpustat[CPUTIME_IRQ];
+	}
+	return sum;
+}
+
+static int
+kfree_perf_thread(void *arg)
+{
+	int i, loop = 0;
+	long me = (long)arg;
+	struct kfree_obj *alloc_ptr;
+	unsigned long batches;
+	u64 t, cputime, nobjs;
+
+	VERBOSE_PERFOUT_STRING("kfree_perf_thread task started");
+	set_cpus_allowed_ptr(current, cpumask_of(me % nr_cpu_ids));
+	set_user_nice(current, MAX_NICE);
+
+	if (atomic_inc_return(&n_kfree_perf_thread_started) >=
+	    kfree_nrealthreads) {
+		t_kfree_perf_started = ktime_get_mono_fast_ns();
+		b_kfree_perf_started = cur_ops->get_gp_seq();
+		c_kfree_perf_started = kfree_perf_cputime();
+	}
+
+	do {
+		for (i = 0; i < kfree_alloc_num; i++) {
+			alloc_ptr = kmalloc(sizeof(*alloc_ptr), GFP_KERNEL);
+			if (!alloc_ptr)
+				return -ENOMEM;
+			kfree_rcu(alloc_ptr, rh);
+		}
+		cond_resched();
+	} while (!torture_must_stop() && ++loop < kfree_loops);
+
+	if (atomic_inc_return(&n_kfree_perf_thread_ended) >=
+	    kfree_nrealthreads) {
+		/* Wait for the objects to actually be freed. */
+		cur_ops->gp_barrier();
+		t = ktime_get_mono_fast_ns() - t_kfree_perf_started;
+		batches = rcuperf_seq_diff(cur_ops->get_gp_seq(),
+					   b_kfree_perf_started);
+		cputime = kfree_perf_cputime() - c_kfree_perf_started;
+		nobjs = (u64)kfree_nrealthreads * kfree_alloc_num *
+			max(kfree_loops, 1);
+
+		pr_alert("%s%s kfree_rcu: threads: %d objects: %llu duration: %llu batches: %ld cputime: %llu ns per object: %llu\n",
+			 perf_type, PERF_FLAG, kfree_nrealthreads, nobjs, t,
+			 batches, cputime, nobjs ? div64_u64(cputime, nobjs) : 0);
+		rcu_perf_print_gp_rate(batches, t);
+		if (shutdown) {
+			smp_mb(); /* Assign before wake. */
+			wake_up(&shutdown_wq);
+		}
+	}
+
+	torture_kthread_stopping("kfree_perf_thread");
+	return 0;
+}
+
+static void
+kfree_perf_cleanup(void)
+{
+	int i;
+
+	if (torture_cleanup_begin())
+		return;
+
+	if (kfree_reader_tasks) {
+		for (i = 0; i < kfree_nrealthreads; i++)
+			torture_stop_kthread(kfree_perf_thread,
+					     kfree_reader_tasks[i]);
+		kfree(kfree_reader_tasks);
+	}
+
+	torture_cleanup_end();
+}
+
+/*
+ * shutdown kthread.  Just waits to be awakened, then shuts down system.
+ */
+static int
+kfree_perf_shutdown(void *arg)
+{
+	do {
+		wait_event(shutdown_wq,
+			   atomic_read(&n_kfree_perf_thread_ended) >=
+			   kfree_nrealthreads);
+	} while (atomic_read(&n_kfree_perf_thread_ended) < kfree_nrealthreads);
+
+	smp_mb(); /* Wake before output. */
+
+	kfree_perf_cleanup();
+	kernel_power_off();
+	return -EINVAL;
+}
+
+static int __init
+kfree_perf_init(void)
+{
+	long i;
+	int firsterr = 0;
+
+	/* kfree_rcu() always uses the default flavor */
+	if (cur_ops != &rcu_ops) {
+		pr_alert("%s" PERF_FLAG " kfree_rcu_test needs perf_type=rcu\n",
+			 perf_type);
+		firsterr = -EINVAL;
+		goto unwind;
+	}
+
+	kfree_nrealthreads = compute_real(kfree_nthreads);
+	atomic_set(&n_kfree_perf_thread_started, 0);
+	atomic_set(&n_kfree_perf_thread_ended, 0);
+
+	/* Start up the kthreads. */
+	if (shutdown) {
+		init_waitqueue_head(&shutdown_wq);
+		firsterr = torture_create_kthread(kfree_perf_shutdown, NULL,
+						  shutdown_task);
+		if (firsterr)
+			goto unwind;
+		schedule_timeout_uninterruptible(1);
+	}
+
+	kfree_reader_tasks = kcalloc(kfree_nrealthreads,
+				     sizeof(kfree_reader_tasks[0]),
+				     GFP_KERNEL);
+	if (kfree_reader_tasks == NULL) {
+		firsterr = -ENOMEM;
+		goto unwind;
+	}
+
+	for (i = 0; i < kfree_nrealthreads; i++) {
+		firsterr = torture_create_kthread(kfree_perf_thread, (void *)i,
+						  kfree_reader_tasks[i]);
+		if (firsterr)
+			goto unwind;
+	}
+
+	torture_init_end();
+	return 0;
+
+unwind:
+	torture_init_end();
+	kfree_perf_cleanup();
+	return firsterr;
+}
+
 static int __init
 rcu_perf_init(void)
 {
@@ -686,6 +891,9 @@ rcu_perf_init(void)
 	if (cur_ops->init)
 		cur_ops->init();
 
+	if (kfree_rcu_test)
+		return kfree_perf_init();
+
 	nrealwriters = compute_real(nwriters);
 	nrealreaders = compute_real(nreaders);
 	atomic_set(&n_rcu_perf_reader_started, 0);
@@ -156,7 +156,7 @@ static void __rcu_process_callbacks(struct rcu_ctrlblk *rcp)
 		prefetch(next);
 		debug_rcu_head_unqueue(list);
 		local_bh_disable();
-		__rcu_reclaim("", list);
+		__rcu_reclaim("", list, NULL);
 		local_bh_enable();
 		list = next;
 	}
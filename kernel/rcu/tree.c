@@ -2542,6 +2542,7 @@ static void rcu_do_batch(struct rcu_state *rsp, struct rcu_data *rdp)
 	unsigned long flags;
 	struct rcu_head *rhp;
 	struct rcu_cblist rcl = RCU_CBLIST_INITIALIZER(rcl);
+	struct rcu_kfree_bulk bulk = RCU_KFREE_BULK_INITIALIZER;
 	long bl, count;
 
 	/* If no callbacks are ready, just return. */
@@ -2573,7 +2574,7 @@ static void rcu_do_batch(struct rcu_state *rsp, struct rcu_data *rdp)
 	rhp = rcu_cblist_dequeue(&rcl);
 	for (; rhp; rhp = rcu_cblist_dequeue(&rcl)) {
 		debug_rcu_head_unqueue(rhp);
-		if (__rcu_reclaim(rsp->name, rhp))
+		if (__rcu_reclaim(rsp->name, rhp, &bulk))
 			rcu_cblist_dequeued_lazy(&rcl);
 		/*
 		 * Stop only if limit reached and CPU has something to do.
@@ -2584,6 +2585,7 @@ static void rcu_do_batch(struct rcu_state *rsp, struct rcu_data *rdp)
 		     (!is_idle_task(current) && !rcu_is_callbacks_kthread())))
 			break;
 	}
+	rcu_kfree_bulk_flush(&bulk);
 
 	local_irq_save(flags);
 	count = -rcl.len;
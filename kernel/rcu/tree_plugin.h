@@ -1878,6 +1878,12 @@ static int __init parse_rcu_nocb_poll(char *arg)
 }
 early_param("rcu_nocb_poll", parse_rcu_nocb_poll);
 
+/* How long lazy callbacks queued to an empty list may wait for company. */
+static ulong jiffies_till_lazy_flush = 10 * HZ;
+#ifdef CONFIG_RCU_LAZY
+module_param(jiffies_till_lazy_flush, ulong, 0644);
+#endif /* #ifdef CONFIG_RCU_LAZY */
+
 /*
  * Wake up any no-CBs CPUs' kthreads that were waiting on the just-ended
  * grace period.
@@ -1955,13 +1961,29 @@ static void wake_nocb_leader_defer(struct rcu_data *rdp, int waketype,
 	unsigned long flags;
 
 	raw_spin_lock_irqsave(&rdp->nocb_lock, flags);
-	if (rdp->nocb_defer_wakeup == RCU_NOCB_WAKE_NOT)
+	if (waketype == RCU_NOCB_WAKE_LAZY) {
+		/* Leave an already pending wakeup alone. */
+		if (rdp->nocb_defer_wakeup != RCU_NOCB_WAKE_NOT)
+			goto out;
+		mod_timer(&rdp->nocb_timer, jiffies + jiffies_till_lazy_flush);
+	} else if (rdp->nocb_defer_wakeup < RCU_NOCB_WAKE) {
 		mod_timer(&rdp->nocb_timer, jiffies + 1);
+	}
 	WRITE_ONCE(rdp->nocb_defer_wakeup, waketype);
 	trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu, reason);
+out:
 	raw_spin_unlock_irqrestore(&rdp->nocb_lock, flags);
 }
 
+/*
+ * Can a string of callbacks just queued to an empty no-CBs list wait
+ * for the lazy-flush timer rather than waking the rcuo kthreads?
+ */
+static bool rcu_nocb_lazy(int rhcount, int rhcount_lazy)
+{
+	return IS_ENABLED(CONFIG_RCU_LAZY) && rhcount == rhcount_lazy;
+}
+
 /*
  * Does the specified CPU need an RCU callback for the specified flavor
  * of rcu_barrier()?
@@ -2015,6 +2037,8 @@ static bool rcu_nocb_cpu_needs_barrier(struct rcu_state *rsp, int cpu)
  * counts are supplied by rhcount and rhcount_lazy.
  *
  * If warranted, also wake up the kthread servicing this CPUs queues.
+ * Lazy callbacks queued to an empty list instead arm a timer, and the
+ * kthread is woken once a non-lazy or many more callbacks show up.
  */
 static void __call_rcu_nocb_enqueue(struct rcu_data *rdp,
 				    struct rcu_head *rhp,
@@ -2043,7 +2067,11 @@ static void __call_rcu_nocb_enqueue(struct rcu_data *rdp,
 	}
 	len = atomic_long_read(&rdp->nocb_q_count);
 	if (old_rhpp == &rdp->nocb_head) {
-		if (!irqs_disabled_flags(flags)) {
+		if (rcu_nocb_lazy(rhcount, rhcount_lazy)) {
+			/* ... unless all of it can wait ... */
+			wake_nocb_leader_defer(rdp, RCU_NOCB_WAKE_LAZY,
+					       TPS("WakeLazy"));
+		} else if (!irqs_disabled_flags(flags)) {
 			/* ... if queue was empty ... */
 			wake_nocb_leader(rdp, false);
 			trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu,
@@ -2064,6 +2092,17 @@ static void __call_rcu_nocb_enqueue(struct rcu_data *rdp,
 					       TPS("WakeOvfIsDeferred"));
 		}
 		rdp->qlen_last_fqs_check = LONG_MAX / 2;
+	} else if (rhcount != rhcount_lazy &&
+		   READ_ONCE(rdp->nocb_defer_wakeup) == RCU_NOCB_WAKE_LAZY) {
+		/* ... or if queued behind lazy callbacks only. */
+		if (!irqs_disabled_flags(flags)) {
+			wake_nocb_leader(rdp, false);
+			trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu,
+					    TPS("WakeNotLazy"));
+		} else {
+			wake_nocb_leader_defer(rdp, RCU_NOCB_WAKE,
+					       TPS("WakeNotLazyIsDeferred"));
+		}
 	} else {
 		trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu, TPS("WakeNot"));
 	}
@@ -2208,6 +2247,20 @@ static void nocb_leader_wait(struct rcu_data *my_rdp)
 	gotcbs = false;
 	smp_mb(); /* wakeup and _sleep before ->nocb_head reads. */
 	for (rdp = my_rdp; rdp; rdp = rdp->nocb_next_follower) {
+		/*
+		 * Lazy callbacks are taken along anyway, so cancel their
+		 * flush.  Do so before looking at the list such that lazy
+		 * callbacks queued after this find it empty and rearm it.
+		 */
+		if (READ_ONCE(rdp->nocb_defer_wakeup) == RCU_NOCB_WAKE_LAZY) {
+			raw_spin_lock_irqsave(&rdp->nocb_lock, flags);
+			if (rdp->nocb_defer_wakeup == RCU_NOCB_WAKE_LAZY) {
+				WRITE_ONCE(rdp->nocb_defer_wakeup,
+					   RCU_NOCB_WAKE_NOT);
+				del_timer(&rdp->nocb_timer);
+			}
+			raw_spin_unlock_irqrestore(&rdp->nocb_lock, flags);
+		}
 		rdp->nocb_gp_head = READ_ONCE(rdp->nocb_head);
 		if (!rdp->nocb_gp_head)
 			continue;  /* No CBs here, try next follower. */
@@ -2295,6 +2348,7 @@ static int rcu_nocb_kthread(void *arg)
 	struct rcu_head *next;
 	struct rcu_head **tail;
 	struct rcu_data *rdp = arg;
+	struct rcu_kfree_bulk bulk = RCU_KFREE_BULK_INITIALIZER;
 
 	/* Each pass through this loop invokes one batch of callbacks */
 	for (;;) {
@@ -2332,13 +2386,14 @@ static int rcu_nocb_kthread(void *arg)
 			}
 			debug_rcu_head_unqueue(list);
 			local_bh_disable();
-			if (__rcu_reclaim(rdp->rsp->name, list))
+			if (__rcu_reclaim(rdp->rsp->name, list, &bulk))
 				cl++;
 			c++;
 			local_bh_enable();
 			cond_resched_tasks_rcu_qs();
 			list = next;
 		}
+		rcu_kfree_bulk_flush(&bulk);
 		trace_rcu_batch_end(rdp->rsp->name, c, !!list, 0, 0, 1);
 		smp_mb__before_atomic();  /* _add after CB invocation. */
 		atomic_long_add(-c, &rdp->nocb_q_count);
@@ -2347,20 +2402,23 @@ static int rcu_nocb_kthread(void *arg)
 	return 0;
 }
 
-/* Is a deferred wakeup of rcu_nocb_kthread() required? */
+/*
+ * Is a deferred wakeup of rcu_nocb_kthread() required?  Lazy ones are
+ * left to ->nocb_timer.
+ */
 static int rcu_nocb_need_deferred_wakeup(struct rcu_data *rdp)
 {
-	return READ_ONCE(rdp->nocb_defer_wakeup);
+	return READ_ONCE(rdp->nocb_defer_wakeup) >= RCU_NOCB_WAKE;
 }
 
-/* Do a deferred wakeup of rcu_nocb_kthread(). */
-static void do_nocb_deferred_wakeup_common(struct rcu_data *rdp)
+/* Do a deferred wakeup of rcu_nocb_kthread() if one of at least @level is pending. */
+static void do_nocb_deferred_wakeup_common(struct rcu_data *rdp, int level)
 {
 	unsigned long flags;
 	int ndw;
 
 	raw_spin_lock_irqsave(&rdp->nocb_lock, flags);
-	if (!rcu_nocb_need_deferred_wakeup(rdp)) {
+	if (READ_ONCE(rdp->nocb_defer_wakeup) < level) {
 		raw_spin_unlock_irqrestore(&rdp->nocb_lock, flags);
 		return;
 	}
@@ -2375,7 +2433,7 @@ static void do_nocb_deferred_wakeup_timer(struct timer_list *t)
 {
 	struct rcu_data *rdp = from_timer(rdp, t, nocb_timer);
 
-	do_nocb_deferred_wakeup_common(rdp);
+	do_nocb_deferred_wakeup_common(rdp, RCU_NOCB_WAKE_LAZY);
 }
 
 /*
@@ -2386,8 +2444,75 @@ static void do_nocb_deferred_wakeup_timer(struct timer_list *t)
 static void do_nocb_deferred_wakeup(struct rcu_data *rdp)
 {
 	if (rcu_nocb_need_deferred_wakeup(rdp))
-		do_nocb_deferred_wakeup_common(rdp);
+		do_nocb_deferred_wakeup_common(rdp, RCU_NOCB_WAKE);
+}
+
+#ifdef CONFIG_RCU_LAZY
+/*
+ * Under memory pressure, do not let lazy callbacks hold on to memory
+ * that a grace period would free.
+ */
+static unsigned long lazy_rcu_shrink_count(struct shrinker *shrink,
+					   struct shrink_control *sc)
+{
+	unsigned long count = 0;
+	struct rcu_data *rdp;
+	struct rcu_state *rsp;
+	int cpu;
+
+	for_each_rcu_flavor(rsp) {
+		for_each_cpu(cpu, rcu_nocb_mask) {
+			rdp = per_cpu_ptr(rsp->rda, cpu);
+			if (READ_ONCE(rdp->nocb_defer_wakeup) ==
+			    RCU_NOCB_WAKE_LAZY)
+				count += atomic_long_read(&rdp->nocb_q_count_lazy);
+		}
+	}
+
+	return count ? count : SHRINK_EMPTY;
+}
+
+static unsigned long lazy_rcu_shrink_scan(struct shrinker *shrink,
+					  struct shrink_control *sc)
+{
+	unsigned long count = 0;
+	struct rcu_data *rdp;
+	struct rcu_state *rsp;
+	int cpu;
+
+	for_each_rcu_flavor(rsp) {
+		for_each_cpu(cpu, rcu_nocb_mask) {
+			rdp = per_cpu_ptr(rsp->rda, cpu);
+			if (READ_ONCE(rdp->nocb_defer_wakeup) !=
+			    RCU_NOCB_WAKE_LAZY)
+				continue;
+			count += atomic_long_read(&rdp->nocb_q_count_lazy);
+			do_nocb_deferred_wakeup_common(rdp, RCU_NOCB_WAKE_LAZY);
+		}
+	}
+
+	return count ? count : SHRINK_STOP;
+}
+
+static struct shrinker lazy_rcu_shrinker = {
+	.count_objects = lazy_rcu_shrink_count,
+	.scan_objects = lazy_rcu_shrink_scan,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static void __init rcu_lazy_init(void)
+{
+	if (register_shrinker(&lazy_rcu_shrinker))
+		pr_err("Failed to register lazy RCU shrinker!\n");
+	else
+		pr_info("\tLazy callbacks are flushed after %lu jiffies.\n",
+			jiffies_till_lazy_flush);
+}
+#else /* #ifdef CONFIG_RCU_LAZY */
+static void __init rcu_lazy_init(void)
+{
 }
+#endif /* #else #ifdef CONFIG_RCU_LAZY */
 
 void __init rcu_init_nohz(void)
 {
@@ -2426,6 +2551,8 @@ void __init rcu_init_nohz(void)
 			cpumask_pr_args(rcu_nocb_mask));
 	if (rcu_nocb_poll)
 		pr_info("\tPoll for callbacks from no-CBs CPUs.\n");
+	else if (!cpumask_empty(rcu_nocb_mask))
+		rcu_lazy_init();
 
 	for_each_rcu_flavor(rsp) {
 		for_each_cpu(cpu, rcu_nocb_mask)
@@ -721,8 +721,10 @@ static inline void enqueue_task(struct rq *rq, struct task_struct *p, int flags)
 	if (!(flags & ENQUEUE_NOCLOCK))
 		update_rq_clock(rq);
 
-	if (!(flags & ENQUEUE_RESTORE))
+	if (!(flags & ENQUEUE_RESTORE)) {
 		sched_info_queued(rq, p);
+		psi_enqueue(p, flags & ENQUEUE_WAKEUP);
+	}
 
 	p->sched_class->enqueue_task(rq, p, flags);
 }
@@ -732,8 +734,10 @@ static inline void dequeue_task(struct rq *rq, struct task_struct *p, int flags)
 	if (!(flags & DEQUEUE_NOCLOCK))
 		update_rq_clock(rq);
 
-	if (!(flags & DEQUEUE_SAVE))
+	if (!(flags & DEQUEUE_SAVE)) {
 		sched_info_dequeued(rq, p);
+		psi_dequeue(p, flags & DEQUEUE_SLEEP);
+	}
 
 	p->sched_class->dequeue_task(rq, p, flags);
 }
@@ -1744,6 +1748,14 @@ void sched_ttwu_pending(void)
 
 void scheduler_ipi(void)
 {
+#ifdef CONFIG_SCHED_CORE
+	/* A sibling changed what this CPU may run next to it */
+	if (unlikely(READ_ONCE(this_rq()->core_kick))) {
+		WRITE_ONCE(this_rq()->core_kick, 0);
+		set_tsk_need_resched(current);
+	}
+#endif
+
 	/*
 	 * Fold TIF_NEED_RESCHED into the preempt_count; anybody setting
 	 * TIF_NEED_RESCHED remotely (for the first time) will also send
@@ -2036,6 +2048,7 @@ try_to_wake_up(struct task_struct *p, unsigned int state, int wake_flags)
 	cpu = select_task_rq(p, p->wake_cpu, SD_BALANCE_WAKE, wake_flags);
 	if (task_cpu(p) != cpu) {
 		wake_flags |= WF_MIGRATED;
+		psi_ttwu_dequeue(p);
 		set_task_cpu(p, cpu);
 	}
 
@@ -2178,21 +2191,31 @@ DEFINE_STATIC_KEY_FALSE(sched_numa_balancing);
 
 #ifdef CONFIG_NUMA_BALANCING
 
-void set_numabalancing_state(bool enabled)
+/* Mask of NUMA_BALANCING_* modes, see the numa_balancing sysctl */
+int sysctl_numa_balancing_mode;
+
+static void __set_numabalancing_state(int mode)
 {
-	if (enabled)
+	WRITE_ONCE(sysctl_numa_balancing_mode, mode);
+	if (mode)
 		static_branch_enable(&sched_numa_balancing);
 	else
 		static_branch_disable(&sched_numa_balancing);
 }
 
+void set_numabalancing_state(bool enabled)
+{
+	__set_numabalancing_state(enabled ? NUMA_BALANCING_NORMAL :
+					    NUMA_BALANCING_DISABLED);
+}
+
 #ifdef CONFIG_PROC_SYSCTL
 int sysctl_numa_balancing(struct ctl_table *table, int write,
 			 void __user *buffer, size_t *lenp, loff_t *ppos)
 {
 	struct ctl_table t;
 	int err;
-	int state = static_branch_likely(&sched_numa_balancing);
+	int state = sysctl_numa_balancing_mode;
 
 	if (write && !capable(CAP_SYS_ADMIN))
 		return -EPERM;
@@ -2203,7 +2226,7 @@ int sysctl_numa_balancing(struct ctl_table *table, int write,
 	if (err < 0)
 		return err;
 	if (write)
-		set_numabalancing_state(state);
+		__set_numabalancing_state(state);
 	return err;
 }
 #endif
@@ -2317,6 +2340,7 @@ int sched_fork(unsigned long clone_flags, struct task_struct *p)
 		} else if (PRIO_TO_NICE(p->static_prio) < 0)
 			p->static_prio = NICE_TO_PRIO(0);
 
+		p->se.latency_nice = 0;
 		p->prio = p->normal_prio = __normal_prio(p);
 		set_load_weight(p, false);
 
@@ -3031,6 +3055,263 @@ unsigned long long task_sched_runtime(struct task_struct *p)
 	return ns;
 }
 
+#ifdef CONFIG_SCHED_CORE
+
+DEFINE_STATIC_KEY_FALSE(__sched_core_enabled);
+
+static DEFINE_MUTEX(sched_core_mutex);
+static atomic_t sched_core_count;
+
+/*
+ * Make @cpu pick again without taking its rq lock, see scheduler_ipi().
+ */
+static void sched_core_kick(int cpu)
+{
+	WRITE_ONCE(cpu_rq(cpu)->core_kick, 1);
+	smp_send_reschedule(cpu);
+}
+
+/*
+ * Clear what the CPUs published for their siblings to arbitrate against,
+ * under the core lock, so that no state is carried across a flip of the
+ * static key. With @kick, the CPUs that were forced idle pick again.
+ */
+static void sched_core_reset(bool kick)
+{
+	int cpu;
+
+	cpus_read_lock();
+	for_each_possible_cpu(cpu) {
+		struct rq *rq = cpu_rq(cpu), *core = NULL;
+		unsigned int forceidle;
+
+		/* Offline CPUs are not in any sibling's smt mask */
+		if (cpu_online(cpu)) {
+			core = cpu_rq(cpumask_first(cpu_smt_mask(cpu)));
+			raw_spin_lock_irq(&core->core_lock);
+		}
+		forceidle = rq->core_forceidle;
+		rq->core_forceidle = 0;
+		rq->core_cookie = 0;
+		rq->core_prio = MAX_PRIO;
+		if (core)
+			raw_spin_unlock_irq(&core->core_lock);
+
+		if (kick && forceidle && core)
+			sched_core_kick(cpu);
+	}
+	cpus_read_unlock();
+}
+
+void sched_core_get(void)
+{
+	if (atomic_inc_not_zero(&sched_core_count))
+		return;
+
+	mutex_lock(&sched_core_mutex);
+	if (!atomic_read(&sched_core_count)) {
+		sched_core_reset(false);
+		static_branch_enable(&__sched_core_enabled);
+	}
+
+	smp_mb__before_atomic();
+	atomic_inc(&sched_core_count);
+	mutex_unlock(&sched_core_mutex);
+}
+
+static void __sched_core_put(struct work_struct *work)
+{
+	if (!atomic_dec_and_mutex_lock(&sched_core_count, &sched_core_mutex))
+		return;
+
+	static_branch_disable(&__sched_core_enabled);
+
+	/*
+	 * Wait for the picks that still saw the key enabled; after that
+	 * nobody is going to end a forced idle period anymore.
+	 */
+	synchronize_sched();
+	sched_core_reset(true);
+
+	mutex_unlock(&sched_core_mutex);
+}
+
+void sched_core_put(void)
+{
+	static DECLARE_WORK(_work, __sched_core_put);
+
+	/*
+	 * Either this is not the last reference and there is nothing to
+	 * do, or it is and the static key has to be flipped from a context
+	 * that can sleep.
+	 */
+	if (!atomic_add_unless(&sched_core_count, -1, 1))
+		schedule_work(&_work);
+}
+
+/* Fair tasks compete for the core by cookie alone, not by nice level */
+static inline int sched_core_prio(struct task_struct *p)
+{
+	return min(p->prio, MAX_RT_PRIO);
+}
+
+/*
+ * Has the forced idle sibling @srq waited long enough to take the core
+ * from a task of priority @prio?
+ */
+static inline bool sched_core_starved(struct rq *srq, int prio, u64 now)
+{
+	int wait_prio = READ_ONCE(srq->core_wait_prio);
+
+	if (wait_prio != prio)
+		return wait_prio < prio;
+
+	return (s64)(now - READ_ONCE(srq->core_forceidle_start)) >=
+	       (s64)sysctl_sched_latency;
+}
+
+/*
+ * With core scheduling enabled, SMT siblings may only run tasks with the
+ * same cookie at the same time. Every CPU still picks from its own
+ * runqueue, the result is then arbitrated against what the siblings
+ * published under the core lock:
+ *
+ *  - a sibling running idle or the stopper never conflicts;
+ *  - a higher priority pick wins and kicks the conflicting sibling;
+ *  - otherwise the sibling keeps the core and this CPU is forced idle,
+ *    unless that sibling has been forced idle itself for longer than
+ *    sysctl_sched_latency waiting for us, in which case we hand over.
+ *
+ * A forced idle CPU is kicked to pick again as soon as none of its
+ * siblings blocks what it wants to run anymore.
+ */
+static struct task_struct *
+sched_core_pick(struct rq *rq, struct task_struct *next, struct rq_flags *rf)
+{
+	int i, cpu = cpu_of(rq), prio = MAX_PRIO, old_prio;
+	unsigned long cookie = 0, old_cookie;
+	const struct cpumask *smt_mask;
+	bool forceidle = false;
+	struct rq *core;
+	u64 now;
+
+	if (!sched_core_enabled(rq))
+		return next;
+
+	if (next != rq->idle && next->sched_class != &stop_sched_class) {
+		cookie = next->core_cookie;
+		prio = sched_core_prio(next);
+	}
+
+	now = rq_clock(rq);
+	smt_mask = cpu_smt_mask(cpu);
+	core = cpu_rq(cpumask_first(smt_mask));
+
+	raw_spin_lock(&core->core_lock);
+
+	for_each_cpu(i, smt_mask) {
+		struct rq *srq = cpu_rq(i);
+
+		if (i == cpu || prio == MAX_PRIO)
+			continue;
+
+		if (srq->core_forceidle) {
+			if (srq->core_wait_cookie != cookie &&
+			    sched_core_starved(srq, prio, now))
+				forceidle = true;
+			continue;
+		}
+
+		if (srq->core_prio != MAX_PRIO && srq->core_cookie != cookie &&
+		    srq->core_prio <= prio)
+			forceidle = true;
+	}
+
+	old_cookie = rq->core_cookie;
+	old_prio = rq->core_prio;
+
+	if (forceidle) {
+		if (!rq->core_forceidle) {
+			rq->core_forceidle = 1;
+			rq->core_forceidle_start = now;
+			rq->core_forceidle_count++;
+		}
+		rq->core_wait_cookie = cookie;
+		rq->core_wait_prio = prio;
+		rq->core_cookie = 0;
+		rq->core_prio = MAX_PRIO;
+	} else {
+		if (rq->core_forceidle) {
+			rq->core_forceidle = 0;
+			rq->core_forceidle_sum += now - rq->core_forceidle_start;
+		}
+		rq->core_cookie = cookie;
+		rq->core_prio = prio;
+	}
+
+	for_each_cpu(i, smt_mask) {
+		struct rq *srq = cpu_rq(i);
+
+		if (i == cpu)
+			continue;
+
+		if (srq->core_forceidle) {
+			unsigned long wait = srq->core_wait_cookie;
+
+			/* Only kick it when we stopped being in its way */
+			if (old_prio != MAX_PRIO && old_cookie != wait &&
+			    (rq->core_prio == MAX_PRIO || rq->core_cookie == wait))
+				sched_core_kick(i);
+		} else if (!forceidle && srq->core_prio != MAX_PRIO &&
+			   srq->core_cookie != cookie) {
+			/* We won on priority, the sibling has to make room */
+			sched_core_kick(i);
+		}
+	}
+
+	raw_spin_unlock(&core->core_lock);
+
+	if (forceidle)
+		next = idle_sched_class.pick_next_task(rq, next, rf);
+
+	return next;
+}
+
+/*
+ * Called from the tick: end the wait of a sibling that our task has kept
+ * forced idle for too long.
+ */
+static void sched_core_tick(struct rq *rq)
+{
+	int i, cpu = cpu_of(rq);
+	u64 now = rq_clock(rq);
+
+	if (!sched_core_enabled(rq) || rq->core_prio == MAX_PRIO)
+		return;
+
+	for_each_cpu(i, cpu_smt_mask(cpu)) {
+		struct rq *srq = cpu_rq(i);
+
+		if (i != cpu && READ_ONCE(srq->core_forceidle) &&
+		    sched_core_starved(srq, rq->core_prio, now)) {
+			resched_curr(rq);
+			break;
+		}
+	}
+}
+
+#else /* !CONFIG_SCHED_CORE */
+
+static inline struct task_struct *
+sched_core_pick(struct rq *rq, struct task_struct *next, struct rq_flags *rf)
+{
+	return next;
+}
+
+static inline void sched_core_tick(struct rq *rq) { }
+
+#endif /* CONFIG_SCHED_CORE */
+
 /*
  * This function gets called by the timer code, with HZ frequency.
  * We call it with interrupts disabled.
@@ -3048,8 +3329,10 @@ void scheduler_tick(void)
 
 	update_rq_clock(rq);
 	curr->sched_class->task_tick(rq, curr, 0);
+	sched_core_tick(rq);
 	cpu_load_update_active(rq);
 	calc_global_load_tick(rq);
+	psi_task_tick(rq);
 
 	rq_unlock(rq, &rf);
 
@@ -3445,6 +3728,7 @@ static void __sched notrace __schedule(bool preempt)
 	}
 
 	next = pick_next_task(rq, prev, &rf);
+	next = sched_core_pick(rq, next, &rf);
 	clear_tsk_need_resched(prev);
 	clear_preempt_need_resched();
 
@@ -4072,6 +4356,9 @@ static void __setscheduler_params(struct task_struct *p,
 	p->rt_priority = attr->sched_priority;
 	p->normal_prio = normal_prio(p);
 	set_load_weight(p, true);
+
+	if (attr->sched_flags & SCHED_FLAG_LATENCY_NICE)
+		p->se.latency_nice = attr->sched_latency_nice;
 }
 
 /* Actually do priority change: must hold pi & rq lock. */
@@ -4155,6 +4442,11 @@ static int __sched_setscheduler(struct task_struct *p,
 	    (rt_policy(policy) != (attr->sched_priority != 0)))
 		return -EINVAL;
 
+	if ((attr->sched_flags & SCHED_FLAG_LATENCY_NICE) &&
+	    (attr->sched_latency_nice < MIN_LATENCY_NICE ||
+	     attr->sched_latency_nice > MAX_LATENCY_NICE))
+		return -EINVAL;
+
 	/*
 	 * Allow unprivileged RT tasks to decrease priority:
 	 */
@@ -4165,6 +4457,12 @@ static int __sched_setscheduler(struct task_struct *p,
 				return -EPERM;
 		}
 
+		/* Asking for quicker wakeups is subject to RLIMIT_NICE too: */
+		if ((attr->sched_flags & SCHED_FLAG_LATENCY_NICE) &&
+		    attr->sched_latency_nice < p->se.latency_nice &&
+		    !can_nice(p, attr->sched_latency_nice))
+			return -EPERM;
+
 		if (rt_policy(policy)) {
 			unsigned long rlim_rtprio =
 					task_rlimit(p, RLIMIT_RTPRIO);
@@ -4244,6 +4542,9 @@ static int __sched_setscheduler(struct task_struct *p,
 			goto change;
 		if (dl_policy(policy) && dl_param_changed(p, attr))
 			goto change;
+		if ((attr->sched_flags & SCHED_FLAG_LATENCY_NICE) &&
+		    attr->sched_latency_nice != p->se.latency_nice)
+			goto change;
 
 		p->sched_reset_on_fork = reset_on_fork;
 		task_rq_unlock(rq, p, &rf);
@@ -4500,6 +4801,10 @@ static int sched_copy_attr(struct sched_attr __user *uattr, struct sched_attr *a
 	if (ret)
 		return -EFAULT;
 
+	/* Keep the padding after sched_latency_nice free for future use */
+	if (attr->__reserved)
+		return -EINVAL;
+
 	/*
 	 * XXX: Do we want to be lenient like existing syscalls; or do we want
 	 * to be strict and return an error on out-of-bounds values?
@@ -4720,6 +5025,7 @@ SYSCALL_DEFINE4(sched_getattr, pid_t, pid, struct sched_attr __user *, uattr,
 		attr.sched_priority = p->rt_priority;
 	else
 		attr.sched_nice = task_nice(p);
+	attr.sched_latency_nice = p->se.latency_nice;
 
 	rcu_read_unlock();
 
@@ -6041,6 +6347,11 @@ void __init sched_init(void)
 #endif /* CONFIG_SMP */
 		hrtick_rq_init(rq);
 		atomic_set(&rq->nr_iowait, 0);
+
+#ifdef CONFIG_SCHED_CORE
+		raw_spin_lock_init(&rq->core_lock);
+		rq->core_prio = MAX_PRIO;
+#endif
 	}
 
 	set_load_weight(&init_task, false);
@@ -6068,6 +6379,8 @@ void __init sched_init(void)
 
 	init_schedstats();
 
+	psi_init();
+
 	scheduler_running = 1;
 }
 
@@ -6242,6 +6555,7 @@ static void sched_free_group(struct task_group *tg)
 	free_fair_sched_group(tg);
 	free_rt_sched_group(tg);
 	autogroup_free(tg);
+	sched_core_group_free(tg);
 	kmem_cache_free(task_group_cache, tg);
 }
 
@@ -6476,8 +6790,10 @@ static void cpu_cgroup_attach(struct cgroup_taskset *tset)
 	struct task_struct *task;
 	struct cgroup_subsys_state *css;
 
-	cgroup_taskset_for_each(task, css, tset)
+	cgroup_taskset_for_each(task, css, tset) {
 		sched_move_task(task);
+		sched_core_cgroup_attach(task, css_tg(css));
+	}
 }
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
@@ -6495,6 +6811,21 @@ static u64 cpu_shares_read_u64(struct cgroup_subsys_state *css,
 	return (u64) scale_load_down(tg->shares);
 }
 
+static s64 cpu_latency_nice_read_s64(struct cgroup_subsys_state *css,
+				     struct cftype *cft)
+{
+	return css_tg(css)->latency_nice;
+}
+
+static int cpu_latency_nice_write_s64(struct cgroup_subsys_state *css,
+				      struct cftype *cft, s64 latency_nice)
+{
+	if (latency_nice < MIN_LATENCY_NICE || latency_nice > MAX_LATENCY_NICE)
+		return -ERANGE;
+
+	return sched_group_set_latency_nice(css_tg(css), latency_nice);
+}
+
 #ifdef CONFIG_CFS_BANDWIDTH
 static DEFINE_MUTEX(cfs_constraints_mutex);
 
@@ -6782,6 +7113,26 @@ static u64 cpu_rt_period_read_uint(struct cgroup_subsys_state *css,
 }
 #endif /* CONFIG_RT_GROUP_SCHED */
 
+#ifdef CONFIG_SCHED_CORE
+static u64 cpu_core_tag_read_u64(struct cgroup_subsys_state *css,
+				 struct cftype *cft)
+{
+	return !!css_tg(css)->core_cookie;
+}
+
+static int cpu_core_tag_write_u64(struct cgroup_subsys_state *css,
+				  struct cftype *cft, u64 val)
+{
+	if (val > 1)
+		return -ERANGE;
+
+	if (!static_branch_likely(&sched_smt_present))
+		return -ENODEV;
+
+	return sched_core_group_set_tag(css_tg(css), val);
+}
+#endif
+
 static struct cftype cpu_legacy_files[] = {
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	{
@@ -6789,6 +7140,19 @@ static struct cftype cpu_legacy_files[] = {
 		.read_u64 = cpu_shares_read_u64,
 		.write_u64 = cpu_shares_write_u64,
 	},
+	{
+		.name = "latency.nice",
+		.read_s64 = cpu_latency_nice_read_s64,
+		.write_s64 = cpu_latency_nice_write_s64,
+	},
+#endif
+#ifdef CONFIG_SCHED_CORE
+	{
+		.name = "core_tag",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.read_u64 = cpu_core_tag_read_u64,
+		.write_u64 = cpu_core_tag_write_u64,
+	},
 #endif
 #ifdef CONFIG_CFS_BANDWIDTH
 	{
@@ -6976,6 +7340,20 @@ static struct cftype cpu_files[] = {
 		.read_s64 = cpu_weight_nice_read_s64,
 		.write_s64 = cpu_weight_nice_write_s64,
 	},
+	{
+		.name = "latency.nice",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.read_s64 = cpu_latency_nice_read_s64,
+		.write_s64 = cpu_latency_nice_write_s64,
+	},
+#endif
+#ifdef CONFIG_SCHED_CORE
+	{
+		.name = "core_tag",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.read_u64 = cpu_core_tag_read_u64,
+		.write_u64 = cpu_core_tag_write_u64,
+	},
 #endif
 #ifdef CONFIG_CFS_BANDWIDTH
 	{
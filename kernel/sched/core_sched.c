@@ -0,0 +1,296 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Core scheduling cookies
+ *
+ * Tasks that may share an SMT core carry the same cookie. A cookie is
+ * the address of a refcounted sched_core_cookie; it is handed out by
+ * prctl(PR_SCHED_CORE) or shared by all tasks of a cgroup with
+ * cpu.core_tag set. Tasks without a cookie only run next to each other.
+ */
+#include "sched.h"
+
+#include <linux/prctl.h>
+#include <linux/ptrace.h>
+#include <linux/random.h>
+#include <linux/siphash.h>
+
+struct sched_core_cookie {
+	refcount_t	refcnt;
+	/* Given out through cpu.core_tag rather than prctl() */
+	bool		group;
+};
+
+static unsigned long sched_core_alloc_cookie(bool group)
+{
+	struct sched_core_cookie *ck = kmalloc(sizeof(*ck), GFP_KERNEL);
+
+	if (!ck)
+		return 0;
+
+	refcount_set(&ck->refcnt, 1);
+	ck->group = group;
+	sched_core_get();
+
+	return (unsigned long)ck;
+}
+
+static void sched_core_put_cookie(unsigned long cookie)
+{
+	struct sched_core_cookie *ptr = (void *)cookie;
+
+	if (ptr && refcount_dec_and_test(&ptr->refcnt)) {
+		kfree(ptr);
+		sched_core_put();
+	}
+}
+
+static unsigned long sched_core_get_cookie(unsigned long cookie)
+{
+	struct sched_core_cookie *ptr = (void *)cookie;
+
+	if (ptr)
+		refcount_inc(&ptr->refcnt);
+
+	return cookie;
+}
+
+/*
+ * Replace the cookie of @p and return the old one, whose reference now
+ * belongs to the caller. The cookie is only ever changed with both
+ * p->pi_lock and the rq lock held.
+ */
+static unsigned long sched_core_update_cookie(struct task_struct *p,
+					      unsigned long cookie)
+{
+	unsigned long old_cookie;
+	struct rq_flags rf;
+	struct rq *rq;
+
+	rq = task_rq_lock(p, &rf);
+	old_cookie = p->core_cookie;
+	p->core_cookie = cookie;
+
+	/* Have the task arbitrate with its siblings again */
+	if (task_running(rq, p))
+		resched_curr(rq);
+	task_rq_unlock(rq, p, &rf);
+
+	return old_cookie;
+}
+
+static unsigned long sched_core_clone_cookie(struct task_struct *p)
+{
+	unsigned long cookie, flags;
+
+	raw_spin_lock_irqsave(&p->pi_lock, flags);
+	cookie = sched_core_get_cookie(p->core_cookie);
+	raw_spin_unlock_irqrestore(&p->pi_lock, flags);
+
+	return cookie;
+}
+
+void sched_core_fork(struct task_struct *p)
+{
+	p->core_cookie = sched_core_clone_cookie(current);
+}
+
+void sched_core_free(struct task_struct *p)
+{
+	sched_core_put_cookie(p->core_cookie);
+}
+
+static void __sched_core_set(struct task_struct *p, unsigned long cookie)
+{
+	cookie = sched_core_get_cookie(cookie);
+	cookie = sched_core_update_cookie(p, cookie);
+	sched_core_put_cookie(cookie);
+}
+
+/* Called from prctl interface: PR_SCHED_CORE */
+int sched_core_share_pid(unsigned int cmd, pid_t pid, enum pid_type type,
+			 unsigned long uaddr)
+{
+	static siphash_key_t cookie_key __read_mostly;
+	unsigned long cookie = 0;
+	struct task_struct *task, *p;
+	struct pid *grp;
+	u64 id = 0;
+	int err = 0;
+
+	if (!static_branch_likely(&sched_smt_present))
+		return -ENODEV;
+
+	BUILD_BUG_ON(PR_SCHED_CORE_SCOPE_THREAD != PIDTYPE_PID);
+	BUILD_BUG_ON(PR_SCHED_CORE_SCOPE_THREAD_GROUP != PIDTYPE_TGID);
+	BUILD_BUG_ON(PR_SCHED_CORE_SCOPE_PROCESS_GROUP != PIDTYPE_PGID);
+
+	if (type > PIDTYPE_PGID || cmd >= PR_SCHED_CORE_MAX || pid < 0 ||
+	    (cmd != PR_SCHED_CORE_GET && uaddr))
+		return -EINVAL;
+
+	rcu_read_lock();
+	if (pid == 0) {
+		task = current;
+	} else {
+		task = find_task_by_vpid(pid);
+		if (!task) {
+			rcu_read_unlock();
+			return -ESRCH;
+		}
+	}
+	get_task_struct(task);
+	rcu_read_unlock();
+
+	/*
+	 * Check if this process has the right to modify the specified
+	 * process. Use the regular "ptrace_may_access()" checks.
+	 */
+	if (!ptrace_may_access(task, PTRACE_MODE_READ_REALCREDS)) {
+		err = -EPERM;
+		goto out;
+	}
+
+	switch (cmd) {
+	case PR_SCHED_CORE_GET:
+		if (type != PIDTYPE_PID || uaddr & 7) {
+			err = -EINVAL;
+			goto out;
+		}
+		cookie = sched_core_clone_cookie(task);
+		if (cookie) {
+			/* Never hand out the address itself */
+			get_random_once(&cookie_key, sizeof(cookie_key));
+			id = siphash_1u64(cookie, &cookie_key);
+		}
+		err = put_user(id, (u64 __user *)uaddr);
+		goto out;
+
+	case PR_SCHED_CORE_CREATE:
+		cookie = sched_core_alloc_cookie(false);
+		if (!cookie) {
+			err = -ENOMEM;
+			goto out;
+		}
+		break;
+
+	case PR_SCHED_CORE_SHARE_TO:
+		cookie = sched_core_clone_cookie(current);
+		break;
+
+	case PR_SCHED_CORE_SHARE_FROM:
+		if (type != PIDTYPE_PID) {
+			err = -EINVAL;
+			goto out;
+		}
+		cookie = sched_core_clone_cookie(task);
+		__sched_core_set(current, cookie);
+		goto out;
+
+	default:
+		err = -EINVAL;
+		goto out;
+	}
+
+	if (type == PIDTYPE_PID) {
+		__sched_core_set(task, cookie);
+		goto out;
+	}
+
+	read_lock(&tasklist_lock);
+	grp = task_pid_type(task, type);
+
+	do_each_pid_thread(grp, type, p) {
+		if (!ptrace_may_access(p, PTRACE_MODE_READ_REALCREDS)) {
+			err = -EPERM;
+			goto out_tasklist;
+		}
+	} while_each_pid_thread(grp, type, p);
+
+	do_each_pid_thread(grp, type, p) {
+		__sched_core_set(p, cookie);
+	} while_each_pid_thread(grp, type, p);
+out_tasklist:
+	read_unlock(&tasklist_lock);
+
+out:
+	sched_core_put_cookie(cookie);
+	put_task_struct(task);
+	return err;
+}
+
+#ifdef CONFIG_CGROUP_SCHED
+
+/* Serializes cpu.core_tag writes against tasks moving between groups */
+static DEFINE_MUTEX(sched_core_tag_mutex);
+
+static bool sched_core_group_cookie(struct task_struct *p)
+{
+	unsigned long cookie = sched_core_clone_cookie(p);
+	bool group = false;
+
+	if (cookie) {
+		group = ((struct sched_core_cookie *)cookie)->group;
+		sched_core_put_cookie(cookie);
+	}
+
+	return group;
+}
+
+/*
+ * Tagging a group gives all its tasks the group's cookie; untagging it
+ * clears the cookie of those tasks that still carry it. Cookies set
+ * through prctl() later on take precedence until the next tag change.
+ */
+int sched_core_group_set_tag(struct task_group *tg, bool tag)
+{
+	unsigned long old_cookie, cookie = 0;
+	struct css_task_iter it;
+	struct task_struct *p;
+
+	mutex_lock(&sched_core_tag_mutex);
+
+	if (tag == !!tg->core_cookie)
+		goto unlock;
+
+	if (tag) {
+		cookie = sched_core_alloc_cookie(true);
+		if (!cookie) {
+			mutex_unlock(&sched_core_tag_mutex);
+			return -ENOMEM;
+		}
+	}
+
+	old_cookie = tg->core_cookie;
+	tg->core_cookie = cookie;
+
+	css_task_iter_start(&tg->css, 0, &it);
+	while ((p = css_task_iter_next(&it))) {
+		if (tag || READ_ONCE(p->core_cookie) == old_cookie)
+			__sched_core_set(p, cookie);
+	}
+	css_task_iter_end(&it);
+
+	sched_core_put_cookie(old_cookie);
+unlock:
+	mutex_unlock(&sched_core_tag_mutex);
+
+	return 0;
+}
+
+/* @p has just been moved into @tg */
+void sched_core_cgroup_attach(struct task_struct *p, struct task_group *tg)
+{
+	mutex_lock(&sched_core_tag_mutex);
+	if (tg->core_cookie)
+		__sched_core_set(p, tg->core_cookie);
+	else if (sched_core_group_cookie(p))
+		__sched_core_set(p, 0);
+	mutex_unlock(&sched_core_tag_mutex);
+}
+
+void sched_core_group_free(struct task_group *tg)
+{
+	sched_core_put_cookie(tg->core_cookie);
+}
+
+#endif /* CONFIG_CGROUP_SCHED */
@@ -666,6 +666,10 @@ do {									\
 	P(cpu_load[2]);
 	P(cpu_load[3]);
 	P(cpu_load[4]);
+#ifdef CONFIG_SCHED_CORE
+	P(core_forceidle_count);
+	PN(core_forceidle_sum);
+#endif
 #undef P
 #undef PN
 
@@ -1034,6 +1034,9 @@ unsigned int sysctl_numa_balancing_scan_size = 256;
 /* Scan @scan_size MB every @scan_period after an initial @scan_delay in ms */
 unsigned int sysctl_numa_balancing_scan_delay = 1000;
 
+/* Restrict the NUMA promotion throughput (MB/s) for each target node. */
+unsigned int sysctl_numa_balancing_promote_rate_limit = 65536;
+
 struct numa_group {
 	atomic_t refcount;
 
@@ -1384,6 +1387,29 @@ static inline unsigned long group_weight(struct task_struct *p, int nid,
 	return 1000 * faults / total_faults;
 }
 
+/*
+ * Promotion candidates are counted per target node; once more than the rate
+ * limit worth of pages was considered within the current one second window,
+ * further slow memory pages stay where they are until the next window.
+ */
+static bool numa_promotion_rate_limit(struct pglist_data *pgdat,
+				      unsigned long rate_limit, int nr)
+{
+	unsigned long nr_cand;
+	unsigned int now, start;
+
+	now = jiffies_to_msecs(jiffies);
+	mod_node_page_state(pgdat, PGPROMOTE_CANDIDATE, nr);
+	nr_cand = node_page_state(pgdat, PGPROMOTE_CANDIDATE);
+	start = pgdat->nbp_rl_start;
+	if (now - start > MSEC_PER_SEC &&
+	    cmpxchg(&pgdat->nbp_rl_start, start, now) == start)
+		pgdat->nbp_rl_nr_cand = nr_cand;
+	if (nr_cand - pgdat->nbp_rl_nr_cand >= rate_limit)
+		return true;
+	return false;
+}
+
 bool should_numa_migrate_memory(struct task_struct *p, struct page * page,
 				int src_nid, int dst_cpu)
 {
@@ -1391,6 +1417,26 @@ bool should_numa_migrate_memory(struct task_struct *p, struct page * page,
 	int dst_nid = cpu_to_node(dst_cpu);
 	int last_cpupid, this_cpupid;
 
+	/*
+	 * With memory tiering, a hinting fault on a slow memory node means
+	 * the page is in use: promote it to the fast node of the faulting
+	 * CPU, as far as the rate limit allows.
+	 */
+	if ((sysctl_numa_balancing_mode & NUMA_BALANCING_MEMORY_TIERING) &&
+	    !node_is_toptier(src_nid)) {
+		struct pglist_data *pgdat = NODE_DATA(dst_nid);
+		unsigned long rate_limit;
+
+		if (!node_is_toptier(dst_nid))
+			return false;
+
+		rate_limit = (unsigned long)READ_ONCE(
+				sysctl_numa_balancing_promote_rate_limit) <<
+			     (20 - PAGE_SHIFT);
+		return !numa_promotion_rate_limit(pgdat, rate_limit,
+						  hpage_nr_pages(page));
+	}
+
 	this_cpupid = cpu_pid_to_cpupid(dst_cpu, current->pid);
 	last_cpupid = page_cpupid_xchg_last(page, this_cpupid);
 
@@ -2384,6 +2430,14 @@ void task_numa_fault(int last_cpupid, int mem_node, int pages, int flags)
 	if (!p->mm)
 		return;
 
+	/*
+	 * Faults on slow memory only drive promotion; they should not make
+	 * a CPU-less node look like the place where the task wants to run.
+	 */
+	if ((sysctl_numa_balancing_mode & NUMA_BALANCING_MEMORY_TIERING) &&
+	    !node_is_toptier(mem_node))
+		return;
+
 	/* Allocate buffer to track faults on a per-node basis */
 	if (unlikely(!p->numa_faults)) {
 		int size = sizeof(*p->numa_faults) *
@@ -6056,13 +6110,69 @@ static inline int select_idle_smt(struct task_struct *p, struct sched_domain *sd
 
 #endif /* CONFIG_SCHED_SMT */
 
+/*
+ * Track which CPUs of the LLC are idle in sd_llc_shared->idle_cpus_span;
+ * called on idle entry and exit. Only touch the shared mask when the bit
+ * actually changes, a CPU bouncing in and out of idle shouldn't keep
+ * pulling the cacheline away from the other CPUs of the LLC.
+ */
+void update_idle_cpumask(int cpu, bool idle)
+{
+	struct sched_domain_shared *sds;
+
+	rcu_read_lock();
+	sds = rcu_dereference(per_cpu(sd_llc_shared, cpu));
+	if (sds && cpumask_test_cpu(cpu, sds_idle_cpus(sds)) != idle) {
+		if (idle)
+			cpumask_set_cpu(cpu, sds_idle_cpus(sds));
+		else
+			cpumask_clear_cpu(cpu, sds_idle_cpus(sds));
+	}
+	rcu_read_unlock();
+}
+
+static inline bool cpus_share_cluster(int this_cpu, int that_cpu)
+{
+	return per_cpu(sd_cluster_id, this_cpu) == per_cpu(sd_cluster_id, that_cpu);
+}
+
+/*
+ * Scan the CPUs sharing the target's L2 for an idle one. The cluster is a
+ * small subset of the LLC, and a CPU found here keeps sharing more cache
+ * with the waker than any other CPU of the LLC would.
+ */
+static int select_idle_cluster(struct task_struct *p, struct sched_domain *sd, int target)
+{
+	int cpu;
+
+	if (!sched_feat(SIS_CLUSTER) || !per_cpu(sd_cluster_size, target))
+		return -1;
+
+	for_each_cpu_and(cpu, topology_cluster_cpumask(target), sched_domain_span(sd)) {
+		if (cpu == target || !cpumask_test_cpu(cpu, &p->cpus_allowed))
+			continue;
+		schedstat_inc(this_rq()->sis_scanned);
+		if (available_idle_cpu(cpu)) {
+			schedstat_inc(this_rq()->sis_cluster);
+			return cpu;
+		}
+	}
+
+	return -1;
+}
+
 /*
  * Scan the LLC domain for idle CPUs; this is dynamically regulated by
  * comparing the average scan cost (tracked in sd->avg_scan_cost) against the
  * average idle time for this rq (as found in rq->avg_idle).
+ *
+ * With SIS_IDLE_MASK only the CPUs that went idle and haven't left idle
+ * since are visited, so the scan budget isn't spent on busy CPUs.
  */
 static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, int target)
 {
+	struct cpumask *cpus = this_cpu_cpumask_var_ptr(select_idle_mask);
+	struct sched_domain_shared *sds;
 	struct sched_domain *this_sd;
 	u64 avg_cost, avg_idle;
 	u64 time, cost;
@@ -6073,6 +6183,8 @@ static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, int t
 	if (!this_sd)
 		return -1;
 
+	schedstat_inc(this_rq()->sis_domain_search);
+
 	/*
 	 * Due to large variance we need a large fuzz factor; hackbench in
 	 * particularly is sensitive here.
@@ -6080,7 +6192,8 @@ static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, int t
 	avg_idle = this_rq()->avg_idle / 512;
 	avg_cost = this_sd->avg_scan_cost + 1;
 
-	if (sched_feat(SIS_AVG_CPU) && avg_idle < avg_cost)
+	if (sched_feat(SIS_AVG_CPU) && avg_idle < avg_cost &&
+	    p->se.latency_nice >= 0)
 		return -1;
 
 	if (sched_feat(SIS_PROP)) {
@@ -6089,19 +6202,37 @@ static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, int t
 			nr = div_u64(span_avg, avg_cost);
 		else
 			nr = 4;
+
+		/*
+		 * Latency sensitive tasks may look at the whole LLC, latency
+		 * tolerant ones give up sooner than the cost estimate allows.
+		 */
+		if (p->se.latency_nice < 0)
+			nr = INT_MAX;
+		else if (p->se.latency_nice > 0)
+			nr = max(2, nr - nr / (LATENCY_NICE_WIDTH / 2) * p->se.latency_nice);
 	}
 
 	time = local_clock();
 
-	for_each_cpu_wrap(cpu, sched_domain_span(sd), target) {
-		if (!--nr)
+	cpumask_and(cpus, sched_domain_span(sd), &p->cpus_allowed);
+	sds = rcu_dereference(per_cpu(sd_llc_shared, target));
+	if (sched_feat(SIS_IDLE_MASK) && sds)
+		cpumask_and(cpus, cpus, sds_idle_cpus(sds));
+
+	for_each_cpu_wrap(cpu, cpus, target) {
+		if (!--nr) {
+			schedstat_inc(this_rq()->sis_failed);
 			return -1;
-		if (!cpumask_test_cpu(cpu, &p->cpus_allowed))
-			continue;
+		}
+		schedstat_inc(this_rq()->sis_scanned);
 		if (available_idle_cpu(cpu))
 			break;
 	}
 
+	if (cpu >= nr_cpumask_bits)
+		schedstat_inc(this_rq()->sis_failed);
+
 	time = local_clock() - time;
 	cost = this_sd->avg_scan_cost;
 	delta = (s64)(time - cost) / 8;
@@ -6117,15 +6248,24 @@ static int select_idle_sibling(struct task_struct *p, int prev, int target)
 {
 	struct sched_domain *sd;
 	int i, recent_used_cpu;
+	int prev_aff = -1, recent_aff = -1;
+	bool cluster = sched_feat(SIS_CLUSTER);
+
+	schedstat_inc(this_rq()->sis_search);
 
 	if (available_idle_cpu(target))
 		return target;
 
 	/*
-	 * If the previous CPU is cache affine and idle, don't be stupid:
+	 * If the previous CPU is cache affine and idle, don't be stupid; but
+	 * if it only shares the LLC and not the L2 with the target, give an
+	 * idle CPU of the target's cluster a chance first:
 	 */
-	if (prev != target && cpus_share_cache(prev, target) && available_idle_cpu(prev))
-		return prev;
+	if (prev != target && cpus_share_cache(prev, target) && available_idle_cpu(prev)) {
+		if (!cluster || cpus_share_cluster(prev, target))
+			return prev;
+		prev_aff = prev;
+	}
 
 	/* Check a recently used CPU as a potential idle candidate: */
 	recent_used_cpu = p->recent_used_cpu;
@@ -6134,12 +6274,15 @@ static int select_idle_sibling(struct task_struct *p, int prev, int target)
 	    cpus_share_cache(recent_used_cpu, target) &&
 	    available_idle_cpu(recent_used_cpu) &&
 	    cpumask_test_cpu(p->recent_used_cpu, &p->cpus_allowed)) {
-		/*
-		 * Replace recent_used_cpu with prev as it is a potential
-		 * candidate for the next wake:
-		 */
-		p->recent_used_cpu = prev;
-		return recent_used_cpu;
+		if (!cluster || cpus_share_cluster(recent_used_cpu, target)) {
+			/*
+			 * Replace recent_used_cpu with prev as it is a potential
+			 * candidate for the next wake:
+			 */
+			p->recent_used_cpu = prev;
+			return recent_used_cpu;
+		}
+		recent_aff = recent_used_cpu;
 	}
 
 	sd = rcu_dereference(per_cpu(sd_llc, target));
@@ -6150,6 +6293,18 @@ static int select_idle_sibling(struct task_struct *p, int prev, int target)
 	if ((unsigned)i < nr_cpumask_bits)
 		return i;
 
+	i = select_idle_cluster(p, sd, target);
+	if ((unsigned)i < nr_cpumask_bits)
+		return i;
+
+	/* Nothing idle next to the target; an idle cache affine CPU will do */
+	if (prev_aff >= 0)
+		return prev_aff;
+	if (recent_aff >= 0) {
+		p->recent_used_cpu = prev;
+		return recent_aff;
+	}
+
 	i = select_idle_cpu(p, sd, target);
 	if ((unsigned)i < nr_cpumask_bits)
 		return i;
@@ -6450,6 +6605,27 @@ static unsigned long wakeup_gran(struct sched_entity *se)
 	return calc_delta_fair(gran, se);
 }
 
+/*
+ * Latency nice shifts the vruntime comparison of a wakeup by up to one
+ * sched_latency: an entity with a lower latency nice than 'curr' gets to
+ * preempt it earlier, one with a higher latency nice later. Only the
+ * difference matters, two entities with the same hint behave as before.
+ * Half the latency nice range is worth a full sched_latency, beyond that
+ * the offset is clamped.
+ */
+static s64 wakeup_latency_offset(struct sched_entity *curr, struct sched_entity *se)
+{
+	int diff = curr->latency_nice - se->latency_nice;
+	s64 offset;
+
+	if (!diff)
+		return 0;
+
+	offset = div_s64((s64)diff * sysctl_sched_latency, LATENCY_NICE_WIDTH / 2);
+	return clamp_t(s64, offset, -(s64)sysctl_sched_latency,
+		       sysctl_sched_latency);
+}
+
 /*
  * Should 'se' preempt 'curr'.
  *
@@ -6469,6 +6645,8 @@ wakeup_preempt_entity(struct sched_entity *curr, struct sched_entity *se)
 {
 	s64 gran, vdiff = curr->vruntime - se->vruntime;
 
+	vdiff += wakeup_latency_offset(curr, se);
+
 	if (vdiff <= 0)
 		return -1;
 
@@ -10085,6 +10263,25 @@ int sched_group_set_shares(struct task_group *tg, unsigned long shares)
 	mutex_unlock(&shares_mutex);
 	return 0;
 }
+
+int sched_group_set_latency_nice(struct task_group *tg, int latency_nice)
+{
+	int i;
+
+	/*
+	 * The root cgroup has no entities to carry the hint.
+	 */
+	if (!tg->se[0])
+		return -EINVAL;
+
+	mutex_lock(&shares_mutex);
+	tg->latency_nice = latency_nice;
+	for_each_possible_cpu(i)
+		WRITE_ONCE(tg->se[i]->latency_nice, latency_nice);
+	mutex_unlock(&shares_mutex);
+
+	return 0;
+}
 #else /* CONFIG_FAIR_GROUP_SCHED */
 
 void free_fair_sched_group(struct task_group *tg) { }
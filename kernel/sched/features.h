@@ -58,6 +58,15 @@ SCHED_FEAT(TTWU_QUEUE, true)
 SCHED_FEAT(SIS_AVG_CPU, false)
 SCHED_FEAT(SIS_PROP, true)
 
+/*
+ * Only scan the CPUs the LLC's idle mask reports idle, and try the CPUs
+ * sharing the target's L2 cluster before the rest of the LLC.  The
+ * cluster step only does something where clusters subdivide the LLC;
+ * on arm64 with DT topologies the cluster spans at least the LLC.
+ */
+SCHED_FEAT(SIS_IDLE_MASK, true)
+SCHED_FEAT(SIS_CLUSTER, true)
+
 /*
  * Issue a WARN when we do multiple update_rq_clock() calls
  * in a single rq->lock section. Default disabled because the
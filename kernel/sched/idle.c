@@ -391,7 +391,11 @@ static void check_preempt_curr_idle(struct rq *rq, struct task_struct *p, int fl
 static struct task_struct *
 pick_next_task_idle(struct rq *rq, struct task_struct *prev, struct rq_flags *rf)
 {
-	put_prev_task(rq, prev);
+	/* Staying idle leaves the CPU's bit in the idle cpumask as it is */
+	if (prev != rq->idle) {
+		put_prev_task(rq, prev);
+		update_idle_cpumask(cpu_of(rq), true);
+	}
 	update_idle_core(rq);
 	schedstat_inc(rq->sched_goidle);
 
@@ -413,6 +417,7 @@ dequeue_task_idle(struct rq *rq, struct task_struct *p, int flags)
 
 static void put_prev_task_idle(struct rq *rq, struct task_struct *prev)
 {
+	update_idle_cpumask(cpu_of(rq), false);
 }
 
 /*
@@ -399,24 +399,48 @@ DEFINE_PER_CPU(struct sched_domain_shared *, sd_llc_shared);
 DEFINE_PER_CPU(struct sched_domain *, sd_numa);
 DEFINE_PER_CPU(struct sched_domain *, sd_asym);
 
+/*
+ * Same for the CPUs sharing an L2 (cluster) inside the LLC domain. The
+ * size is left 0 when the cluster doesn't subdivide the LLC, so that the
+ * wakeup path doesn't bother scanning it separately.
+ */
+DEFINE_PER_CPU(int, sd_cluster_size);
+DEFINE_PER_CPU(int, sd_cluster_id);
+
 static void update_top_cache_domain(int cpu)
 {
 	struct sched_domain_shared *sds = NULL;
 	struct sched_domain *sd;
-	int id = cpu;
-	int size = 1;
+	int id = cpu, cls_id = cpu;
+	int size = 1, cls_size = 0;
+	int i;
 
 	sd = highest_flag_domain(cpu, SD_SHARE_PKG_RESOURCES);
 	if (sd) {
 		id = cpumask_first(sched_domain_span(sd));
 		size = cpumask_weight(sched_domain_span(sd));
 		sds = sd->shared;
+
+		for_each_cpu_and(i, topology_cluster_cpumask(cpu),
+				 sched_domain_span(sd)) {
+			if (!cls_size++)
+				cls_id = i;
+		}
+		if (cls_size <= 1 || cls_size >= size) {
+			cls_size = 0;
+			cls_id = id;
+		}
 	}
 
 	rcu_assign_pointer(per_cpu(sd_llc, cpu), sd);
 	per_cpu(sd_llc_size, cpu) = size;
 	per_cpu(sd_llc_id, cpu) = id;
 	rcu_assign_pointer(per_cpu(sd_llc_shared, cpu), sds);
+	per_cpu(sd_cluster_size, cpu) = cls_size;
+	per_cpu(sd_cluster_id, cpu) = cls_id;
+
+	if (sds && available_idle_cpu(cpu))
+		cpumask_set_cpu(cpu, sds_idle_cpus(sds));
 
 	sd = lowest_flag_domain(cpu, SD_NUMA);
 	rcu_assign_pointer(per_cpu(sd_numa, cpu), sd);
@@ -1534,7 +1558,7 @@ static int __sdt_alloc(const struct cpumask *cpu_map)
 
 			*per_cpu_ptr(sdd->sd, j) = sd;
 
-			sds = kzalloc_node(sizeof(struct sched_domain_shared),
+			sds = kzalloc_node(sizeof(struct sched_domain_shared) + cpumask_size(),
 					GFP_KERNEL, cpu_to_node(j));
 			if (!sds)
 				return -ENOMEM;
@@ -0,0 +1,220 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Timer wakeup test kernel module
+ *
+ * Test is executed by writing and reading to /sys/kernel/debug/timer_wakeup_test
+ * Tests are configured by writing: TIMERS [PERIOD_MS [SECONDS]]
+ * Tests are executed by reading from the same file.
+ *
+ * The test queues TIMERS periodic timers which are not pinned, spread
+ * over the online CPUs, and counts per CPU how often a timer expired
+ * and how often it expired while the CPU was idle, i.e. the timer woke
+ * up an otherwise idle CPU. With timer migration in place, the global
+ * timers of idle CPUs should mostly expire on the CPUs which are awake.
+ */
+
+#include <linux/cpu.h>
+#include <linux/debugfs.h>
+#include <linux/delay.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/tick.h>
+#include <linux/timer.h>
+#include <linux/uaccess.h>
+#include <linux/workqueue.h>
+
+#define DEFAULT_PERIOD_MS 10
+#define DEFAULT_SECONDS 5
+
+#define DEBUGFS_FILENAME "timer_wakeup_test"
+
+struct tw_timer {
+	struct timer_list	timer;
+	unsigned long		period;
+	bool			stop;
+};
+
+static DEFINE_MUTEX(timer_wakeup_test_lock);
+static struct dentry *timer_wakeup_test_debugfs_file;
+static int timer_wakeup_test_timers;
+static int timer_wakeup_test_period = DEFAULT_PERIOD_MS;
+static int timer_wakeup_test_seconds = DEFAULT_SECONDS;
+
+static DEFINE_PER_CPU(unsigned long, tw_expiries);
+static DEFINE_PER_CPU(unsigned long, tw_idle_expiries);
+
+static void tw_timer_fn(struct timer_list *timer)
+{
+	struct tw_timer *t = from_timer(t, timer, timer);
+
+	this_cpu_inc(tw_expiries);
+	if (is_idle_task(current))
+		this_cpu_inc(tw_idle_expiries);
+
+	if (!READ_ONCE(t->stop))
+		mod_timer(&t->timer, jiffies + t->period);
+}
+
+/* Queue the timer from @cpu, so it starts out on that CPU's wheel */
+static long tw_timer_start(void *arg)
+{
+	struct tw_timer *t = arg;
+
+	mod_timer(&t->timer, jiffies + t->period);
+	return 0;
+}
+
+static int timer_wakeup_test_run(struct seq_file *s, int nr, int period_ms,
+				 int seconds)
+{
+	unsigned long expiries = 0, idle_expiries = 0;
+	u64 *idle_us;
+	struct tw_timer *timers;
+	int i, cpu;
+
+	timers = kcalloc(nr, sizeof(*timers), GFP_KERNEL);
+	idle_us = kcalloc(nr_cpu_ids, sizeof(*idle_us), GFP_KERNEL);
+	if (!timers || !idle_us) {
+		kfree(timers);
+		kfree(idle_us);
+		return -ENOMEM;
+	}
+
+	get_online_cpus();
+	for_each_online_cpu(cpu) {
+		per_cpu(tw_expiries, cpu) = 0;
+		per_cpu(tw_idle_expiries, cpu) = 0;
+		idle_us[cpu] = get_cpu_idle_time_us(cpu, NULL);
+	}
+
+	cpu = cpumask_first(cpu_online_mask);
+	for (i = 0; i < nr; i++) {
+		timer_setup(&timers[i].timer, tw_timer_fn, 0);
+		timers[i].period = max(msecs_to_jiffies(period_ms), 1UL);
+		work_on_cpu(cpu, tw_timer_start, &timers[i]);
+
+		cpu = cpumask_next(cpu, cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(cpu_online_mask);
+	}
+
+	msleep_interruptible(seconds * MSEC_PER_SEC);
+
+	for (i = 0; i < nr; i++) {
+		WRITE_ONCE(timers[i].stop, true);
+		del_timer_sync(&timers[i].timer);
+	}
+
+	seq_printf(s, "%d timers, %d ms period, %d s\n", nr, period_ms, seconds);
+	seq_puts(s, "cpu expiries idle_expiries idle_ms\n");
+	for_each_online_cpu(cpu) {
+		unsigned long exp = per_cpu(tw_expiries, cpu);
+		unsigned long idle_exp = per_cpu(tw_idle_expiries, cpu);
+		u64 idle = get_cpu_idle_time_us(cpu, NULL);
+
+		seq_printf(s, "%3d %8lu %13lu %7llu\n", cpu, exp, idle_exp,
+			   idle == -1ULL ? 0 :
+			   div_u64(idle - idle_us[cpu], USEC_PER_MSEC));
+		expiries += exp;
+		idle_expiries += idle_exp;
+	}
+	put_online_cpus();
+
+	seq_printf(s, "total: expiries=%lu idle_expiries=%lu\n", expiries,
+		   idle_expiries);
+
+	kfree(idle_us);
+	kfree(timers);
+	return 0;
+}
+
+static int timer_wakeup_test_show(struct seq_file *s, void *v)
+{
+	int nr, period, seconds;
+
+	mutex_lock(&timer_wakeup_test_lock);
+	nr = timer_wakeup_test_timers;
+	period = timer_wakeup_test_period;
+	seconds = timer_wakeup_test_seconds;
+
+	if (nr > 0 && period > 0 && seconds > 0) {
+		int ret = timer_wakeup_test_run(s, nr, period, seconds);
+
+		mutex_unlock(&timer_wakeup_test_lock);
+		return ret;
+	}
+	mutex_unlock(&timer_wakeup_test_lock);
+
+	seq_puts(s, "usage:\n");
+	seq_puts(s, "echo TIMERS [PERIOD_MS [SECONDS]] > " DEBUGFS_FILENAME "\n");
+	seq_puts(s, "cat " DEBUGFS_FILENAME "\n");
+
+	return 0;
+}
+
+static int timer_wakeup_test_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, timer_wakeup_test_show, inode->i_private);
+}
+
+static ssize_t timer_wakeup_test_write(struct file *file,
+				       const char __user *buf, size_t count,
+				       loff_t *pos)
+{
+	int nr, period = DEFAULT_PERIOD_MS, seconds = DEFAULT_SECONDS;
+	char lbuf[32];
+
+	if (count >= sizeof(lbuf))
+		return -EINVAL;
+
+	if (copy_from_user(lbuf, buf, count))
+		return -EFAULT;
+	lbuf[count] = '\0';
+
+	if (sscanf(lbuf, "%d %d %d", &nr, &period, &seconds) < 1)
+		return -EINVAL;
+
+	mutex_lock(&timer_wakeup_test_lock);
+	timer_wakeup_test_timers = nr;
+	timer_wakeup_test_period = period;
+	timer_wakeup_test_seconds = seconds;
+	mutex_unlock(&timer_wakeup_test_lock);
+
+	return count;
+}
+
+static const struct file_operations timer_wakeup_test_debugfs_ops = {
+	.owner = THIS_MODULE,
+	.open = timer_wakeup_test_open,
+	.read = seq_read,
+	.write = timer_wakeup_test_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int __init timer_wakeup_test_init(void)
+{
+	mutex_lock(&timer_wakeup_test_lock);
+	timer_wakeup_test_debugfs_file = debugfs_create_file(DEBUGFS_FILENAME,
+			S_IRUSR | S_IWUSR, NULL, NULL,
+			&timer_wakeup_test_debugfs_ops);
+	mutex_unlock(&timer_wakeup_test_lock);
+
+	return 0;
+}
+
+module_init(timer_wakeup_test_init);
+
+static void __exit timer_wakeup_test_exit(void)
+{
+	mutex_lock(&timer_wakeup_test_lock);
+	debugfs_remove(timer_wakeup_test_debugfs_file);
+	mutex_unlock(&timer_wakeup_test_lock);
+}
+
+module_exit(timer_wakeup_test_exit);
+
+MODULE_LICENSE("GPL");
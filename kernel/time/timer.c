@@ -52,6 +52,7 @@
 #include <asm/io.h>
 
 #include "tick-internal.h"
+#include "timer_migration.h"
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/timer.h>
@@ -179,18 +180,23 @@ EXPORT_SYMBOL(jiffies_64);
 #define WHEEL_TIMEOUT_MAX	(WHEEL_TIMEOUT_CUTOFF - LVL_GRAN(LVL_DEPTH - 1))
 
 /*
- * The resulting wheel size. If NOHZ is configured we allocate two
- * wheels so we have a separate storage for the deferrable timers.
+ * The resulting wheel size. If NOHZ is configured we allocate three
+ * wheels: pinned timers go to the local one, timers which may run on any
+ * CPU to the global one, and the deferrable timers have their own. The
+ * global timers of an idle CPU are expired by an active CPU, see
+ * timer_migration.c.
  */
 #define WHEEL_SIZE	(LVL_SIZE * LVL_DEPTH)
 
 #ifdef CONFIG_NO_HZ_COMMON
-# define NR_BASES	2
-# define BASE_STD	0
-# define BASE_DEF	1
+# define NR_BASES	3
+# define BASE_LOCAL	0
+# define BASE_GLOBAL	1
+# define BASE_DEF	2
 #else
 # define NR_BASES	1
-# define BASE_STD	0
+# define BASE_LOCAL	0
+# define BASE_GLOBAL	0
 # define BASE_DEF	0
 #endif
 
@@ -581,6 +587,17 @@ trigger_dyntick_cpu(struct timer_base *base, struct timer_list *timer)
 	 * wheel:
 	 */
 	base->next_expiry = timer->expires;
+
+	/*
+	 * Unless it is a global timer of a CPU whose global timers are taken
+	 * care of by someone else. Global timers are always queued locally
+	 * (see get_target_base()), so such a timer only ends up on the idle
+	 * CPU when it is requeued while its callback runs, and the CPU
+	 * expiring it updates the timer migration hierarchy afterwards.
+	 */
+	if (!(timer->flags & TIMER_PINNED) && tmigr_cpu_is_idle(base->cpu))
+		return;
+
 	wake_up_nohz_cpu(base->cpu);
 }
 
@@ -835,9 +852,16 @@ static int detach_if_pending(struct timer_list *timer, struct timer_base *base,
 	return 1;
 }
 
+static inline unsigned int timer_base_index(u32 tflags)
+{
+	return tflags & TIMER_PINNED ? BASE_LOCAL : BASE_GLOBAL;
+}
+
 static inline struct timer_base *get_timer_cpu_base(u32 tflags, u32 cpu)
 {
-	struct timer_base *base = per_cpu_ptr(&timer_bases[BASE_STD], cpu);
+	struct timer_base *base;
+
+	base = per_cpu_ptr(&timer_bases[timer_base_index(tflags)], cpu);
 
 	/*
 	 * If the timer is deferrable and NO_HZ_COMMON is set then we need
@@ -850,7 +874,9 @@ static inline struct timer_base *get_timer_cpu_base(u32 tflags, u32 cpu)
 
 static inline struct timer_base *get_timer_this_cpu_base(u32 tflags)
 {
-	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_STD]);
+	struct timer_base *base;
+
+	base = this_cpu_ptr(&timer_bases[timer_base_index(tflags)]);
 
 	/*
 	 * If the timer is deferrable and NO_HZ_COMMON is set then we need
@@ -866,14 +892,14 @@ static inline struct timer_base *get_timer_base(u32 tflags)
 	return get_timer_cpu_base(tflags, tflags & TIMER_CPUMASK);
 }
 
+/*
+ * Global timers are queued on the local CPU as well: when it goes idle the
+ * timer migration hierarchy takes care of them. Queueing them on a remote
+ * idle CPU instead would neither kick that CPU nor update the hierarchy.
+ */
 static inline struct timer_base *
 get_target_base(struct timer_base *base, unsigned tflags)
 {
-#if defined(CONFIG_SMP) && defined(CONFIG_NO_HZ_COMMON)
-	if (static_branch_likely(&timers_migration_enabled) &&
-	    !(tflags & TIMER_PINNED))
-		return get_timer_cpu_base(tflags, get_nohz_timer_target());
-#endif
 	return get_timer_this_cpu_base(tflags);
 }
 
@@ -1153,6 +1179,8 @@ void add_timer_on(struct timer_list *timer, int cpu)
 
 	BUG_ON(timer_pending(timer) || !timer->function);
 
+	/* The timer must stay on @cpu, not end up on its global wheel */
+	timer->flags |= TIMER_PINNED;
 	new_base = get_timer_cpu_base(timer->flags, cpu);
 
 	/*
@@ -1508,6 +1536,53 @@ static u64 cmp_next_hrtimer_event(u64 basem, u64 expires)
 	return DIV_ROUND_UP_ULL(nextevt, TICK_NSEC) * TICK_NSEC;
 }
 
+/*
+ * Find the next expiring timer of @base and forward its clock if
+ * possible. Caller must hold base->lock.
+ */
+static unsigned long next_timer_forward(struct timer_base *base,
+					unsigned long basej, bool *is_max_delta)
+{
+	unsigned long nextevt = __next_timer_interrupt(base);
+
+	*is_max_delta = (nextevt == base->clk + NEXT_TIMER_MAX_DELTA);
+	base->next_expiry = nextevt;
+	/*
+	 * We have a fresh next event. Check whether we can forward the
+	 * base. We can only do that when @basej is past base->clk
+	 * otherwise we might rewind base->clk.
+	 */
+	if (time_after(basej, base->clk)) {
+		if (time_after(nextevt, basej))
+			base->clk = basej;
+		else if (time_after(nextevt, base->clk))
+			base->clk = nextevt;
+	}
+
+	return nextevt;
+}
+
+static void timer_base_set_idle(struct timer_base *base, bool idle)
+{
+	if (idle)
+		base->must_forward_clk = true;
+	base->is_idle = idle;
+}
+
+/*
+ * Combine the first local timer with the first global one, which is
+ * only taken into account when @global_has is set.
+ */
+static unsigned long next_timer_combine(unsigned long local, bool *is_max_delta,
+					unsigned long global, bool global_has)
+{
+	if (global_has && (*is_max_delta || time_before(global, local))) {
+		*is_max_delta = false;
+		return global;
+	}
+	return local;
+}
+
 /**
  * get_next_timer_interrupt - return the time (clock mono) of the next timer
  * @basej:	base time jiffies
@@ -1515,13 +1590,19 @@ static u64 cmp_next_hrtimer_event(u64 basem, u64 expires)
  *
  * Returns the tick aligned clock monotonic time of the next pending
  * timer or KTIME_MAX if no timer is pending.
+ *
+ * When the CPU goes idle for more than a tick, its global timers are
+ * handed over to the timer migration hierarchy, and only the local
+ * timers (plus the global ones of everyone, if this is the last CPU to
+ * go idle) determine the next event.
  */
 u64 get_next_timer_interrupt(unsigned long basej, u64 basem)
 {
-	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_STD]);
+	struct timer_base *base_local, *base_global;
+	unsigned long local_next, global_next, nextevt;
+	bool local_max, global_max, is_max_delta;
 	u64 expires = KTIME_MAX;
-	unsigned long nextevt;
-	bool is_max_delta;
+	bool idle = false;
 
 	/*
 	 * Pretend that there is no timer pending if the cpu is offline.
@@ -1530,41 +1611,63 @@ u64 get_next_timer_interrupt(unsigned long basej, u64 basem)
 	if (cpu_is_offline(smp_processor_id()))
 		return expires;
 
-	raw_spin_lock(&base->lock);
-	nextevt = __next_timer_interrupt(base);
-	is_max_delta = (nextevt == base->clk + NEXT_TIMER_MAX_DELTA);
-	base->next_expiry = nextevt;
-	/*
-	 * We have a fresh next event. Check whether we can forward the
-	 * base. We can only do that when @basej is past base->clk
-	 * otherwise we might rewind base->clk.
-	 */
-	if (time_after(basej, base->clk)) {
-		if (time_after(nextevt, basej))
-			base->clk = basej;
-		else if (time_after(nextevt, base->clk))
-			base->clk = nextevt;
-	}
+	base_local = this_cpu_ptr(&timer_bases[BASE_LOCAL]);
+	base_global = this_cpu_ptr(&timer_bases[BASE_GLOBAL]);
+
+	raw_spin_lock(&base_local->lock);
+	raw_spin_lock_nested(&base_global->lock, SINGLE_DEPTH_NESTING);
+
+	local_next = next_timer_forward(base_local, basej, &local_max);
+	global_next = next_timer_forward(base_global, basej, &global_max);
+
+	is_max_delta = local_max;
+	nextevt = next_timer_combine(local_next, &is_max_delta, global_next,
+				     !global_max);
 
 	if (time_before_eq(nextevt, basej)) {
 		expires = basem;
-		base->is_idle = false;
 	} else {
 		if (!is_max_delta)
 			expires = basem + (u64)(nextevt - basej) * TICK_NSEC;
 		/*
-		 * If we expect to sleep more than a tick, mark the base idle.
-		 * Also the tick is stopped so any added timer must forward
-		 * the base clk itself to keep granularity small. This idle
-		 * logic is only maintained for the BASE_STD base, deferrable
-		 * timers may still see large granularity skew (by design).
+		 * If we expect to sleep more than a tick, mark the bases
+		 * idle. Also the tick is stopped so any added timer must
+		 * forward the base clk itself to keep granularity small.
+		 * This idle logic is only maintained for the local and
+		 * global bases, deferrable timers may still see large
+		 * granularity skew (by design).
 		 */
-		if ((expires - basem) > TICK_NSEC) {
-			base->must_forward_clk = true;
-			base->is_idle = true;
+		idle = (expires - basem) > TICK_NSEC;
+	}
+	timer_base_set_idle(base_local, idle);
+	timer_base_set_idle(base_global, idle);
+
+	raw_spin_unlock(&base_global->lock);
+	raw_spin_unlock(&base_local->lock);
+
+	/*
+	 * Hand the global timers over when the CPU really goes idle. A
+	 * remote enqueue which sneaks in before the hierarchy knows still
+	 * kicks this CPU, as the base is idle already.
+	 */
+#ifdef CONFIG_SMP
+	if (idle && is_idle_task(current) &&
+	    static_branch_likely(&timers_migration_enabled)) {
+		bool global_has = !global_max;
+
+		if (tmigr_cpu_deactivate(&global_has, &global_next)) {
+			is_max_delta = local_max;
+			nextevt = next_timer_combine(local_next, &is_max_delta,
+						     global_next, global_has);
+			if (time_before_eq(nextevt, basej))
+				expires = basem;
+			else if (is_max_delta)
+				expires = KTIME_MAX;
+			else
+				expires = basem + (u64)(nextevt - basej) * TICK_NSEC;
 		}
 	}
-	raw_spin_unlock(&base->lock);
+#endif
 
 	return cmp_next_hrtimer_event(basem, expires);
 }
@@ -1576,15 +1679,16 @@ u64 get_next_timer_interrupt(unsigned long basej, u64 basem)
  */
 void timer_clear_idle(void)
 {
-	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_STD]);
-
 	/*
 	 * We do this unlocked. The worst outcome is a remote enqueue sending
 	 * a pointless IPI, but taking the lock would just make the window for
 	 * sending the IPI a few instructions smaller for the cost of taking
 	 * the lock in the exit from idle path.
 	 */
-	base->is_idle = false;
+	__this_cpu_write(timer_bases[BASE_LOCAL].is_idle, false);
+	__this_cpu_write(timer_bases[BASE_GLOBAL].is_idle, false);
+
+	tmigr_cpu_activate();
 }
 
 static int collect_expired_timers(struct timer_base *base,
@@ -1657,11 +1761,21 @@ static inline void __run_timers(struct timer_base *base)
 
 	raw_spin_lock_irq(&base->lock);
 
+	/*
+	 * The global base of an idle CPU is expired remotely, so the CPU
+	 * itself or another migrator may come along while a timer runs.
+	 * Leave the base to whoever is expiring it already.
+	 */
+	if (base->running_timer) {
+		raw_spin_unlock_irq(&base->lock);
+		return;
+	}
+
 	/*
 	 * timer_base::must_forward_clk must be cleared before running
 	 * timers so that any timer functions that call mod_timer() will
 	 * not try to forward the base. Idle tracking / clock forwarding
-	 * logic is only used with BASE_STD timers.
+	 * logic is only used with the local and global bases.
 	 *
 	 * The must_forward_clk flag is cleared unconditionally also for
 	 * the deferrable base. The deferrable base is not affected by idle
@@ -1690,29 +1804,64 @@ static inline void __run_timers(struct timer_base *base)
  */
 static __latent_entropy void run_timer_softirq(struct softirq_action *h)
 {
-	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_STD]);
+	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_LOCAL]);
 
 	__run_timers(base);
-	if (IS_ENABLED(CONFIG_NO_HZ_COMMON))
+	if (IS_ENABLED(CONFIG_NO_HZ_COMMON)) {
+		__run_timers(this_cpu_ptr(&timer_bases[BASE_GLOBAL]));
 		__run_timers(this_cpu_ptr(&timer_bases[BASE_DEF]));
+		tmigr_handle_remote();
+	}
 }
 
+#if defined(CONFIG_SMP) && defined(CONFIG_NO_HZ_COMMON)
+/**
+ * timer_expire_remote - expire the global timers of an idle CPU
+ * @cpu:	The idle CPU
+ * @nextevt:	Returns the first global timer of @cpu afterwards
+ *
+ * Called from the timer softirq of the migrator. Return true if @cpu
+ * still has a global timer pending.
+ */
+bool timer_expire_remote(unsigned int cpu, unsigned long *nextevt)
+{
+	struct timer_base *base = per_cpu_ptr(&timer_bases[BASE_GLOBAL], cpu);
+	unsigned long next;
+
+	__run_timers(base);
+
+	raw_spin_lock_irq(&base->lock);
+	/* Keep forwarding the clock on enqueue while the CPU sleeps */
+	base->must_forward_clk = base->is_idle;
+	next = __next_timer_interrupt(base);
+	base->next_expiry = next;
+	raw_spin_unlock_irq(&base->lock);
+
+	*nextevt = next;
+	return next != base->clk + NEXT_TIMER_MAX_DELTA;
+}
+#endif
+
 /*
  * Called by the local, per-CPU timer interrupt on SMP.
  */
 void run_local_timers(void)
 {
-	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_STD]);
+	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_LOCAL]);
 
 	hrtimer_run_queues();
 	/* Raise the softirq only if required. */
 	if (time_before(jiffies, base->clk)) {
 		if (!IS_ENABLED(CONFIG_NO_HZ_COMMON))
 			return;
-		/* CPU is awake, so check the deferrable base. */
+		/* CPU is awake, so check the global and deferrable bases. */
 		base++;
-		if (time_before(jiffies, base->clk))
-			return;
+		if (time_before(jiffies, base->clk)) {
+			base++;
+			if (time_before(jiffies, base->clk) &&
+			    !tmigr_requires_handle_remote())
+				return;
+		}
 	}
 	raise_softirq(TIMER_SOFTIRQ);
 }
@@ -0,0 +1,427 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Hierarchical expiry of the global timers of idle CPUs
+ *
+ * Timers which are not pinned to a CPU ("global" timers) do not need to
+ * wake up the CPU they are queued on. The CPUs are arranged in groups of
+ * up to TMIGR_CHILDREN_PER_GROUP, level 0 groups per NUMA node, which are
+ * again grouped up to a single top level group.
+ *
+ * When a CPU goes idle, it reports the expiry of its first global timer
+ * to its group and stops caring about its global timers. Of the CPUs
+ * (or groups) which are still active in a group, one is the migrator:
+ * it expires the global timers of the idle members of the group from its
+ * tick, on their behalf. Once the last member of a group goes idle, the
+ * group itself goes idle in its parent and reports the first global
+ * timer of all its members there. The CPU which makes the top level
+ * group idle is the last active CPU of the system; it keeps waking up
+ * for the first global timer of everyone.
+ *
+ * CPUs in nohz_full mode do not take part, as their tick is not
+ * reliable enough to act as a migrator.
+ */
+#include <linux/cpu.h>
+#include <linux/cpuhotplug.h>
+#include <linux/interrupt.h>
+#include <linux/jiffies.h>
+#include <linux/sched/nohz.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/tick.h>
+
+#include "timer_migration.h"
+
+static DEFINE_PER_CPU(struct tmigr_cpu, tmigr_cpu);
+
+enum tmigr_op {
+	TMIGR_ACTIVATE,
+	TMIGR_DEACTIVATE,
+	TMIGR_UPDATE,
+};
+
+/*
+ * Find the first global timer of the idle children of @group. Caller
+ * must hold group->lock.
+ */
+static bool tmigr_group_next(struct tmigr_group *group, unsigned long *next)
+{
+	unsigned long pending = group->pending & ~group->active;
+	bool found = false;
+	unsigned int i;
+
+	for_each_set_bit(i, &pending, TMIGR_CHILDREN_PER_GROUP) {
+		if (!found || time_before(group->child_expiry[i], *next)) {
+			*next = group->child_expiry[i];
+			found = true;
+		}
+	}
+
+	WRITE_ONCE(group->next_expiry, *next);
+	WRITE_ONCE(group->has_event, found);
+	return found;
+}
+
+/*
+ * Apply @op with the given first global timer of @tmc to its group, and
+ * propagate the change upwards as long as it changes what the parent
+ * sees: a group becoming active or idle, or the timers of an idle group.
+ * The groups stay locked bottom-up until the walk is done, so concurrent
+ * walks cannot overtake each other.
+ *
+ * A TMIGR_UPDATE is dropped if @tmc is no longer idle by the time its
+ * group is locked.
+ *
+ * Return true if the walk went past the top level group, i.e. the whole
+ * hierarchy is idle, with the first global timer of all CPUs in
+ * @pending and @expires.
+ */
+static bool tmigr_walk(struct tmigr_cpu *tmc, enum tmigr_op op,
+		       bool *pending, unsigned long *expires)
+{
+	struct tmigr_group *locked[TMIGR_MAX_LEVELS];
+	unsigned int childmask = tmc->childmask;
+	struct tmigr_group *group;
+	unsigned long flags;
+	int nr = 0;
+
+	local_irq_save(flags);
+	for (group = tmc->group; group; group = group->parent) {
+		unsigned int idx = __ffs(childmask);
+		bool was_active;
+
+		raw_spin_lock_nested(&group->lock, group->level);
+		locked[nr++] = group;
+
+		if (!group->level) {
+			/*
+			 * The CPU might have woken up and reported itself
+			 * since the migrator expired its timers.
+			 */
+			if (op == TMIGR_UPDATE && !tmc->idle)
+				break;
+			WRITE_ONCE(tmc->idle, op != TMIGR_ACTIVATE);
+			WRITE_ONCE(tmc->pending, *pending);
+			WRITE_ONCE(tmc->wakeup, *expires);
+		}
+
+		if (*pending)
+			group->pending |= childmask;
+		else
+			group->pending &= ~childmask;
+		group->child_expiry[idx] = *expires;
+
+		was_active = group->active;
+		if (op == TMIGR_ACTIVATE) {
+			group->active |= childmask;
+			if (!was_active)
+				WRITE_ONCE(group->migrator, childmask);
+		} else if (op == TMIGR_DEACTIVATE) {
+			group->active &= ~childmask;
+			if (group->migrator == childmask && group->active)
+				WRITE_ONCE(group->migrator,
+					   BIT(__ffs(group->active)));
+		}
+
+		*pending = tmigr_group_next(group, expires);
+
+		/* Nothing changes for the parent of an active group */
+		if (was_active && group->active)
+			break;
+		childmask = group->childmask;
+	}
+
+	while (nr--)
+		raw_spin_unlock(&locked[nr]->lock);
+	local_irq_restore(flags);
+
+	return !group;
+}
+
+/**
+ * tmigr_cpu_deactivate - hand the global timers of this CPU over
+ * @has_event:	Whether this CPU has a global timer
+ * @nextevt:	The first global timer of this CPU
+ *
+ * Called with interrupts disabled when the CPU is about to stop its tick
+ * in idle.
+ *
+ * Return: false if the CPU has to take care of its global timers itself.
+ * Otherwise true, and @has_event and @nextevt describe the first global
+ * timer of the whole system if this CPU was the last one to go idle, or
+ * @has_event is false.
+ */
+bool tmigr_cpu_deactivate(bool *has_event, unsigned long *nextevt)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+
+	if (!tmc->online)
+		return false;
+
+	if (!tmigr_walk(tmc, TMIGR_DEACTIVATE, has_event, nextevt))
+		*has_event = false;
+
+	return true;
+}
+
+/**
+ * tmigr_cpu_activate - take the global timers of this CPU back
+ *
+ * Called with interrupts disabled when the CPU restarts its tick, or
+ * leaves idle without having stopped it.
+ */
+void tmigr_cpu_activate(void)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	unsigned long expires = 0;
+	bool pending = false;
+
+	if (!tmc->online || !tmc->idle)
+		return;
+
+	tmigr_walk(tmc, TMIGR_ACTIVATE, &pending, &expires);
+}
+
+/* Are the global timers of @cpu handled by the hierarchy? */
+bool tmigr_cpu_is_idle(unsigned int cpu)
+{
+	return READ_ONCE(per_cpu(tmigr_cpu, cpu).idle);
+}
+
+/*
+ * Iterate over the groups this CPU is the migrator of, which it is up to
+ * the first level where it (or its group) is not.
+ */
+#define for_each_migrator_group(tmc, group, childmask)			\
+	for (group = (tmc)->group, childmask = (tmc)->childmask;	\
+	     group && READ_ONCE(group->migrator) == childmask;		\
+	     childmask = group->childmask, group = group->parent)
+
+static bool tmigr_group_due(struct tmigr_group *group, unsigned long jnow)
+{
+	return READ_ONCE(group->has_event) &&
+	       time_after_eq(jnow, READ_ONCE(group->next_expiry));
+}
+
+/**
+ * tmigr_requires_handle_remote - check for due global timers of idle CPUs
+ *
+ * Called from the tick. Return true if this CPU is the migrator of a
+ * group whose idle members have a global timer which has expired.
+ */
+bool tmigr_requires_handle_remote(void)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	unsigned long jnow = jiffies;
+	struct tmigr_group *group;
+	unsigned int childmask;
+
+	if (!tmc->online)
+		return false;
+
+	for_each_migrator_group(tmc, group, childmask) {
+		if (tmigr_group_due(group, jnow))
+			return true;
+	}
+	return false;
+}
+
+/* Expire the global timers of the idle CPUs below @group which are due */
+static void tmigr_handle_group(struct tmigr_group *group, unsigned long jnow)
+{
+	unsigned int cpu, this_cpu = smp_processor_id();
+	unsigned long expires;
+	bool pending;
+
+	for_each_cpu(cpu, group->span) {
+		struct tmigr_cpu *tmc = per_cpu_ptr(&tmigr_cpu, cpu);
+
+		if (cpu == this_cpu || !READ_ONCE(tmc->idle) ||
+		    !READ_ONCE(tmc->pending) ||
+		    time_before(jnow, READ_ONCE(tmc->wakeup)))
+			continue;
+
+		pending = timer_expire_remote(cpu, &expires);
+		tmigr_walk(tmc, TMIGR_UPDATE, &pending, &expires);
+	}
+}
+
+/**
+ * tmigr_handle_remote - expire the due global timers of idle CPUs
+ *
+ * Called from the timer softirq.
+ */
+void tmigr_handle_remote(void)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	unsigned long jnow = jiffies;
+	struct tmigr_group *group;
+	unsigned int childmask;
+
+	if (!tmc->online)
+		return;
+
+	for_each_migrator_group(tmc, group, childmask) {
+		if (tmigr_group_due(group, jnow))
+			tmigr_handle_group(group, jnow);
+	}
+}
+
+static int tmigr_cpu_online(unsigned int cpu)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	unsigned long expires = 0;
+	bool pending = false;
+
+	if (tick_nohz_full_cpu(cpu))
+		return 0;
+
+	tmc->online = true;
+	tmigr_walk(tmc, TMIGR_ACTIVATE, &pending, &expires);
+	return 0;
+}
+
+static int tmigr_cpu_offline(unsigned int cpu)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	unsigned long expires = 0;
+	bool pending = false;
+	unsigned int target;
+	bool idle;
+
+	if (!tmc->online)
+		return 0;
+
+	/* The timers of the CPU are moved away by timers_dead_cpu() */
+	idle = tmigr_walk(tmc, TMIGR_DEACTIVATE, &pending, &expires);
+	WRITE_ONCE(tmc->idle, false);
+	tmc->online = false;
+
+	/*
+	 * If this was the last active CPU, nobody is left to expire the
+	 * global timers of the idle ones. Kick another CPU out of idle; it
+	 * becomes the migrator and picks up the first global timer of the
+	 * hierarchy when it goes idle again.
+	 */
+	if (idle && pending) {
+		for_each_online_cpu(target) {
+			if (target != cpu && per_cpu(tmigr_cpu, target).online) {
+				wake_up_nohz_cpu(target);
+				break;
+			}
+		}
+	}
+	return 0;
+}
+
+static struct tmigr_group * __init tmigr_group_alloc(unsigned int level,
+						     int node)
+{
+	struct tmigr_group *group;
+
+	group = kzalloc_node(sizeof(*group), GFP_KERNEL, node);
+	if (!group)
+		return NULL;
+
+	if (!zalloc_cpumask_var_node(&group->span, GFP_KERNEL, node)) {
+		kfree(group);
+		return NULL;
+	}
+
+	raw_spin_lock_init(&group->lock);
+	group->level = level;
+	group->numa_node = node;
+	return group;
+}
+
+/* Add @tmc or @child, whichever is non-NULL, to @group */
+static void __init tmigr_group_add(struct tmigr_group *group,
+				   struct tmigr_cpu *tmc, unsigned int cpu,
+				   struct tmigr_group *child)
+{
+	unsigned int childmask = BIT(group->num_children++);
+
+	if (tmc) {
+		tmc->group = group;
+		tmc->childmask = childmask;
+		cpumask_set_cpu(cpu, group->span);
+	} else {
+		child->parent = group;
+		child->childmask = childmask;
+		cpumask_or(group->span, group->span, child->span);
+	}
+}
+
+static int __init tmigr_init(void)
+{
+	struct tmigr_group **cur, **next, *group;
+	unsigned int cpu, level = 0;
+	int i, j, nr_cur = 0, nr_next;
+	int ret;
+
+	cur = kcalloc(nr_cpu_ids, sizeof(*cur), GFP_KERNEL);
+	if (!cur)
+		return -ENOMEM;
+
+	/* Level 0: the CPUs, grouped by node */
+	for_each_possible_cpu(cpu) {
+		int node = cpu_to_node(cpu);
+
+		group = NULL;
+		for (i = nr_cur - 1; i >= 0; i--) {
+			if (cur[i]->numa_node == node) {
+				group = cur[i];
+				break;
+			}
+		}
+		if (!group || group->num_children == TMIGR_CHILDREN_PER_GROUP) {
+			group = tmigr_group_alloc(0, node);
+			if (!group)
+				goto err;
+			cur[nr_cur++] = group;
+		}
+		tmigr_group_add(group, per_cpu_ptr(&tmigr_cpu, cpu), cpu, NULL);
+	}
+
+	/* Upper levels, until a single group holds everything */
+	while (nr_cur > 1) {
+		if (++level == TMIGR_MAX_LEVELS)
+			goto err;
+
+		nr_next = DIV_ROUND_UP(nr_cur, TMIGR_CHILDREN_PER_GROUP);
+		next = kcalloc(nr_next, sizeof(*next), GFP_KERNEL);
+		if (!next)
+			goto err;
+
+		for (i = 0; i < nr_next; i++) {
+			next[i] = tmigr_group_alloc(level, NUMA_NO_NODE);
+			if (!next[i]) {
+				kfree(next);
+				goto err;
+			}
+			for (j = i * TMIGR_CHILDREN_PER_GROUP;
+			     j < min(nr_cur, (i + 1) * TMIGR_CHILDREN_PER_GROUP);
+			     j++)
+				tmigr_group_add(next[i], NULL, 0, cur[j]);
+		}
+
+		kfree(cur);
+		cur = next;
+		nr_cur = nr_next;
+	}
+	kfree(cur);
+
+	ret = cpuhp_setup_state(CPUHP_AP_ONLINE_DYN, "tmigr:online",
+				tmigr_cpu_online, tmigr_cpu_offline);
+	if (ret < 0)
+		return ret;
+
+	pr_info("Timer migration: %u hierarchy levels\n", level + 1);
+	return 0;
+
+err:
+	/* Groups already set up stay unused, no CPU is online in them */
+	kfree(cur);
+	pr_err("Timer migration setup failed\n");
+	return -ENOMEM;
+}
+early_initcall(tmigr_init);
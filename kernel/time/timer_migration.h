@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _KERNEL_TIME_MIGRATION_H
+#define _KERNEL_TIME_MIGRATION_H
+
+/* Per group capacity, must not exceed the bits of an unsigned int */
+#define TMIGR_CHILDREN_PER_GROUP	8
+#define TMIGR_MAX_LEVELS		8
+
+/**
+ * struct tmigr_group - a group in the timer migration hierarchy
+ * @lock:		Protects all fields below except @parent, @level,
+ *			@childmask and @span, which are set up at boot
+ * @parent:		Parent group, NULL for the top level group
+ * @level:		Level in the hierarchy, CPUs are children of level 0
+ * @childmask:		Bit of this group in @parent's masks
+ * @num_children:	Number of children
+ * @active:		Mask of the children which are not idle
+ * @migrator:		Bit of the child which expires the global timers of
+ *			the idle children; the last child to go idle keeps
+ *			it while the whole group is idle
+ * @pending:		Mask of the children which have a global timer
+ * @has_event:		Any idle child has a global timer
+ * @next_expiry:	First global timer of the idle children
+ * @child_expiry:	First global timer of each child
+ * @numa_node:		Node of the CPUs of a level 0 group
+ * @span:		CPUs below this group
+ */
+struct tmigr_group {
+	raw_spinlock_t		lock;
+	struct tmigr_group	*parent;
+	unsigned int		level;
+	unsigned int		childmask;
+	unsigned int		num_children;
+	unsigned int		active;
+	unsigned int		migrator;
+	unsigned int		pending;
+	bool			has_event;
+	unsigned long		next_expiry;
+	unsigned long		child_expiry[TMIGR_CHILDREN_PER_GROUP];
+	int			numa_node;
+	cpumask_var_t		span;
+};
+
+/**
+ * struct tmigr_cpu - per CPU timer migration state
+ * @group:		Level 0 group of the CPU
+ * @childmask:		Bit of the CPU in @group's masks
+ * @online:		The CPU takes part in the hierarchy
+ * @idle:		The global timers of the CPU are handed to the hierarchy
+ * @pending:		The CPU has a global timer while idle
+ * @wakeup:		First global timer of the CPU while idle
+ */
+struct tmigr_cpu {
+	struct tmigr_group	*group;
+	unsigned int		childmask;
+	bool			online;
+	bool			idle;
+	bool			pending;
+	unsigned long		wakeup;
+};
+
+#if defined(CONFIG_SMP) && defined(CONFIG_NO_HZ_COMMON)
+extern bool tmigr_cpu_deactivate(bool *has_event, unsigned long *nextevt);
+extern void tmigr_cpu_activate(void);
+extern bool tmigr_cpu_is_idle(unsigned int cpu);
+extern bool tmigr_requires_handle_remote(void);
+extern void tmigr_handle_remote(void);
+#else
+static inline bool tmigr_cpu_deactivate(bool *has_event, unsigned long *nextevt)
+{
+	return false;
+}
+static inline void tmigr_cpu_activate(void) { }
+static inline bool tmigr_cpu_is_idle(unsigned int cpu) { return false; }
+static inline bool tmigr_requires_handle_remote(void) { return false; }
+static inline void tmigr_handle_remote(void) { }
+#endif
+
+/* Provided by the timer wheel */
+extern bool timer_expire_remote(unsigned int cpu, unsigned long *nextevt);
+
+#endif
@@ -49,6 +49,8 @@
 #include <linux/uaccess.h>
 #include <linux/sched/isolation.h>
 #include <linux/nmi.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include "workqueue_internal.h"
 
@@ -103,6 +105,7 @@ enum {
 	 */
 	RESCUER_NICE_LEVEL	= MIN_NICE,
 	HIGHPRI_NICE_LEVEL	= MIN_NICE,
+	MEDPRI_NICE_LEVEL	= MIN_NICE / 2,
 
 	WQ_NAME_LEN		= 24,
 };
@@ -153,6 +156,7 @@ struct worker_pool {
 	unsigned long		watchdog_ts;	/* L: watchdog timestamp */
 
 	struct list_head	worklist;	/* L: list of pending works */
+	struct list_head	*prio_tail;	/* L: end of WQ_MEDPRI works */
 
 	int			nr_workers;	/* L: total number of workers */
 	int			nr_idle;	/* L: currently idle workers */
@@ -260,6 +264,9 @@ struct workqueue_struct {
 #endif
 #ifdef CONFIG_LOCKDEP
 	struct lockdep_map	lockdep_map;
+#endif
+#ifdef CONFIG_WQ_LATENCY_HIST
+	struct wq_latency_hist __percpu *lat_hist; /* I: latency histograms */
 #endif
 	char			name[WQ_NAME_LEN]; /* I: workqueue name */
 
@@ -909,6 +916,27 @@ struct task_struct *wq_worker_sleeping(struct task_struct *task)
 	return to_wakeup ? to_wakeup->task : NULL;
 }
 
+/**
+ * wq_worker_last_func - retrieve worker's last work function
+ * @task: Task to retrieve last work function of.
+ *
+ * Determine the last function a worker executed. This is called from
+ * the scheduler to get a worker's last known identity.
+ *
+ * CONTEXT:
+ * spin_lock_irq(rq->lock)
+ *
+ * Return:
+ * The last work function %current executed as a worker, NULL if it
+ * hasn't executed any work yet.
+ */
+work_func_t wq_worker_last_func(struct task_struct *task)
+{
+	struct worker *worker = kthread_data(task);
+
+	return worker->last_func;
+}
+
 /**
  * worker_set_flags - set worker flags and adjust nr_running accordingly
  * @worker: self
@@ -1010,6 +1038,40 @@ static struct worker *find_worker_executing_work(struct worker_pool *pool,
 	return NULL;
 }
 
+/*
+ * Work items of WQ_MEDPRI workqueues form a band at the head of
+ * pool->worklist which ends at pool->prio_tail, or pool->prio_tail points
+ * to pool->worklist itself if there are none.
+ */
+static inline bool pwq_is_medpri(struct pool_workqueue *pwq)
+{
+	return pwq->wq->flags & WQ_MEDPRI;
+}
+
+/* Return the position in pool->worklist new work items of @pwq go before */
+static struct list_head *pwq_worklist_pos(struct pool_workqueue *pwq)
+{
+	if (pwq_is_medpri(pwq))
+		return pwq->pool->prio_tail->next;
+	return &pwq->pool->worklist;
+}
+
+/* Work items of @pwq have been put before @pos from pwq_worklist_pos() */
+static void pwq_worklist_inserted(struct pool_workqueue *pwq,
+				  struct list_head *pos)
+{
+	if (pwq_is_medpri(pwq))
+		pwq->pool->prio_tail = pos->prev;
+}
+
+/* @work is about to be taken off the list it is on */
+static inline void pool_worklist_unlink(struct worker_pool *pool,
+					struct work_struct *work)
+{
+	if (pool->prio_tail == &work->entry)
+		pool->prio_tail = work->entry.prev;
+}
+
 /**
  * move_linked_works - move linked works to a list
  * @work: start of series of works to be scheduled
@@ -1030,6 +1092,7 @@ static struct worker *find_worker_executing_work(struct worker_pool *pool,
 static void move_linked_works(struct work_struct *work, struct list_head *head,
 			      struct work_struct **nextp)
 {
+	struct worker_pool *pool = get_work_pwq(work)->pool;
 	struct work_struct *n;
 
 	/*
@@ -1037,6 +1100,7 @@ static void move_linked_works(struct work_struct *work, struct list_head *head,
 	 * use NULL for list head.
 	 */
 	list_for_each_entry_safe_from(work, n, NULL, entry) {
+		pool_worklist_unlink(pool, work);
 		list_move_tail(&work->entry, head);
 		if (!(*work_data_bits(work) & WORK_STRUCT_LINKED))
 			break;
@@ -1112,11 +1176,13 @@ static void put_pwq_unlocked(struct pool_workqueue *pwq)
 static void pwq_activate_delayed_work(struct work_struct *work)
 {
 	struct pool_workqueue *pwq = get_work_pwq(work);
+	struct list_head *pos = pwq_worklist_pos(pwq);
 
 	trace_workqueue_activate_work(work);
 	if (list_empty(&pwq->pool->worklist))
 		pwq->pool->watchdog_ts = jiffies;
-	move_linked_works(work, &pwq->pool->worklist, NULL);
+	move_linked_works(work, pos, NULL);
+	pwq_worklist_inserted(pwq, pos);
 	__clear_bit(WORK_STRUCT_DELAYED_BIT, work_data_bits(work));
 	pwq->nr_active++;
 }
@@ -1259,6 +1325,7 @@ static int try_to_grab_pending(struct work_struct *work, bool is_dwork,
 		if (*work_data_bits(work) & WORK_STRUCT_DELAYED)
 			pwq_activate_delayed_work(work);
 
+		pool_worklist_unlink(pool, work);
 		list_del_init(&work->entry);
 		pwq_dec_nr_in_flight(pwq, get_work_color(work));
 
@@ -1277,6 +1344,160 @@ static int try_to_grab_pending(struct work_struct *work, bool is_dwork,
 	return -EAGAIN;
 }
 
+#ifdef CONFIG_WQ_LATENCY_HIST
+/*
+ * Bucket i counts times of 2^i up to 2^(i+1) - 1 usecs, except that the
+ * first one also counts shorter and the last one also longer times.
+ */
+#define WQ_LAT_BUCKETS		24
+
+struct wq_latency_hist {
+	u64			queued[WQ_LAT_BUCKETS];	/* queued to started */
+	u64			exec[WQ_LAT_BUCKETS];	/* started to done */
+};
+
+static unsigned int wq_lat_bucket(u64 start, u64 end)
+{
+	u64 usecs;
+
+	if ((s64)(end - start) <= 0)
+		return 0;
+
+	usecs = div_u64(end - start, NSEC_PER_USEC);
+	if (!usecs)
+		return 0;
+
+	return min_t(unsigned int, ilog2(usecs), WQ_LAT_BUCKETS - 1);
+}
+
+static inline void wq_lat_queued(struct work_struct *work)
+{
+	work->queued_at = local_clock();
+}
+
+/* @work is about to be executed, return the start time */
+static u64 wq_lat_start(struct workqueue_struct *wq, struct work_struct *work)
+{
+	u64 now = local_clock();
+
+	this_cpu_inc(wq->lat_hist->queued[wq_lat_bucket(work->queued_at, now)]);
+	return now;
+}
+
+static void wq_lat_done(struct workqueue_struct *wq, u64 start)
+{
+	this_cpu_inc(wq->lat_hist->exec[wq_lat_bucket(start, local_clock())]);
+}
+
+static int wq_lat_alloc(struct workqueue_struct *wq)
+{
+	wq->lat_hist = alloc_percpu(struct wq_latency_hist);
+	return wq->lat_hist ? 0 : -ENOMEM;
+}
+
+static void wq_lat_free(struct workqueue_struct *wq)
+{
+	free_percpu(wq->lat_hist);
+}
+
+static void wq_lat_show_one(struct seq_file *m, struct workqueue_struct *wq)
+{
+	u64 queued[WQ_LAT_BUCKETS] = { }, exec[WQ_LAT_BUCKETS] = { };
+	int cpu, i, last = -1;
+
+	for_each_possible_cpu(cpu) {
+		struct wq_latency_hist *hist = per_cpu_ptr(wq->lat_hist, cpu);
+
+		for (i = 0; i < WQ_LAT_BUCKETS; i++) {
+			queued[i] += hist->queued[i];
+			exec[i] += hist->exec[i];
+			if (queued[i] || exec[i])
+				last = max(last, i);
+		}
+	}
+
+	if (last < 0)
+		return;
+
+	seq_printf(m, "workqueue %s\n", wq->name);
+	seq_printf(m, "%20s : %-12s %-12s\n", "usecs", "queued", "executing");
+	for (i = 0; i <= last; i++)
+		seq_printf(m, "%9lu -> %-8lu : %-12llu %-12llu\n",
+			   i ? 1UL << i : 0, (2UL << i) - 1,
+			   queued[i], exec[i]);
+	seq_putc(m, '\n');
+}
+
+static int wq_lat_show(struct seq_file *m, void *v)
+{
+	struct workqueue_struct *wq;
+
+	mutex_lock(&wq_pool_mutex);
+	list_for_each_entry(wq, &workqueues, list)
+		wq_lat_show_one(m, wq);
+	mutex_unlock(&wq_pool_mutex);
+
+	return 0;
+}
+
+static int wq_lat_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, wq_lat_show, NULL);
+}
+
+static ssize_t wq_lat_write(struct file *file, const char __user *buf,
+			    size_t count, loff_t *ppos)
+{
+	struct workqueue_struct *wq;
+	int cpu;
+
+	mutex_lock(&wq_pool_mutex);
+	list_for_each_entry(wq, &workqueues, list) {
+		for_each_possible_cpu(cpu)
+			memset(per_cpu_ptr(wq->lat_hist, cpu), 0,
+			       sizeof(struct wq_latency_hist));
+	}
+	mutex_unlock(&wq_pool_mutex);
+
+	return count;
+}
+
+static const struct file_operations wq_lat_fops = {
+	.open		= wq_lat_open,
+	.read		= seq_read,
+	.write		= wq_lat_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init wq_lat_debugfs_init(void)
+{
+	struct dentry *dir;
+
+	dir = debugfs_create_dir("workqueue", NULL);
+	if (!dir)
+		return -ENOMEM;
+
+	if (!debugfs_create_file("latency", 0600, dir, NULL, &wq_lat_fops)) {
+		debugfs_remove(dir);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+late_initcall(wq_lat_debugfs_init);
+
+#else	/* CONFIG_WQ_LATENCY_HIST */
+
+static inline void wq_lat_queued(struct work_struct *work) { }
+static inline u64 wq_lat_start(struct workqueue_struct *wq,
+			       struct work_struct *work) { return 0; }
+static inline void wq_lat_done(struct workqueue_struct *wq, u64 start) { }
+static inline int wq_lat_alloc(struct workqueue_struct *wq) { return 0; }
+static inline void wq_lat_free(struct workqueue_struct *wq) { }
+
+#endif	/* CONFIG_WQ_LATENCY_HIST */
+
 /**
  * insert_work - insert a work into a pool
  * @pwq: pwq @work belongs to
@@ -1299,6 +1520,7 @@ static void insert_work(struct pool_workqueue *pwq, struct work_struct *work,
 	set_work_pwq(work, pwq, extra_flags);
 	list_add_tail(&work->entry, head);
 	get_pwq(pwq);
+	wq_lat_queued(work);
 
 	/*
 	 * Ensure either wq_worker_sleeping() sees the above
@@ -1450,16 +1672,16 @@ static void __queue_work(int cpu, struct workqueue_struct *wq,
 	if (likely(pwq->nr_active < pwq->max_active)) {
 		trace_workqueue_activate_work(work);
 		pwq->nr_active++;
-		worklist = &pwq->pool->worklist;
-		if (list_empty(worklist))
+		if (list_empty(&pwq->pool->worklist))
 			pwq->pool->watchdog_ts = jiffies;
+		worklist = pwq_worklist_pos(pwq);
+		insert_work(pwq, work, worklist, work_flags);
+		pwq_worklist_inserted(pwq, worklist);
 	} else {
 		work_flags |= WORK_STRUCT_DELAYED;
-		worklist = &pwq->delayed_works;
+		insert_work(pwq, work, &pwq->delayed_works, work_flags);
 	}
 
-	insert_work(pwq, work, worklist, work_flags);
-
 	spin_unlock(&pwq->pool->lock);
 }
 
@@ -2049,9 +2271,12 @@ __acquires(&pool->lock)
 {
 	struct pool_workqueue *pwq = get_work_pwq(work);
 	struct worker_pool *pool = worker->pool;
-	bool cpu_intensive = pwq->wq->flags & WQ_CPU_INTENSIVE;
-	int work_color;
+	struct workqueue_struct *wq = pwq->wq;
+	bool cpu_intensive = wq->flags & WQ_CPU_INTENSIVE;
+	int work_color, saved_nice = 0;
+	bool boosted = false;
 	struct worker *collision;
+	u64 start;
 #ifdef CONFIG_LOCKDEP
 	/*
 	 * It is permissible to free the struct work_struct from
@@ -2094,6 +2319,7 @@ __acquires(&pool->lock)
 	 */
 	strscpy(worker->desc, pwq->wq->name, WORKER_DESC_LEN);
 
+	pool_worklist_unlink(pool, work);
 	list_del_init(&work->entry);
 
 	/*
@@ -2125,6 +2351,15 @@ __acquires(&pool->lock)
 
 	spin_unlock_irq(&pool->lock);
 
+	/* WQ_MEDPRI work items share the pool, boost the worker while at it */
+	if ((wq->flags & WQ_MEDPRI) && task_nice(current) > MEDPRI_NICE_LEVEL) {
+		saved_nice = task_nice(current);
+		set_user_nice(current, MEDPRI_NICE_LEVEL);
+		boosted = true;
+	}
+
+	start = wq_lat_start(wq, work);
+
 	lock_map_acquire(&pwq->wq->lockdep_map);
 	lock_map_acquire(&lockdep_map);
 	/*
@@ -2159,6 +2394,11 @@ __acquires(&pool->lock)
 	lock_map_release(&lockdep_map);
 	lock_map_release(&pwq->wq->lockdep_map);
 
+	wq_lat_done(wq, start);
+
+	if (boosted)
+		set_user_nice(current, saved_nice);
+
 	if (unlikely(in_atomic() || lockdep_depth(current) > 0)) {
 		pr_err("BUG: workqueue leaked lock or atomic: %s/0x%08x/%d\n"
 		       "     last function: %pf\n",
@@ -2187,6 +2427,7 @@ __acquires(&pool->lock)
 	/* we're done with it, release */
 	hash_del(&worker->hentry);
 	worker->current_work = NULL;
+	worker->last_func = worker->current_func;
 	worker->current_func = NULL;
 	worker->current_pwq = NULL;
 	pwq_dec_nr_in_flight(pwq, work_color);
@@ -2560,6 +2801,10 @@ static void insert_wq_barrier(struct pool_workqueue *pwq,
 	debug_work_activate(&barr->work);
 	insert_work(pwq, &barr->work, head,
 		    work_color_to_flags(WORK_NO_COLOR) | linked);
+
+	/* keep the barrier in the priority band together with @target */
+	if (!worker && pwq->pool->prio_tail == &target->entry)
+		pwq->pool->prio_tail = &barr->work.entry;
 }
 
 /**
@@ -3294,6 +3539,7 @@ static int init_worker_pool(struct worker_pool *pool)
 	pool->flags |= POOL_DISASSOCIATED;
 	pool->watchdog_ts = jiffies;
 	INIT_LIST_HEAD(&pool->worklist);
+	pool->prio_tail = &pool->worklist;
 	INIT_LIST_HEAD(&pool->idle_list);
 	hash_init(pool->busy_hash);
 
@@ -3324,6 +3570,7 @@ static void rcu_free_wq(struct rcu_head *rcu)
 	else
 		free_workqueue_attrs(wq->unbound_attrs);
 
+	wq_lat_free(wq);
 	kfree(wq->rescuer);
 	kfree(wq);
 }
@@ -4069,6 +4316,10 @@ struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 	if ((flags & WQ_POWER_EFFICIENT) && wq_power_efficient)
 		flags |= WQ_UNBOUND;
 
+	/* WQ_HIGHPRI already gets a pool of its own */
+	if (WARN_ON((flags & WQ_HIGHPRI) && (flags & WQ_MEDPRI)))
+		flags &= ~WQ_MEDPRI;
+
 	/* allocate wq and format name */
 	if (flags & WQ_UNBOUND)
 		tbl_size = nr_node_ids * sizeof(wq->numa_pwq_tbl[0]);
@@ -4083,6 +4334,9 @@ struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 			goto err_free_wq;
 	}
 
+	if (wq_lat_alloc(wq))
+		goto err_free_wq;
+
 	va_start(args, lock_name);
 	vsnprintf(wq->name, sizeof(wq->name), fmt, args);
 	va_end(args);
@@ -4131,6 +4385,7 @@ struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 	return wq;
 
 err_free_wq:
+	wq_lat_free(wq);
 	free_workqueue_attrs(wq->unbound_attrs);
 	kfree(wq);
 	return NULL;
@@ -166,8 +166,33 @@ extern void __free_pages_bootmem(struct page *page, unsigned long pfn,
 extern void prep_compound_page(struct page *page, unsigned int order);
 extern void post_alloc_hook(struct page *page, unsigned int order,
 					gfp_t gfp_flags);
+extern unsigned long pageset_nr_pages(struct per_cpu_pageset *pset);
 extern int user_min_free_kbytes;
 
+/*
+ * Map an order above zero to its index in per_cpu_pageset->order_pcp, or
+ * return -1 if pages of that order are not kept on per-cpu lists.
+ */
+static inline int pcp_high_order_index(unsigned int order)
+{
+	if (order <= PAGE_ALLOC_COSTLY_ORDER)
+		return order - 1;
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	if (order == HPAGE_PMD_ORDER)
+		return PAGE_ALLOC_COSTLY_ORDER;
+#endif
+	return -1;
+}
+
+static inline unsigned int pcp_high_order(int index)
+{
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	if (index == PAGE_ALLOC_COSTLY_ORDER)
+		return HPAGE_PMD_ORDER;
+#endif
+	return index + 1;
+}
+
 #if defined CONFIG_COMPACTION || defined CONFIG_CMA
 
 /*
@@ -284,6 +309,13 @@ static inline bool is_data_mapping(vm_flags_t flags)
 void __vma_link_list(struct mm_struct *mm, struct vm_area_struct *vma,
 		struct vm_area_struct *prev, struct rb_node *rb_parent);
 
+/* mm/mmap.c */
+extern void put_vma(struct vm_area_struct *vma);
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+extern struct vm_area_struct *get_vma(struct mm_struct *mm,
+				      unsigned long addr);
+#endif
+
 #ifdef CONFIG_MMU
 extern long populate_vma_page_range(struct vm_area_struct *vma,
 		unsigned long start, unsigned long end, int *nonblocking);
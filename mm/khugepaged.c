@@ -18,6 +18,7 @@
 #include <linux/page_idle.h>
 #include <linux/swapops.h>
 #include <linux/shmem_fs.h>
+#include <linux/workqueue.h>
 
 #include <asm/tlb.h>
 #include <asm/pgalloc.h>
@@ -48,6 +49,7 @@ enum scan_result {
 	SCAN_CGROUP_CHARGE_FAIL,
 	SCAN_EXCEED_SWAP_PTE,
 	SCAN_TRUNCATED,
+	SCAN_PAGE_HAS_PRIVATE,
 };
 
 #define CREATE_TRACE_POINTS
@@ -106,6 +108,45 @@ static struct khugepaged_scan khugepaged_scan = {
 	.mm_head = LIST_HEAD_INIT(khugepaged_scan.mm_head),
 };
 
+/**
+ * struct collapse_control - per-scanner collapse state
+ * @node_load: how many of the scanned pages sit on each node
+ *
+ * khugepaged itself uses khugepaged_collapse_control, every queued collapse
+ * request carries its own so the collapse workers can run in parallel.
+ */
+struct collapse_control {
+	int node_load[MAX_NUMNODES];
+};
+
+static struct collapse_control khugepaged_collapse_control;
+
+/**
+ * struct khugepaged_request - MADV_COLLAPSE_ASYNC request
+ * @node: link in khugepaged_requests while the request is pending
+ * @work: collapse work, run on khugepaged_collapse_wq
+ * @mm: the mm to collapse in, pinned with mmgrab()
+ * @start: first address of the range, HPAGE_PMD_SIZE aligned
+ * @end: end of the range, HPAGE_PMD_SIZE aligned
+ * @cc: collapse state of the worker servicing this request
+ *
+ * There is at most one pending request per mm: further MADV_COLLAPSE_ASYNC
+ * calls widen its range until a worker picks it up.
+ */
+struct khugepaged_request {
+	struct list_head node;
+	struct work_struct work;
+	struct mm_struct *mm;
+	unsigned long start;
+	unsigned long end;
+	struct collapse_control cc;
+};
+
+/* pending requests, protected by khugepaged_mm_lock */
+static LIST_HEAD(khugepaged_requests);
+static struct workqueue_struct *khugepaged_collapse_wq;
+static unsigned int khugepaged_collapse_workers __read_mostly = 4;
+
 #ifdef CONFIG_SYSFS
 static ssize_t scan_sleep_millisecs_show(struct kobject *kobj,
 					 struct kobj_attribute *attr,
@@ -283,6 +324,38 @@ static struct kobj_attribute khugepaged_max_ptes_swap_attr =
 	__ATTR(max_ptes_swap, 0644, khugepaged_max_ptes_swap_show,
 	       khugepaged_max_ptes_swap_store);
 
+/*
+ * collapse_workers caps how many MADV_COLLAPSE_ASYNC requests are serviced
+ * in parallel, independently of the khugepaged thread.
+ */
+static ssize_t collapse_workers_show(struct kobject *kobj,
+				     struct kobj_attribute *attr,
+				     char *buf)
+{
+	return sprintf(buf, "%u\n", khugepaged_collapse_workers);
+}
+
+static ssize_t collapse_workers_store(struct kobject *kobj,
+				      struct kobj_attribute *attr,
+				      const char *buf, size_t count)
+{
+	int err;
+	unsigned int workers;
+
+	err = kstrtouint(buf, 10, &workers);
+	if (err || !workers || workers > WQ_MAX_ACTIVE)
+		return -EINVAL;
+
+	khugepaged_collapse_workers = workers;
+	if (khugepaged_collapse_wq)
+		workqueue_set_max_active(khugepaged_collapse_wq, workers);
+
+	return count;
+}
+static struct kobj_attribute collapse_workers_attr =
+	__ATTR(collapse_workers, 0644, collapse_workers_show,
+	       collapse_workers_store);
+
 static struct attribute *khugepaged_attr[] = {
 	&khugepaged_defrag_attr.attr,
 	&khugepaged_max_ptes_none_attr.attr,
@@ -292,6 +365,7 @@ static struct attribute *khugepaged_attr[] = {
 	&scan_sleep_millisecs_attr.attr,
 	&alloc_sleep_millisecs_attr.attr,
 	&khugepaged_max_ptes_swap_attr.attr,
+	&collapse_workers_attr.attr,
 	NULL,
 };
 
@@ -350,6 +424,14 @@ int __init khugepaged_init(void)
 	if (!mm_slot_cache)
 		return -ENOMEM;
 
+	khugepaged_collapse_wq = alloc_workqueue("khugepaged_collapse",
+						 WQ_UNBOUND | WQ_FREEZABLE,
+						 khugepaged_collapse_workers);
+	if (!khugepaged_collapse_wq) {
+		kmem_cache_destroy(mm_slot_cache);
+		return -ENOMEM;
+	}
+
 	khugepaged_pages_to_scan = HPAGE_PMD_NR * 8;
 	khugepaged_max_ptes_none = HPAGE_PMD_NR - 1;
 	khugepaged_max_ptes_swap = HPAGE_PMD_NR / 8;
@@ -359,6 +441,7 @@ int __init khugepaged_init(void)
 
 void __init khugepaged_destroy(void)
 {
+	destroy_workqueue(khugepaged_collapse_wq);
 	kmem_cache_destroy(mm_slot_cache);
 }
 
@@ -397,6 +480,24 @@ static inline int khugepaged_test_exit(struct mm_struct *mm)
 	return atomic_read(&mm->mm_users) == 0;
 }
 
+/*
+ * Page cache of regular files that nobody has open for write can be
+ * collapsed. The huge pages are never written to: opening the file for write
+ * drops them in do_dentry_open(), and truncate_pagecache() drops the one
+ * straddling the new size.
+ */
+static bool file_thp_enabled(struct vm_area_struct *vma)
+{
+	struct inode *inode;
+
+	if (!IS_ENABLED(CONFIG_READ_ONLY_THP_FOR_FS) || !vma->vm_file ||
+	    vma_is_dax(vma))
+		return false;
+
+	inode = file_inode(vma->vm_file);
+	return S_ISREG(inode->i_mode) && !inode_is_open_for_write(inode);
+}
+
 static bool hugepage_vma_check(struct vm_area_struct *vma,
 			       unsigned long vm_flags)
 {
@@ -404,7 +505,7 @@ static bool hugepage_vma_check(struct vm_area_struct *vma,
 	    (vm_flags & VM_NOHUGEPAGE) ||
 	    test_bit(MMF_DISABLE_THP, &vma->vm_mm->flags))
 		return false;
-	if (shmem_file(vma->vm_file)) {
+	if (shmem_file(vma->vm_file) || file_thp_enabled(vma)) {
 		if (!IS_ENABLED(CONFIG_TRANSPARENT_HUGE_PAGECACHE))
 			return false;
 		return IS_ALIGNED((vma->vm_start >> PAGE_SHIFT) - vma->vm_pgoff,
@@ -456,8 +557,9 @@ int khugepaged_enter_vma_merge(struct vm_area_struct *vma,
 	unsigned long hstart, hend;
 
 	/*
-	 * khugepaged does not yet work on non-shmem files or special
-	 * mappings. And file-private shmem THP is not supported.
+	 * khugepaged does not yet work on special mappings, or on files
+	 * other than shmem and read-only regular files. And file-private
+	 * shmem THP is not supported.
 	 */
 	if (!hugepage_vma_check(vma, vm_flags))
 		return 0;
@@ -690,9 +792,7 @@ static void khugepaged_alloc_sleep(void)
 	remove_wait_queue(&khugepaged_wait, &wait);
 }
 
-static int khugepaged_node_load[MAX_NUMNODES];
-
-static bool khugepaged_scan_abort(int nid)
+static bool khugepaged_scan_abort(int nid, struct collapse_control *cc)
 {
 	int i;
 
@@ -704,11 +804,11 @@ static bool khugepaged_scan_abort(int nid)
 		return false;
 
 	/* If there is a count for this node already, it must be acceptable */
-	if (khugepaged_node_load[nid])
+	if (cc->node_load[nid])
 		return false;
 
 	for (i = 0; i < MAX_NUMNODES; i++) {
-		if (!khugepaged_node_load[i])
+		if (!cc->node_load[i])
 			continue;
 		if (node_distance(nid, i) > RECLAIM_DISTANCE)
 			return true;
@@ -723,15 +823,15 @@ static inline gfp_t alloc_hugepage_khugepaged_gfpmask(void)
 }
 
 #ifdef CONFIG_NUMA
-static int khugepaged_find_target_node(void)
+static int khugepaged_find_target_node(struct collapse_control *cc)
 {
 	static int last_khugepaged_target_node = NUMA_NO_NODE;
 	int nid, target_node = 0, max_value = 0;
 
 	/* find first node with max normal pages hit */
 	for (nid = 0; nid < MAX_NUMNODES; nid++)
-		if (khugepaged_node_load[nid] > max_value) {
-			max_value = khugepaged_node_load[nid];
+		if (cc->node_load[nid] > max_value) {
+			max_value = cc->node_load[nid];
 			target_node = nid;
 		}
 
@@ -739,7 +839,7 @@ static int khugepaged_find_target_node(void)
 	if (target_node <= last_khugepaged_target_node)
 		for (nid = last_khugepaged_target_node + 1; nid < MAX_NUMNODES;
 				nid++)
-			if (max_value == khugepaged_node_load[nid]) {
+			if (max_value == cc->node_load[nid]) {
 				target_node = nid;
 				break;
 			}
@@ -782,7 +882,7 @@ khugepaged_alloc_page(struct page **hpage, gfp_t gfp, int node)
 	return *hpage;
 }
 #else
-static int khugepaged_find_target_node(void)
+static int khugepaged_find_target_node(struct collapse_control *cc)
 {
 	return 0;
 }
@@ -931,6 +1031,14 @@ static bool __collapse_huge_page_swapin(struct mm_struct *mm,
 	return true;
 }
 
+static void khugepaged_account_collapse(struct mm_struct *mm, int result)
+{
+	if (result == SCAN_SUCCEED)
+		atomic_long_inc(&mm->thp_collapsed);
+	else
+		atomic_long_inc(&mm->thp_collapse_failed);
+}
+
 static void collapse_huge_page(struct mm_struct *mm,
 				   unsigned long address,
 				   struct page **hpage,
@@ -1020,6 +1128,8 @@ static void collapse_huge_page(struct mm_struct *mm,
 	mmun_start = address;
 	mmun_end   = address + HPAGE_PMD_SIZE;
 	mmu_notifier_invalidate_range_start(mm, mmun_start, mmun_end);
+	/* Speculative faults must not walk into the page table we remove */
+	vm_write_begin(vma);
 	pmd_ptl = pmd_lock(mm, pmd); /* probably unnecessary */
 	/*
 	 * After this gup_fast can't run anymore. This also removes
@@ -1046,6 +1156,7 @@ static void collapse_huge_page(struct mm_struct *mm,
 		 */
 		pmd_populate(mm, pmd, pmd_pgtable(_pmd));
 		spin_unlock(pmd_ptl);
+		vm_write_end(vma);
 		anon_vma_unlock_write(vma->anon_vma);
 		result = SCAN_FAIL;
 		goto out;
@@ -1081,6 +1192,7 @@ static void collapse_huge_page(struct mm_struct *mm,
 	set_pmd_at(mm, address, pmd, _pmd);
 	update_mmu_cache_pmd(vma, address, pmd);
 	spin_unlock(pmd_ptl);
+	vm_write_end(vma);
 
 	*hpage = NULL;
 
@@ -1089,6 +1201,7 @@ static void collapse_huge_page(struct mm_struct *mm,
 out_up_write:
 	up_write(&mm->mmap_sem);
 out_nolock:
+	khugepaged_account_collapse(mm, result);
 	trace_mm_collapse_huge_page(mm, isolated, result);
 	return;
 out:
@@ -1099,7 +1212,8 @@ static void collapse_huge_page(struct mm_struct *mm,
 static int khugepaged_scan_pmd(struct mm_struct *mm,
 			       struct vm_area_struct *vma,
 			       unsigned long address,
-			       struct page **hpage)
+			       struct page **hpage,
+			       struct collapse_control *cc)
 {
 	pmd_t *pmd;
 	pte_t *pte, *_pte;
@@ -1118,7 +1232,7 @@ static int khugepaged_scan_pmd(struct mm_struct *mm,
 		goto out;
 	}
 
-	memset(khugepaged_node_load, 0, sizeof(khugepaged_node_load));
+	memset(cc->node_load, 0, sizeof(cc->node_load));
 	pte = pte_offset_map_lock(mm, pmd, address, &ptl);
 	for (_address = address, _pte = pte; _pte < pte+HPAGE_PMD_NR;
 	     _pte++, _address += PAGE_SIZE) {
@@ -1161,16 +1275,16 @@ static int khugepaged_scan_pmd(struct mm_struct *mm,
 
 		/*
 		 * Record which node the original page is from and save this
-		 * information to khugepaged_node_load[].
+		 * information to cc->node_load[].
 		 * Khupaged will allocate hugepage from the node has the max
 		 * hit record.
 		 */
 		node = page_to_nid(page);
-		if (khugepaged_scan_abort(node)) {
+		if (khugepaged_scan_abort(node, cc)) {
 			result = SCAN_SCAN_ABORT;
 			goto out_unmap;
 		}
-		khugepaged_node_load[node]++;
+		cc->node_load[node]++;
 		if (!PageLRU(page)) {
 			result = SCAN_PAGE_LRU;
 			goto out_unmap;
@@ -1211,7 +1325,7 @@ static int khugepaged_scan_pmd(struct mm_struct *mm,
 out_unmap:
 	pte_unmap_unlock(pte, ptl);
 	if (ret) {
-		node = khugepaged_find_target_node();
+		node = khugepaged_find_target_node(cc);
 		/* collapse_huge_page will return with the mmap_sem released */
 		collapse_huge_page(mm, address, hpage, node, referenced);
 	}
@@ -1271,10 +1385,14 @@ static void retract_page_tables(struct address_space *mapping, pgoff_t pgoff)
 		 * the system too much.
 		 */
 		if (down_write_trylock(&vma->vm_mm->mmap_sem)) {
-			spinlock_t *ptl = pmd_lock(vma->vm_mm, pmd);
+			spinlock_t *ptl;
+
+			vm_write_begin(vma);
+			ptl = pmd_lock(vma->vm_mm, pmd);
 			/* assume page table is clear */
 			_pmd = pmdp_collapse_flush(vma, addr, pmd);
 			spin_unlock(ptl);
+			vm_write_end(vma);
 			up_write(&vma->vm_mm->mmap_sem);
 			mm_dec_nr_ptes(vma->vm_mm);
 			pte_free(vma->vm_mm, pmd_pgtable(_pmd));
@@ -1284,13 +1402,14 @@ static void retract_page_tables(struct address_space *mapping, pgoff_t pgoff)
 }
 
 /**
- * collapse_shmem - collapse small tmpfs/shmem pages into huge one.
+ * collapse_file - collapse small tmpfs/shmem or read-only file pages into
+ * huge one.
  *
  * Basic scheme is simple, details are more complex:
  *  - allocate and freeze a new huge page;
  *  - scan over radix tree replacing old pages the new one
  *    + swap in pages if necessary;
- *    + fill in gaps;
+ *    + fill in gaps (shmem only, other files must be fully cached);
  *    + keep old pages around in case if rollback is required;
  *  - if replacing succeed:
  *    + copy data over;
@@ -1301,10 +1420,12 @@ static void retract_page_tables(struct address_space *mapping, pgoff_t pgoff)
  *    + restore gaps in the radix-tree;
  *    + free huge page;
  */
-static void collapse_shmem(struct mm_struct *mm,
-		struct address_space *mapping, pgoff_t start,
+static void collapse_file(struct mm_struct *mm,
+		struct file *file, pgoff_t start,
 		struct page **hpage, int node)
 {
+	struct address_space *mapping = file->f_mapping;
+	bool is_shmem = shmem_file(file);
 	gfp_t gfp;
 	struct page *page, *new_page, *tmp;
 	struct mem_cgroup *memcg;
@@ -1332,7 +1453,8 @@ static void collapse_shmem(struct mm_struct *mm,
 
 	new_page->index = start;
 	new_page->mapping = mapping;
-	__SetPageSwapBacked(new_page);
+	if (is_shmem)
+		__SetPageSwapBacked(new_page);
 	__SetPageLocked(new_page);
 	BUG_ON(!page_ref_freeze(new_page, 1));
 
@@ -1352,8 +1474,9 @@ static void collapse_shmem(struct mm_struct *mm,
 		/*
 		 * Handle holes in the radix tree: charge it from shmem and
 		 * insert relevant subpage of new_page into the radix-tree.
+		 * Other files have no way to fill them in.
 		 */
-		if (n && !shmem_charge(mapping->host, n)) {
+		if (n && (!is_shmem || !shmem_charge(mapping->host, n))) {
 			result = SCAN_FAIL;
 			break;
 		}
@@ -1369,7 +1492,33 @@ static void collapse_shmem(struct mm_struct *mm,
 
 		page = radix_tree_deref_slot_protected(slot,
 				&mapping->i_pages.xa_lock);
-		if (radix_tree_exceptional_entry(page) || !PageUptodate(page)) {
+		if (!is_shmem) {
+			/* shadow entries and pages under I/O are not cached */
+			if (radix_tree_exceptional_entry(page) ||
+			    !PageUptodate(page)) {
+				result = SCAN_FAIL;
+				break;
+			}
+			if (!trylock_page(page)) {
+				result = SCAN_PAGE_LOCK;
+				break;
+			}
+			get_page(page);
+			/*
+			 * Nobody may write to the file, so a dirty page is one
+			 * that was not written back since the writer went away.
+			 * Kick off writeback, and retry on the next pass.
+			 */
+			if (PageDirty(page) || PageWriteback(page)) {
+				xa_unlock_irq(&mapping->i_pages);
+				unlock_page(page);
+				put_page(page);
+				filemap_flush(mapping);
+				result = SCAN_FAIL;
+				goto tree_unlocked;
+			}
+		} else if (radix_tree_exceptional_entry(page) ||
+			   !PageUptodate(page)) {
 			xa_unlock_irq(&mapping->i_pages);
 			/* swap in or instantiate fallocated page */
 			if (shmem_getpage(mapping->host, index, &page,
@@ -1399,6 +1548,13 @@ static void collapse_shmem(struct mm_struct *mm,
 		}
 		xa_unlock_irq(&mapping->i_pages);
 
+		/* buffer heads pin the page, and would go stale anyway */
+		if (page_has_private(page) &&
+		    !try_to_release_page(page, GFP_KERNEL)) {
+			result = SCAN_PAGE_HAS_PRIVATE;
+			goto out_isolate_failed;
+		}
+
 		if (isolate_lru_page(page)) {
 			result = SCAN_DEL_PAGE_LRU;
 			goto out_isolate_failed;
@@ -1459,7 +1615,7 @@ static void collapse_shmem(struct mm_struct *mm,
 	if (result == SCAN_SUCCEED && index < end) {
 		int n = end - index;
 
-		if (!shmem_charge(mapping->host, n)) {
+		if (!is_shmem || !shmem_charge(mapping->host, n)) {
 			result = SCAN_FAIL;
 			goto tree_locked;
 		}
@@ -1471,6 +1627,20 @@ static void collapse_shmem(struct mm_struct *mm,
 		nr_none += n;
 	}
 
+	if (result == SCAN_SUCCEED && !is_shmem) {
+		/*
+		 * Pairs with smp_mb() in do_dentry_open(): either the opener
+		 * sees the THP and drops the page cache, or we see that the
+		 * file was opened for write and back off.
+		 */
+		filemap_nr_thps_inc(mapping);
+		smp_mb();
+		if (inode_is_open_for_write(mapping->host)) {
+			filemap_nr_thps_dec(mapping);
+			result = SCAN_FAIL;
+		}
+	}
+
 tree_locked:
 	xa_unlock_irq(&mapping->i_pages);
 tree_unlocked:
@@ -1496,7 +1666,10 @@ static void collapse_shmem(struct mm_struct *mm,
 		}
 
 		local_irq_save(flags);
-		__inc_node_page_state(new_page, NR_SHMEM_THPS);
+		if (is_shmem)
+			__inc_node_page_state(new_page, NR_SHMEM_THPS);
+		else
+			__inc_node_page_state(new_page, NR_FILE_THPS);
 		if (nr_none) {
 			__mod_node_page_state(zone->zone_pgdat, NR_FILE_PAGES, nr_none);
 			__mod_node_page_state(zone->zone_pgdat, NR_SHMEM, nr_none);
@@ -1510,11 +1683,15 @@ static void collapse_shmem(struct mm_struct *mm,
 		retract_page_tables(mapping, start);
 
 		/* Everything is ready, let's unfreeze the new_page */
-		set_page_dirty(new_page);
+		if (is_shmem)
+			set_page_dirty(new_page);
 		SetPageUptodate(new_page);
 		page_ref_unfreeze(new_page, HPAGE_PMD_NR);
 		mem_cgroup_commit_charge(new_page, memcg, false, true);
-		lru_cache_add_anon(new_page);
+		if (is_shmem)
+			lru_cache_add_anon(new_page);
+		else
+			lru_cache_add_file(new_page);
 		unlock_page(new_page);
 
 		*hpage = NULL;
@@ -1522,7 +1699,8 @@ static void collapse_shmem(struct mm_struct *mm,
 		khugepaged_pages_collapsed++;
 	} else {
 		/* Something went wrong: rollback changes to the radix-tree */
-		shmem_uncharge(mapping->host, nr_none);
+		if (nr_none)
+			shmem_uncharge(mapping->host, nr_none);
 		xa_lock_irq(&mapping->i_pages);
 		radix_tree_for_each_slot(slot, &mapping->i_pages, &iter, start) {
 			if (iter.index >= end)
@@ -1561,13 +1739,16 @@ static void collapse_shmem(struct mm_struct *mm,
 	}
 out:
 	VM_BUG_ON(!list_empty(&pagelist));
+	khugepaged_account_collapse(mm, result);
 	/* TODO: tracepoints */
 }
 
-static void khugepaged_scan_shmem(struct mm_struct *mm,
-		struct address_space *mapping,
-		pgoff_t start, struct page **hpage)
+static void khugepaged_scan_file(struct mm_struct *mm,
+		struct file *file, pgoff_t start, struct page **hpage,
+		struct collapse_control *cc)
 {
+	struct address_space *mapping = file->f_mapping;
+	bool is_shmem = shmem_file(file);
 	struct page *page = NULL;
 	struct radix_tree_iter iter;
 	void **slot;
@@ -1577,7 +1758,7 @@ static void khugepaged_scan_shmem(struct mm_struct *mm,
 
 	present = 0;
 	swap = 0;
-	memset(khugepaged_node_load, 0, sizeof(khugepaged_node_load));
+	memset(cc->node_load, 0, sizeof(cc->node_load));
 	rcu_read_lock();
 	radix_tree_for_each_slot(slot, &mapping->i_pages, &iter, start) {
 		if (iter.index >= start + HPAGE_PMD_NR)
@@ -1590,6 +1771,9 @@ static void khugepaged_scan_shmem(struct mm_struct *mm,
 		}
 
 		if (radix_tree_exception(page)) {
+			/* a shadow entry of a regular file is just a hole */
+			if (!is_shmem)
+				continue;
 			if (++swap > khugepaged_max_ptes_swap) {
 				result = SCAN_EXCEED_SWAP_PTE;
 				break;
@@ -1603,18 +1787,19 @@ static void khugepaged_scan_shmem(struct mm_struct *mm,
 		}
 
 		node = page_to_nid(page);
-		if (khugepaged_scan_abort(node)) {
+		if (khugepaged_scan_abort(node, cc)) {
 			result = SCAN_SCAN_ABORT;
 			break;
 		}
-		khugepaged_node_load[node]++;
+		cc->node_load[node]++;
 
 		if (!PageLRU(page)) {
 			result = SCAN_PAGE_LRU;
 			break;
 		}
 
-		if (page_count(page) != 1 + page_mapcount(page)) {
+		if (page_count(page) !=
+		    1 + page_mapcount(page) + page_has_private(page)) {
 			result = SCAN_PAGE_COUNT;
 			break;
 		}
@@ -1635,20 +1820,22 @@ static void khugepaged_scan_shmem(struct mm_struct *mm,
 	rcu_read_unlock();
 
 	if (result == SCAN_SUCCEED) {
-		if (present < HPAGE_PMD_NR - khugepaged_max_ptes_none) {
+		/* only shmem can fill in the holes */
+		if (present < HPAGE_PMD_NR -
+			      (is_shmem ? khugepaged_max_ptes_none : 0)) {
 			result = SCAN_EXCEED_NONE_PTE;
 		} else {
-			node = khugepaged_find_target_node();
-			collapse_shmem(mm, mapping, start, hpage, node);
+			node = khugepaged_find_target_node(cc);
+			collapse_file(mm, file, start, hpage, node);
 		}
 	}
 
 	/* TODO: tracepoints */
 }
 #else
-static void khugepaged_scan_shmem(struct mm_struct *mm,
-		struct address_space *mapping,
-		pgoff_t start, struct page **hpage)
+static void khugepaged_scan_file(struct mm_struct *mm,
+		struct file *file, pgoff_t start, struct page **hpage,
+		struct collapse_control *cc)
 {
 	BUILD_BUG();
 }
@@ -1721,22 +1908,25 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 			VM_BUG_ON(khugepaged_scan.address < hstart ||
 				  khugepaged_scan.address + HPAGE_PMD_SIZE >
 				  hend);
-			if (shmem_file(vma->vm_file)) {
+			if (IS_ENABLED(CONFIG_SHMEM) && vma->vm_file) {
 				struct file *file;
 				pgoff_t pgoff = linear_page_index(vma,
 						khugepaged_scan.address);
-				if (!shmem_huge_enabled(vma))
+				if (shmem_file(vma->vm_file)
+				    && !shmem_huge_enabled(vma))
 					goto skip;
 				file = get_file(vma->vm_file);
 				up_read(&mm->mmap_sem);
 				ret = 1;
-				khugepaged_scan_shmem(mm, file->f_mapping,
-						pgoff, hpage);
+				khugepaged_scan_file(mm, file,
+						pgoff, hpage,
+						&khugepaged_collapse_control);
 				fput(file);
 			} else {
 				ret = khugepaged_scan_pmd(mm, vma,
 						khugepaged_scan.address,
-						hpage);
+						hpage,
+						&khugepaged_collapse_control);
 			}
 			/* move to next address */
 			khugepaged_scan.address += HPAGE_PMD_SIZE;
@@ -1780,6 +1970,129 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 	return progress;
 }
 
+static void khugepaged_collapse_range(struct khugepaged_request *req,
+				      unsigned long address, unsigned long end)
+{
+	struct mm_struct *mm = req->mm;
+	struct page *hpage = NULL;
+	bool wait = false;
+
+	while (address < end) {
+		struct vm_area_struct *vma;
+		unsigned long hstart, hend;
+
+		cond_resched();
+		if (unlikely(!khugepaged_enabled()))
+			break;
+		if (!khugepaged_prealloc_page(&hpage, &wait))
+			break;
+
+		down_read(&mm->mmap_sem);
+		vma = find_vma(mm, address);
+		if (!vma || vma->vm_start >= end) {
+			up_read(&mm->mmap_sem);
+			break;
+		}
+		hstart = (vma->vm_start + ~HPAGE_PMD_MASK) & HPAGE_PMD_MASK;
+		hend = min(vma->vm_end & HPAGE_PMD_MASK, end);
+		address = max(address, hstart);
+		if (!hugepage_vma_check(vma, vma->vm_flags) || address >= hend ||
+		    (shmem_file(vma->vm_file) && !shmem_huge_enabled(vma))) {
+			address = vma->vm_end;
+			up_read(&mm->mmap_sem);
+			continue;
+		}
+
+		if (IS_ENABLED(CONFIG_SHMEM) && vma->vm_file) {
+			struct file *file = get_file(vma->vm_file);
+			pgoff_t pgoff = linear_page_index(vma, address);
+
+			up_read(&mm->mmap_sem);
+			khugepaged_scan_file(mm, file, pgoff, &hpage,
+					     &req->cc);
+			fput(file);
+		} else if (!khugepaged_scan_pmd(mm, vma, address, &hpage,
+						&req->cc)) {
+			/* no collapse, so mmap_sem is still held */
+			up_read(&mm->mmap_sem);
+		}
+		address += HPAGE_PMD_SIZE;
+	}
+
+	if (!IS_ERR_OR_NULL(hpage))
+		put_page(hpage);
+}
+
+static void khugepaged_collapse_work(struct work_struct *work)
+{
+	struct khugepaged_request *req;
+	unsigned long start, end;
+
+	req = container_of(work, struct khugepaged_request, work);
+
+	spin_lock(&khugepaged_mm_lock);
+	list_del(&req->node);
+	start = req->start;
+	end = req->end;
+	spin_unlock(&khugepaged_mm_lock);
+
+	/* the address space is only worked on while its users keep it alive */
+	if (mmget_not_zero(req->mm)) {
+		khugepaged_collapse_range(req, start, end);
+		mmput(req->mm);
+	}
+
+	mmdrop(req->mm);
+	kfree(req);
+}
+
+/*
+ * Queue [start, end) of the vma for collapse. The range is serviced by the
+ * collapse workers as soon as one is free, ahead of the round-robin scan done
+ * by khugepaged, so a process does not have to wait for khugepaged to come
+ * around to its mm. Ranges khugepaged would not collapse are ignored.
+ */
+int khugepaged_request_collapse(struct vm_area_struct *vma,
+				unsigned long start, unsigned long end)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	struct khugepaged_request *req, *new;
+
+	if (!khugepaged_enabled() || !hugepage_vma_check(vma, vma->vm_flags))
+		return 0;
+
+	start = ALIGN(start, HPAGE_PMD_SIZE);
+	end &= HPAGE_PMD_MASK;
+	if (start >= end)
+		return 0;
+
+	new = kmalloc(sizeof(*new), GFP_KERNEL);
+	if (!new)
+		return -ENOMEM;
+
+	spin_lock(&khugepaged_mm_lock);
+	list_for_each_entry(req, &khugepaged_requests, node) {
+		if (req->mm == mm) {
+			req->start = min(req->start, start);
+			req->end = max(req->end, end);
+			spin_unlock(&khugepaged_mm_lock);
+			kfree(new);
+			return 0;
+		}
+	}
+
+	new->mm = mm;
+	new->start = start;
+	new->end = end;
+	INIT_WORK(&new->work, khugepaged_collapse_work);
+	mmgrab(mm);
+	list_add_tail(&new->node, &khugepaged_requests);
+	queue_work(khugepaged_collapse_wq, &new->work);
+	spin_unlock(&khugepaged_mm_lock);
+
+	return 0;
+}
+
 static int khugepaged_has_work(void)
 {
 	return !list_empty(&khugepaged_scan.mm_head) &&
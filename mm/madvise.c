@@ -16,6 +16,7 @@
 #include <linux/falloc.h>
 #include <linux/sched.h>
 #include <linux/ksm.h>
+#include <linux/khugepaged.h>
 #include <linux/fs.h>
 #include <linux/file.h>
 #include <linux/blkdev.h>
@@ -41,6 +42,7 @@ static int madvise_need_mmap_write(int behavior)
 	case MADV_WILLNEED:
 	case MADV_DONTNEED:
 	case MADV_FREE:
+	case MADV_COLLAPSE_ASYNC:
 		return 0;
 	default:
 		/* be safe, default to 1. list exceptions explicitly */
@@ -184,7 +186,9 @@ static long madvise_behavior(struct vm_area_struct *vma,
 	/*
 	 * vm_flags is protected by the mmap_sem held in write mode.
 	 */
+	vm_write_begin(vma);
 	vma->vm_flags = new_flags;
+	vm_write_end(vma);
 out:
 	return error;
 }
@@ -684,6 +688,20 @@ static int madvise_inject_error(int behavior,
 }
 #endif
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*
+ * Hand the range to khugepaged's collapse workers. The vma is left alone, the
+ * collapse happens asynchronously and only where khugepaged would collapse.
+ */
+static long madvise_collapse(struct vm_area_struct *vma,
+			     struct vm_area_struct **prev,
+			     unsigned long start, unsigned long end)
+{
+	*prev = vma;
+	return khugepaged_request_collapse(vma, start, end);
+}
+#endif
+
 static long
 madvise_vma(struct vm_area_struct *vma, struct vm_area_struct **prev,
 		unsigned long start, unsigned long end, int behavior)
@@ -696,6 +714,10 @@ madvise_vma(struct vm_area_struct *vma, struct vm_area_struct **prev,
 	case MADV_FREE:
 	case MADV_DONTNEED:
 		return madvise_dontneed_free(vma, prev, start, end, behavior);
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	case MADV_COLLAPSE_ASYNC:
+		return madvise_collapse(vma, prev, start, end);
+#endif
 	default:
 		return madvise_behavior(vma, prev, start, end, behavior);
 	}
@@ -721,6 +743,7 @@ madvise_behavior_valid(int behavior)
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 	case MADV_HUGEPAGE:
 	case MADV_NOHUGEPAGE:
+	case MADV_COLLAPSE_ASYNC:
 #endif
 	case MADV_DONTDUMP:
 	case MADV_DODUMP:
@@ -781,6 +804,10 @@ madvise_behavior_valid(int behavior)
  *  MADV_NOHUGEPAGE - mark the given range as not worth being backed by
  *		transparent huge pages so the existing pages will not be
  *		coalesced into THP and new pages will not be allocated as THP.
+ *  MADV_COLLAPSE_ASYNC - ask khugepaged to collapse the given range into
+ *		transparent huge pages now, ahead of its regular scan. The
+ *		call returns once the range is queued; the collapse follows
+ *		the same rules as khugepaged's.
  *  MADV_DONTDUMP - the application wants to prevent pages in the given range
  *		from being included in its core dump.
  *  MADV_DODUMP - cancel MADV_DONTDUMP: no longer exclude from core dump.
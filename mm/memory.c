@@ -3112,10 +3112,74 @@ vm_fault_t do_swap_page(struct vm_fault *vmf)
 	return ret;
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+static inline bool vma_has_changed(struct vm_fault *vmf)
+{
+	return read_seqcount_retry(&vmf->vma->vm_sequence, vmf->sequence);
+}
+
+/*
+ * Map and lock the pte for vmf->address.  A speculative fault holds no
+ * mmap_sem, so the VMA may have been changed and the page table freed
+ * since the walk in handle_speculative_fault().  Interrupts are disabled
+ * while the pmd is rechecked, which holds off the TLB flush IPI or RCU
+ * grace period that freeing a page table waits for, and for the same
+ * reason the pte lock is only trylocked: its holder may be waiting for
+ * that IPI.  The VMA sequence count is checked once more under the lock,
+ * after which a racing unmap has to wait for us on the pte lock.
+ */
+static bool pte_map_lock(struct vm_fault *vmf)
+{
+	bool ret = false;
+	spinlock_t *ptl;
+	pte_t *pte;
+
+	if (!(vmf->flags & FAULT_FLAG_SPECULATIVE)) {
+		vmf->pte = pte_offset_map_lock(vmf->vma->vm_mm, vmf->pmd,
+					       vmf->address, &vmf->ptl);
+		return true;
+	}
+
+	local_irq_disable();
+	if (vma_has_changed(vmf))
+		goto out;
+	if (!pmd_same(READ_ONCE(*vmf->pmd), vmf->orig_pmd))
+		goto out;
+
+	ptl = pte_lockptr(vmf->vma->vm_mm, vmf->pmd);
+	pte = pte_offset_map(vmf->pmd, vmf->address);
+	if (unlikely(!spin_trylock(ptl))) {
+		pte_unmap(pte);
+		goto out;
+	}
+	if (vma_has_changed(vmf)) {
+		pte_unmap_unlock(pte, ptl);
+		goto out;
+	}
+
+	vmf->pte = pte;
+	vmf->ptl = ptl;
+	ret = true;
+out:
+	local_irq_enable();
+	return ret;
+}
+#else
+static inline bool pte_map_lock(struct vm_fault *vmf)
+{
+	vmf->pte = pte_offset_map_lock(vmf->vma->vm_mm, vmf->pmd,
+				       vmf->address, &vmf->ptl);
+	return true;
+}
+#endif
+
 /*
  * We enter with non-exclusive mmap_sem (to exclude vma changes,
  * but allow concurrent faults), and pte mapped but not yet locked.
  * We return with mmap_sem still held, but pte unmapped and unlocked.
+ *
+ * For a speculative fault mmap_sem is not held; the page table was found
+ * by handle_speculative_fault() and is revalidated by pte_map_lock().
  */
 static vm_fault_t do_anonymous_page(struct vm_fault *vmf)
 {
@@ -3139,20 +3203,22 @@ static vm_fault_t do_anonymous_page(struct vm_fault *vmf)
 	 *
 	 * Here we only have down_read(mmap_sem).
 	 */
-	if (pte_alloc(vma->vm_mm, vmf->pmd, vmf->address))
-		return VM_FAULT_OOM;
+	if (!(vmf->flags & FAULT_FLAG_SPECULATIVE)) {
+		if (pte_alloc(vma->vm_mm, vmf->pmd, vmf->address))
+			return VM_FAULT_OOM;
 
-	/* See the comment in pte_alloc_one_map() */
-	if (unlikely(pmd_trans_unstable(vmf->pmd)))
-		return 0;
+		/* See the comment in pte_alloc_one_map() */
+		if (unlikely(pmd_trans_unstable(vmf->pmd)))
+			return 0;
+	}
 
 	/* Use the zero-page for reads */
 	if (!(vmf->flags & FAULT_FLAG_WRITE) &&
 			!mm_forbids_zeropage(vma->vm_mm)) {
 		entry = pte_mkspecial(pfn_pte(my_zero_pfn(vmf->address),
 						vma->vm_page_prot));
-		vmf->pte = pte_offset_map_lock(vma->vm_mm, vmf->pmd,
-				vmf->address, &vmf->ptl);
+		if (!pte_map_lock(vmf))
+			return VM_FAULT_RETRY;
 		if (!pte_none(*vmf->pte))
 			goto unlock;
 		ret = check_stable_address_space(vma->vm_mm);
@@ -3188,8 +3254,11 @@ static vm_fault_t do_anonymous_page(struct vm_fault *vmf)
 	if (vma->vm_flags & VM_WRITE)
 		entry = pte_mkwrite(pte_mkdirty(entry));
 
-	vmf->pte = pte_offset_map_lock(vma->vm_mm, vmf->pmd, vmf->address,
-			&vmf->ptl);
+	if (!pte_map_lock(vmf)) {
+		mem_cgroup_cancel_charge(page, memcg, false);
+		put_page(page);
+		return VM_FAULT_RETRY;
+	}
 	if (!pte_none(*vmf->pte))
 		goto release;
 
@@ -3273,6 +3342,10 @@ static vm_fault_t pte_alloc_one_map(struct vm_fault *vmf)
 {
 	struct vm_area_struct *vma = vmf->vma;
 
+	/* The page table must already be there, see pte_map_lock() */
+	if (vmf->flags & FAULT_FLAG_SPECULATIVE)
+		return pte_map_lock(vmf) ? 0 : VM_FAULT_RETRY;
+
 	if (!pmd_none(*vmf->pmd))
 		goto map_pte;
 	if (vmf->prealloc_pte) {
@@ -3431,7 +3504,8 @@ vm_fault_t alloc_set_pte(struct vm_fault *vmf, struct mem_cgroup *memcg,
 	pte_t entry;
 	vm_fault_t ret;
 
-	if (pmd_none(*vmf->pmd) && PageTransCompound(page) &&
+	if (!(vmf->flags & FAULT_FLAG_SPECULATIVE) &&
+			pmd_none(*vmf->pmd) && PageTransCompound(page) &&
 			IS_ENABLED(CONFIG_TRANSPARENT_HUGE_PAGECACHE)) {
 		/* THP on COW? */
 		VM_BUG_ON_PAGE(memcg, page);
@@ -3602,7 +3676,7 @@ static vm_fault_t do_fault_around(struct vm_fault *vmf)
 	end_pgoff = min3(end_pgoff, vma_pages(vmf->vma) + vmf->vma->vm_pgoff - 1,
 			start_pgoff + nr_pages - 1);
 
-	if (pmd_none(*vmf->pmd)) {
+	if (!(vmf->flags & FAULT_FLAG_SPECULATIVE) && pmd_none(*vmf->pmd)) {
 		vmf->prealloc_pte = pte_alloc_one(vmf->vma->vm_mm,
 						  vmf->address);
 		if (!vmf->prealloc_pte)
@@ -4159,6 +4233,144 @@ vm_fault_t handle_mm_fault(struct vm_area_struct *vma, unsigned long address,
 }
 EXPORT_SYMBOL_GPL(handle_mm_fault);
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Try to resolve a user fault without taking mmap_sem.  Only the common
+ * cheap cases are handled: the first touch of an anonymous page, and a read
+ * of a file page that is already uptodate in the page cache (which is
+ * mapped through ->map_pages(), so never sleeps on I/O).  Anything else,
+ * and any change to the VMA seen on the way, returns VM_FAULT_RETRY and the
+ * caller falls back to handle_mm_fault() under mmap_sem.
+ *
+ * The VMA is pinned with get_vma() and its vm_sequence sampled before any
+ * of its fields are used; pte_map_lock() checks it again under the pte
+ * lock before the new pte is set.
+ */
+vm_fault_t handle_speculative_fault(struct mm_struct *mm,
+				    unsigned long address, unsigned int flags)
+{
+	struct vm_fault vmf = {
+		.address = address & PAGE_MASK,
+	};
+	struct vm_area_struct *vma;
+	pgd_t *pgd;
+	p4d_t *p4d;
+	pte_t *pte;
+	vm_fault_t ret = VM_FAULT_RETRY;
+
+	/* Nothing here may drop a lock the caller does not hold */
+	flags &= ~(FAULT_FLAG_ALLOW_RETRY | FAULT_FLAG_KILLABLE);
+	flags |= FAULT_FLAG_SPECULATIVE;
+
+	vma = get_vma(mm, address);
+	if (!vma)
+		return VM_FAULT_RETRY;
+
+	vmf.vma = vma;
+	vmf.flags = flags;
+	vmf.sequence = raw_read_seqcount(&vma->vm_sequence);
+	/* A writer is in progress, or the vma is already unlinked */
+	if (vmf.sequence & 1)
+		goto out_put;
+
+	if (address < vma->vm_start || is_vm_hugetlb_page(vma))
+		goto out_put;
+	if (vma->vm_flags & (VM_PFNMAP | VM_MIXEDMAP | VM_IO |
+			     VM_UFFD_MISSING | VM_UFFD_WP))
+		goto out_put;
+
+	if (flags & FAULT_FLAG_WRITE) {
+		if (!(vma->vm_flags & VM_WRITE))
+			goto out_put;
+	} else if (flags & FAULT_FLAG_INSTRUCTION) {
+		if (!(vma->vm_flags & VM_EXEC))
+			goto out_put;
+	} else if (!(vma->vm_flags & VM_READ)) {
+		goto out_put;
+	}
+	if (!arch_vma_access_permitted(vma, flags & FAULT_FLAG_WRITE,
+				       flags & FAULT_FLAG_INSTRUCTION, false))
+		goto out_put;
+
+	if (vma_is_anonymous(vma)) {
+		/* anon_vma_prepare() and mempolicy need mmap_sem */
+		if (flags & FAULT_FLAG_WRITE && !vma->anon_vma)
+			goto out_put;
+		if (vma_policy(vma))
+			goto out_put;
+	} else {
+		/* Only page cache hits, and no COW */
+		if (flags & FAULT_FLAG_WRITE)
+			goto out_put;
+		if (vma->vm_ops->map_pages != filemap_map_pages ||
+		    fault_around_bytes >> PAGE_SHIFT <= 1)
+			goto out_put;
+	}
+
+	vmf.pgoff = linear_page_index(vma, address);
+	vmf.gfp_mask = __get_fault_gfp_mask(vma);
+
+	/*
+	 * Walk the page tables with interrupts disabled so that none of them
+	 * can be freed under us; only an existing pte page is used, nothing
+	 * is allocated.
+	 */
+	local_irq_disable();
+	pgd = pgd_offset(mm, address);
+	if (pgd_none(*pgd) || unlikely(pgd_bad(*pgd)))
+		goto out_walk;
+	p4d = p4d_offset(pgd, address);
+	if (p4d_none(*p4d) || unlikely(p4d_bad(*p4d)))
+		goto out_walk;
+	vmf.pud = pud_offset(p4d, address);
+	if (pud_none(*vmf.pud) || unlikely(pud_bad(*vmf.pud)))
+		goto out_walk;
+	vmf.pmd = pmd_offset(vmf.pud, address);
+	vmf.orig_pmd = READ_ONCE(*vmf.pmd);
+	if (!pmd_present(vmf.orig_pmd) || pmd_trans_huge(vmf.orig_pmd) ||
+	    pmd_devmap(vmf.orig_pmd) || unlikely(pmd_bad(vmf.orig_pmd)))
+		goto out_walk;
+
+	/* Use the copy of the pmd, *vmf.pmd may change under us */
+	pte = pte_offset_map(&vmf.orig_pmd, address);
+	vmf.orig_pte = READ_ONCE(*pte);
+	pte_unmap(pte);
+	local_irq_enable();
+
+	if (!pte_none(vmf.orig_pte))
+		goto out_put;
+	vmf.pte = NULL;
+
+	check_sync_rss_stat(current);
+
+	if (vma_is_anonymous(vma)) {
+		ret = do_anonymous_page(&vmf);
+	} else {
+		ret = do_fault_around(&vmf);
+		/* Not in the page cache, ->fault() would have to sleep */
+		if (!(ret & VM_FAULT_NOPAGE))
+			ret = VM_FAULT_RETRY;
+	}
+	goto out_put;
+
+out_walk:
+	local_irq_enable();
+out_put:
+	put_vma(vma);
+
+	if (ret & (VM_FAULT_ERROR | VM_FAULT_RETRY)) {
+		/* Let the regular path report errors, and OOM in particular */
+		count_vm_event(SPECULATIVE_PGFAULT_ABORT);
+		return VM_FAULT_RETRY;
+	}
+
+	count_vm_event(PGFAULT);
+	count_memcg_event_mm(mm, PGFAULT);
+	count_vm_event(SPECULATIVE_PGFAULT);
+	return ret;
+}
+#endif /* CONFIG_SPECULATIVE_PAGE_FAULT */
+
 #ifndef __PAGETABLE_P4D_FOLDED
 /*
  * Allocate p4d page table.
@@ -46,6 +46,8 @@
 #include <linux/page_idle.h>
 #include <linux/page_owner.h>
 #include <linux/sched/mm.h>
+#include <linux/sched/sysctl.h>
+#include <linux/memory.h>
 #include <linux/ptrace.h>
 
 #include <asm/tlbflush.h>
@@ -1865,8 +1867,24 @@ static int numamigrate_isolate_page(pg_data_t *pgdat, struct page *page)
 	VM_BUG_ON_PAGE(compound_order(page) && !PageTransHuge(page), page);
 
 	/* Avoid migrating to a node that is nearly full */
-	if (!migrate_balanced_pgdat(pgdat, 1UL << compound_order(page)))
+	if (!migrate_balanced_pgdat(pgdat, 1UL << compound_order(page))) {
+		int z;
+
+		/*
+		 * With memory tiering, a full fast node is expected: let
+		 * kswapd demote some cold pages to make room for promotion.
+		 */
+		if (!(sysctl_numa_balancing_mode & NUMA_BALANCING_MEMORY_TIERING))
+			return 0;
+		for (z = pgdat->nr_zones - 1; z >= 0; z--) {
+			if (populated_zone(pgdat->node_zones + z))
+				break;
+		}
+		if (z >= 0)
+			wakeup_kswapd(pgdat->node_zones + z, 0,
+				      compound_order(page), ZONE_MOVABLE);
 		return 0;
+	}
 
 	if (isolate_lru_page(page))
 		return 0;
@@ -1913,6 +1931,7 @@ int migrate_misplaced_page(struct page *page, struct vm_area_struct *vma,
 	pg_data_t *pgdat = NODE_DATA(node);
 	int isolated;
 	int nr_remaining;
+	int page_node = page_to_nid(page);
 	LIST_HEAD(migratepages);
 
 	/*
@@ -1946,8 +1965,11 @@ int migrate_misplaced_page(struct page *page, struct vm_area_struct *vma,
 			putback_lru_page(page);
 		}
 		isolated = 0;
-	} else
+	} else {
 		count_vm_numa_event(NUMA_PAGE_MIGRATE);
+		if (!node_is_toptier(page_node) && node_is_toptier(node))
+			mod_node_page_state(pgdat, PGPROMOTE_SUCCESS, 1);
+	}
 	BUG_ON(!list_empty(&migratepages));
 	return isolated;
 
@@ -2064,6 +2086,8 @@ int migrate_misplaced_transhuge_page(struct mm_struct *mm,
 
 	count_vm_events(PGMIGRATE_SUCCESS, HPAGE_PMD_NR);
 	count_vm_numa_events(NUMA_PAGE_MIGRATE, HPAGE_PMD_NR);
+	if (!node_is_toptier(page_to_nid(page)) && node_is_toptier(node))
+		mod_node_page_state(pgdat, PGPROMOTE_SUCCESS, HPAGE_PMD_NR);
 
 	mod_node_page_state(page_pgdat(page),
 			NR_ISOLATED_ANON + page_lru,
@@ -2087,6 +2111,122 @@ int migrate_misplaced_transhuge_page(struct mm_struct *mm,
 }
 #endif /* CONFIG_NUMA_BALANCING */
 
+/*
+ * node_demotion[] maps each node with CPUs to the nearest CPU-less memory
+ * node that reclaim may demote its cold pages to, or NUMA_NO_NODE if there
+ * is none. Slow nodes do not demote any further, their pages get reclaimed.
+ */
+static int node_demotion[MAX_NUMNODES] __read_mostly = {
+	[0 ... MAX_NUMNODES - 1] = NUMA_NO_NODE,
+};
+static DEFINE_MUTEX(node_demotion_lock);
+
+bool numa_demotion_enabled __read_mostly;
+
+int next_demotion_node(int node)
+{
+	return READ_ONCE(node_demotion[node]);
+}
+
+static void establish_demotion_targets(void)
+{
+	int node, target;
+
+	mutex_lock(&node_demotion_lock);
+	for_each_node(node) {
+		int best = NUMA_NO_NODE;
+
+		if (node_is_toptier(node) && node_state(node, N_MEMORY)) {
+			for_each_node_state(target, N_MEMORY) {
+				if (node_is_toptier(target))
+					continue;
+				if (best == NUMA_NO_NODE ||
+				    node_distance(node, target) <
+				    node_distance(node, best))
+					best = target;
+			}
+		}
+		WRITE_ONCE(node_demotion[node], best);
+	}
+	mutex_unlock(&node_demotion_lock);
+}
+
+static int demotion_memory_callback(struct notifier_block *self,
+				    unsigned long action, void *arg)
+{
+	switch (action) {
+	case MEM_ONLINE:
+	case MEM_OFFLINE:
+		establish_demotion_targets();
+		break;
+	}
+	return notifier_from_errno(0);
+}
+
+static int demotion_cpu_online(unsigned int cpu)
+{
+	establish_demotion_targets();
+	return 0;
+}
+
+#ifdef CONFIG_SYSFS
+static ssize_t demotion_enabled_show(struct kobject *kobj,
+				     struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%s\n",
+		       numa_demotion_enabled ? "true" : "false");
+}
+
+static ssize_t demotion_enabled_store(struct kobject *kobj,
+				      struct kobj_attribute *attr,
+				      const char *buf, size_t count)
+{
+	bool enable;
+	int err;
+
+	err = kstrtobool(buf, &enable);
+	if (err)
+		return err;
+
+	WRITE_ONCE(numa_demotion_enabled, enable);
+	return count;
+}
+
+static struct kobj_attribute numa_demotion_enabled_attr =
+	__ATTR(demotion_enabled, 0644, demotion_enabled_show,
+	       demotion_enabled_store);
+
+static struct attribute *numa_attrs[] = {
+	&numa_demotion_enabled_attr.attr,
+	NULL,
+};
+
+static const struct attribute_group numa_attr_group = {
+	.name = "numa",
+	.attrs = numa_attrs,
+};
+#endif /* CONFIG_SYSFS */
+
+static int __init numa_demotion_init(void)
+{
+	int ret;
+
+	establish_demotion_targets();
+	hotplug_memory_notifier(demotion_memory_callback, 100);
+	/* A node gaining its first CPU moves to the fast tier */
+	ret = cpuhp_setup_state_nocalls(CPUHP_AP_ONLINE_DYN,
+					"mm/demotion:online",
+					demotion_cpu_online, NULL);
+	if (ret < 0)
+		pr_err("demotion: failed to register 'online' hotplug state\n");
+#ifdef CONFIG_SYSFS
+	if (sysfs_create_group(mm_kobj, &numa_attr_group))
+		pr_err("demotion: failed to create sysfs group\n");
+#endif
+	return 0;
+}
+subsys_initcall(numa_demotion_init);
+
 #endif /* CONFIG_NUMA */
 
 #if defined(CONFIG_MIGRATE_VMA_HELPER)
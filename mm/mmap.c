@@ -169,6 +169,50 @@ void unlink_file_vma(struct vm_area_struct *vma)
 	}
 }
 
+static void __free_vma(struct vm_area_struct *vma)
+{
+	if (vma->vm_file)
+		fput(vma->vm_file);
+	mpol_put(vma_policy(vma));
+	vm_area_free(vma);
+}
+
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * A speculative page fault may still be looking at a VMA that has been
+ * unlinked, so the final free is deferred to whoever drops the last
+ * reference.
+ */
+void put_vma(struct vm_area_struct *vma)
+{
+	if (atomic_dec_and_test(&vma->vm_ref_count))
+		__free_vma(vma);
+}
+
+static inline void mm_rb_write_lock(struct mm_struct *mm)
+{
+	write_lock(&mm->mm_rb_lock);
+}
+
+static inline void mm_rb_write_unlock(struct mm_struct *mm)
+{
+	write_unlock(&mm->mm_rb_lock);
+}
+#else
+void put_vma(struct vm_area_struct *vma)
+{
+	__free_vma(vma);
+}
+
+static inline void mm_rb_write_lock(struct mm_struct *mm)
+{
+}
+
+static inline void mm_rb_write_unlock(struct mm_struct *mm)
+{
+}
+#endif
+
 /*
  * Close a vm structure and free it, returning the next.
  */
@@ -179,10 +223,7 @@ static struct vm_area_struct *remove_vma(struct vm_area_struct *vma)
 	might_sleep();
 	if (vma->vm_ops && vma->vm_ops->close)
 		vma->vm_ops->close(vma);
-	if (vma->vm_file)
-		fput(vma->vm_file);
-	mpol_put(vma_policy(vma));
-	vm_area_free(vma);
+	put_vma(vma);
 	return next;
 }
 
@@ -576,10 +617,12 @@ void __vma_link_rb(struct mm_struct *mm, struct vm_area_struct *vma,
 	 * immediately update the gap to the correct value. Finally we
 	 * rebalance the rbtree after all augmented values have been set.
 	 */
+	mm_rb_write_lock(mm);
 	rb_link_node(&vma->vm_rb, rb_parent, rb_link);
 	vma->rb_subtree_gap = 0;
 	vma_gap_update(vma);
 	vma_rb_insert(vma, &mm->mm_rb);
+	mm_rb_write_unlock(mm);
 }
 
 static void __vma_link_file(struct vm_area_struct *vma)
@@ -655,7 +698,9 @@ static __always_inline void __vma_unlink_common(struct mm_struct *mm,
 {
 	struct vm_area_struct *next;
 
+	mm_rb_write_lock(mm);
 	vma_rb_erase_ignore(vma, &mm->mm_rb, ignore);
+	mm_rb_write_unlock(mm);
 	next = vma->vm_next;
 	if (has_prev)
 		prev->vm_next = next;
@@ -786,6 +831,9 @@ int __vma_adjust(struct vm_area_struct *vma, unsigned long start,
 		}
 	}
 again:
+	vm_write_begin(vma);
+	if (next)
+		vm_write_begin(next);
 	vma_adjust_trans_huge(orig_vma, start, end, adjust_next);
 
 	if (file) {
@@ -903,15 +951,13 @@ int __vma_adjust(struct vm_area_struct *vma, unsigned long start,
 	}
 
 	if (remove_next) {
-		if (file) {
+		if (file)
 			uprobe_munmap(next, next->vm_start, next->vm_end);
-			fput(file);
-		}
 		if (next->anon_vma)
 			anon_vma_merge(vma, next);
 		mm->map_count--;
-		mpol_put(vma_policy(next));
-		vm_area_free(next);
+		/* The sequence count of the removed vma is left odd. */
+		put_vma(next);
 		/*
 		 * In mprotect's case 6 (see comments on vma_merge),
 		 * we must remove another next too. It would clutter
@@ -941,6 +987,7 @@ int __vma_adjust(struct vm_area_struct *vma, unsigned long start,
 		if (remove_next == 2) {
 			remove_next = 1;
 			end = next->vm_end;
+			vm_write_end(vma);
 			goto again;
 		}
 		else if (next)
@@ -971,6 +1018,10 @@ int __vma_adjust(struct vm_area_struct *vma, unsigned long start,
 	if (insert && file)
 		uprobe_mmap(insert);
 
+	if (!remove_next && next)
+		vm_write_end(next);
+	vm_write_end(vma);
+
 	validate_mm(mm);
 
 	return 0;
@@ -1794,6 +1845,7 @@ unsigned long mmap_region(struct file *file, unsigned long addr,
 out:
 	perf_event_mmap(vma);
 
+	vm_write_begin(vma);
 	vm_stat_account(mm, vm_flags, len >> PAGE_SHIFT);
 	if (vm_flags & VM_LOCKED) {
 		if ((vm_flags & VM_SPECIAL) || vma_is_dax(vma) ||
@@ -1807,6 +1859,10 @@ unsigned long mmap_region(struct file *file, unsigned long addr,
 	if (file)
 		uprobe_mmap(vma);
 
+	/* Regular files may be collapsed too, see READ_ONLY_THP_FOR_FS */
+	if (IS_ENABLED(CONFIG_READ_ONLY_THP_FOR_FS) && file)
+		khugepaged_enter_vma_merge(vma, vm_flags);
+
 	/*
 	 * New (or expanded) vma always get soft dirty status.
 	 * Otherwise user-space soft-dirty page tracker won't
@@ -1817,6 +1873,7 @@ unsigned long mmap_region(struct file *file, unsigned long addr,
 	vma->vm_flags |= VM_SOFTDIRTY;
 
 	vma_set_page_prot(vma);
+	vm_write_end(vma);
 
 	return addr;
 
@@ -2221,6 +2278,41 @@ struct vm_area_struct *find_vma(struct mm_struct *mm, unsigned long addr)
 
 EXPORT_SYMBOL(find_vma);
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Like find_vma() but callable without mmap_sem: the tree is walked under
+ * mm_rb_lock, and the vma returned holds a reference that must be dropped
+ * with put_vma().  The vmacache is skipped as it is only coherent under
+ * mmap_sem.
+ */
+struct vm_area_struct *get_vma(struct mm_struct *mm, unsigned long addr)
+{
+	struct vm_area_struct *vma = NULL;
+	struct rb_node *rb_node;
+
+	read_lock(&mm->mm_rb_lock);
+	rb_node = mm->mm_rb.rb_node;
+	while (rb_node) {
+		struct vm_area_struct *tmp;
+
+		tmp = rb_entry(rb_node, struct vm_area_struct, vm_rb);
+
+		if (tmp->vm_end > addr) {
+			vma = tmp;
+			if (tmp->vm_start <= addr)
+				break;
+			rb_node = rb_node->rb_left;
+		} else
+			rb_node = rb_node->rb_right;
+	}
+	if (vma)
+		atomic_inc(&vma->vm_ref_count);
+	read_unlock(&mm->mm_rb_lock);
+
+	return vma;
+}
+#endif
+
 /*
  * Same as find_vma, but also return a pointer to the previous VMA in *pprev.
  */
@@ -2587,12 +2679,16 @@ detach_vmas_to_be_unmapped(struct mm_struct *mm, struct vm_area_struct *vma,
 
 	insertion_point = (prev ? &prev->vm_next : &mm->mmap);
 	vma->vm_prev = NULL;
+	mm_rb_write_lock(mm);
 	do {
+		/* Never ended: speculative faults must not use it anymore. */
+		vm_write_begin(vma);
 		vma_rb_erase(vma, &mm->mm_rb);
 		mm->map_count--;
 		tail_vma = vma;
 		vma = vma->vm_next;
 	} while (vma && vma->vm_start < end);
+	mm_rb_write_unlock(mm);
 	*insertion_point = vma;
 	if (vma) {
 		vma->vm_prev = prev;
@@ -2999,7 +3095,9 @@ static int do_brk_flags(unsigned long addr, unsigned long len, unsigned long fla
 	mm->data_vm += len >> PAGE_SHIFT;
 	if (flags & VM_LOCKED)
 		mm->locked_vm += (len >> PAGE_SHIFT);
+	vm_write_begin(vma);
 	vma->vm_flags |= VM_SOFTDIRTY;
+	vm_write_end(vma);
 	return 0;
 }
 
@@ -26,6 +26,7 @@
 #include <linux/perf_event.h>
 #include <linux/pkeys.h>
 #include <linux/ksm.h>
+#include <linux/sched/sysctl.h>
 #include <linux/uaccess.h>
 #include <linux/mm_inline.h>
 #include <asm/pgtable.h>
@@ -108,6 +109,15 @@ static unsigned long change_pte_range(struct vm_area_struct *vma, pmd_t *pmd,
 				 */
 				if (target_node == page_to_nid(page))
 					continue;
+
+				/*
+				 * With only memory tiering enabled, faults
+				 * are wanted for promotion candidates only.
+				 */
+				if (sysctl_numa_balancing_mode ==
+				    NUMA_BALANCING_MEMORY_TIERING &&
+				    node_is_toptier(page_to_nid(page)))
+					continue;
 			}
 
 			ptent = ptep_modify_prot_start(mm, addr, pte);
@@ -424,12 +434,14 @@ mprotect_fixup(struct vm_area_struct *vma, struct vm_area_struct **pprev,
 	 * vm_flags and vm_page_prot are protected by the mmap_sem
 	 * held in write mode.
 	 */
+	vm_write_begin(vma);
 	vma->vm_flags = newflags;
 	dirty_accountable = vma_wants_writenotify(vma, vma->vm_page_prot);
 	vma_set_page_prot(vma);
 
 	change_protection(vma, start, end, vma->vm_page_prot,
 			  dirty_accountable, 0);
+	vm_write_end(vma);
 
 	/*
 	 * Private VM_LOCKED VMA becoming writable: trigger COW to avoid major
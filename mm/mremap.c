@@ -294,8 +294,18 @@ static unsigned long move_vma(struct vm_area_struct *vma,
 	if (!new_vma)
 		return -ENOMEM;
 
+	/*
+	 * Keep speculative faults off both ranges while the ptes are in
+	 * flight; copy_vma() may have merged the new range into vma itself.
+	 */
+	vm_write_begin(vma);
+	if (new_vma != vma)
+		vm_write_begin(new_vma);
 	moved_len = move_page_tables(vma, old_addr, new_vma, new_addr, old_len,
 				     need_rmap_locks);
+	if (new_vma != vma)
+		vm_write_end(new_vma);
+	vm_write_end(vma);
 	if (moved_len < old_len) {
 		err = -ENOMEM;
 	} else if (vma->vm_ops && vma->vm_ops->mremap) {
@@ -308,8 +318,14 @@ static unsigned long move_vma(struct vm_area_struct *vma,
 		 * which will succeed since page tables still there,
 		 * and then proceed to unmap new area instead of old.
 		 */
+		vm_write_begin(vma);
+		if (new_vma != vma)
+			vm_write_begin(new_vma);
 		move_page_tables(new_vma, new_addr, vma, old_addr, moved_len,
 				 true);
+		if (new_vma != vma)
+			vm_write_end(new_vma);
+		vm_write_end(vma);
 		vma = new_vma;
 		old_len = new_len;
 		old_addr = new_addr;
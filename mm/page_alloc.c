@@ -66,6 +66,7 @@
 #include <linux/ftrace.h>
 #include <linux/lockdep.h>
 #include <linux/nmi.h>
+#include <linux/psi.h>
 
 #include <asm/sections.h>
 #include <asm/tlbflush.h>
@@ -129,6 +130,7 @@ unsigned long totalreserve_pages __read_mostly;
 unsigned long totalcma_pages __read_mostly;
 
 int percpu_pagelist_fraction;
+int percpu_high_order_pagelist_fraction;
 gfp_t gfp_allowed_mask __read_mostly = GFP_BOOT_MASK;
 
 /*
@@ -1057,10 +1059,10 @@ static bool bulkfree_pcp_prepare(struct page *page)
 }
 #endif /* CONFIG_DEBUG_VM */
 
-static inline void prefetch_buddy(struct page *page)
+static inline void prefetch_buddy(struct page *page, unsigned int order)
 {
 	unsigned long pfn = page_to_pfn(page);
-	unsigned long buddy_pfn = __find_buddy_pfn(pfn, 0);
+	unsigned long buddy_pfn = __find_buddy_pfn(pfn, order);
 	struct page *buddy = page + (buddy_pfn - pfn);
 
 	prefetch(buddy);
@@ -1068,7 +1070,7 @@ static inline void prefetch_buddy(struct page *page)
 
 /*
  * Frees a number of pages from the PCP lists
- * Assumes all pages on list are in same zone, and of same order.
+ * Assumes all pages on list are in same zone, and of the given order.
  * count is the number of pages to free.
  *
  * If the zone was previously in an "all pages pinned" state then look to
@@ -1078,7 +1080,8 @@ static inline void prefetch_buddy(struct page *page)
  * pinned" detection logic.
  */
 static void free_pcppages_bulk(struct zone *zone, int count,
-					struct per_cpu_pages *pcp)
+					struct per_cpu_pages *pcp,
+					unsigned int order)
 {
 	int migratetype = 0;
 	int batch_free = 0;
@@ -1129,7 +1132,7 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 			 * prefetch buddy for the first pcp->batch nr of pages.
 			 */
 			if (prefetch_nr++ < pcp->batch)
-				prefetch_buddy(page);
+				prefetch_buddy(page, order);
 		} while (--count && --batch_free && !list_empty(list));
 	}
 
@@ -1148,8 +1151,8 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 		if (unlikely(isolated_pageblocks))
 			mt = get_pageblock_migratetype(page);
 
-		__free_one_page(page, page_to_pfn(page), zone, 0, mt);
-		trace_mm_page_pcpu_drain(page, 0, mt);
+		__free_one_page(page, page_to_pfn(page), zone, order, mt);
+		trace_mm_page_pcpu_drain(page, order, mt);
 	}
 	spin_unlock(&zone->lock);
 }
@@ -1236,6 +1239,40 @@ void __meminit reserve_bootmem_region(phys_addr_t start, phys_addr_t end)
 	}
 }
 
+/*
+ * Put a high-order page that has been prepared for freeing on the per-cpu
+ * list for its order. Returns false if the order is not cached per-cpu or
+ * the page must go straight back to the buddy lists. Called with
+ * interrupts disabled.
+ */
+static bool free_high_order_pcp(struct page *page, unsigned int order,
+				int migratetype)
+{
+	struct zone *zone = page_zone(page);
+	struct per_cpu_pages *pcp;
+	int index = pcp_high_order_index(order);
+
+	if (index < 0)
+		return false;
+
+	/* Same migratetype handling as free_unref_page_commit() */
+	if (migratetype >= MIGRATE_PCPTYPES) {
+		if (unlikely(is_migrate_isolate(migratetype)))
+			return false;
+		migratetype = MIGRATE_MOVABLE;
+	}
+
+	set_pcppage_migratetype(page, migratetype);
+	pcp = &this_cpu_ptr(zone->pageset)->order_pcp[index];
+	list_add(&page->lru, &pcp->lists[migratetype]);
+	pcp->count++;
+	if (pcp->count >= pcp->high) {
+		unsigned long batch = READ_ONCE(pcp->batch);
+		free_pcppages_bulk(zone, batch, pcp, order);
+	}
+	return true;
+}
+
 static void __free_pages_ok(struct page *page, unsigned int order)
 {
 	unsigned long flags;
@@ -1248,7 +1285,8 @@ static void __free_pages_ok(struct page *page, unsigned int order)
 	migratetype = get_pfnblock_migratetype(page, pfn);
 	local_irq_save(flags);
 	__count_vm_events(PGFREE, 1 << order);
-	free_one_page(page_zone(page), page, pfn, order, migratetype);
+	if (!free_high_order_pcp(page, order, migratetype))
+		free_one_page(page_zone(page), page, pfn, order, migratetype);
 	local_irq_restore(flags);
 }
 
@@ -1859,40 +1897,40 @@ static inline bool free_pages_prezeroed(void)
 		page_poisoning_enabled();
 }
 
+static bool check_new_pages(struct page *page, unsigned int order)
+{
+	int i;
+	for (i = 0; i < (1 << order); i++) {
+		struct page *p = page + i;
+
+		if (unlikely(check_new_page(p)))
+			return true;
+	}
+
+	return false;
+}
+
 #ifdef CONFIG_DEBUG_VM
-static bool check_pcp_refill(struct page *page)
+static bool check_pcp_refill(struct page *page, unsigned int order)
 {
 	return false;
 }
 
-static bool check_new_pcp(struct page *page)
+static bool check_new_pcp(struct page *page, unsigned int order)
 {
-	return check_new_page(page);
+	return check_new_pages(page, order);
 }
 #else
-static bool check_pcp_refill(struct page *page)
+static bool check_pcp_refill(struct page *page, unsigned int order)
 {
-	return check_new_page(page);
+	return check_new_pages(page, order);
 }
-static bool check_new_pcp(struct page *page)
+static bool check_new_pcp(struct page *page, unsigned int order)
 {
 	return false;
 }
 #endif /* CONFIG_DEBUG_VM */
 
-static bool check_new_pages(struct page *page, unsigned int order)
-{
-	int i;
-	for (i = 0; i < (1 << order); i++) {
-		struct page *p = page + i;
-
-		if (unlikely(check_new_page(p)))
-			return true;
-	}
-
-	return false;
-}
-
 inline void post_alloc_hook(struct page *page, unsigned int order,
 				gfp_t gfp_flags)
 {
@@ -2471,7 +2509,7 @@ static int rmqueue_bulk(struct zone *zone, unsigned int order,
 		if (unlikely(page == NULL))
 			break;
 
-		if (unlikely(check_pcp_refill(page)))
+		if (unlikely(check_pcp_refill(page, order)))
 			continue;
 
 		/*
@@ -2511,20 +2549,44 @@ static int rmqueue_bulk(struct zone *zone, unsigned int order,
  * Note that this function must be called with the thread pinned to
  * a single processor.
  */
-void drain_zone_pages(struct zone *zone, struct per_cpu_pages *pcp)
+void drain_zone_pages(struct zone *zone, struct per_cpu_pageset *pset)
 {
+	struct per_cpu_pages *pcp = &pset->pcp;
 	unsigned long flags;
-	int to_drain, batch;
+	int to_drain, batch, i;
 
 	local_irq_save(flags);
 	batch = READ_ONCE(pcp->batch);
 	to_drain = min(pcp->count, batch);
 	if (to_drain > 0)
-		free_pcppages_bulk(zone, to_drain, pcp);
+		free_pcppages_bulk(zone, to_drain, pcp, 0);
+
+	for (i = 0; i < NR_PCP_HIGH_ORDERS; i++) {
+		pcp = &pset->order_pcp[i];
+		batch = READ_ONCE(pcp->batch);
+		to_drain = min(pcp->count, batch);
+		if (to_drain > 0)
+			free_pcppages_bulk(zone, to_drain, pcp,
+					   pcp_high_order(i));
+	}
 	local_irq_restore(flags);
 }
 #endif
 
+/*
+ * Number of base pages held on all per-cpu lists of a pageset.
+ */
+unsigned long pageset_nr_pages(struct per_cpu_pageset *pset)
+{
+	unsigned long nr_pages = pset->pcp.count;
+	int i;
+
+	for (i = 0; i < NR_PCP_HIGH_ORDERS; i++)
+		nr_pages += (unsigned long)pset->order_pcp[i].count <<
+			    pcp_high_order(i);
+	return nr_pages;
+}
+
 /*
  * Drain pcplists of the indicated processor and zone.
  *
@@ -2537,13 +2599,21 @@ static void drain_pages_zone(unsigned int cpu, struct zone *zone)
 	unsigned long flags;
 	struct per_cpu_pageset *pset;
 	struct per_cpu_pages *pcp;
+	int i;
 
 	local_irq_save(flags);
 	pset = per_cpu_ptr(zone->pageset, cpu);
 
 	pcp = &pset->pcp;
 	if (pcp->count)
-		free_pcppages_bulk(zone, pcp->count, pcp);
+		free_pcppages_bulk(zone, pcp->count, pcp, 0);
+
+	for (i = 0; i < NR_PCP_HIGH_ORDERS; i++) {
+		pcp = &pset->order_pcp[i];
+		if (pcp->count)
+			free_pcppages_bulk(zone, pcp->count, pcp,
+					   pcp_high_order(i));
+	}
 	local_irq_restore(flags);
 }
 
@@ -2641,12 +2711,12 @@ void drain_all_pages(struct zone *zone)
 
 		if (zone) {
 			pcp = per_cpu_ptr(zone->pageset, cpu);
-			if (pcp->pcp.count)
+			if (pageset_nr_pages(pcp))
 				has_pcps = true;
 		} else {
 			for_each_populated_zone(z) {
 				pcp = per_cpu_ptr(z->pageset, cpu);
-				if (pcp->pcp.count) {
+				if (pageset_nr_pages(pcp)) {
 					has_pcps = true;
 					break;
 				}
@@ -2766,7 +2836,7 @@ static void free_unref_page_commit(struct page *page, unsigned long pfn)
 	pcp->count++;
 	if (pcp->count >= pcp->high) {
 		unsigned long batch = READ_ONCE(pcp->batch);
-		free_pcppages_bulk(zone, batch, pcp);
+		free_pcppages_bulk(zone, batch, pcp, 0);
 	}
 }
 
@@ -2922,15 +2992,15 @@ static inline void zone_statistics(struct zone *preferred_zone, struct zone *z)
 }
 
 /* Remove page from the per-cpu list, caller must protect the list */
-static struct page *__rmqueue_pcplist(struct zone *zone, int migratetype,
-			struct per_cpu_pages *pcp,
+static struct page *__rmqueue_pcplist(struct zone *zone, unsigned int order,
+			int migratetype, struct per_cpu_pages *pcp,
 			struct list_head *list)
 {
 	struct page *page;
 
 	do {
 		if (list_empty(list)) {
-			pcp->count += rmqueue_bulk(zone, 0,
+			pcp->count += rmqueue_bulk(zone, order,
 					pcp->batch, list,
 					migratetype);
 			if (unlikely(list_empty(list)))
@@ -2940,7 +3010,7 @@ static struct page *__rmqueue_pcplist(struct zone *zone, int migratetype,
 		page = list_first_entry(list, struct page, lru);
 		list_del(&page->lru);
 		pcp->count--;
-	} while (check_new_pcp(page));
+	} while (check_new_pcp(page, order));
 
 	return page;
 }
@@ -2956,9 +3026,18 @@ static struct page *rmqueue_pcplist(struct zone *preferred_zone,
 	unsigned long flags;
 
 	local_irq_save(flags);
-	pcp = &this_cpu_ptr(zone->pageset)->pcp;
-	list = &pcp->lists[migratetype];
-	page = __rmqueue_pcplist(zone,  migratetype, pcp, list);
+	if (order) {
+		pcp = &this_cpu_ptr(zone->pageset)->order_pcp[
+					pcp_high_order_index(order)];
+		list = &pcp->lists[migratetype];
+		__count_vm_event(list_empty(list) ?
+				 PGALLOC_PCP_HIGH_ORDER_MISS :
+				 PGALLOC_PCP_HIGH_ORDER_HIT);
+	} else {
+		pcp = &this_cpu_ptr(zone->pageset)->pcp;
+		list = &pcp->lists[migratetype];
+	}
+	page = __rmqueue_pcplist(zone, order, migratetype, pcp, list);
 	if (page) {
 		__count_zid_vm_events(PGALLOC, page_zonenum(page), 1 << order);
 		zone_statistics(preferred_zone, zone);
@@ -2968,7 +3047,8 @@ static struct page *rmqueue_pcplist(struct zone *preferred_zone,
 }
 
 /*
- * Allocate a page from the given zone. Use pcplists for order-0 allocations.
+ * Allocate a page from the given zone. Use pcplists for order-0 allocations
+ * and for the higher orders that have their own per-cpu lists.
  */
 static inline
 struct page *rmqueue(struct zone *preferred_zone,
@@ -2990,6 +3070,19 @@ struct page *rmqueue(struct zone *preferred_zone,
 	 * allocate greater than order-1 page units with __GFP_NOFAIL.
 	 */
 	WARN_ON_ONCE((gfp_flags & __GFP_NOFAIL) && (order > 1));
+
+	/*
+	 * Fall back to the buddy lists if the per-cpu list could not be
+	 * refilled so that ALLOC_HARDER can still use the highatomic
+	 * reserve.
+	 */
+	if (pcp_high_order_index(order) >= 0) {
+		page = rmqueue_pcplist(preferred_zone, zone, order,
+				gfp_flags, migratetype);
+		if (page)
+			goto out;
+	}
+
 	spin_lock_irqsave(&zone->lock, flags);
 
 	do {
@@ -3549,15 +3642,20 @@ __alloc_pages_direct_compact(gfp_t gfp_mask, unsigned int order,
 		enum compact_priority prio, enum compact_result *compact_result)
 {
 	struct page *page;
+	unsigned long pflags;
 	unsigned int noreclaim_flag;
 
 	if (!order)
 		return NULL;
 
+	psi_memstall_enter(&pflags);
 	noreclaim_flag = memalloc_noreclaim_save();
+
 	*compact_result = try_to_compact_pages(gfp_mask, order, alloc_flags, ac,
 									prio);
+
 	memalloc_noreclaim_restore(noreclaim_flag);
+	psi_memstall_leave(&pflags);
 
 	if (*compact_result <= COMPACT_INACTIVE)
 		return NULL;
@@ -3756,11 +3854,13 @@ __perform_reclaim(gfp_t gfp_mask, unsigned int order,
 	struct reclaim_state reclaim_state;
 	int progress;
 	unsigned int noreclaim_flag;
+	unsigned long pflags;
 
 	cond_resched();
 
 	/* We now go into synchronous reclaim */
 	cpuset_memory_pressure_bump();
+	psi_memstall_enter(&pflags);
 	fs_reclaim_acquire(gfp_mask);
 	noreclaim_flag = memalloc_noreclaim_save();
 	reclaim_state.reclaimed_slab = 0;
@@ -3772,6 +3872,7 @@ __perform_reclaim(gfp_t gfp_mask, unsigned int order,
 	current->reclaim_state = NULL;
 	memalloc_noreclaim_restore(noreclaim_flag);
 	fs_reclaim_release(gfp_mask);
+	psi_memstall_leave(&pflags);
 
 	cond_resched();
 
@@ -4862,7 +4963,8 @@ void show_free_areas(unsigned int filter, nodemask_t *nodemask)
 			continue;
 
 		for_each_online_cpu(cpu)
-			free_pcp += per_cpu_ptr(zone->pageset, cpu)->pcp.count;
+			free_pcp += pageset_nr_pages(per_cpu_ptr(zone->pageset,
+								 cpu));
 	}
 
 	printk("active_anon:%lu inactive_anon:%lu isolated_anon:%lu\n"
@@ -4948,7 +5050,8 @@ void show_free_areas(unsigned int filter, nodemask_t *nodemask)
 
 		free_pcp = 0;
 		for_each_online_cpu(cpu)
-			free_pcp += per_cpu_ptr(zone->pageset, cpu)->pcp.count;
+			free_pcp += pageset_nr_pages(per_cpu_ptr(zone->pageset,
+								 cpu));
 
 		show_node(zone);
 		printk(KERN_CONT
@@ -5632,6 +5735,26 @@ static void pageset_update(struct per_cpu_pages *pcp, unsigned long high,
 	pcp->batch = batch;
 }
 
+/*
+ * The higher-order lists are limited to @high base pages each, but always
+ * keep room for a couple of entries so that THP frees can be recycled. A
+ * zero @high disables caching, as for NOMMU.
+ */
+static void pageset_set_order_high(struct per_cpu_pageset *p,
+				   unsigned long high)
+{
+	int i;
+
+	for (i = 0; i < NR_PCP_HIGH_ORDERS; i++) {
+		unsigned long order_high = 0;
+
+		if (high)
+			order_high = max(2UL, high >> pcp_high_order(i));
+		pageset_update(&p->order_pcp[i], order_high,
+			       max(1UL, order_high / 4));
+	}
+}
+
 /* a companion to pageset_set_high() */
 static void pageset_set_batch(struct per_cpu_pageset *p, unsigned long batch)
 {
@@ -5641,7 +5764,7 @@ static void pageset_set_batch(struct per_cpu_pageset *p, unsigned long batch)
 static void pageset_init(struct per_cpu_pageset *p)
 {
 	struct per_cpu_pages *pcp;
-	int migratetype;
+	int migratetype, i;
 
 	memset(p, 0, sizeof(*p));
 
@@ -5649,12 +5772,20 @@ static void pageset_init(struct per_cpu_pageset *p)
 	pcp->count = 0;
 	for (migratetype = 0; migratetype < MIGRATE_PCPTYPES; migratetype++)
 		INIT_LIST_HEAD(&pcp->lists[migratetype]);
+
+	for (i = 0; i < NR_PCP_HIGH_ORDERS; i++) {
+		pcp = &p->order_pcp[i];
+		for (migratetype = 0; migratetype < MIGRATE_PCPTYPES;
+		     migratetype++)
+			INIT_LIST_HEAD(&pcp->lists[migratetype]);
+	}
 }
 
 static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
 {
 	pageset_init(p);
 	pageset_set_batch(p, batch);
+	pageset_set_order_high(p, 6 * batch);
 }
 
 /*
@@ -5680,6 +5811,13 @@ static void pageset_set_high_and_batch(struct zone *zone,
 				percpu_pagelist_fraction));
 	else
 		pageset_set_batch(pcp, zone_batchsize(zone));
+
+	if (percpu_high_order_pagelist_fraction)
+		pageset_set_order_high(pcp,
+			(zone->managed_pages /
+				percpu_high_order_pagelist_fraction));
+	else
+		pageset_set_order_high(pcp, 6 * zone_batchsize(zone));
 }
 
 static void __meminit zone_pageset_init(struct zone *zone, int cpu)
@@ -7457,31 +7595,34 @@ int lowmem_reserve_ratio_sysctl_handler(struct ctl_table *table, int write,
  * percpu_pagelist_fraction - changes the pcp->high for each zone on each
  * cpu.  It is the fraction of total pages in each zone that a hot per cpu
  * pagelist can have before it gets flushed back to buddy allocator.
+ *
+ * percpu_high_order_pagelist_fraction does the same for each of the
+ * higher-order per cpu pagelists and shares this handler.
  */
 int percpu_pagelist_fraction_sysctl_handler(struct ctl_table *table, int write,
 	void __user *buffer, size_t *length, loff_t *ppos)
 {
 	struct zone *zone;
-	int old_percpu_pagelist_fraction;
+	int *fraction = table->data;
+	int old_fraction;
 	int ret;
 
 	mutex_lock(&pcp_batch_high_lock);
-	old_percpu_pagelist_fraction = percpu_pagelist_fraction;
+	old_fraction = *fraction;
 
 	ret = proc_dointvec_minmax(table, write, buffer, length, ppos);
 	if (!write || ret < 0)
 		goto out;
 
 	/* Sanity checking to avoid pcp imbalance */
-	if (percpu_pagelist_fraction &&
-	    percpu_pagelist_fraction < MIN_PERCPU_PAGELIST_FRACTION) {
-		percpu_pagelist_fraction = old_percpu_pagelist_fraction;
+	if (*fraction && *fraction < MIN_PERCPU_PAGELIST_FRACTION) {
+		*fraction = old_fraction;
 		ret = -EINVAL;
 		goto out;
 	}
 
 	/* No change? */
-	if (percpu_pagelist_fraction == old_percpu_pagelist_fraction)
+	if (*fraction == old_fraction)
 		goto out;
 
 	for_each_populated_zone(zone) {
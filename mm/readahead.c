@@ -24,6 +24,8 @@
 
 #include "internal.h"
 
+#include <trace/events/filemap.h>
+
 /*
  * Initialise a struct file's readahead state.  Assumes that the caller has
  * memset *ra to zero.
@@ -376,6 +378,137 @@ static int try_context_readahead(struct address_space *mapping,
 	return 1;
 }
 
+/*
+ * Streams further apart than this are not considered to be one stream
+ */
+#define RA_STREAM_MAX_STRIDE(max_pages)	(16 * (max_pages))
+
+/* Stamp a stream as most recently used; 0 is left for unused streams */
+static void ra_stream_touch(struct file_ra_state *ra, struct file_ra_stream *s)
+{
+	if (!++ra->stream_stamp)
+		ra->stream_stamp = 1;
+	s->stamp = ra->stream_stamp;
+}
+
+/* The PG_readahead page of the last window of @s, -1 if there is none */
+static pgoff_t ra_stream_marker(struct file_ra_stream *s)
+{
+	unsigned long mark = s->size > 1 ? s->size / 2 : 0;
+
+	if (!mark)
+		return -1;
+	return s->last - (s->size - 1 - mark) * s->stride;
+}
+
+/*
+ * Read the next window of stream @s, starting with the request after the
+ * last one covered. The window doubles on each use, up to about
+ * @max_pages, and its middle request is marked PG_readahead so that the
+ * next window is started before the reader catches up.
+ */
+static unsigned long ra_stream_submit(struct address_space *mapping,
+				      struct file_ra_state *ra,
+				      struct file *filp,
+				      struct file_ra_stream *s,
+				      unsigned long req_size,
+				      unsigned long max_pages)
+{
+	unsigned long chunk = max(req_size, 1UL);
+	unsigned long step = abs(s->stride);
+	pgoff_t first = s->last + s->stride;
+	unsigned long n, k, mark, nr_pages = 0;
+
+	/* A backward stream stops at the start of the file */
+	if (s->stride < 0 && s->last < step)
+		return 0;
+
+	n = s->size ? 2 * s->size : 2;
+	n = min3(n, max(max_pages / chunk, 1UL), (unsigned long)USHRT_MAX);
+	if (s->stride < 0)
+		n = min(n, first / step + 1);
+	mark = n > 1 ? n / 2 : 0;
+
+	if (step <= chunk) {
+		/* the requests touch or overlap: one contiguous range */
+		pgoff_t start = s->stride > 0 ? first : first - (n - 1) * step;
+		unsigned long len = (n - 1) * step + chunk;
+		pgoff_t marker = first + mark * s->stride;
+
+		nr_pages = __do_page_cache_readahead(mapping, filp, start, len,
+					mark ? len - (marker - start) : 0);
+	} else {
+		for (k = 0; k < n; k++)
+			nr_pages += __do_page_cache_readahead(mapping, filp,
+					first + k * s->stride, chunk,
+					mark && k == mark ? chunk : 0);
+	}
+
+	s->last = first + (n - 1) * s->stride;
+	s->size = n;
+	ra_stream_touch(ra, s);
+
+	return nr_pages;
+}
+
+/*
+ * Feed a request at @offset into the stream table of @ra. If it continues
+ * a known stream, or hits the marker of one, the stream's next window is
+ * read and its size returned. Otherwise the request refines the stride of
+ * the nearest stream or starts a new one, and 0 is returned.
+ */
+static unsigned long ra_stream_readahead(struct address_space *mapping,
+					 struct file_ra_state *ra,
+					 struct file *filp, bool hit_marker,
+					 pgoff_t offset, unsigned long req_size,
+					 unsigned long max_pages, int *pattern)
+{
+	struct file_ra_stream *s, *near = NULL, *oldest = &ra->streams[0];
+	unsigned long dist, near_dist;
+	int i;
+
+	/* The stride has to fit struct file_ra_stream */
+	near_dist = min_t(unsigned long, RA_STREAM_MAX_STRIDE(max_pages),
+			  INT_MAX);
+
+	for (i = 0; i < RA_NR_STREAMS; i++) {
+		s = &ra->streams[i];
+		if (!s->stride)
+			continue;
+		if (hit_marker ? offset == ra_stream_marker(s) :
+				 offset == s->last + s->stride) {
+			*pattern = s->stride < 0 ? RA_PATTERN_REVERSE :
+						   RA_PATTERN_STRIDE;
+			return ra_stream_submit(mapping, ra, filp, s,
+						req_size, max_pages);
+		}
+	}
+
+	if (hit_marker)
+		return 0;
+
+	for (i = 0; i < RA_NR_STREAMS; i++) {
+		s = &ra->streams[i];
+		if ((short)(s->stamp - oldest->stamp) < 0)
+			oldest = s;
+		if (!s->stamp)
+			continue;
+		dist = offset > s->last ? offset - s->last : s->last - offset;
+		if (dist && dist <= near_dist) {
+			near = s;
+			near_dist = dist;
+		}
+	}
+
+	s = near ? near : oldest;
+	s->stride = near ? (int)(offset - s->last) : 0;
+	s->last = offset;
+	s->size = 0;
+	ra_stream_touch(ra, s);
+
+	return 0;
+}
+
 /*
  * A minimal readahead algorithm for trivial sequential/random reads.
  */
@@ -387,8 +520,9 @@ ondemand_readahead(struct address_space *mapping,
 {
 	struct backing_dev_info *bdi = inode_to_bdi(mapping->host);
 	unsigned long max_pages = ra->ra_pages;
-	unsigned long add_pages;
+	unsigned long add_pages, nr_pages;
 	pgoff_t prev_offset;
+	int pattern = RA_PATTERN_INITIAL;
 
 	/*
 	 * If the request exceeds the readahead window, allow the read to
@@ -412,24 +546,34 @@ ondemand_readahead(struct address_space *mapping,
 		ra->start += ra->size;
 		ra->size = get_next_ra_size(ra, max_pages);
 		ra->async_size = ra->size;
+		pattern = RA_PATTERN_SEQUENTIAL;
 		goto readit;
 	}
 
 	/*
 	 * Hit a marked page without valid readahead state.
 	 * E.g. interleaved reads.
-	 * Query the pagecache for async_size, which normally equals to
+	 * The marker may belong to a strided or backward stream; if not,
+	 * query the pagecache for async_size, which normally equals to
 	 * readahead size. Ramp it up and use it as the new readahead size.
 	 */
 	if (hit_readahead_marker) {
 		pgoff_t start;
 
+		nr_pages = ra_stream_readahead(mapping, ra, filp, true, offset,
+					       req_size, max_pages, &pattern);
+		if (nr_pages)
+			goto out;
+
+		pattern = RA_PATTERN_MARKER;
 		rcu_read_lock();
 		start = page_cache_next_hole(mapping, offset + 1, max_pages);
 		rcu_read_unlock();
 
-		if (!start || start - offset > max_pages)
-			return 0;
+		if (!start || start - offset > max_pages) {
+			nr_pages = 0;
+			goto out;
+		}
 
 		ra->start = start;
 		ra->size = start - offset;	/* old async_size */
@@ -454,18 +598,32 @@ ondemand_readahead(struct address_space *mapping,
 	if (offset - prev_offset <= 1UL)
 		goto initial_readahead;
 
+	/*
+	 * A request continuing a strided or backward stream gets that
+	 * stream's next window; any other one is recorded so such a
+	 * stream can be recognised on its third request.
+	 */
+	nr_pages = ra_stream_readahead(mapping, ra, filp, false, offset,
+				       req_size, max_pages, &pattern);
+	if (nr_pages)
+		goto out;
+
 	/*
 	 * Query the page cache and look for the traces(cached history pages)
 	 * that a sequential stream would leave behind.
 	 */
-	if (try_context_readahead(mapping, ra, offset, req_size, max_pages))
+	if (try_context_readahead(mapping, ra, offset, req_size, max_pages)) {
+		pattern = RA_PATTERN_CONTEXT;
 		goto readit;
+	}
 
 	/*
 	 * standalone, small random read
 	 * Read as is, and do not pollute the readahead state.
 	 */
-	return __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
+	pattern = RA_PATTERN_RANDOM;
+	nr_pages = __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
+	goto out;
 
 initial_readahead:
 	ra->start = offset;
@@ -490,7 +648,11 @@ ondemand_readahead(struct address_space *mapping,
 		}
 	}
 
-	return ra_submit(ra, mapping, filp);
+	nr_pages = ra_submit(ra, mapping, filp);
+out:
+	trace_mm_filemap_readahead(mapping, offset, req_size,
+				   hit_readahead_marker, pattern, nr_pages);
+	return nr_pages;
 }
 
 /**
@@ -1781,6 +1781,7 @@ static inline void *acquire_slab(struct kmem_cache *s,
 
 static void put_cpu_partial(struct kmem_cache *s, struct page *page, int drain);
 static inline bool pfmemalloc_match(struct page *page, gfp_t gfpflags);
+static void magazine_drain(struct kmem_cache *s, int cpu);
 
 /*
  * Try to allocate a partial slab from a specific node.
@@ -2275,6 +2276,9 @@ static inline void __flush_cpu_slab(struct kmem_cache *s, int cpu)
 {
 	struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
 
+	if (s->magazine)
+		magazine_drain(s, cpu);
+
 	if (likely(c)) {
 		if (c->page)
 			flush_slab(s, c);
@@ -2295,6 +2299,9 @@ static bool has_cpu_slab(int cpu, void *info)
 	struct kmem_cache *s = info;
 	struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
 
+	if (s->magazine && per_cpu_ptr(s->magazine, cpu)->nr)
+		return true;
+
 	return c->page || slub_percpu_partial(c);
 }
 
@@ -2611,6 +2618,60 @@ static void *__slab_alloc(struct kmem_cache *s, gfp_t gfpflags, int node,
 	return p;
 }
 
+/*
+ * SLAB_MAGAZINE caches keep a per cpu stack of free objects in front of the
+ * cpu slab. Allocations pop from it with interrupts disabled. Once it is empty
+ * it is refilled in one go from the cpu slab's freelist, after loading a new
+ * cpu slab if that ran dry, instead of going through ___slab_alloc() for every
+ * object. Objects in a magazine are free as far as the debug hooks go.
+ */
+static void *magazine_alloc(struct kmem_cache *s, gfp_t gfpflags,
+			    unsigned long addr)
+{
+	struct kmem_cache_magazine *m;
+	struct kmem_cache_cpu *c;
+	unsigned long flags;
+	bool refilled = false;
+	void *object;
+
+	local_irq_save(flags);
+	m = this_cpu_ptr(s->magazine);
+	if (likely(m->nr)) {
+		object = m->objects[--m->nr];
+		local_irq_restore(flags);
+		stat(s, MAGAZINE_ALLOC);
+		return object;
+	}
+
+	c = this_cpu_ptr(s->cpu_slab);
+	object = c->freelist;
+	if (likely(object)) {
+		c->freelist = get_freepointer(s, object);
+	} else {
+		object = ___slab_alloc(s, gfpflags, NUMA_NO_NODE, addr, c);
+		/* We may have been rescheduled while the slab was allocated */
+		c = this_cpu_ptr(s->cpu_slab);
+		m = this_cpu_ptr(s->magazine);
+	}
+
+	/* Objects of a pfmemalloc slab must not leak to other allocations */
+	if (object && c->page && !PageSlabPfmemalloc(c->page)) {
+		while (m->nr < SLUB_MAGAZINE_SIZE / 2 && c->freelist) {
+			void *p = c->freelist;
+
+			c->freelist = get_freepointer(s, p);
+			m->objects[m->nr++] = p;
+			refilled = true;
+		}
+	}
+	c->tid = next_tid(c->tid);
+	local_irq_restore(flags);
+	if (refilled)
+		stat(s, MAGAZINE_REFILL);
+
+	return object;
+}
+
 /*
  * Inlined fastpath so that allocation functions (kmalloc, kmem_cache_alloc)
  * have the fastpath folded into their functions. So no function call
@@ -2632,6 +2693,11 @@ static __always_inline void *slab_alloc_node(struct kmem_cache *s,
 	s = slab_pre_alloc_hook(s, gfpflags);
 	if (!s)
 		return NULL;
+
+	if (s->magazine && node == NUMA_NO_NODE) {
+		object = magazine_alloc(s, gfpflags, addr);
+		goto out;
+	}
 redo:
 	/*
 	 * Must read kmem_cache cpu data via this cpu ptr. Preemption is
@@ -2699,7 +2765,7 @@ static __always_inline void *slab_alloc_node(struct kmem_cache *s,
 		prefetch_freepointer(s, next_object);
 		stat(s, ALLOC_FASTPATH);
 	}
-
+out:
 	if (unlikely(gfpflags & __GFP_ZERO) && object)
 		memset(object, 0, s->object_size);
 
@@ -2942,6 +3008,56 @@ static __always_inline void do_slab_free(struct kmem_cache *s,
 
 }
 
+/*
+ * Push a single object onto the cpu magazine. A full magazine first hands
+ * its older half back to the slabs, outside of the interrupt disabled
+ * section.
+ */
+static bool magazine_free(struct kmem_cache *s, struct page *page,
+			  void *object, unsigned long addr)
+{
+	void *flush[SLUB_MAGAZINE_SIZE / 2];
+	struct kmem_cache_magazine *m;
+	unsigned long flags;
+	unsigned int i, nr = 0;
+
+	if (unlikely(PageSlabPfmemalloc(page)))
+		return false;
+
+	local_irq_save(flags);
+	m = this_cpu_ptr(s->magazine);
+	if (unlikely(m->nr == SLUB_MAGAZINE_SIZE)) {
+		nr = ARRAY_SIZE(flush);
+		memcpy(flush, m->objects, sizeof(flush));
+		m->nr -= nr;
+		memmove(m->objects, m->objects + nr, m->nr * sizeof(void *));
+	}
+	m->objects[m->nr++] = object;
+	local_irq_restore(flags);
+	stat(s, MAGAZINE_FREE);
+
+	if (nr) {
+		for (i = 0; i < nr; i++)
+			do_slab_free(s, virt_to_head_page(flush[i]), flush[i],
+				     NULL, 1, addr);
+		stat(s, MAGAZINE_FLUSH);
+	}
+	return true;
+}
+
+/* Called with interrupts disabled, see __flush_cpu_slab() */
+static void magazine_drain(struct kmem_cache *s, int cpu)
+{
+	struct kmem_cache_magazine *m = per_cpu_ptr(s->magazine, cpu);
+
+	while (m->nr) {
+		void *object = m->objects[--m->nr];
+
+		do_slab_free(s, virt_to_head_page(object), object, NULL, 1,
+			     _RET_IP_);
+	}
+}
+
 static __always_inline void slab_free(struct kmem_cache *s, struct page *page,
 				      void *head, void *tail, int cnt,
 				      unsigned long addr)
@@ -2950,8 +3066,11 @@ static __always_inline void slab_free(struct kmem_cache *s, struct page *page,
 	 * With KASAN enabled slab_free_freelist_hook modifies the freelist
 	 * to remove objects, whose reuse must be delayed.
 	 */
-	if (slab_free_freelist_hook(s, &head, &tail))
+	if (slab_free_freelist_hook(s, &head, &tail)) {
+		if (s->magazine && !tail && magazine_free(s, page, head, addr))
+			return;
 		do_slab_free(s, page, head, tail, cnt, addr);
+	}
 }
 
 #ifdef CONFIG_KASAN
@@ -3293,6 +3412,19 @@ static inline int alloc_kmem_cache_cpus(struct kmem_cache *s)
 	if (!s->cpu_slab)
 		return 0;
 
+	/*
+	 * Debug caches need every object to go through the slow paths, and
+	 * memcg caches must be able to drain all their objects on their own.
+	 */
+	if ((s->flags & SLAB_MAGAZINE) && !kmem_cache_debug(s) &&
+	    is_root_cache(s)) {
+		s->magazine = alloc_percpu(struct kmem_cache_magazine);
+		if (!s->magazine) {
+			free_percpu(s->cpu_slab);
+			return 0;
+		}
+	}
+
 	init_kmem_cache_cpus(s);
 
 	return 1;
@@ -3360,6 +3492,7 @@ static void free_kmem_cache_nodes(struct kmem_cache *s)
 void __kmem_cache_release(struct kmem_cache *s)
 {
 	cache_random_seq_destroy(s);
+	free_percpu(s->magazine);
 	free_percpu(s->cpu_slab);
 	free_kmem_cache_nodes(s);
 }
@@ -5049,6 +5182,12 @@ static ssize_t reclaim_account_store(struct kmem_cache *s,
 }
 SLAB_ATTR(reclaim_account);
 
+static ssize_t magazine_show(struct kmem_cache *s, char *buf)
+{
+	return sprintf(buf, "%d\n", !!s->magazine);
+}
+SLAB_ATTR_RO(magazine);
+
 static ssize_t hwcache_align_show(struct kmem_cache *s, char *buf)
 {
 	return sprintf(buf, "%d\n", !!(s->flags & SLAB_HWCACHE_ALIGN));
@@ -5367,6 +5506,10 @@ STAT_ATTR(CPU_PARTIAL_ALLOC, cpu_partial_alloc);
 STAT_ATTR(CPU_PARTIAL_FREE, cpu_partial_free);
 STAT_ATTR(CPU_PARTIAL_NODE, cpu_partial_node);
 STAT_ATTR(CPU_PARTIAL_DRAIN, cpu_partial_drain);
+STAT_ATTR(MAGAZINE_ALLOC, magazine_alloc);
+STAT_ATTR(MAGAZINE_REFILL, magazine_refill);
+STAT_ATTR(MAGAZINE_FREE, magazine_free);
+STAT_ATTR(MAGAZINE_FLUSH, magazine_flush);
 #endif
 
 static struct attribute *slab_attrs[] = {
@@ -5385,6 +5528,7 @@ static struct attribute *slab_attrs[] = {
 	&align_attr.attr,
 	&hwcache_align_attr.attr,
 	&reclaim_account_attr.attr,
+	&magazine_attr.attr,
 	&destroy_by_rcu_attr.attr,
 	&shrink_attr.attr,
 	&slabs_cpu_partial_attr.attr,
@@ -5433,6 +5577,10 @@ static struct attribute *slab_attrs[] = {
 	&cpu_partial_free_attr.attr,
 	&cpu_partial_node_attr.attr,
 	&cpu_partial_drain_attr.attr,
+	&magazine_alloc_attr.attr,
+	&magazine_refill_attr.attr,
+	&magazine_free_attr.attr,
+	&magazine_flush_attr.attr,
 #endif
 #ifdef CONFIG_FAILSLAB
 	&failslab_attr.attr,
@@ -58,6 +58,21 @@ static bool enable_vma_readahead __read_mostly = true;
 #define GET_SWAP_RA_VAL(vma)					\
 	(atomic_long_read(&(vma)->swap_readahead_info) ? : 4)
 
+/*
+ * vma->swap_readahead_stride holds the distance in pages between the last
+ * two swap faults or hits in the VMA, and how many times in a row it has
+ * repeated. A repeated distance is followed by the readahead window.
+ */
+#define SWAP_RA_CONF_BITS	4
+#define SWAP_RA_CONF_MAX	((1UL << SWAP_RA_CONF_BITS) - 1)
+#define SWAP_RA_STRIDE_MAX	(PTRS_PER_PTE / 4)
+
+#define SWAP_RA_STRIDE(v)	((long)(v) >> SWAP_RA_CONF_BITS)
+#define SWAP_RA_CONF(v)		((v) & SWAP_RA_CONF_MAX)
+#define SWAP_RA_STRIDE_VAL(stride, conf)			\
+	(((unsigned long)(stride) << SWAP_RA_CONF_BITS) |	\
+	 ((conf) & SWAP_RA_CONF_MAX))
+
 #define INC_CACHE_INFO(x)	do { swap_cache_info.x++; } while (0)
 #define ADD_CACHE_INFO(x, nr)	do { swap_cache_info.x += (nr); } while (0)
 
@@ -191,6 +206,9 @@ void __delete_from_swap_cache(struct page *page)
 		radix_tree_delete(&address_space->i_pages, idx + i);
 		set_page_private(page + i, 0);
 	}
+	/* Read ahead, but never looked up */
+	if (unlikely(!PageCompound(page) && PageReadahead(page)))
+		__count_vm_event(SWAP_RA_WASTED);
 	ClearPageSwapCache(page);
 	address_space->nrpages -= nr;
 	__mod_node_page_state(page_pgdat(page), NR_FILE_PAGES, -nr);
@@ -324,6 +342,38 @@ static inline bool swap_use_vma_readahead(void)
 	return READ_ONCE(enable_vma_readahead) && !atomic_read(&nr_rotate_swap);
 }
 
+/*
+ * Feed the access at @pfn, following one at @prev_pfn, into the pattern
+ * detector of @vma. Returns the stride in pages once it has been seen at
+ * least twice in a row (1 is sequential, -1 reverse), otherwise 0.
+ */
+static long swap_ra_update_pattern(struct vm_area_struct *vma,
+				   unsigned long prev_pfn, unsigned long pfn)
+{
+	unsigned long val = atomic_long_read(&vma->swap_readahead_stride);
+	long stride = SWAP_RA_STRIDE(val);
+	unsigned long conf = SWAP_RA_CONF(val);
+	long delta = pfn - prev_pfn;
+
+	/* The same page again says nothing about the direction */
+	if (!delta)
+		return conf ? stride : 0;
+
+	if (delta > SWAP_RA_STRIDE_MAX || delta < -SWAP_RA_STRIDE_MAX)
+		delta = 0;
+
+	if (delta && delta == stride) {
+		conf = min(conf + 1, SWAP_RA_CONF_MAX);
+	} else {
+		stride = delta;
+		conf = 0;
+	}
+	atomic_long_set(&vma->swap_readahead_stride,
+			SWAP_RA_STRIDE_VAL(stride, conf));
+
+	return conf ? stride : 0;
+}
+
 /*
  * Lookup a swap entry in the swap cache. A found page will be returned
  * unlocked and with its refcount incremented - we rely on the kernel
@@ -360,6 +410,8 @@ struct page *lookup_swap_cache(swp_entry_t entry, struct vm_area_struct *vma,
 			hits = SWAP_RA_HITS(ra_val);
 			if (readahead)
 				hits = min_t(int, hits + 1, SWAP_RA_HITS_MAX);
+			swap_ra_update_pattern(vma, PFN_DOWN(SWAP_RA_ADDR(ra_val)),
+					       PFN_DOWN(addr));
 			atomic_long_set(&vma->swap_readahead_info,
 					SWAP_RA_VAL(addr, win, hits));
 		}
@@ -525,6 +577,22 @@ static unsigned int __swapin_nr_pages(unsigned long prev_offset,
 	return pages;
 }
 
+/*
+ * Window for a detected access pattern: it doubles for as long as the
+ * pages read ahead are used, and holds while they are not.
+ */
+static unsigned int swap_ra_pattern_win(unsigned int hits,
+					unsigned int max_win,
+					unsigned int prev_win)
+{
+	unsigned int win = max(prev_win, 2U);
+
+	if (hits)
+		win *= 2;
+
+	return min(win, max_win);
+}
+
 static unsigned long swapin_nr_pages(unsigned long offset)
 {
 	static unsigned long prev_offset;
@@ -670,7 +738,8 @@ static void swap_ra_info(struct vm_fault *vmf,
 	unsigned long faddr, pfn, fpfn;
 	unsigned long start, end;
 	pte_t *pte, *orig_pte;
-	unsigned int max_win, hits, prev_win, win, left;
+	unsigned int max_win, hits, prev_win, win, left, step;
+	long stride;
 #ifndef CONFIG_64BIT
 	pte_t *tpte;
 #endif
@@ -695,8 +764,12 @@ static void swap_ra_info(struct vm_fault *vmf,
 	pfn = PFN_DOWN(SWAP_RA_ADDR(ra_val));
 	prev_win = SWAP_RA_WIN(ra_val);
 	hits = SWAP_RA_HITS(ra_val);
-	ra_info->win = win = __swapin_nr_pages(pfn, fpfn, hits,
-					       max_win, prev_win);
+	stride = swap_ra_update_pattern(vma, pfn, fpfn);
+	if (stride)
+		win = swap_ra_pattern_win(hits, max_win, prev_win);
+	else
+		win = __swapin_nr_pages(pfn, fpfn, hits, max_win, prev_win);
+	ra_info->win = win;
 	atomic_long_set(&vma->swap_readahead_info,
 			SWAP_RA_VAL(faddr, win, 0));
 
@@ -706,38 +779,70 @@ static void swap_ra_info(struct vm_fault *vmf,
 	}
 
 	/* Copy the PTEs because the page table may be unmapped */
-	if (fpfn == pfn + 1)
+	step = 1;
+	if (stride > 1 || stride < -1) {
+		/* Every stride-th page, in the direction of the accesses */
+		step = abs(stride);
+		left = (win - 1) * step;
+		if (stride > 0)
+			swap_ra_clamp_pfn(vma, faddr, fpfn, fpfn + left + 1,
+					  &start, &end);
+		else
+			swap_ra_clamp_pfn(vma, faddr,
+					  fpfn - min_t(unsigned long, fpfn, left),
+					  fpfn + 1, &start, &end);
+		/* Keep the faulting page on the grid */
+		start = fpfn - (fpfn - start) / step * step;
+	} else if (stride == 1 || (!stride && fpfn == pfn + 1)) {
 		swap_ra_clamp_pfn(vma, faddr, fpfn, fpfn + win, &start, &end);
-	else if (pfn == fpfn + 1)
+	} else if (stride == -1 || (!stride && pfn == fpfn + 1)) {
 		swap_ra_clamp_pfn(vma, faddr, fpfn - win + 1, fpfn + 1,
 				  &start, &end);
-	else {
+	} else {
 		left = (win - 1) / 2;
 		swap_ra_clamp_pfn(vma, faddr, fpfn - left, fpfn + win - left,
 				  &start, &end);
 	}
-	ra_info->nr_pte = end - start;
-	ra_info->offset = fpfn - start;
-	pte -= ra_info->offset;
+	if (stride)
+		count_vm_event(SWAP_RA_PATTERN);
+
+	ra_info->nr_pte = DIV_ROUND_UP(end - start, step);
+	ra_info->offset = (fpfn - start) / step;
+	pte -= fpfn - start;
 #ifdef CONFIG_64BIT
 	ra_info->ptes = pte;
+	ra_info->step = step;
 #else
 	tpte = ra_info->ptes;
-	for (pfn = start; pfn != end; pfn++)
-		*tpte++ = *pte++;
+	for (pfn = start; pfn < end; pfn += step, pte += step)
+		*tpte++ = *pte;
+	ra_info->step = 1;
 #endif
 	pte_unmap(orig_pte);
 }
 
+/* Pages of a readahead window whose reads are issued back to back */
+#define SWAP_RA_BATCH	8
+
+static void swap_ra_submit(struct page **pages, unsigned int nr)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr; i++) {
+		swap_readpage(pages[i], false);
+		put_page(pages[i]);
+	}
+}
+
 static struct page *swap_vma_readahead(swp_entry_t fentry, gfp_t gfp_mask,
 				       struct vm_fault *vmf)
 {
 	struct blk_plug plug;
 	struct vm_area_struct *vma = vmf->vma;
-	struct page *page;
+	struct page *page, *batch[SWAP_RA_BATCH];
 	pte_t *pte, pentry;
 	swp_entry_t entry;
-	unsigned int i;
+	unsigned int i, nr = 0;
 	bool page_allocated;
 	struct vma_swap_readahead ra_info = {0,};
 
@@ -745,9 +850,17 @@ static struct page *swap_vma_readahead(swp_entry_t fentry, gfp_t gfp_mask,
 	if (ra_info.win == 1)
 		goto skip;
 
+	/*
+	 * Add up to SWAP_RA_BATCH pages of the window, faulting page
+	 * included, to the swap cache before reading them. Allocating a page
+	 * may sleep and flush the plug, so doing it between reads would split
+	 * the window into single page requests. The new pages stay locked
+	 * until their read completes, which direct compaction copes with as it
+	 * does for file readahead.
+	 */
 	blk_start_plug(&plug);
 	for (i = 0, pte = ra_info.ptes; i < ra_info.nr_pte;
-	     i++, pte++) {
+	     i++, pte += ra_info.step) {
 		pentry = *pte;
 		if (pte_none(pentry))
 			continue;
@@ -760,15 +873,21 @@ static struct page *swap_vma_readahead(swp_entry_t fentry, gfp_t gfp_mask,
 					       vmf->address, &page_allocated);
 		if (!page)
 			continue;
-		if (page_allocated) {
-			swap_readpage(page, false);
-			if (i != ra_info.offset) {
-				SetPageReadahead(page);
-				count_vm_event(SWAP_RA);
-			}
+		if (!page_allocated) {
+			put_page(page);
+			continue;
+		}
+		if (i != ra_info.offset) {
+			SetPageReadahead(page);
+			count_vm_event(SWAP_RA);
+		}
+		batch[nr++] = page;
+		if (nr == SWAP_RA_BATCH) {
+			swap_ra_submit(batch, nr);
+			nr = 0;
 		}
-		put_page(page);
 	}
+	swap_ra_submit(batch, nr);
 	blk_finish_plug(&plug);
 	lru_add_drain();
 skip:
@@ -788,6 +788,24 @@ void truncate_pagecache(struct inode *inode, loff_t newsize)
 	struct address_space *mapping = inode->i_mapping;
 	loff_t holebegin = round_up(newsize, PAGE_SIZE);
 
+	/*
+	 * Read-only THPs of a regular file cannot be split: drop the whole
+	 * huge page that straddles the new size, writing back any dirty small
+	 * pages in front of @newsize first.  The truncating task holds write
+	 * access to @inode; smp_mb() pairs with the one in collapse_file().
+	 */
+	if (IS_ENABLED(CONFIG_READ_ONLY_THP_FOR_FS)) {
+		smp_mb();
+		if (filemap_nr_thps(mapping)) {
+			loff_t start = round_down(newsize, HPAGE_PMD_SIZE);
+
+			if (start < newsize)
+				filemap_write_and_wait_range(mapping, start,
+							     newsize - 1);
+			newsize = holebegin = start;
+		}
+	}
+
 	/*
 	 * unmap_mapping_range is called twice, first simply for
 	 * efficiency so that truncate_inode_pages does fewer
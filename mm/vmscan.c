@@ -49,12 +49,16 @@
 #include <linux/prefetch.h>
 #include <linux/printk.h>
 #include <linux/dax.h>
+#include <linux/mmu_notifier.h>
+#include <linux/pid_namespace.h>
+#include <linux/migrate.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
 
 #include <linux/swapops.h>
 #include <linux/balloon_compaction.h>
+#include <linux/psi.h>
 
 #include "internal.h"
 
@@ -99,6 +103,9 @@ struct scan_control {
 	/* One of the zones is ready for compaction */
 	unsigned int compaction_ready:1;
 
+	/* Pages must be freed, not moved to a slower memory node */
+	unsigned int no_demotion:1;
+
 	/* Allocation order */
 	s8 order;
 
@@ -907,7 +914,7 @@ static int __remove_mapping(struct address_space *mapping, struct page *page,
 	 * Note that if SetPageDirty is always performed via set_page_dirty,
 	 * and thus under the i_pages lock, then this ordering is not required.
 	 */
-	if (unlikely(PageTransHuge(page)) && PageSwapCache(page))
+	if (unlikely(PageTransHuge(page)))
 		refcount = 1 + HPAGE_PMD_NR;
 	else
 		refcount = 2;
@@ -1090,6 +1097,113 @@ static void page_check_dirty_writeback(struct page *page,
 		mapping->a_ops->is_dirty_writeback(page, dirty, writeback);
 }
 
+/*
+ * Demoting a page keeps it in memory, so it does not help with reclaim on
+ * behalf of a memory cgroup: the charge moves along with the page.
+ */
+static bool can_demote(int nid, struct scan_control *sc)
+{
+	if (!numa_demotion_enabled)
+		return false;
+	if (sc) {
+		if (sc->no_demotion)
+			return false;
+		if (!global_reclaim(sc))
+			return false;
+	}
+	return next_demotion_node(nid) != NUMA_NO_NODE;
+}
+
+/*
+ * Anonymous pages are worth aging if they can be swapped out or demoted.
+ */
+static bool can_age_anon_pages(struct pglist_data *pgdat,
+			       struct scan_control *sc)
+{
+	if (total_swap_pages > 0)
+		return true;
+	return can_demote(pgdat->node_id, sc);
+}
+
+struct demote_control {
+	int nid;
+	/* base pages handed out and not returned unused */
+	unsigned int nr_demoted;
+};
+
+static struct page *alloc_demote_page(struct page *page,
+				      unsigned long private)
+{
+	struct demote_control *dc = (struct demote_control *)private;
+	/* Do not reclaim on the slow node, fall back to freeing the page */
+	gfp_t gfp_mask = (GFP_HIGHUSER_MOVABLE & ~__GFP_RECLAIM) |
+			 __GFP_THISNODE | __GFP_NOWARN | __GFP_NOMEMALLOC;
+	unsigned int order = 0;
+	struct page *newpage;
+
+	if (PageTransHuge(page)) {
+		gfp_mask |= __GFP_COMP;
+		order = HPAGE_PMD_ORDER;
+	}
+
+	newpage = __alloc_pages_node(dc->nid, gfp_mask, order);
+	if (!newpage)
+		return NULL;
+	if (PageTransHuge(newpage))
+		prep_transhuge_page(newpage);
+	dc->nr_demoted += hpage_nr_pages(newpage);
+	return newpage;
+}
+
+static void free_demote_page(struct page *page, unsigned long private)
+{
+	struct demote_control *dc = (struct demote_control *)private;
+
+	dc->nr_demoted -= hpage_nr_pages(page);
+	put_page(page);
+}
+
+/*
+ * Take pages on @demote_pages and attempt to demote them to another node.
+ * Pages which are not demoted are left on @demote_pages.
+ */
+static unsigned int demote_page_list(struct list_head *demote_pages,
+				     struct pglist_data *pgdat)
+{
+	struct demote_control dc = {
+		.nid = next_demotion_node(pgdat->node_id),
+	};
+	unsigned long nr_isolated[2] = { 0, 0 };
+	struct page *page;
+
+	if (list_empty(demote_pages) || dc.nid == NUMA_NO_NODE)
+		return 0;
+
+	/*
+	 * migrate_pages() drops NR_ISOLATED_* for every page that leaves the
+	 * list, but our caller does that for the whole batch it isolated.
+	 */
+	list_for_each_entry(page, demote_pages, lru)
+		nr_isolated[page_is_file_cache(page)] += hpage_nr_pages(page);
+	mod_node_page_state(pgdat, NR_ISOLATED_ANON, nr_isolated[0]);
+	mod_node_page_state(pgdat, NR_ISOLATED_FILE, nr_isolated[1]);
+
+	migrate_pages(demote_pages, alloc_demote_page, free_demote_page,
+		      (unsigned long)&dc, MIGRATE_ASYNC, MR_DEMOTION);
+
+	list_for_each_entry(page, demote_pages, lru)
+		nr_isolated[page_is_file_cache(page)] -= hpage_nr_pages(page);
+	mod_node_page_state(pgdat, NR_ISOLATED_ANON, -nr_isolated[0]);
+	mod_node_page_state(pgdat, NR_ISOLATED_FILE, -nr_isolated[1]);
+
+	if (current_is_kswapd())
+		mod_node_page_state(pgdat, PGDEMOTE_KSWAPD, dc.nr_demoted);
+	else
+		mod_node_page_state(pgdat, PGDEMOTE_DIRECT, dc.nr_demoted);
+
+	return dc.nr_demoted;
+}
+
 /*
  * shrink_page_list() returns the number of reclaimed pages
  */
@@ -1102,6 +1216,8 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 {
 	LIST_HEAD(ret_pages);
 	LIST_HEAD(free_pages);
+	LIST_HEAD(demote_pages);
+	bool do_demote_pass = can_demote(pgdat->node_id, sc);
 	int pgactivate = 0;
 	unsigned nr_unqueued_dirty = 0;
 	unsigned nr_dirty = 0;
@@ -1114,6 +1230,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 
 	cond_resched();
 
+retry:
 	while (!list_empty(page_list)) {
 		struct address_space *mapping;
 		struct page *page;
@@ -1264,6 +1381,17 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			; /* try to reclaim the page below */
 		}
 
+		/*
+		 * Before reclaiming the page, try to relocate its contents
+		 * to a slower memory node.
+		 */
+		if (do_demote_pass &&
+		    (thp_migration_supported() || !PageTransHuge(page))) {
+			list_add(&page->lru, &demote_pages);
+			unlock_page(page);
+			continue;
+		}
+
 		/*
 		 * Anonymous process memory has backing store?
 		 * Try to allocate it some swap space here.
@@ -1486,6 +1614,15 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 		VM_BUG_ON_PAGE(PageLRU(page) || PageUnevictable(page), page);
 	}
 
+	/* Migrate pages selected for demotion */
+	nr_reclaimed += demote_page_list(&demote_pages, pgdat);
+	/* Pages that could not be demoted go through regular reclaim */
+	if (!list_empty(&demote_pages)) {
+		list_splice_init(&demote_pages, page_list);
+		do_demote_pass = false;
+		goto retry;
+	}
+
 	mem_cgroup_uncharge_list(&free_pages);
 	try_to_unmap_flush();
 	free_unref_page_list(&free_pages);
@@ -1513,6 +1650,7 @@ unsigned long reclaim_clean_pages_from_list(struct zone *zone,
 		.gfp_mask = GFP_KERNEL,
 		.priority = DEF_PRIORITY,
 		.may_unmap = 1,
+		.no_demotion = 1,
 	};
 	unsigned long ret;
 	struct page *page, *next;
@@ -1632,6 +1770,638 @@ static __always_inline void update_lru_sizes(struct lruvec *lruvec,
 
 }
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * Multi-generational LRU. The list and size helpers live in mm_inline.h;
+ * this is the aging side, which walks page tables to find accessed pages,
+ * and the eviction side, which isolates pages from the oldest generation.
+ */
+DEFINE_STATIC_KEY_FALSE(lru_gen_key);
+
+/* Protects lru_gen_state and serialises switching every lruvec over */
+static DEFINE_MUTEX(lru_gen_state_mutex);
+static bool lru_gen_state;
+
+/* Pages moved per lru_lock hold when switching an lruvec over */
+#define LRU_GEN_MOVE_BATCH	64
+/* mm_structs pinned per round of the process walk */
+#define LRU_GEN_MM_BATCH	16
+
+static inline bool lru_gen_lruvec_enabled(struct lruvec *lruvec)
+{
+	return READ_ONCE(lruvec->lrugen.enabled);
+}
+
+static inline unsigned long lru_gen_nr_gens(struct lruvec *lruvec, int type)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+
+	return READ_ONCE(lrugen->max_seq[type]) -
+	       READ_ONCE(lrugen->min_seq[type]) + 1;
+}
+
+void lru_gen_init_lruvec(struct lruvec *lruvec)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int gen, type, zid;
+
+	lrugen->enabled = READ_ONCE(lru_gen_state);
+	lrugen->walking = 0;
+	for (type = 0; type < ANON_AND_FILE; type++) {
+		lrugen->max_seq[type] = MIN_NR_GENS - 1;
+		lrugen->min_seq[type] = 0;
+	}
+
+	for (gen = 0; gen < MAX_NR_GENS; gen++) {
+		for (type = 0; type < ANON_AND_FILE; type++) {
+			for (zid = 0; zid < MAX_NR_ZONES; zid++) {
+				INIT_LIST_HEAD(&lrugen->lists[gen][type][zid]);
+				lrugen->nr_pages[gen][type][zid] = 0;
+			}
+		}
+	}
+}
+
+/* Move @page, which is on generation @old_gen, to the head of @new_gen */
+static void lru_gen_move_page(struct lruvec *lruvec, struct page *page,
+			      int old_gen, int new_gen)
+{
+	int type = page_is_file_cache(page);
+
+	list_move(&page->lru,
+		  &lruvec->lrugen.lists[new_gen][type][page_zonenum(page)]);
+	lru_gen_update_size(lruvec, page, old_gen, new_gen);
+	set_page_lru_gen(page, new_gen);
+}
+
+/*
+ * Start a new generation. The previous second youngest generation drops
+ * out of the active accounting.
+ */
+static void lru_gen_inc_max_seq(struct lruvec *lruvec, int type)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int gen = lru_gen_from_seq(lrugen->max_seq[type] - 1);
+	enum lru_list lru = type * LRU_FILE;
+	int zid;
+
+	lockdep_assert_held(&lruvec_pgdat(lruvec)->lru_lock);
+
+	for (zid = 0; zid < MAX_NR_ZONES; zid++) {
+		long nr_pages = lrugen->nr_pages[gen][type][zid];
+
+		if (!nr_pages)
+			continue;
+
+		update_lru_size(lruvec, lru + LRU_ACTIVE, zid, -nr_pages);
+		update_lru_size(lruvec, lru, zid, nr_pages);
+	}
+
+	WRITE_ONCE(lrugen->max_seq[type], lrugen->max_seq[type] + 1);
+}
+
+/* Retire the oldest generation once all of its lists are empty */
+static bool lru_gen_try_inc_min_seq(struct lruvec *lruvec, int type)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int gen = lru_gen_from_seq(lrugen->min_seq[type]);
+	int zid;
+
+	lockdep_assert_held(&lruvec_pgdat(lruvec)->lru_lock);
+
+	if (lrugen->max_seq[type] - lrugen->min_seq[type] + 1 <= MIN_NR_GENS)
+		return false;
+
+	for (zid = 0; zid < MAX_NR_ZONES; zid++) {
+		if (!list_empty(&lrugen->lists[gen][type][zid]))
+			return false;
+	}
+
+	WRITE_ONCE(lrugen->min_seq[type], lrugen->min_seq[type] + 1);
+	return true;
+}
+
+struct lru_gen_walk {
+	struct pglist_data *pgdat;
+	struct pagevec pvec;
+};
+
+/*
+ * Move the pages collected by the page table walk to the youngest
+ * generation of their lruvec, and drop the references taken on them.
+ */
+static void lru_gen_promote_pages(struct lru_gen_walk *args)
+{
+	struct pglist_data *pgdat = args->pgdat;
+	struct pagevec *pvec = &args->pvec;
+	unsigned long nr_promoted = 0;
+	int i;
+
+	spin_lock_irq(&pgdat->lru_lock);
+	for (i = 0; i < pagevec_count(pvec); i++) {
+		struct page *page = pvec->pages[i];
+		struct lruvec *lruvec;
+		int old_gen, new_gen;
+
+		if (!PageLRU(page))
+			continue;
+
+		old_gen = page_lru_gen(page);
+		if (old_gen < 0)
+			continue;
+
+		lruvec = mem_cgroup_page_lruvec(page, pgdat);
+		if (!lruvec->lrugen.enabled)
+			continue;
+
+		new_gen = lru_gen_from_seq(
+			lruvec->lrugen.max_seq[page_is_file_cache(page)]);
+		if (old_gen == new_gen)
+			continue;
+
+		lru_gen_move_page(lruvec, page, old_gen, new_gen);
+		nr_promoted += hpage_nr_pages(page);
+	}
+	spin_unlock_irq(&pgdat->lru_lock);
+
+	count_vm_events(LRU_GEN_PROMOTED, nr_promoted);
+	pagevec_release(pvec);
+}
+
+/* Returns true when the pagevec is full and has to be flushed */
+static bool lru_gen_collect_page(struct lru_gen_walk *args, struct page *page)
+{
+	page = compound_head(page);
+	if (page_pgdat(page) != args->pgdat || !PageLRU(page) ||
+	    PageUnevictable(page))
+		return false;
+
+	if (!get_page_unless_zero(page))
+		return false;
+
+	return !pagevec_add(&args->pvec, page);
+}
+
+static int lru_gen_walk_pmd_range(pmd_t *pmd, unsigned long addr,
+				  unsigned long end, struct mm_walk *walk)
+{
+	struct lru_gen_walk *args = walk->private;
+	struct vm_area_struct *vma = walk->vma;
+	pte_t *pte, *orig_pte;
+	spinlock_t *ptl;
+	bool full;
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	ptl = pmd_trans_huge_lock(pmd, vma);
+	if (ptl) {
+		full = false;
+		if (pmd_trans_huge(*pmd) && !is_huge_zero_pmd(*pmd) &&
+		    pmd_young(*pmd) && pmdp_clear_young_notify(vma, addr, pmd))
+			full = lru_gen_collect_page(args, pmd_page(*pmd));
+		spin_unlock(ptl);
+
+		if (full)
+			lru_gen_promote_pages(args);
+		return 0;
+	}
+#endif
+
+	if (pmd_trans_unstable(pmd))
+		return 0;
+restart:
+	full = false;
+	orig_pte = pte = pte_offset_map_lock(walk->mm, pmd, addr, &ptl);
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		pte_t ptent = *pte;
+		struct page *page;
+
+		if (!pte_present(ptent) || !pte_young(ptent))
+			continue;
+
+		page = vm_normal_page(vma, addr, ptent);
+		if (!page)
+			continue;
+
+		if (!ptep_clear_young_notify(vma, addr, pte))
+			continue;
+
+		if (lru_gen_collect_page(args, page)) {
+			full = true;
+			addr += PAGE_SIZE;
+			break;
+		}
+	}
+	pte_unmap_unlock(orig_pte, ptl);
+
+	/* The pages are moved without holding the page table lock */
+	if (full) {
+		lru_gen_promote_pages(args);
+		if (addr != end)
+			goto restart;
+	}
+	cond_resched();
+	return 0;
+}
+
+static int lru_gen_walk_test(unsigned long start, unsigned long end,
+			     struct mm_walk *walk)
+{
+	struct vm_area_struct *vma = walk->vma;
+
+	/* Mlocked pages are unevictable; special mappings are left alone */
+	if (vma->vm_flags & (VM_LOCKED | VM_HUGETLB | VM_SPECIAL))
+		return 1;
+
+	return 0;
+}
+
+static void lru_gen_walk_mm(struct mm_struct *mm, struct lru_gen_walk *args)
+{
+	struct mm_walk walk = {
+		.pmd_entry = lru_gen_walk_pmd_range,
+		.test_walk = lru_gen_walk_test,
+		.mm = mm,
+		.private = args,
+	};
+
+	/* Aging is best effort; never wait for a writer */
+	if (!down_read_trylock(&mm->mmap_sem))
+		return;
+
+	walk_page_range(0, mm->highest_vm_end, &walk);
+	up_read(&mm->mmap_sem);
+}
+
+static bool lru_gen_mm_match(struct mm_struct *mm, struct mem_cgroup *memcg)
+{
+	if (!memcg || mem_cgroup_is_root(memcg))
+		return true;
+
+	return mm_match_cgroup(mm, memcg);
+}
+
+/*
+ * Clear the accessed bits of every process mapping pages charged to @memcg
+ * and promote the pages found accessed on @pgdat. The processes are pinned
+ * in small batches so the walk itself runs outside the RCU read side.
+ */
+static void lru_gen_walk_mms(struct pglist_data *pgdat,
+			     struct mem_cgroup *memcg)
+{
+	struct lru_gen_walk args = { .pgdat = pgdat };
+	struct mm_struct *mms[LRU_GEN_MM_BATCH];
+	int next = 1;
+	int nr, i;
+
+	pagevec_init(&args.pvec);
+
+	do {
+		struct pid *pid;
+
+		nr = 0;
+		rcu_read_lock();
+		while (nr < LRU_GEN_MM_BATCH &&
+		       (pid = find_ge_pid(next, &init_pid_ns))) {
+			struct task_struct *task = pid_task(pid, PIDTYPE_PID);
+			struct mm_struct *mm;
+
+			next = pid_nr(pid) + 1;
+			if (!task || !thread_group_leader(task))
+				continue;
+
+			mm = get_task_mm(task);
+			if (!mm)
+				continue;
+
+			if (!lru_gen_mm_match(mm, memcg)) {
+				mmput_async(mm);
+				continue;
+			}
+			mms[nr++] = mm;
+		}
+		rcu_read_unlock();
+
+		for (i = 0; i < nr; i++) {
+			lru_gen_walk_mm(mms[i], &args);
+			mmput_async(mms[i]);
+			cond_resched();
+		}
+	} while (nr == LRU_GEN_MM_BATCH);
+
+	if (pagevec_count(&args.pvec))
+		lru_gen_promote_pages(&args);
+}
+
+/*
+ * Age @lruvec when a type it can reclaim from is down to the minimum
+ * number of generations, which leaves nothing inactive to evict. Only one
+ * reclaimer walks page tables for an lruvec at a time; the others carry on
+ * with what is left in the older generations.
+ */
+static void lru_gen_age_lruvec(struct lruvec *lruvec, struct mem_cgroup *memcg,
+			       struct scan_control *sc)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	struct pglist_data *pgdat = lruvec_pgdat(lruvec);
+	bool need_aging = false;
+	bool aged = false;
+	int type;
+
+	if (!lru_gen_lruvec_enabled(lruvec))
+		return;
+
+	for (type = 0; type < ANON_AND_FILE; type++) {
+		if (!type && (!sc->may_swap ||
+			      (mem_cgroup_get_nr_swap_pages(memcg) <= 0 &&
+			       !can_demote(pgdat->node_id, sc))))
+			continue;
+
+		if (lru_gen_nr_gens(lruvec, type) <= MIN_NR_GENS)
+			need_aging = true;
+	}
+
+	if (!need_aging || test_and_set_bit(0, &lrugen->walking))
+		return;
+
+	spin_lock_irq(&pgdat->lru_lock);
+	if (lrugen->enabled) {
+		for (type = 0; type < ANON_AND_FILE; type++) {
+			if (lru_gen_nr_gens(lruvec, type) < MAX_NR_GENS) {
+				lru_gen_inc_max_seq(lruvec, type);
+				aged = true;
+			}
+		}
+	}
+	spin_unlock_irq(&pgdat->lru_lock);
+
+	if (aged) {
+		count_vm_event(LRU_GEN_AGING);
+		lru_gen_walk_mms(pgdat, memcg);
+	}
+
+	clear_bit(0, &lrugen->walking);
+}
+
+/*
+ * The generation counterpart of the classic loop below: isolate pages from
+ * the tail of the oldest generation, retiring it once it is empty. The two
+ * youngest generations are never evicted; aging has to make room first.
+ */
+static unsigned long lru_gen_isolate_pages(unsigned long nr_to_scan,
+		struct lruvec *lruvec, struct list_head *dst,
+		unsigned long *nr_scanned, struct scan_control *sc,
+		isolate_mode_t mode, enum lru_list lru)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int type = is_file_lru(lru);
+	unsigned long nr_taken = 0;
+	unsigned long skipped = 0;
+	unsigned long scan = 0;
+	unsigned long total_scan = 0;
+	int gen, zid;
+
+	/* Activation is done by aging; there is no active list to shrink */
+	if (is_active_lru(lru))
+		goto out;
+
+	while (scan < nr_to_scan && nr_taken < nr_to_scan &&
+	       lrugen->max_seq[type] - lrugen->min_seq[type] + 1 > MIN_NR_GENS) {
+		gen = lru_gen_from_seq(lrugen->min_seq[type]);
+
+		for (zid = MAX_NR_ZONES - 1; zid >= 0; zid--) {
+			struct list_head *head = &lrugen->lists[gen][type][zid];
+
+			while (scan < nr_to_scan && nr_taken < nr_to_scan &&
+			       !list_empty(head)) {
+				struct page *page = lru_to_page(head);
+
+				VM_BUG_ON_PAGE(!PageLRU(page), page);
+				total_scan++;
+
+				/*
+				 * Ineligible pages move on to the next
+				 * generation so the oldest one can still be
+				 * retired when reclaiming for lower zones.
+				 */
+				if (zid > sc->reclaim_idx) {
+					lru_gen_move_page(lruvec, page, gen,
+						lru_gen_from_seq(lrugen->min_seq[type] + 1));
+					__count_zid_vm_events(PGSCAN_SKIP, zid, 1);
+					skipped++;
+					continue;
+				}
+
+				scan++;
+				switch (__isolate_lru_page(page, mode)) {
+				case 0:
+					nr_taken += hpage_nr_pages(page);
+					lru_gen_del_page(lruvec, page);
+					list_add(&page->lru, dst);
+					break;
+
+				case -EBUSY:
+					/* else it is being freed elsewhere */
+					list_move(&page->lru, head);
+					break;
+
+				default:
+					BUG();
+				}
+			}
+		}
+
+		if (!lru_gen_try_inc_min_seq(lruvec, type))
+			break;
+	}
+out:
+	*nr_scanned = total_scan;
+	trace_mm_vmscan_lru_isolate(sc->reclaim_idx, sc->order, nr_to_scan,
+				    total_scan, skipped, nr_taken, mode, lru);
+	return nr_taken;
+}
+
+/* Move every page of @lruvec from the classic lists onto generations */
+static void lru_gen_fill_lruvec(struct lruvec *lruvec)
+{
+	struct pglist_data *pgdat = lruvec_pgdat(lruvec);
+	unsigned long nr_moved = 0;
+	enum lru_list lru;
+
+	spin_lock_irq(&pgdat->lru_lock);
+	lruvec->lrugen.enabled = true;
+
+	for_each_evictable_lru(lru) {
+		struct list_head *head = &lruvec->lists[lru];
+
+		while (!list_empty(head)) {
+			struct page *page;
+
+			/* Walk from the hottest page to keep the order */
+			page = list_first_entry(head, struct page, lru);
+			del_page_from_lru_list(page, lruvec, lru);
+			add_page_to_lru_list_tail(page, lruvec, lru);
+
+			if (++nr_moved % LRU_GEN_MOVE_BATCH == 0) {
+				spin_unlock_irq(&pgdat->lru_lock);
+				cond_resched();
+				spin_lock_irq(&pgdat->lru_lock);
+			}
+		}
+	}
+	spin_unlock_irq(&pgdat->lru_lock);
+}
+
+/* Move every page of @lruvec from generations back to the classic lists */
+static void lru_gen_drain_lruvec(struct lruvec *lruvec)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	struct pglist_data *pgdat = lruvec_pgdat(lruvec);
+	unsigned long nr_moved = 0;
+	unsigned long seq;
+	int type, zid;
+
+	spin_lock_irq(&pgdat->lru_lock);
+	lrugen->enabled = false;
+
+	/* With the lruvec disabled, neither sequence moves any more */
+	for (type = 0; type < ANON_AND_FILE; type++) {
+		for (seq = lrugen->min_seq[type];
+		     seq <= lrugen->max_seq[type]; seq++) {
+			int gen = lru_gen_from_seq(seq);
+			bool active = lru_gen_is_active(lruvec, type, gen);
+
+			for (zid = 0; zid < MAX_NR_ZONES; zid++) {
+				struct list_head *head =
+					&lrugen->lists[gen][type][zid];
+
+				while (!list_empty(head)) {
+					struct page *page = lru_to_page(head);
+
+					del_page_from_lru_list(page, lruvec,
+							       page_lru(page));
+					if (active)
+						SetPageActive(page);
+					add_page_to_lru_list(page, lruvec,
+							     page_lru(page));
+
+					if (++nr_moved % LRU_GEN_MOVE_BATCH == 0) {
+						spin_unlock_irq(&pgdat->lru_lock);
+						cond_resched();
+						spin_lock_irq(&pgdat->lru_lock);
+					}
+				}
+			}
+		}
+	}
+	spin_unlock_irq(&pgdat->lru_lock);
+}
+
+static void lru_gen_change_state(bool enable)
+{
+	struct mem_cgroup *memcg;
+
+	mutex_lock(&lru_gen_state_mutex);
+	if (enable == lru_gen_state)
+		goto unlock;
+
+	/*
+	 * The key only gates the generation hooks; each lruvec decides for
+	 * itself under the lru_lock. It is never turned off again because
+	 * pages can be left on generations while an lruvec is drained.
+	 */
+	if (enable)
+		static_branch_enable(&lru_gen_key);
+	WRITE_ONCE(lru_gen_state, enable);
+
+	memcg = mem_cgroup_iter(NULL, NULL, NULL);
+	do {
+		struct pglist_data *pgdat;
+
+		for_each_online_pgdat(pgdat) {
+			struct lruvec *lruvec = mem_cgroup_lruvec(pgdat, memcg);
+
+			if (enable)
+				lru_gen_fill_lruvec(lruvec);
+			else
+				lru_gen_drain_lruvec(lruvec);
+		}
+
+		memcg = mem_cgroup_iter(NULL, memcg, NULL);
+	} while (memcg);
+unlock:
+	mutex_unlock(&lru_gen_state_mutex);
+}
+
+static ssize_t lru_gen_enabled_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", READ_ONCE(lru_gen_state));
+}
+
+static ssize_t lru_gen_enabled_store(struct kobject *kobj,
+				     struct kobj_attribute *attr,
+				     const char *buf, size_t count)
+{
+	bool enable;
+	int err;
+
+	err = kstrtobool(buf, &enable);
+	if (err)
+		return err;
+
+	lru_add_drain_all();
+	lru_gen_change_state(enable);
+	return count;
+}
+
+static struct kobj_attribute lru_gen_enabled_attr =
+	__ATTR(enabled, 0644, lru_gen_enabled_show, lru_gen_enabled_store);
+
+static struct attribute *lru_gen_attrs[] = {
+	&lru_gen_enabled_attr.attr,
+	NULL,
+};
+
+static const struct attribute_group lru_gen_attr_group = {
+	.name = "lru_gen",
+	.attrs = lru_gen_attrs,
+};
+
+static int __init lru_gen_init(void)
+{
+	if (sysfs_create_group(mm_kobj, &lru_gen_attr_group))
+		pr_err("lru_gen: failed to create sysfs group\n");
+
+	if (IS_ENABLED(CONFIG_LRU_GEN_ENABLED))
+		lru_gen_change_state(true);
+
+	return 0;
+}
+late_initcall(lru_gen_init);
+
+#else /* !CONFIG_LRU_GEN */
+
+static inline bool lru_gen_lruvec_enabled(struct lruvec *lruvec)
+{
+	return false;
+}
+
+static inline void lru_gen_age_lruvec(struct lruvec *lruvec,
+				      struct mem_cgroup *memcg,
+				      struct scan_control *sc)
+{
+}
+
+static inline unsigned long lru_gen_isolate_pages(unsigned long nr_to_scan,
+		struct lruvec *lruvec, struct list_head *dst,
+		unsigned long *nr_scanned, struct scan_control *sc,
+		isolate_mode_t mode, enum lru_list lru)
+{
+	return 0;
+}
+
+#endif /* CONFIG_LRU_GEN */
+
 /*
  * zone_lru_lock is heavily contended.  Some of the functions that
  * shrink the lists perform better by taking out a batch of pages
@@ -1665,6 +2435,10 @@ static unsigned long isolate_lru_pages(unsigned long nr_to_scan,
 	unsigned long scan, total_scan, nr_pages;
 	LIST_HEAD(pages_skipped);
 
+	if (lru_gen_lruvec_enabled(lruvec))
+		return lru_gen_isolate_pages(nr_to_scan, lruvec, dst,
+					     nr_scanned, sc, mode, lru);
+
 	scan = 0;
 	for (total_scan = 0;
 	     scan < nr_to_scan && nr_taken < nr_to_scan && !list_empty(src);
@@ -1776,6 +2550,7 @@ int isolate_lru_page(struct page *page)
 			int lru = page_lru(page);
 			get_page(page);
 			ClearPageLRU(page);
+			lru_gen_mark_active(lruvec, page);
 			del_page_from_lru_list(page, lruvec, lru);
 			ret = 0;
 		}
@@ -2042,8 +2817,8 @@ static unsigned move_active_pages_to_lru(struct lruvec *lruvec,
 		SetPageLRU(page);
 
 		nr_pages = hpage_nr_pages(page);
-		update_lru_size(lruvec, lru, page_zonenum(page), nr_pages);
-		list_move(&page->lru, &lruvec->lists[lru]);
+		list_del(&page->lru);
+		add_page_to_lru_list(page, lruvec, lru);
 
 		if (put_page_testzero(page)) {
 			__ClearPageLRU(page);
@@ -2212,10 +2987,10 @@ static bool inactive_list_is_low(struct lruvec *lruvec, bool file,
 	unsigned long gb;
 
 	/*
-	 * If we don't have swap space, anonymous page deactivation
-	 * is pointless.
+	 * If we don't have swap space and cannot demote, anonymous page
+	 * deactivation is pointless.
 	 */
-	if (!file && !total_swap_pages)
+	if (!file && !can_age_anon_pages(pgdat, sc))
 		return false;
 
 	inactive = lruvec_lru_size(lruvec, inactive_lru, sc->reclaim_idx);
@@ -2255,7 +3030,8 @@ static unsigned long shrink_list(enum lru_list lru, unsigned long nr_to_scan,
 				 struct scan_control *sc)
 {
 	if (is_active_lru(lru)) {
-		if (inactive_list_is_low(lruvec, is_file_lru(lru),
+		if (!lru_gen_lruvec_enabled(lruvec) &&
+		    inactive_list_is_low(lruvec, is_file_lru(lru),
 					 memcg, sc, true))
 			shrink_active_list(nr_to_scan, lruvec, sc, lru);
 		return 0;
@@ -2295,8 +3071,12 @@ static void get_scan_count(struct lruvec *lruvec, struct mem_cgroup *memcg,
 	unsigned long ap, fp;
 	enum lru_list lru;
 
-	/* If we have no swap space, do not bother scanning anon pages. */
-	if (!sc->may_swap || mem_cgroup_get_nr_swap_pages(memcg) <= 0) {
+	/*
+	 * If we have no swap space and cannot demote, do not bother
+	 * scanning anon pages.
+	 */
+	if (!sc->may_swap || (mem_cgroup_get_nr_swap_pages(memcg) <= 0 &&
+			      !can_demote(pgdat->node_id, sc))) {
 		scan_balance = SCAN_FILE;
 		goto out;
 	}
@@ -2494,6 +3274,7 @@ static void shrink_node_memcg(struct pglist_data *pgdat, struct mem_cgroup *memc
 	struct blk_plug plug;
 	bool scan_adjusted;
 
+	lru_gen_age_lruvec(lruvec, memcg, sc);
 	get_scan_count(lruvec, memcg, sc, nr, lru_pages);
 
 	/* Record the original scan target for proportional adjustments later */
@@ -2592,7 +3373,8 @@ static void shrink_node_memcg(struct pglist_data *pgdat, struct mem_cgroup *memc
 	 * Even if we did not try to evict anon pages at all, we want to
 	 * rebalance the anon lru active/inactive ratio.
 	 */
-	if (inactive_list_is_low(lruvec, false, memcg, sc, true))
+	if (!lru_gen_lruvec_enabled(lruvec) &&
+	    inactive_list_is_low(lruvec, false, memcg, sc, true))
 		shrink_active_list(SWAP_CLUSTER_MAX, lruvec,
 				   sc, LRU_ACTIVE_ANON);
 }
@@ -3302,6 +4084,7 @@ unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
 {
 	struct zonelist *zonelist;
 	unsigned long nr_reclaimed;
+	unsigned long pflags;
 	int nid;
 	unsigned int noreclaim_flag;
 	struct scan_control sc = {
@@ -3330,9 +4113,13 @@ unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
 					    sc.gfp_mask,
 					    sc.reclaim_idx);
 
+	psi_memstall_enter(&pflags);
 	noreclaim_flag = memalloc_noreclaim_save();
+
 	nr_reclaimed = do_try_to_free_pages(zonelist, &sc);
+
 	memalloc_noreclaim_restore(noreclaim_flag);
+	psi_memstall_leave(&pflags);
 
 	trace_mm_vmscan_memcg_reclaim_end(nr_reclaimed);
 
@@ -3345,14 +4132,15 @@ static void age_active_anon(struct pglist_data *pgdat,
 {
 	struct mem_cgroup *memcg;
 
-	if (!total_swap_pages)
+	if (!can_age_anon_pages(pgdat, sc))
 		return;
 
 	memcg = mem_cgroup_iter(NULL, NULL, NULL);
 	do {
 		struct lruvec *lruvec = mem_cgroup_lruvec(pgdat, memcg);
 
-		if (inactive_list_is_low(lruvec, false, memcg, sc, true))
+		if (!lru_gen_lruvec_enabled(lruvec) &&
+		    inactive_list_is_low(lruvec, false, memcg, sc, true))
 			shrink_active_list(SWAP_CLUSTER_MAX, lruvec,
 					   sc, LRU_ACTIVE_ANON);
 
@@ -3497,6 +4285,7 @@ static int balance_pgdat(pg_data_t *pgdat, int order, int classzone_idx)
 	int i;
 	unsigned long nr_soft_reclaimed;
 	unsigned long nr_soft_scanned;
+	unsigned long pflags;
 	struct zone *zone;
 	struct scan_control sc = {
 		.gfp_mask = GFP_KERNEL,
@@ -3507,6 +4296,7 @@ static int balance_pgdat(pg_data_t *pgdat, int order, int classzone_idx)
 		.may_swap = 1,
 	};
 
+	psi_memstall_enter(&pflags);
 	__fs_reclaim_acquire();
 
 	count_vm_event(PAGEOUTRUN);
@@ -3608,6 +4398,7 @@ static int balance_pgdat(pg_data_t *pgdat, int order, int classzone_idx)
 out:
 	snapshot_refaults(NULL, pgdat);
 	__fs_reclaim_release();
+	psi_memstall_leave(&pflags);
 	/*
 	 * Return the order kswapd stopped reclaiming at as
 	 * prepare_kswapd_sleep() takes it into account. If another caller
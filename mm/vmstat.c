@@ -793,7 +793,7 @@ static int refresh_cpu_vm_stats(bool do_pagesets)
 			 * if not then there is nothing to expire.
 			 */
 			if (!__this_cpu_read(p->expire) ||
-			       !__this_cpu_read(p->pcp.count))
+			       !pageset_nr_pages(this_cpu_ptr(p)))
 				continue;
 
 			/*
@@ -807,8 +807,8 @@ static int refresh_cpu_vm_stats(bool do_pagesets)
 			if (__this_cpu_dec_return(p->expire))
 				continue;
 
-			if (__this_cpu_read(p->pcp.count)) {
-				drain_zone_pages(zone, this_cpu_ptr(&p->pcp));
+			if (pageset_nr_pages(this_cpu_ptr(p))) {
+				drain_zone_pages(zone, this_cpu_ptr(p));
 				changes++;
 			}
 		}
@@ -1155,6 +1155,8 @@ const char * const vmstat_text[] = {
 	"nr_shmem",
 	"nr_shmem_hugepages",
 	"nr_shmem_pmdmapped",
+	"nr_file_hugepages",
+	"nr_file_pmdmapped",
 	"nr_anon_transparent_hugepages",
 	"nr_unstable",
 	"nr_vmscan_write",
@@ -1162,6 +1164,12 @@ const char * const vmstat_text[] = {
 	"nr_dirtied",
 	"nr_written",
 	"", /* nr_indirectly_reclaimable */
+#ifdef CONFIG_NUMA_BALANCING
+	"pgpromote_success",
+	"pgpromote_candidate",
+#endif
+	"pgdemote_kswapd",
+	"pgdemote_direct",
 
 	/* enum writeback_stat_item counters */
 	"nr_dirty_threshold",
@@ -1182,9 +1190,15 @@ const char * const vmstat_text[] = {
 	"pgactivate",
 	"pgdeactivate",
 	"pglazyfree",
+	"pgalloc_pcp_high_order_hit",
+	"pgalloc_pcp_high_order_miss",
 
 	"pgfault",
 	"pgmajfault",
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	"speculative_pgfault",
+	"speculative_pgfault_abort",
+#endif
 	"pglazyfreed",
 
 	"pgrefill",
@@ -1210,6 +1224,10 @@ const char * const vmstat_text[] = {
 	"drop_slab",
 	"oom_kill",
 
+#ifdef CONFIG_LRU_GEN
+	"lru_gen_aging",
+	"lru_gen_promoted",
+#endif
 #ifdef CONFIG_NUMA_BALANCING
 	"numa_pte_updates",
 	"numa_huge_pte_updates",
@@ -1290,6 +1308,8 @@ const char * const vmstat_text[] = {
 #ifdef CONFIG_SWAP
 	"swap_ra",
 	"swap_ra_hit",
+	"swap_ra_wasted",
+	"swap_ra_pattern",
 #endif
 #endif /* CONFIG_VM_EVENTS_COUNTERS */
 };
@@ -1596,6 +1616,7 @@ static void zoneinfo_show_print(struct seq_file *m, pg_data_t *pgdat,
 	seq_printf(m, "\n  pagesets");
 	for_each_online_cpu(i) {
 		struct per_cpu_pageset *pageset;
+		int j;
 
 		pageset = per_cpu_ptr(zone->pageset, i);
 		seq_printf(m,
@@ -1607,6 +1628,15 @@ static void zoneinfo_show_print(struct seq_file *m, pg_data_t *pgdat,
 			   pageset->pcp.count,
 			   pageset->pcp.high,
 			   pageset->pcp.batch);
+		for (j = 0; j < NR_PCP_HIGH_ORDERS; j++) {
+			struct per_cpu_pages *pcp = &pageset->order_pcp[j];
+
+			seq_printf(m,
+				   "\n              order %i count: %i"
+				   " high: %i batch: %i",
+				   pcp_high_order(j), pcp->count,
+				   pcp->high, pcp->batch);
+		}
 #ifdef CONFIG_SMP
 		seq_printf(m, "\n  vm stats threshold: %d",
 				pageset->stat_threshold);
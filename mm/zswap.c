@@ -41,6 +41,8 @@
 #include <linux/swapops.h>
 #include <linux/writeback.h>
 #include <linux/pagemap.h>
+#include <linux/workqueue.h>
+#include <linux/blkdev.h>
 
 /*********************************
 * statistics
@@ -61,8 +63,10 @@ static atomic_t zswap_same_filled_pages = ATOMIC_INIT(0);
 
 /* Pool limit was hit (see zswap_max_pool_percent) */
 static u64 zswap_pool_limit_hit;
-/* Pages written back when pool limit was reached */
+/* Pages written back to the swap device, for any reason */
 static u64 zswap_written_back_pages;
+/* Pages written back because they were stored longer than writeback_age_ms */
+static u64 zswap_aged_written_back_pages;
 /* Store failed due to a reclaim failure after pool limit was reached */
 static u64 zswap_reject_reclaim_fail;
 /* Compressed page was too big for the allocator to (optimally) store */
@@ -123,6 +127,20 @@ static bool zswap_same_filled_pages_enabled = true;
 module_param_named(same_filled_pages_enabled, zswap_same_filled_pages_enabled,
 		   bool, 0644);
 
+/*
+ * Write compressed pages back to the swap device once they have not been
+ * stored or loaded for this many milliseconds (0, the default, disables it)
+ */
+static unsigned int zswap_writeback_age_ms;
+static int zswap_writeback_age_param_set(const char *,
+				const struct kernel_param *);
+static struct kernel_param_ops zswap_writeback_age_param_ops = {
+	.set =		zswap_writeback_age_param_set,
+	.get =		param_get_uint,
+};
+module_param_cb(writeback_age_ms, &zswap_writeback_age_param_ops,
+		&zswap_writeback_age_ms, 0644);
+
 /*********************************
 * data structures
 **********************************/
@@ -144,7 +162,11 @@ struct zswap_pool {
  * page within zswap.
  *
  * rbnode - links the entry into red-black tree for the appropriate swap type
+ * lru - links the entry into the lru of its tree while it is in the tree
+ *       and has compressed data
  * offset - the swap offset for the entry.  Index into the red-black tree.
+ * type - the swap type of the entry, for writeback
+ * stored - jiffies when the entry was last stored or loaded
  * refcount - the number of outstanding reference to the entry. This is needed
  *            to protect against premature freeing of the entry by code
  *            concurrent calls to load, invalidate, and writeback.  The lock
@@ -159,7 +181,10 @@ struct zswap_pool {
  */
 struct zswap_entry {
 	struct rb_node rbnode;
+	struct list_head lru;
 	pgoff_t offset;
+	unsigned int type;
+	unsigned long stored;
 	int refcount;
 	unsigned int length;
 	struct zswap_pool *pool;
@@ -177,13 +202,28 @@ struct zswap_header {
  * The tree lock in the zswap_tree struct protects a few things:
  * - the rbtree
  * - the refcount field of each entry in the tree
+ * - the lru of entries with compressed data, least recently stored or
+ *   loaded first
+ *
+ * Each swap type has one tree per SWAP_ADDRESS_SPACE_PAGES offsets, like
+ * the swap cache, so that stores and loads to different parts of a swap
+ * device do not serialize on a single lock.
  */
 struct zswap_tree {
 	struct rb_root rbroot;
+	struct list_head lru;
 	spinlock_t lock;
 };
 
+/* lru writeback walks the trees under RCU, see zswap_writeback_lru() */
 static struct zswap_tree *zswap_trees[MAX_SWAPFILES];
+static unsigned int nr_zswap_trees[MAX_SWAPFILES];
+
+/* where lru writeback resumes, so that every tree gets its turn */
+static unsigned int zswap_lru_type, zswap_lru_index;
+
+static void zswap_writeback_worker(struct work_struct *work);
+static DECLARE_DELAYED_WORK(zswap_writeback_work, zswap_writeback_worker);
 
 /* RCU-protected iteration */
 static LIST_HEAD(zswap_pools);
@@ -262,6 +302,7 @@ static struct zswap_entry *zswap_entry_cache_alloc(gfp_t gfp)
 		return NULL;
 	entry->refcount = 1;
 	RB_CLEAR_NODE(&entry->rbnode);
+	INIT_LIST_HEAD(&entry->lru);
 	return entry;
 }
 
@@ -271,8 +312,29 @@ static void zswap_entry_cache_free(struct zswap_entry *entry)
 }
 
 /*********************************
-* rbtree functions
+* tree and lru functions
 **********************************/
+static struct zswap_tree *zswap_tree(unsigned type, pgoff_t offset)
+{
+	return &zswap_trees[type][offset >> SWAP_ADDRESS_SPACE_SHIFT];
+}
+
+/* caller must hold the tree lock; (re)queues the entry as most recent */
+static void zswap_lru_add(struct zswap_tree *tree, struct zswap_entry *entry)
+{
+	if (!entry->length)
+		return;
+
+	entry->stored = jiffies;
+	list_move_tail(&entry->lru, &tree->lru);
+}
+
+/* caller must hold the tree lock */
+static void zswap_lru_del(struct zswap_entry *entry)
+{
+	list_del_init(&entry->lru);
+}
+
 static struct zswap_entry *zswap_rb_search(struct rb_root *root, pgoff_t offset)
 {
 	struct rb_node *node = root->rb_node;
@@ -322,6 +384,7 @@ static void zswap_rb_erase(struct rb_root *root, struct zswap_entry *entry)
 	if (!RB_EMPTY_NODE(&entry->rbnode)) {
 		rb_erase(&entry->rbnode, root);
 		RB_CLEAR_NODE(&entry->rbnode);
+		zswap_lru_del(entry);
 	}
 }
 
@@ -331,6 +394,7 @@ static void zswap_rb_erase(struct rb_root *root, struct zswap_entry *entry)
  */
 static void zswap_free_entry(struct zswap_entry *entry)
 {
+	zswap_lru_del(entry);
 	if (!entry->length)
 		atomic_dec(&zswap_same_filled_pages);
 	else {
@@ -794,9 +858,43 @@ static int zswap_enabled_param_set(const char *val,
 	return param_set_bool(val, kp);
 }
 
+static int zswap_writeback_age_param_set(const char *val,
+					 const struct kernel_param *kp)
+{
+	int ret = param_set_uint(val, kp);
+
+	/* the worker picks up the new age; it stops itself when disabled */
+	if (!ret && zswap_init_started && !zswap_init_failed &&
+	    zswap_writeback_age_ms)
+		mod_delayed_work(system_unbound_wq, &zswap_writeback_work, 0);
+	return ret;
+}
+
 /*********************************
 * writeback code
 **********************************/
+static int zswap_is_page_same_filled(void *ptr, unsigned long *value)
+{
+	unsigned int pos;
+	unsigned long *page;
+
+	page = (unsigned long *)ptr;
+	for (pos = 1; pos < PAGE_SIZE / sizeof(*page); pos++) {
+		if (page[pos] != page[0])
+			return 0;
+	}
+	*value = page[0];
+	return 1;
+}
+
+static void zswap_fill_page(void *ptr, unsigned long value)
+{
+	unsigned long *page;
+
+	page = (unsigned long *)ptr;
+	memset_l(page, value, PAGE_SIZE / sizeof(unsigned long));
+}
+
 /* return enum for zswap_get_swap_cache_page */
 enum zswap_get_swap_ret {
 	ZSWAP_SWAPCACHE_NEW,
@@ -845,41 +943,23 @@ static int zswap_get_swap_cache_page(swp_entry_t entry,
  * in the first place.  After the page has been decompressed into
  * the swap cache, the compressed version stored by zswap can be
  * freed.
+ *
+ * The caller holds a reference on the entry, which is dropped here.
  */
-static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
+static int __zswap_writeback_entry(struct zswap_tree *tree,
+				   struct zswap_entry *entry)
 {
-	struct zswap_header *zhdr;
-	swp_entry_t swpentry;
-	struct zswap_tree *tree;
-	pgoff_t offset;
-	struct zswap_entry *entry;
+	swp_entry_t swpentry = swp_entry(entry->type, entry->offset);
+	pgoff_t offset = entry->offset;
 	struct page *page;
 	struct crypto_comp *tfm;
 	u8 *src, *dst;
 	unsigned int dlen;
-	int ret;
+	int ret = 0;
 	struct writeback_control wbc = {
 		.sync_mode = WB_SYNC_NONE,
 	};
 
-	/* extract swpentry from data */
-	zhdr = zpool_map_handle(pool, handle, ZPOOL_MM_RO);
-	swpentry = zhdr->swpentry; /* here */
-	zpool_unmap_handle(pool, handle);
-	tree = zswap_trees[swp_type(swpentry)];
-	offset = swp_offset(swpentry);
-
-	/* find and ref zswap entry */
-	spin_lock(&tree->lock);
-	entry = zswap_entry_find_get(&tree->rbroot, offset);
-	if (!entry) {
-		/* entry was invalidated */
-		spin_unlock(&tree->lock);
-		return 0;
-	}
-	spin_unlock(&tree->lock);
-	BUG_ON(offset != entry->offset);
-
 	/* try to allocate swap cache page */
 	switch (zswap_get_swap_cache_page(swpentry, &page)) {
 	case ZSWAP_SWAPCACHE_FAIL: /* no memory or invalidate happened */
@@ -895,8 +975,10 @@ static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
 	case ZSWAP_SWAPCACHE_NEW: /* page is locked */
 		/* decompress */
 		dlen = PAGE_SIZE;
-		src = (u8 *)zpool_map_handle(entry->pool->zpool, entry->handle,
-				ZPOOL_MM_RO) + sizeof(struct zswap_header);
+		src = zpool_map_handle(entry->pool->zpool, entry->handle,
+				       ZPOOL_MM_RO);
+		if (zpool_evictable(entry->pool->zpool))
+			src += sizeof(struct zswap_header);
 		dst = kmap_atomic(page);
 		tfm = *get_cpu_ptr(entry->pool->tfm);
 		ret = crypto_comp_decompress(tfm, src, entry->length,
@@ -945,6 +1027,9 @@ static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
 	*/
 fail:
 	spin_lock(&tree->lock);
+	/* still valid, give it another lru round */
+	if (entry == zswap_rb_search(&tree->rbroot, offset))
+		zswap_lru_add(tree, entry);
 	zswap_entry_put(tree, entry);
 	spin_unlock(&tree->lock);
 
@@ -952,42 +1037,143 @@ static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
 	return ret;
 }
 
-static int zswap_shrink(void)
+static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
 {
-	struct zswap_pool *pool;
-	int ret;
-
-	pool = zswap_pool_last_get();
-	if (!pool)
-		return -ENOENT;
+	struct zswap_header *zhdr;
+	swp_entry_t swpentry;
+	struct zswap_tree *tree;
+	pgoff_t offset;
+	struct zswap_entry *entry;
 
-	ret = zpool_shrink(pool->zpool, 1, NULL);
+	/* extract swpentry from data */
+	zhdr = zpool_map_handle(pool, handle, ZPOOL_MM_RO);
+	swpentry = zhdr->swpentry; /* here */
+	zpool_unmap_handle(pool, handle);
+	offset = swp_offset(swpentry);
+	tree = zswap_tree(swp_type(swpentry), offset);
 
-	zswap_pool_put(pool);
+	/* find and ref zswap entry */
+	spin_lock(&tree->lock);
+	entry = zswap_entry_find_get(&tree->rbroot, offset);
+	if (!entry) {
+		/* entry was invalidated */
+		spin_unlock(&tree->lock);
+		return 0;
+	}
+	spin_unlock(&tree->lock);
+	BUG_ON(offset != entry->offset);
 
-	return ret;
+	return __zswap_writeback_entry(tree, entry);
 }
 
-static int zswap_is_page_same_filled(void *ptr, unsigned long *value)
+/*
+ * Write back up to @nr_to_write entries that were stored at least @min_age
+ * jiffies ago, taking them from the head of the tree lrus in turn. If the
+ * oldest entry of a tree is younger than that, *@next is lowered to the
+ * jiffies until it comes of age. Returns the number of entries written back.
+ *
+ * The tree arrays are looked up under RCU so that swapoff can't free them
+ * underneath us; an entry taken off an lru is pinned by its refcount.
+ */
+static int zswap_writeback_lru(int nr_to_write, unsigned long min_age,
+			       unsigned long *next)
 {
-	unsigned int pos;
-	unsigned long *page;
+	unsigned int type = READ_ONCE(zswap_lru_type);
+	unsigned int index = READ_ONCE(zswap_lru_index);
+	unsigned int nr_types = 0;
+	struct zswap_entry *entry;
+	struct zswap_tree *trees, *tree;
+	struct blk_plug plug;
+	int nr_scanned = 0, nr_written = 0;
+
+	blk_start_plug(&plug);
+	while (nr_scanned < nr_to_write) {
+		rcu_read_lock();
+		trees = smp_load_acquire(&zswap_trees[type]);
+		if (!trees || index >= READ_ONCE(nr_zswap_trees[type])) {
+			rcu_read_unlock();
+			index = 0;
+			type = (type + 1) % MAX_SWAPFILES;
+			/* one more than a full round to revisit the first */
+			if (++nr_types > MAX_SWAPFILES)
+				break;
+			continue;
+		}
 
-	page = (unsigned long *)ptr;
-	for (pos = 1; pos < PAGE_SIZE / sizeof(*page); pos++) {
-		if (page[pos] != page[0])
-			return 0;
+		tree = &trees[index];
+		spin_lock(&tree->lock);
+		entry = list_first_entry_or_null(&tree->lru,
+						 struct zswap_entry, lru);
+		if (entry && time_before(jiffies, entry->stored + min_age)) {
+			if (next)
+				*next = min(*next,
+					    entry->stored + min_age - jiffies);
+			entry = NULL;
+		}
+		if (!entry) {
+			spin_unlock(&tree->lock);
+			rcu_read_unlock();
+			index++;
+			continue;
+		}
+		list_del_init(&entry->lru);
+		zswap_entry_get(entry);
+		spin_unlock(&tree->lock);
+		rcu_read_unlock();
+
+		if (!__zswap_writeback_entry(tree, entry))
+			nr_written++;
+		nr_scanned++;
+		cond_resched();
 	}
-	*value = page[0];
-	return 1;
+	blk_finish_plug(&plug);
+
+	WRITE_ONCE(zswap_lru_type, type);
+	WRITE_ONCE(zswap_lru_index, index);
+
+	return nr_written;
 }
 
-static void zswap_fill_page(void *ptr, unsigned long value)
+/* Number of entries the age based writeback handles per run */
+#define ZSWAP_WRITEBACK_BATCH 64
+
+static void zswap_writeback_worker(struct work_struct *work)
 {
-	unsigned long *page;
+	unsigned int age_ms = READ_ONCE(zswap_writeback_age_ms);
+	unsigned long age = msecs_to_jiffies(age_ms);
+	unsigned long next = age;
+	int nr_written;
 
-	page = (unsigned long *)ptr;
-	memset_l(page, value, PAGE_SIZE / sizeof(unsigned long));
+	if (!age_ms)
+		return;
+
+	nr_written = zswap_writeback_lru(ZSWAP_WRITEBACK_BATCH, age, &next);
+	zswap_aged_written_back_pages += nr_written;
+
+	/* come back right away while there is a backlog of old entries */
+	if (nr_written == ZSWAP_WRITEBACK_BATCH)
+		next = 1;
+	queue_delayed_work(system_unbound_wq, &zswap_writeback_work, next);
+}
+
+static int zswap_shrink(void)
+{
+	struct zswap_pool *pool;
+	int ret;
+
+	pool = zswap_pool_last_get();
+	if (!pool)
+		return -ENOENT;
+
+	/* allocators that can't evict are shrunk from the lru instead */
+	if (zpool_evictable(pool->zpool))
+		ret = zpool_shrink(pool->zpool, 1, NULL);
+	else
+		ret = zswap_writeback_lru(1, 0, NULL) ? 0 : -EAGAIN;
+
+	zswap_pool_put(pool);
+
+	return ret;
 }
 
 /*********************************
@@ -997,7 +1183,7 @@ static void zswap_fill_page(void *ptr, unsigned long value)
 static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 				struct page *page)
 {
-	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_tree *tree;
 	struct zswap_entry *entry, *dupentry;
 	struct crypto_comp *tfm;
 	int ret;
@@ -1013,10 +1199,11 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 		goto reject;
 	}
 
-	if (!zswap_enabled || !tree) {
+	if (!zswap_enabled || !zswap_trees[type]) {
 		ret = -ENODEV;
 		goto reject;
 	}
+	tree = zswap_tree(type, offset);
 
 	/* reclaim space if needed */
 	if (zswap_is_full()) {
@@ -1050,6 +1237,7 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 		if (zswap_is_page_same_filled(src, &value)) {
 			kunmap_atomic(src);
 			entry->offset = offset;
+			entry->type = type;
 			entry->length = 0;
 			entry->value = value;
 			atomic_inc(&zswap_same_filled_pages);
@@ -1098,6 +1286,7 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 
 	/* populate entry */
 	entry->offset = offset;
+	entry->type = type;
 	entry->handle = handle;
 	entry->length = dlen;
 
@@ -1113,6 +1302,7 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 			zswap_entry_put(tree, dupentry);
 		}
 	} while (ret == -EEXIST);
+	zswap_lru_add(tree, entry);
 	spin_unlock(&tree->lock);
 
 	/* update stats */
@@ -1137,7 +1327,7 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 static int zswap_frontswap_load(unsigned type, pgoff_t offset,
 				struct page *page)
 {
-	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_tree *tree = zswap_tree(type, offset);
 	struct zswap_entry *entry;
 	struct crypto_comp *tfm;
 	u8 *src, *dst;
@@ -1152,6 +1342,8 @@ static int zswap_frontswap_load(unsigned type, pgoff_t offset,
 		spin_unlock(&tree->lock);
 		return -1;
 	}
+	/* the page is in use again, keep it compressed in memory longer */
+	zswap_lru_add(tree, entry);
 	spin_unlock(&tree->lock);
 
 	if (!entry->length) {
@@ -1185,7 +1377,7 @@ static int zswap_frontswap_load(unsigned type, pgoff_t offset,
 /* frees an entry in zswap */
 static void zswap_frontswap_invalidate_page(unsigned type, pgoff_t offset)
 {
-	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_tree *tree = zswap_tree(type, offset);
 	struct zswap_entry *entry;
 
 	/* find */
@@ -1209,35 +1401,52 @@ static void zswap_frontswap_invalidate_page(unsigned type, pgoff_t offset)
 /* frees all zswap entries for the given swap type */
 static void zswap_frontswap_invalidate_area(unsigned type)
 {
-	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_tree *trees = zswap_trees[type];
 	struct zswap_entry *entry, *n;
+	unsigned int i;
 
-	if (!tree)
+	if (!trees)
 		return;
 
-	/* walk the tree and free everything */
-	spin_lock(&tree->lock);
-	rbtree_postorder_for_each_entry_safe(entry, n, &tree->rbroot, rbnode)
-		zswap_free_entry(entry);
-	tree->rbroot = RB_ROOT;
-	spin_unlock(&tree->lock);
-	kfree(tree);
-	zswap_trees[type] = NULL;
+	/* walk the trees and free everything */
+	for (i = 0; i < nr_zswap_trees[type]; i++) {
+		struct zswap_tree *tree = &trees[i];
+
+		spin_lock(&tree->lock);
+		rbtree_postorder_for_each_entry_safe(entry, n, &tree->rbroot,
+						     rbnode)
+			zswap_free_entry(entry);
+		tree->rbroot = RB_ROOT;
+		spin_unlock(&tree->lock);
+	}
+	/* wait for lru writeback to let go of the trees */
+	WRITE_ONCE(zswap_trees[type], NULL);
+	synchronize_rcu();
+	kvfree(trees);
+	WRITE_ONCE(nr_zswap_trees[type], 0);
 }
 
 static void zswap_frontswap_init(unsigned type)
 {
-	struct zswap_tree *tree;
+	struct swap_info_struct *sis = swp_swap_info(swp_entry(type, 0));
+	struct zswap_tree *trees;
+	unsigned int nr, i;
 
-	tree = kzalloc(sizeof(*tree), GFP_KERNEL);
-	if (!tree) {
+	nr = DIV_ROUND_UP(sis->max, SWAP_ADDRESS_SPACE_PAGES);
+	trees = kvcalloc(nr, sizeof(*trees), GFP_KERNEL);
+	if (!trees) {
 		pr_err("alloc failed, zswap disabled for swap type %d\n", type);
 		return;
 	}
 
-	tree->rbroot = RB_ROOT;
-	spin_lock_init(&tree->lock);
-	zswap_trees[type] = tree;
+	for (i = 0; i < nr; i++) {
+		trees[i].rbroot = RB_ROOT;
+		INIT_LIST_HEAD(&trees[i].lru);
+		spin_lock_init(&trees[i].lock);
+	}
+	WRITE_ONCE(nr_zswap_trees[type], nr);
+	/* pairs with smp_load_acquire() in zswap_writeback_lru() */
+	smp_store_release(&zswap_trees[type], trees);
 }
 
 static struct frontswap_ops zswap_frontswap_ops = {
@@ -1277,6 +1486,8 @@ static int __init zswap_debugfs_init(void)
 			   zswap_debugfs_root, &zswap_reject_compress_poor);
 	debugfs_create_u64("written_back_pages", 0444,
 			   zswap_debugfs_root, &zswap_written_back_pages);
+	debugfs_create_u64("aged_written_back_pages", 0444,
+			   zswap_debugfs_root, &zswap_aged_written_back_pages);
 	debugfs_create_u64("duplicate_entry", 0444,
 			   zswap_debugfs_root, &zswap_duplicate_entry);
 	debugfs_create_u64("pool_total_size", 0444,
@@ -1345,6 +1556,9 @@ static int __init init_zswap(void)
 	frontswap_register_ops(&zswap_frontswap_ops);
 	if (zswap_debugfs_init())
 		pr_warn("debugfs initialization failed\n");
+	if (zswap_writeback_age_ms)
+		queue_delayed_work(system_unbound_wq, &zswap_writeback_work,
+				   msecs_to_jiffies(zswap_writeback_age_ms));
 	return 0;
 
 hp_fail:
@@ -6,7 +6,8 @@
  *
  * This program is particularly useful for measuring the kernel's futex hash
  * table/function implementation. In order for it to make sense, use with as
- * many threads and futexes as possible.
+ * many threads and futexes as possible. Running several processes at once
+ * shows how well private futexes of unrelated processes scale.
  */
 
 /* For the CLR_() macros */
@@ -18,7 +19,10 @@
 #include <stdlib.h>
 #include <linux/compiler.h>
 #include <linux/kernel.h>
+#include <sys/mman.h>
 #include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "../util/stat.h"
 #include <subcmd/parse-options.h>
@@ -32,6 +36,7 @@ static unsigned int nthreads = 0;
 static unsigned int nsecs    = 10;
 /* amount of futexes per thread */
 static unsigned int nfutexes = 1024;
+static unsigned int nprocs   = 1;
 static bool fshared = false, done = false, silent = false;
 static int futex_flag = 0;
 
@@ -52,6 +57,7 @@ static const struct option options[] = {
 	OPT_UINTEGER('t', "threads", &nthreads, "Specify amount of threads"),
 	OPT_UINTEGER('r', "runtime", &nsecs,    "Specify runtime (in seconds)"),
 	OPT_UINTEGER('f', "futexes", &nfutexes, "Specify amount of futexes per threads"),
+	OPT_UINTEGER('p', "processes", &nprocs, "Specify amount of processes, each running --threads threads"),
 	OPT_BOOLEAN( 's', "silent",  &silent,   "Silent mode: do not display data/details"),
 	OPT_BOOLEAN( 'S', "shared",  &fshared,  "Use shared futexes instead of private ones"),
 	OPT_END()
@@ -124,6 +130,9 @@ int bench_futex_hash(int argc, const char **argv)
 	pthread_attr_t thread_attr;
 	struct worker *worker = NULL;
 	struct cpu_map *cpu;
+	unsigned long *proc_ops, total = 0;
+	unsigned int proc;
+	pid_t pid;
 
 	argc = parse_options(argc, argv, options, bench_futex_hash_usage, 0);
 	if (argc) {
@@ -141,16 +150,35 @@ int bench_futex_hash(int argc, const char **argv)
 
 	if (!nthreads) /* default to the number of CPUs */
 		nthreads = cpu->nr;
-
-	worker = calloc(nthreads, sizeof(*worker));
-	if (!worker)
-		goto errmem;
+	if (!nprocs)
+		nprocs = 1;
 
 	if (!fshared)
 		futex_flag = FUTEX_PRIVATE_FLAG;
 
-	printf("Run summary [PID %d]: %d threads, each operating on %d [%s] futexes for %d secs.\n\n",
-	       getpid(), nthreads, nfutexes, fshared ? "shared":"private", nsecs);
+	printf("Run summary [PID %d]: %d processes of %d threads, each operating on %d [%s] futexes for %d secs.\n\n",
+	       getpid(), nprocs, nthreads, nfutexes, fshared ? "shared":"private", nsecs);
+
+	/* ops/sec of each process, the first one does the reporting */
+	proc_ops = mmap(NULL, nprocs * sizeof(*proc_ops), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (proc_ops == MAP_FAILED)
+		err(EXIT_FAILURE, "mmap");
+
+	fflush(stdout);
+	for (proc = 1; proc < nprocs; proc++) {
+		pid = fork();
+		if (pid < 0)
+			err(EXIT_FAILURE, "fork");
+		if (!pid)
+			break;
+	}
+	if (proc == nprocs)
+		proc = 0;
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		goto errmem;
 
 	init_stats(&throughput_stats);
 	pthread_mutex_init(&thread_lock, NULL);
@@ -167,7 +195,7 @@ int bench_futex_hash(int argc, const char **argv)
 			goto errmem;
 
 		CPU_ZERO(&cpuset);
-		CPU_SET(cpu->map[i % cpu->nr], &cpuset);
+		CPU_SET(cpu->map[(proc * nthreads + i) % cpu->nr], &cpuset);
 
 		ret = pthread_attr_setaffinity_np(&thread_attr, sizeof(cpu_set_t), &cpuset);
 		if (ret)
@@ -204,7 +232,8 @@ int bench_futex_hash(int argc, const char **argv)
 	for (i = 0; i < nthreads; i++) {
 		unsigned long t = worker[i].ops/runtime.tv_sec;
 		update_stats(&throughput_stats, t);
-		if (!silent) {
+		proc_ops[proc] += t;
+		if (!silent && !proc) {
 			if (nfutexes == 1)
 				printf("[thread %2d] futex: %p [ %ld ops/sec ]\n",
 				       worker[i].tid, &worker[i].futex[0], t);
@@ -217,10 +246,24 @@ int bench_futex_hash(int argc, const char **argv)
 		free(worker[i].futex);
 	}
 
-	print_summary();
-
 	free(worker);
 	free(cpu);
+
+	if (proc)
+		exit(EXIT_SUCCESS);
+
+	print_summary();
+
+	if (nprocs > 1) {
+		while (wait(NULL) > 0)
+			;
+		for (proc = 0; proc < nprocs; proc++)
+			total += proc_ops[proc];
+		printf("Total %lu operations/sec over %u processes\n", total,
+		       nprocs);
+	}
+
+	munmap(proc_ops, nprocs * sizeof(*proc_ops));
 	return ret;
 errmem:
 	err(EXIT_FAILURE, "calloc");
@@ -0,0 +1,325 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * sched-latency.c
+ *
+ * latency: wakeup latency of tagged and untagged tasks, schbench style
+ *
+ * A number of message threads periodically wake up their worker threads
+ * through a private futex and stamp the time of the wakeup. The workers
+ * record how long it took until they actually got to run, while optional
+ * busy threads keep the CPUs loaded so that a wakeup has to preempt
+ * something. The first --tagged workers of each message thread run with
+ * the given latency nice value, the rest with the default, and the
+ * wakeup latency percentiles are reported separately for both groups.
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include <subcmd/parse-options.h>
+#include "../builtin.h"
+#include "bench.h"
+#include "futex.h"
+
+#include <err.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/time64.h>
+#include <linux/types.h>
+
+#ifndef SCHED_FLAG_LATENCY_NICE
+#define SCHED_FLAG_LATENCY_NICE		0x80
+#endif
+
+/* Latencies are bucketed per microsecond, anything slower lands in the last */
+#define LAT_BUCKETS	10000
+
+/* sched_attr as of SCHED_ATTR_SIZE_VER1, libc does not provide it */
+struct latency_sched_attr {
+	u32	size;
+	u32	sched_policy;
+	u64	sched_flags;
+	s32	sched_nice;
+	u32	sched_priority;
+	u64	sched_runtime;
+	u64	sched_deadline;
+	u64	sched_period;
+	s32	sched_latency_nice;
+	u32	__reserved;
+};
+
+struct worker {
+	u_int32_t		futex;
+	u64			wake_ns;
+	bool			tagged;
+	unsigned int		*hist;
+	unsigned long		nr;
+	u64			max_ns;
+	pthread_t		pthread;
+};
+
+struct message {
+	struct worker		*workers;
+	pthread_t		pthread;
+};
+
+static unsigned int	nr_message = 2;
+static unsigned int	nr_workers = 4;
+static int		nr_tagged = -1;
+static int		latency_nice = -20;
+static int		nr_busy = -1;
+static unsigned int	runtime = 5;
+static unsigned int	sleep_usec = 1000;
+
+static volatile bool	done;
+static bool		setattr_failed;
+
+static const struct option options[] = {
+	OPT_UINTEGER('m', "message-threads", &nr_message,	"Specify number of message threads"),
+	OPT_UINTEGER('t', "threads",	&nr_workers,		"Specify number of workers per message thread"),
+	OPT_INTEGER('T', "tagged",	&nr_tagged,		"Specify number of tagged workers per message thread (default: half)"),
+	OPT_INTEGER('L', "latency-nice", &latency_nice,		"Specify latency nice of the tagged workers"),
+	OPT_INTEGER('b', "busy",	&nr_busy,		"Specify number of CPU hogs (default: number of CPUs)"),
+	OPT_UINTEGER('r', "runtime",	&runtime,		"Specify runtime in seconds"),
+	OPT_UINTEGER('s', "sleep",	&sleep_usec,		"Specify usecs between two wakeups of a worker"),
+	OPT_END()
+};
+
+static const char * const bench_sched_latency_usage[] = {
+	"perf bench sched latency <options>",
+	NULL
+};
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void set_latency_nice(int value)
+{
+	struct latency_sched_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.sched_flags = SCHED_FLAG_LATENCY_NICE;
+	attr.sched_latency_nice = value;
+
+	if (syscall(__NR_sched_setattr, 0, &attr, 0))
+		setattr_failed = true;
+}
+
+static void *worker_thread(void *arg)
+{
+	struct worker *w = arg;
+	u64 delta;
+
+	if (w->tagged)
+		set_latency_nice(latency_nice);
+
+	while (!done) {
+		if (!__atomic_load_n(&w->futex, __ATOMIC_ACQUIRE)) {
+			futex_wait(&w->futex, 0, NULL, FUTEX_PRIVATE_FLAG);
+			continue;
+		}
+
+		delta = now_ns() - w->wake_ns;
+		__atomic_store_n(&w->futex, 0, __ATOMIC_RELEASE);
+
+		if (delta > w->max_ns)
+			w->max_ns = delta;
+		w->hist[min(delta / NSEC_PER_USEC, (u64)LAT_BUCKETS - 1)]++;
+		w->nr++;
+	}
+
+	return NULL;
+}
+
+static void *message_thread(void *arg)
+{
+	struct message *m = arg;
+	struct timespec ts = {
+		.tv_sec = sleep_usec / USEC_PER_SEC,
+		.tv_nsec = (sleep_usec % USEC_PER_SEC) * NSEC_PER_USEC,
+	};
+	unsigned int i;
+
+	while (!done) {
+		for (i = 0; i < nr_workers; i++) {
+			struct worker *w = m->workers + i;
+
+			/* Still busy with the previous wakeup */
+			if (__atomic_load_n(&w->futex, __ATOMIC_ACQUIRE))
+				continue;
+
+			w->wake_ns = now_ns();
+			__atomic_store_n(&w->futex, 1, __ATOMIC_RELEASE);
+			futex_wake(&w->futex, 1, FUTEX_PRIVATE_FLAG);
+		}
+		nanosleep(&ts, NULL);
+	}
+
+	return NULL;
+}
+
+static void *busy_thread(void *arg __maybe_unused)
+{
+	while (!done)
+		;
+
+	return NULL;
+}
+
+static unsigned int percentile(unsigned int *hist, unsigned long nr, double pct)
+{
+	unsigned long want = nr * pct / 100.0, seen = 0;
+	unsigned int i;
+
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		seen += hist[i];
+		if (seen > want)
+			break;
+	}
+
+	return i;
+}
+
+static void print_group(const char *name, int value, unsigned int *hist,
+			unsigned long nr, u64 max_ns)
+{
+	static const double pcts[] = { 50.0, 90.0, 99.0, 99.9 };
+	unsigned int i;
+
+	printf(" %-8s (latency nice %3d): %lu wakeups\n", name, value, nr);
+	if (!nr)
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(pcts); i++) {
+		unsigned int usec = percentile(hist, nr, pcts[i]);
+
+		printf("\t%5.1fth: %s%u usecs\n", pcts[i],
+		       usec == LAT_BUCKETS - 1 ? ">=" : "", usec);
+	}
+	printf("\t    max: %" PRIu64 " usecs\n", max_ns / NSEC_PER_USEC);
+}
+
+int bench_sched_latency(int argc, const char **argv)
+{
+	unsigned int tagged_hist[LAT_BUCKETS], other_hist[LAT_BUCKETS];
+	unsigned long tagged_nr = 0, other_nr = 0;
+	u64 tagged_max = 0, other_max = 0;
+	struct message *messages;
+	struct worker *workers;
+	pthread_t *busy;
+	unsigned int i, j;
+
+	argc = parse_options(argc, argv, options, bench_sched_latency_usage, 0);
+	if (argc) {
+		usage_with_options(bench_sched_latency_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	if (nr_tagged < 0)
+		nr_tagged = nr_workers / 2;
+	if ((unsigned int)nr_tagged > nr_workers)
+		nr_tagged = nr_workers;
+	if (nr_busy < 0)
+		nr_busy = sysconf(_SC_NPROCESSORS_ONLN);
+
+	messages = calloc(nr_message, sizeof(*messages));
+	workers = calloc(nr_message * nr_workers, sizeof(*workers));
+	busy = calloc(nr_busy ?: 1, sizeof(*busy));
+	if (!messages || !workers || !busy)
+		err(EXIT_FAILURE, "calloc");
+
+	for (i = 0; i < nr_message * nr_workers; i++) {
+		struct worker *w = workers + i;
+
+		w->tagged = i % nr_workers < (unsigned int)nr_tagged;
+		w->hist = calloc(LAT_BUCKETS, sizeof(*w->hist));
+		if (!w->hist)
+			err(EXIT_FAILURE, "calloc");
+		if (pthread_create(&w->pthread, NULL, worker_thread, w))
+			err(EXIT_FAILURE, "pthread_create");
+	}
+
+	for (i = 0; i < (unsigned int)nr_busy; i++) {
+		if (pthread_create(&busy[i], NULL, busy_thread, NULL))
+			err(EXIT_FAILURE, "pthread_create");
+	}
+
+	for (i = 0; i < nr_message; i++) {
+		messages[i].workers = workers + i * nr_workers;
+		if (pthread_create(&messages[i].pthread, NULL, message_thread,
+				   messages + i))
+			err(EXIT_FAILURE, "pthread_create");
+	}
+
+	sleep(runtime);
+	done = true;
+
+	for (i = 0; i < nr_message; i++)
+		pthread_join(messages[i].pthread, NULL);
+	for (i = 0; i < (unsigned int)nr_busy; i++)
+		pthread_join(busy[i], NULL);
+
+	memset(tagged_hist, 0, sizeof(tagged_hist));
+	memset(other_hist, 0, sizeof(other_hist));
+
+	for (i = 0; i < nr_message * nr_workers; i++) {
+		struct worker *w = workers + i;
+		unsigned int *hist = w->tagged ? tagged_hist : other_hist;
+
+		__atomic_store_n(&w->futex, 1, __ATOMIC_RELEASE);
+		futex_wake(&w->futex, 1, FUTEX_PRIVATE_FLAG);
+		pthread_join(w->pthread, NULL);
+
+		for (j = 0; j < LAT_BUCKETS; j++)
+			hist[j] += w->hist[j];
+		if (w->tagged) {
+			tagged_nr += w->nr;
+			tagged_max = max(tagged_max, w->max_ns);
+		} else {
+			other_nr += w->nr;
+			other_max = max(other_max, w->max_ns);
+		}
+		free(w->hist);
+	}
+
+	if (setattr_failed)
+		fprintf(stderr, "Warning: latency nice not supported, tagged workers run untagged\n");
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u message threads, %u workers each (%d tagged), %d busy threads\n\n",
+		       nr_message, nr_workers, nr_tagged, nr_busy);
+		print_group("tagged", latency_nice, tagged_hist, tagged_nr,
+			    tagged_max);
+		print_group("untagged", 0, other_hist, other_nr, other_max);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%u %u\n", percentile(tagged_hist, tagged_nr, 99.0),
+		       percentile(other_hist, other_nr, 99.0));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(busy);
+	free(workers);
+	free(messages);
+	return 0;
+}
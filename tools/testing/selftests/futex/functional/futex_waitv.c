@@ -0,0 +1,262 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * futex_waitv() test: wait on a vector of private and shared futexes, wake
+ * one of them and check that its index is returned. Also check the timeout
+ * and the argument validation.
+ */
+
+#include <errno.h>
+#include <error.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/shm.h>
+#include <sys/syscall.h>
+#include "futextest.h"
+#include "logging.h"
+
+#define TEST_NAME "futex-waitv"
+#define NR_FUTEXES 30
+#define WAKE_WAIT_US 10000
+
+#ifndef __NR_futex_waitv
+#define __NR_futex_waitv 449
+#endif
+
+#ifndef FUTEX_32
+#define FUTEX_32 2
+
+struct futex_waitv {
+	uint64_t val;
+	uint64_t uaddr;
+	uint32_t flags;
+	uint32_t __reserved;
+};
+#endif
+
+static struct futex_waitv waitv[NR_FUTEXES];
+static int ret = RET_PASS;
+
+/* The timeout is a struct __kernel_timespec, 64 bit for every ABI */
+struct kernel_timespec {
+	long long tv_sec;
+	long long tv_nsec;
+};
+
+static inline int futex_waitv(struct futex_waitv *waiters,
+			      unsigned long nr_waiters, unsigned long flags,
+			      struct timespec *timo, clockid_t clockid)
+{
+	struct kernel_timespec ts, *tsp = NULL;
+
+	if (timo) {
+		ts.tv_sec = timo->tv_sec;
+		ts.tv_nsec = timo->tv_nsec;
+		tsp = &ts;
+	}
+
+	return syscall(__NR_futex_waitv, waiters, nr_waiters, flags, tsp,
+		       clockid);
+}
+
+void usage(char *prog)
+{
+	printf("Usage: %s\n", prog);
+	printf("  -c	Use color\n");
+	printf("  -h	Display this help message\n");
+	printf("  -v L	Verbosity level: %d=QUIET %d=CRITICAL %d=INFO\n",
+	       VQUIET, VCRITICAL, VINFO);
+}
+
+static void timeout_in(struct timespec *to, long nsec)
+{
+	if (clock_gettime(CLOCK_MONOTONIC, to))
+		error(1, errno, "clock_gettime() failed");
+
+	to->tv_nsec += nsec;
+	to->tv_sec += to->tv_nsec / 1000000000;
+	to->tv_nsec %= 1000000000;
+}
+
+void *waiterfn(void *arg)
+{
+	struct timespec to;
+	int res;
+
+	/* Long enough for the waker to come along */
+	timeout_in(&to, 500000000);
+
+	res = futex_waitv(waitv, NR_FUTEXES, 0, &to, CLOCK_MONOTONIC);
+	if (res < 0) {
+		fail("futex_waitv returned: %d %s\n", errno, strerror(errno));
+		ret = RET_FAIL;
+	} else if (res != NR_FUTEXES - 1) {
+		fail("futex_waitv returned index %d, expected %d\n", res,
+		     NR_FUTEXES - 1);
+		ret = RET_FAIL;
+	}
+
+	return NULL;
+}
+
+static void test_wake(const char *what, futex_t *last, int opflags)
+{
+	pthread_t waiter;
+	int res;
+
+	if (pthread_create(&waiter, NULL, waiterfn, NULL))
+		error(1, errno, "pthread_create failed");
+
+	usleep(WAKE_WAIT_US);
+
+	info("Calling %s futex_wake on futex: %p\n", what, last);
+	res = futex_wake(last, 1, opflags);
+	if (res != 1) {
+		fail("futex_wake on %s futex returned: %d %s\n", what,
+		     res, res < 0 ? strerror(errno) : "");
+		ret = RET_FAIL;
+	}
+
+	pthread_join(waiter, NULL);
+}
+
+int main(int argc, char *argv[])
+{
+	futex_t private_futexes[NR_FUTEXES];
+	int shm_ids[NR_FUTEXES];
+	struct timespec to;
+	int res, i, c;
+
+	while ((c = getopt(argc, argv, "cht:v:")) != -1) {
+		switch (c) {
+		case 'c':
+			log_color(1);
+			break;
+		case 'h':
+			usage(basename(argv[0]));
+			exit(0);
+		case 'v':
+			log_verbosity(atoi(optarg));
+			break;
+		default:
+			usage(basename(argv[0]));
+			exit(1);
+		}
+	}
+
+	ksft_print_header();
+	ksft_print_msg("%s: Test FUTEX_WAITV\n", basename(argv[0]));
+
+	/* Private futexes */
+	for (i = 0; i < NR_FUTEXES; i++) {
+		private_futexes[i] = 0;
+		waitv[i].uaddr = (uintptr_t)&private_futexes[i];
+		waitv[i].val = 0;
+		waitv[i].flags = FUTEX_32 | FUTEX_PRIVATE_FLAG;
+		waitv[i].__reserved = 0;
+	}
+	test_wake("private", &private_futexes[NR_FUTEXES - 1],
+		  FUTEX_PRIVATE_FLAG);
+
+	/* Timeout */
+	timeout_in(&to, 10000000);
+	res = futex_waitv(waitv, NR_FUTEXES, 0, &to, CLOCK_MONOTONIC);
+	if (res != -1 || errno != ETIMEDOUT) {
+		fail("futex_waitv returned: %d %s, expected ETIMEDOUT\n",
+		     res ? errno : res, res ? strerror(errno) : "");
+		ret = RET_FAIL;
+	}
+
+	/* A futex not containing its expected value */
+	waitv[NR_FUTEXES / 2].val = 1;
+	timeout_in(&to, 10000000);
+	res = futex_waitv(waitv, NR_FUTEXES, 0, &to, CLOCK_MONOTONIC);
+	if (res != -1 || errno != EWOULDBLOCK) {
+		fail("futex_waitv returned: %d %s, expected EWOULDBLOCK\n",
+		     res ? errno : res, res ? strerror(errno) : "");
+		ret = RET_FAIL;
+	}
+	waitv[NR_FUTEXES / 2].val = 0;
+
+	/* Shared futexes */
+	for (i = 0; i < NR_FUTEXES; i++) {
+		int *shared;
+
+		shm_ids[i] = shmget(IPC_PRIVATE, 4096, IPC_CREAT | 0666);
+		if (shm_ids[i] < 0)
+			error(1, errno, "shmget failed");
+
+		shared = shmat(shm_ids[i], NULL, 0);
+		if (shared == (void *)-1)
+			error(1, errno, "shmat failed");
+
+		*shared = 0;
+		waitv[i].uaddr = (uintptr_t)shared;
+		waitv[i].flags = FUTEX_32;
+		waitv[i].val = 0;
+		waitv[i].__reserved = 0;
+	}
+	test_wake("shared", (futex_t *)(uintptr_t)waitv[NR_FUTEXES - 1].uaddr,
+		  0);
+
+	for (i = 0; i < NR_FUTEXES; i++) {
+		shmdt((void *)(uintptr_t)waitv[i].uaddr);
+		shmctl(shm_ids[i], IPC_RMID, NULL);
+	}
+
+	/* Invalid arguments */
+	for (i = 0; i < NR_FUTEXES; i++) {
+		waitv[i].uaddr = (uintptr_t)&private_futexes[i];
+		waitv[i].val = 0;
+		waitv[i].flags = FUTEX_32 | FUTEX_PRIVATE_FLAG;
+		waitv[i].__reserved = 0;
+	}
+
+	waitv[0].uaddr = (uintptr_t)&private_futexes[0] + 1;
+	timeout_in(&to, 10000000);
+	res = futex_waitv(waitv, NR_FUTEXES, 0, &to, CLOCK_MONOTONIC);
+	if (res != -1 || errno != EINVAL) {
+		fail("futex_waitv with an unaligned address returned: %d %s\n",
+		     res ? errno : res, res ? strerror(errno) : "");
+		ret = RET_FAIL;
+	}
+	waitv[0].uaddr = (uintptr_t)&private_futexes[0];
+
+	waitv[0].flags = FUTEX_PRIVATE_FLAG;
+	res = futex_waitv(waitv, NR_FUTEXES, 0, &to, CLOCK_MONOTONIC);
+	if (res != -1 || errno != EINVAL) {
+		fail("futex_waitv without a futex size returned: %d %s\n",
+		     res ? errno : res, res ? strerror(errno) : "");
+		ret = RET_FAIL;
+	}
+	waitv[0].flags = FUTEX_32 | FUTEX_PRIVATE_FLAG;
+
+	res = futex_waitv(NULL, NR_FUTEXES, 0, &to, CLOCK_MONOTONIC);
+	if (res != -1 || errno != EINVAL) {
+		fail("futex_waitv with NULL waiters returned: %d %s\n",
+		     res ? errno : res, res ? strerror(errno) : "");
+		ret = RET_FAIL;
+	}
+
+	res = futex_waitv(waitv, NR_FUTEXES, 0, &to, CLOCK_TAI);
+	if (res != -1 || errno != EINVAL) {
+		fail("futex_waitv with CLOCK_TAI returned: %d %s\n",
+		     res ? errno : res, res ? strerror(errno) : "");
+		ret = RET_FAIL;
+	}
+
+	res = futex_waitv(waitv, 129, 0, &to, CLOCK_MONOTONIC);
+	if (res != -1 || errno != EINVAL) {
+		fail("futex_waitv with too many futexes returned: %d %s\n",
+		     res ? errno : res, res ? strerror(errno) : "");
+		ret = RET_FAIL;
+	}
+
+	print_result(TEST_NAME, ret);
+	return ret;
+}
@@ -0,0 +1,341 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Basic io_uring tests: set up a ring, map it, and push nop, readv,
+ * fixed buffer read, fsync, poll and socket receive requests through it.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include "../kselftest.h"
+
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup	425
+#define __NR_io_uring_enter	426
+#define __NR_io_uring_register	427
+#endif
+
+#define RING_ENTRIES	8
+#define BUF_SIZE	4096
+
+#define read_barrier()	__atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define write_barrier()	__atomic_thread_fence(__ATOMIC_RELEASE)
+
+struct ring {
+	int fd;
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+};
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+			      unsigned flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+		       NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg,
+				 unsigned nr_args)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static int ring_setup(struct ring *r)
+{
+	struct io_uring_params p;
+	void *sq, *cq;
+
+	memset(&p, 0, sizeof(p));
+	r->fd = sys_io_uring_setup(RING_ENTRIES, &p);
+	if (r->fd < 0)
+		return -errno;
+
+	sq = mmap(NULL, p.sq_off.array + p.sq_entries * sizeof(unsigned),
+		  PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+		  IORING_OFF_SQ_RING);
+	cq = mmap(NULL, p.cq_off.cqes +
+		  p.cq_entries * sizeof(struct io_uring_cqe),
+		  PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+		  IORING_OFF_CQ_RING);
+	r->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+		       PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+		       IORING_OFF_SQES);
+	if (sq == MAP_FAILED || cq == MAP_FAILED || r->sqes == MAP_FAILED)
+		return -errno;
+
+	r->sq_head = sq + p.sq_off.head;
+	r->sq_tail = sq + p.sq_off.tail;
+	r->sq_mask = sq + p.sq_off.ring_mask;
+	r->sq_array = sq + p.sq_off.array;
+	r->cq_head = cq + p.cq_off.head;
+	r->cq_tail = cq + p.cq_off.tail;
+	r->cq_mask = cq + p.cq_off.ring_mask;
+	r->cqes = cq + p.cq_off.cqes;
+	return 0;
+}
+
+/* Hand out the next free sqe; it isn't visible to the kernel until committed */
+static struct io_uring_sqe *ring_get_sqe(struct ring *r)
+{
+	unsigned index = *r->sq_tail & *r->sq_mask;
+	struct io_uring_sqe *sqe = &r->sqes[index];
+
+	memset(sqe, 0, sizeof(*sqe));
+	return sqe;
+}
+
+/* Publish the sqe from ring_get_sqe() once it has been filled in */
+static void ring_commit_sqe(struct ring *r)
+{
+	unsigned tail = *r->sq_tail;
+	unsigned index = tail & *r->sq_mask;
+
+	r->sq_array[index] = index;
+	write_barrier();
+	*r->sq_tail = tail + 1;
+	write_barrier();
+}
+
+/* Submit everything queued and wait for one completion */
+static int ring_submit_and_wait(struct ring *r, unsigned nr,
+				struct io_uring_cqe *cqe)
+{
+	unsigned head;
+
+	if (sys_io_uring_enter(r->fd, nr, 1, IORING_ENTER_GETEVENTS) < 0)
+		return -errno;
+
+	head = *r->cq_head;
+	read_barrier();
+	if (head == *r->cq_tail)
+		return -EAGAIN;
+
+	*cqe = r->cqes[head & *r->cq_mask];
+	*r->cq_head = head + 1;
+	write_barrier();
+	return 0;
+}
+
+static void test_nop(struct ring *r)
+{
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe cqe;
+
+	sqe = ring_get_sqe(r);
+	sqe->opcode = IORING_OP_NOP;
+	sqe->user_data = 0x1234;
+
+	ring_commit_sqe(r);
+	if (ring_submit_and_wait(r, 1, &cqe))
+		ksft_exit_fail_msg("nop: submit failed\n");
+	if (cqe.user_data != 0x1234 || cqe.res != 0)
+		ksft_exit_fail_msg("nop: bad completion %llu/%d\n",
+				   cqe.user_data, cqe.res);
+	ksft_test_result_pass("nop\n");
+}
+
+static void test_readv(struct ring *r, int fd, const char *expect)
+{
+	char buf[BUF_SIZE];
+	struct iovec iov = { .iov_base = buf, .iov_len = sizeof(buf) };
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe cqe;
+
+	sqe = ring_get_sqe(r);
+	sqe->opcode = IORING_OP_READV;
+	sqe->fd = fd;
+	sqe->addr = (unsigned long)&iov;
+	sqe->len = 1;
+	sqe->user_data = 1;
+
+	ring_commit_sqe(r);
+	if (ring_submit_and_wait(r, 1, &cqe))
+		ksft_exit_fail_msg("readv: submit failed\n");
+	if (cqe.res != BUF_SIZE || memcmp(buf, expect, BUF_SIZE))
+		ksft_exit_fail_msg("readv: res %d\n", cqe.res);
+	ksft_test_result_pass("readv\n");
+}
+
+static void test_read_fixed(struct ring *r, int fd, const char *expect)
+{
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe cqe;
+	struct iovec iov;
+	char *buf;
+
+	buf = aligned_alloc(BUF_SIZE, BUF_SIZE);
+	if (!buf)
+		ksft_exit_fail_msg("read_fixed: out of memory\n");
+	iov.iov_base = buf;
+	iov.iov_len = BUF_SIZE;
+	if (sys_io_uring_register(r->fd, IORING_REGISTER_BUFFERS, &iov, 1)) {
+		ksft_test_result_skip("read_fixed: register failed: %s\n",
+				      strerror(errno));
+		free(buf);
+		return;
+	}
+
+	sqe = ring_get_sqe(r);
+	sqe->opcode = IORING_OP_READ_FIXED;
+	sqe->fd = fd;
+	sqe->addr = (unsigned long)buf;
+	sqe->len = BUF_SIZE;
+	sqe->buf_index = 0;
+	sqe->user_data = 2;
+
+	ring_commit_sqe(r);
+	if (ring_submit_and_wait(r, 1, &cqe))
+		ksft_exit_fail_msg("read_fixed: submit failed\n");
+	if (cqe.res != BUF_SIZE || memcmp(buf, expect, BUF_SIZE))
+		ksft_exit_fail_msg("read_fixed: res %d\n", cqe.res);
+
+	if (sys_io_uring_register(r->fd, IORING_UNREGISTER_BUFFERS, NULL, 0))
+		ksft_exit_fail_msg("read_fixed: unregister failed\n");
+	free(buf);
+	ksft_test_result_pass("read_fixed\n");
+}
+
+static void test_fsync(struct ring *r, int fd)
+{
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe cqe;
+
+	sqe = ring_get_sqe(r);
+	sqe->opcode = IORING_OP_FSYNC;
+	sqe->fd = fd;
+	sqe->user_data = 3;
+
+	ring_commit_sqe(r);
+	if (ring_submit_and_wait(r, 1, &cqe))
+		ksft_exit_fail_msg("fsync: submit failed\n");
+	if (cqe.user_data != 3 || cqe.res != 0)
+		ksft_exit_fail_msg("fsync: res %d\n", cqe.res);
+	ksft_test_result_pass("fsync\n");
+}
+
+static void test_poll(struct ring *r)
+{
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe cqe;
+	int fds[2];
+
+	if (pipe(fds))
+		ksft_exit_fail_msg("poll: pipe failed\n");
+
+	sqe = ring_get_sqe(r);
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fds[0];
+	sqe->poll_events = POLLIN;
+	sqe->user_data = 4;
+	ring_commit_sqe(r);
+	if (sys_io_uring_enter(r->fd, 1, 0, 0) != 1)
+		ksft_exit_fail_msg("poll: submit failed\n");
+
+	/* Nothing to read yet, so nothing may have completed */
+	read_barrier();
+	if (*r->cq_head != *r->cq_tail)
+		ksft_exit_fail_msg("poll: completed without data\n");
+
+	if (write(fds[1], "x", 1) != 1)
+		ksft_exit_fail_msg("poll: write failed\n");
+	if (ring_submit_and_wait(r, 0, &cqe))
+		ksft_exit_fail_msg("poll: wait failed\n");
+	if (cqe.user_data != 4 || !(cqe.res & POLLIN))
+		ksft_exit_fail_msg("poll: res %d\n", cqe.res);
+
+	close(fds[0]);
+	close(fds[1]);
+	ksft_test_result_pass("poll\n");
+}
+
+/* A blocking socket is waited on, not read from a blocked worker */
+static void test_recvmsg(struct ring *r)
+{
+	char buf[16];
+	struct iovec iov = { .iov_base = buf, .iov_len = sizeof(buf) };
+	struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe cqe;
+	int fds[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+		ksft_exit_fail_msg("recvmsg: socketpair failed\n");
+
+	sqe = ring_get_sqe(r);
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = fds[0];
+	sqe->addr = (unsigned long)&msg;
+	sqe->len = 1;
+	sqe->user_data = 5;
+	ring_commit_sqe(r);
+	if (sys_io_uring_enter(r->fd, 1, 0, 0) != 1)
+		ksft_exit_fail_msg("recvmsg: submit failed\n");
+
+	read_barrier();
+	if (*r->cq_head != *r->cq_tail)
+		ksft_exit_fail_msg("recvmsg: completed without data\n");
+
+	if (write(fds[1], "hello", 5) != 5)
+		ksft_exit_fail_msg("recvmsg: write failed\n");
+	if (ring_submit_and_wait(r, 0, &cqe))
+		ksft_exit_fail_msg("recvmsg: wait failed\n");
+	if (cqe.user_data != 5 || cqe.res != 5 || memcmp(buf, "hello", 5))
+		ksft_exit_fail_msg("recvmsg: res %d\n", cqe.res);
+
+	close(fds[0]);
+	close(fds[1]);
+	ksft_test_result_pass("recvmsg\n");
+}
+
+int main(void)
+{
+	char path[] = "/tmp/io_uring_test.XXXXXX";
+	char data[BUF_SIZE];
+	struct ring r;
+	int fd, ret, i;
+
+	ksft_print_header();
+
+	ret = ring_setup(&r);
+	if (ret == -ENOSYS)
+		ksft_exit_skip("io_uring not supported\n");
+	if (ret)
+		ksft_exit_fail_msg("ring setup: %s\n", strerror(-ret));
+
+	fd = mkstemp(path);
+	if (fd < 0)
+		ksft_exit_fail_msg("mkstemp: %s\n", strerror(errno));
+	unlink(path);
+	for (i = 0; i < BUF_SIZE; i++)
+		data[i] = i;
+	if (write(fd, data, BUF_SIZE) != BUF_SIZE)
+		ksft_exit_fail_msg("write: %s\n", strerror(errno));
+
+	test_nop(&r);
+	test_readv(&r, fd, data);
+	test_read_fixed(&r, fd, data);
+	test_fsync(&r, fd);
+	test_poll(&r);
+	test_recvmsg(&r);
+
+	close(fd);
+	close(r.fd);
+	return ksft_exit_pass();
+}
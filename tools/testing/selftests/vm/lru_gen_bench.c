@@ -0,0 +1,204 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Compare the classic active/inactive LRU with the multi-generational LRU.
+ *
+ * The workload keeps a hot set that is touched on every pass and streams
+ * through a cold set once per pass; the whole mapping should be larger than
+ * the memory available to the test (run it in a memory cgroup with a limit,
+ * or pick -m accordingly). For each LRU the run reports the refaults, swap
+ * ins and kswapd CPU time accumulated while the workload ran.
+ */
+#include <ctype.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+
+#define MB (1UL << 20)
+#define LRU_GEN_ENABLED "/sys/kernel/mm/lru_gen/enabled"
+
+struct snapshot {
+	unsigned long refault;
+	unsigned long activate;
+	unsigned long pswpin;
+	unsigned long pgscan;
+	unsigned long kswapd_ticks;
+	double time;
+};
+
+static unsigned long read_vmstat(const char *name)
+{
+	char key[64];
+	unsigned long val, ret = 0;
+	FILE *f = fopen("/proc/vmstat", "r");
+
+	if (!f)
+		return 0;
+
+	while (fscanf(f, "%63s %lu", key, &val) == 2) {
+		/* pgscan_kswapd and pgscan_direct are summed up */
+		if (!strcmp(key, name) ||
+		    (!strcmp(name, "pgscan") && !strncmp(key, "pgscan_", 7) &&
+		     strcmp(key, "pgscan_direct_throttle")))
+			ret += val;
+	}
+	fclose(f);
+	return ret;
+}
+
+/* utime + stime of every kswapd thread, in clock ticks */
+static unsigned long kswapd_ticks(void)
+{
+	struct dirent *de;
+	unsigned long ret = 0;
+	DIR *d = opendir("/proc");
+
+	if (!d)
+		return 0;
+
+	while ((de = readdir(d))) {
+		char path[300], buf[512], *p;
+		unsigned long utime, stime;
+		FILE *f;
+
+		if (!isdigit(de->d_name[0]))
+			continue;
+
+		snprintf(path, sizeof(path), "/proc/%s/stat", de->d_name);
+		f = fopen(path, "r");
+		if (!f)
+			continue;
+		p = fgets(buf, sizeof(buf), f);
+		fclose(f);
+		if (!p || !strstr(buf, "(kswapd"))
+			continue;
+
+		/* Fields 14 and 15, counted from after the command name */
+		p = strrchr(buf, ')');
+		if (p && sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+				&utime, &stime) == 2)
+			ret += utime + stime;
+	}
+	closedir(d);
+	return ret;
+}
+
+static void take_snapshot(struct snapshot *s)
+{
+	struct timespec ts;
+
+	s->refault = read_vmstat("workingset_refault");
+	s->activate = read_vmstat("workingset_activate");
+	s->pswpin = read_vmstat("pswpin");
+	s->pgscan = read_vmstat("pgscan");
+	s->kswapd_ticks = kswapd_ticks();
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	s->time = ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int set_lru_gen(int enable)
+{
+	FILE *f = fopen(LRU_GEN_ENABLED, "w");
+
+	if (!f) {
+		perror(LRU_GEN_ENABLED);
+		return -1;
+	}
+	fprintf(f, "%d\n", enable);
+	return fclose(f);
+}
+
+static void run_workload(char *p, unsigned long size, unsigned long hot,
+			 int passes, int hot_repeats)
+{
+	unsigned long page = sysconf(_SC_PAGESIZE), i;
+	int pass, r;
+
+	for (pass = 0; pass < passes; pass++) {
+		for (r = 0; r < hot_repeats; r++)
+			for (i = 0; i < hot; i += page)
+				p[i]++;
+		for (i = hot; i < size; i += page)
+			p[i]++;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long size = 1024 * MB;
+	int opt, passes = 10, hot_pct = 25, hot_repeats = 4, only = -1;
+	long hz = sysconf(_SC_CLK_TCK);
+	int mode;
+
+	while ((opt = getopt(argc, argv, "m:p:h:r:e:")) != -1) {
+		switch (opt) {
+		case 'm':
+			size = atol(optarg) * MB;
+			break;
+		case 'p':
+			passes = atoi(optarg);
+			break;
+		case 'h':
+			hot_pct = atoi(optarg);
+			break;
+		case 'r':
+			hot_repeats = atoi(optarg);
+			break;
+		case 'e':
+			only = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-m MB] [-p passes] [-h hot%%] [-r hot repeats] [-e 0|1]\n",
+				argv[0]);
+			return -1;
+		}
+	}
+
+	if (access(LRU_GEN_ENABLED, F_OK)) {
+		printf("%s not present, skipping\n", LRU_GEN_ENABLED);
+		return 4; /* KSFT_SKIP */
+	}
+
+	printf("%-8s %10s %10s %10s %12s %10s %8s\n", "lru", "refault",
+	       "activate", "pswpin", "pgscan", "kswapd_ms", "secs");
+
+	for (mode = 0; mode < 2; mode++) {
+		struct snapshot start, end;
+		unsigned long hot = size / 100 * hot_pct;
+		char *p;
+
+		if (only >= 0 && mode != only)
+			continue;
+		if (set_lru_gen(mode))
+			return 1;
+
+		p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED) {
+			perror("mmap");
+			return 1;
+		}
+		madvise(p, size, MADV_NOHUGEPAGE);
+		memset(p, 1, size);
+
+		take_snapshot(&start);
+		run_workload(p, size, hot, passes, hot_repeats);
+		take_snapshot(&end);
+		munmap(p, size);
+
+		printf("%-8s %10lu %10lu %10lu %12lu %10lu %8.2f\n",
+		       mode ? "lru_gen" : "classic",
+		       end.refault - start.refault,
+		       end.activate - start.activate,
+		       end.pswpin - start.pswpin,
+		       end.pgscan - start.pgscan,
+		       (end.kswapd_ticks - start.kswapd_ticks) * 1000 / hz,
+		       end.time - start.time);
+	}
+
+	return 0;
+}
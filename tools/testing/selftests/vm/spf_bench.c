@@ -0,0 +1,230 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Page fault scalability against a concurrent mmap()/munmap() writer.
+ *
+ * Each fault thread repeatedly touches every page of its own part of a
+ * shared anonymous mapping (or reads a file mapping with -f) and drops it
+ * again with MADV_DONTNEED, while a writer thread keeps taking mmap_sem for
+ * write by mapping and unmapping a small unrelated region. The run is
+ * repeated for 1, 2, 4, ... up to -t fault threads and reports the fault
+ * rate together with how many faults took the speculative path.
+ */
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+
+#define MB (1UL << 20)
+
+static unsigned long page_size;
+static unsigned long chunk;
+static char *area;
+static volatile int stop;
+static int file_backed;
+
+struct worker {
+	pthread_t thread;
+	int id;
+	unsigned long faults;
+};
+
+static unsigned long read_vmstat(const char *name)
+{
+	char key[64];
+	unsigned long val, ret = 0;
+	FILE *f = fopen("/proc/vmstat", "r");
+
+	if (!f)
+		return 0;
+
+	while (fscanf(f, "%63s %lu", key, &val) == 2)
+		if (!strcmp(key, name))
+			ret = val;
+	fclose(f);
+	return ret;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *fault_thread(void *arg)
+{
+	struct worker *w = arg;
+	char *p = area + w->id * chunk;
+	volatile char sink;
+	unsigned long i;
+
+	while (!stop) {
+		for (i = 0; i < chunk; i += page_size) {
+			if (file_backed)
+				sink = p[i];
+			else
+				p[i] = 1;
+		}
+		w->faults += chunk / page_size;
+		madvise(p, chunk, MADV_DONTNEED);
+	}
+	(void)sink;
+	return NULL;
+}
+
+static void *mmap_thread(void *arg)
+{
+	unsigned long *ops = arg;
+
+	while (!stop) {
+		char *p = mmap(NULL, 16 * page_size, PROT_READ | PROT_WRITE,
+			       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+		if (p == MAP_FAILED)
+			break;
+		p[0] = 1;
+		munmap(p, 16 * page_size);
+		(*ops)++;
+	}
+	return NULL;
+}
+
+static int run(int nr_threads, int seconds, int writer)
+{
+	struct worker *workers = calloc(nr_threads, sizeof(*workers));
+	unsigned long spf, abort, ops = 0, faults = 0;
+	pthread_t writer_thread;
+	double start, elapsed;
+	int i;
+
+	if (!workers)
+		return -1;
+
+	stop = 0;
+	spf = read_vmstat("speculative_pgfault");
+	abort = read_vmstat("speculative_pgfault_abort");
+	start = now();
+
+	for (i = 0; i < nr_threads; i++) {
+		workers[i].id = i;
+		if (pthread_create(&workers[i].thread, NULL, fault_thread,
+				   &workers[i])) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	if (writer && pthread_create(&writer_thread, NULL, mmap_thread, &ops)) {
+		perror("pthread_create");
+		exit(1);
+	}
+
+	sleep(seconds);
+	stop = 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		faults += workers[i].faults;
+	}
+	if (writer)
+		pthread_join(writer_thread, NULL);
+	elapsed = now() - start;
+
+	printf("%8d %14.0f %14.0f %12lu %12lu %10.0f\n", nr_threads,
+	       faults / elapsed, faults / elapsed / nr_threads,
+	       read_vmstat("speculative_pgfault") - spf,
+	       read_vmstat("speculative_pgfault_abort") - abort,
+	       ops / elapsed);
+
+	free(workers);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int opt, max_threads = sysconf(_SC_NPROCESSORS_ONLN), seconds = 5;
+	int writer = 1, nr;
+	unsigned long size;
+	char *path = NULL;
+
+	page_size = sysconf(_SC_PAGESIZE);
+	chunk = 16 * MB;
+
+	while ((opt = getopt(argc, argv, "t:s:m:f:n")) != -1) {
+		switch (opt) {
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'm':
+			chunk = atol(optarg) * MB;
+			break;
+		case 'f':
+			path = optarg;
+			break;
+		case 'n':
+			writer = 0;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-t threads] [-s seconds] [-m MB per thread] [-f file] [-n]\n",
+				argv[0]);
+			return -1;
+		}
+	}
+
+	if (max_threads < 1)
+		max_threads = 1;
+	size = chunk * max_threads;
+
+	if (path) {
+		int fd = open(path, O_RDWR | O_CREAT, 0600);
+
+		if (fd < 0 || ftruncate(fd, size)) {
+			perror(path);
+			return 1;
+		}
+		area = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		file_backed = 1;
+	} else {
+		area = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	}
+	if (area == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	madvise(area, size, MADV_NOHUGEPAGE);
+
+	/* Populate the page cache once so that the reads are all hits */
+	if (file_backed) {
+		volatile char sink;
+		unsigned long i;
+
+		for (i = 0; i < size; i += page_size)
+			sink = area[i];
+		(void)sink;
+	}
+
+	printf("%8s %14s %14s %12s %12s %10s\n", "threads", "faults/s",
+	       "faults/s/thr", "spf", "spf_abort", "mmap/s");
+
+	for (nr = 1; ; nr *= 2) {
+		if (nr > max_threads)
+			nr = max_threads;
+		if (run(nr, seconds, writer))
+			return 1;
+		if (nr == max_threads)
+			break;
+	}
+
+	munmap(area, size);
+	return 0;
+}
@@ -44,6 +44,8 @@ struct slabinfo {
 	unsigned long cmpxchg_double_cpu_fail, cmpxchg_double_fail;
 	unsigned long alloc_node_mismatch, deactivate_bypass;
 	unsigned long cpu_partial_alloc, cpu_partial_free;
+	unsigned long magazine_alloc, magazine_refill;
+	unsigned long magazine_free, magazine_flush;
 	int numa[MAX_NODES];
 	int numa_partial[MAX_NODES];
 } slabinfo[MAX_SLABS];
@@ -445,8 +447,9 @@ static void slab_stats(struct slabinfo *s)
 	if (!s->alloc_slab)
 		return;
 
-	total_alloc = s->alloc_fastpath + s->alloc_slowpath;
-	total_free = s->free_fastpath + s->free_slowpath;
+	total_alloc = s->alloc_fastpath + s->alloc_slowpath +
+		s->magazine_alloc + s->magazine_refill;
+	total_free = s->free_fastpath + s->free_slowpath + s->magazine_free;
 
 	if (!total_alloc)
 		return;
@@ -459,9 +462,16 @@ static void slab_stats(struct slabinfo *s)
 		s->alloc_fastpath * 100 / total_alloc,
 		total_free ? s->free_fastpath * 100 / total_free : 0);
 	printf("Slowpath             %8lu %8lu %3lu %3lu\n",
-		total_alloc - s->alloc_fastpath, s->free_slowpath,
-		(total_alloc - s->alloc_fastpath) * 100 / total_alloc,
+		s->alloc_slowpath, s->free_slowpath,
+		s->alloc_slowpath * 100 / total_alloc,
 		total_free ? s->free_slowpath * 100 / total_free : 0);
+	if (s->magazine_alloc || s->magazine_refill || s->magazine_free)
+		printf("Magazine             %8lu %8lu %3lu %3lu\n",
+			s->magazine_alloc + s->magazine_refill,
+			s->magazine_free,
+			(s->magazine_alloc + s->magazine_refill) * 100 /
+				total_alloc,
+			total_free ? s->magazine_free * 100 / total_free : 0);
 	printf("Page Alloc           %8lu %8lu %3lu %3lu\n",
 		s->alloc_slab, s->free_slab,
 		s->alloc_slab * 100 / total_alloc,
@@ -491,6 +501,14 @@ static void slab_stats(struct slabinfo *s)
 	if (s->cpuslab_flush)
 		printf("Flushes %8lu\n", s->cpuslab_flush);
 
+	if (s->magazine_alloc || s->magazine_refill) {
+		printf("\nMagazine hits %8lu refills %8lu flushes %8lu hit rate %3lu%%\n",
+			s->magazine_alloc, s->magazine_refill,
+			s->magazine_flush,
+			s->magazine_alloc * 100 /
+				(s->magazine_alloc + s->magazine_refill));
+	}
+
 	total = s->deactivate_full + s->deactivate_empty +
 			s->deactivate_to_head + s->deactivate_to_tail + s->deactivate_bypass;
 
@@ -1252,6 +1270,10 @@ static void read_slab_dir(void)
 			slab->cpu_partial_free = get_obj("cpu_partial_free");
 			slab->alloc_node_mismatch = get_obj("alloc_node_mismatch");
 			slab->deactivate_bypass = get_obj("deactivate_bypass");
+			slab->magazine_alloc = get_obj("magazine_alloc");
+			slab->magazine_refill = get_obj("magazine_refill");
+			slab->magazine_free = get_obj("magazine_free");
+			slab->magazine_flush = get_obj("magazine_flush");
 			chdir("..");
 			if (slab->name[0] == ':')
 				alias_targets++;